@@ -0,0 +1,243 @@
+///////////////////////////////////////////////////////////////////////////////
+// deferredrenderer.cpp
+// ============
+// G-buffer of the deferred shading path, and its full screen lighting pass
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "DeferredRenderer.h"
+
+#include <iostream>
+
+// declaration of the global variables and defines
+namespace
+{
+	// storage format, pixel format, pixel type, bytes per
+	// pixel and texture unit of each G-buffer texture; the
+	// normal is stored as half floats, which hold the material
+	// indices exactly up to 2048
+	const GLenum g_TargetFormats[] = { GL_RGBA8, GL_RGBA16F, GL_DEPTH_COMPONENT24 };
+	const GLenum g_TargetPixelFormats[] = { GL_RGBA, GL_RGBA, GL_DEPTH_COMPONENT };
+	const GLenum g_TargetPixelTypes[] = { GL_UNSIGNED_BYTE, GL_HALF_FLOAT, GL_UNSIGNED_INT };
+	const size_t g_TargetPixelBytes[] = { 4, 8, 4 };
+	const int g_TargetUnits[] =
+	{
+		DeferredRenderer::ALBEDO_UNIT,
+		DeferredRenderer::NORMAL_UNIT,
+		DeferredRenderer::DEPTH_UNIT
+	};
+}
+
+/***********************************************************
+ *  DeferredRenderer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+DeferredRenderer::DeferredRenderer()
+{
+	m_framebuffer = 0;
+	for (int i = 0; i < TARGET_COUNT; i++)
+	{
+		m_textures[i] = 0;
+	}
+	m_vertexArray = 0;
+	m_width = 0;
+	m_height = 0;
+	m_frameFramebuffer = 0;
+	m_bFrameBlending = GL_FALSE;
+}
+
+/***********************************************************
+ *  ~DeferredRenderer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+DeferredRenderer::~DeferredRenderer()
+{
+	Release();
+
+	if (m_vertexArray != 0)
+	{
+		glDeleteVertexArrays(1, &m_vertexArray);
+		m_vertexArray = 0;
+	}
+}
+
+/***********************************************************
+ *  BeginGeometryPass()
+ *
+ *  This method is used for starting the geometry pass.  The
+ *  G-buffer is created again when the viewport has changed
+ *  size, then bound and cleared, with the depth at the far
+ *  plane marking the pixels nothing is drawn on.  Blending
+ *  is turned off, as it would mix the normals.
+ ***********************************************************/
+bool DeferredRenderer::BeginGeometryPass()
+{
+	GLint viewport[4] = { 0, 0, 0, 0 };
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if ((viewport[2] != m_width) || (viewport[3] != m_height) || (m_framebuffer == 0))
+	{
+		if (Resize(viewport[2], viewport[3]) == false)
+		{
+			return(false);
+		}
+	}
+
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_frameFramebuffer);
+	m_bFrameBlending = glIsEnabled(GL_BLEND);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+	glDisable(GL_BLEND);
+
+	const GLfloat noColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	const GLfloat farDepth = 1.0f;
+	glClearBufferfv(GL_COLOR, 0, noColor);
+	glClearBufferfv(GL_COLOR, 1, noColor);
+	glClearBufferfv(GL_DEPTH, 0, &farDepth);
+
+	return(true);
+}
+
+/***********************************************************
+ *  EndGeometryPass()
+ *
+ *  This method is used for drawing into the framebuffer of
+ *  the frame again, with its blending restored.
+ ***********************************************************/
+void DeferredRenderer::EndGeometryPass()
+{
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)m_frameFramebuffer);
+	if (m_bFrameBlending == GL_TRUE)
+	{
+		glEnable(GL_BLEND);
+	}
+}
+
+/***********************************************************
+ *  DrawLightingPass()
+ *
+ *  This method is used for drawing the triangle that covers
+ *  the screen.  The depth test passes every pixel, so the
+ *  G-buffer depth the shader writes replaces the depth of
+ *  the frame, and later draws are hidden by the scene.
+ ***********************************************************/
+void DeferredRenderer::DrawLightingPass()
+{
+	if (m_vertexArray == 0)
+	{
+		glGenVertexArrays(1, &m_vertexArray);
+	}
+
+	GLint depthFunction = GL_LESS;
+	glGetIntegerv(GL_DEPTH_FUNC, &depthFunction);
+	glDepthFunc(GL_ALWAYS);
+
+	glBindVertexArray(m_vertexArray);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+
+	glDepthFunc((GLenum)depthFunction);
+}
+
+/***********************************************************
+ *  GetBytes()
+ *
+ *  This method is used for getting the memory used by the
+ *  G-buffer textures.
+ ***********************************************************/
+size_t DeferredRenderer::GetBytes() const
+{
+	size_t bytes = 0;
+	if (m_framebuffer != 0)
+	{
+		for (int i = 0; i < TARGET_COUNT; i++)
+		{
+			bytes += (size_t)m_width * m_height * g_TargetPixelBytes[i];
+		}
+	}
+
+	return(bytes);
+}
+
+/***********************************************************
+ *  Resize()
+ *
+ *  This method is used for creating the G-buffer textures
+ *  for a viewport size, and attaching them to the
+ *  framebuffer.  Each texture is bound to its own texture
+ *  unit, where the lighting pass samples it.
+ ***********************************************************/
+bool DeferredRenderer::Resize(int width, int height)
+{
+	Release();
+	if ((width <= 0) || (height <= 0))
+	{
+		return(false);
+	}
+
+	m_width = width;
+	m_height = height;
+
+	glGenFramebuffers(1, &m_framebuffer);
+	glGenTextures(TARGET_COUNT, m_textures);
+
+	GLint frameFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &frameFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+
+	for (int i = 0; i < TARGET_COUNT; i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + g_TargetUnits[i]);
+		glBindTexture(GL_TEXTURE_2D, m_textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, g_TargetFormats[i], width, height, 0,
+			g_TargetPixelFormats[i], g_TargetPixelTypes[i], NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		const GLenum attachment = (i == TARGET_DEPTH) ? GL_DEPTH_ATTACHMENT : GL_COLOR_ATTACHMENT0 + i;
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, attachment, GL_TEXTURE_2D, m_textures[i], 0);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+
+	const GLenum status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)frameFramebuffer);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR: the G-buffer framebuffer is incomplete, status 0x" << std::hex << status << std::dec << std::endl;
+		Release();
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  Release()
+ *
+ *  This method is used for deleting the framebuffer and the
+ *  G-buffer textures.
+ ***********************************************************/
+void DeferredRenderer::Release()
+{
+	if (m_framebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &m_framebuffer);
+		m_framebuffer = 0;
+	}
+	for (int i = 0; i < TARGET_COUNT; i++)
+	{
+		if (m_textures[i] != 0)
+		{
+			glDeleteTextures(1, &m_textures[i]);
+			m_textures[i] = 0;
+		}
+	}
+	m_width = 0;
+	m_height = 0;
+}
@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////////
+// deferredrenderer.h
+// ============
+// G-buffer of the deferred shading path, and its full screen lighting pass
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+/***********************************************************
+ *  DeferredRenderer
+ *
+ *  This class owns the G-buffer of the deferred shading
+ *  path.  The geometry pass draws the scene into it with no
+ *  lighting, keeping the base color, the normal with the
+ *  material index, and the depth of the nearest surface of
+ *  every pixel.  The lighting pass then draws one triangle
+ *  over the screen, so each pixel is lit once, whatever
+ *  number of surfaces were drawn over it, and writes the
+ *  depth back for the draws that follow.
+ *
+ *  The G-buffer follows the size of the viewport, and its
+ *  textures stay bound to their reserved texture units.
+ ***********************************************************/
+class DeferredRenderer
+{
+public:
+	// constructor
+	DeferredRenderer();
+	// destructor
+	~DeferredRenderer();
+
+	// texture units the base color, the normal with the
+	// material index, and the depth are bound to
+	static const int ALBEDO_UNIT = 8;
+	static const int NORMAL_UNIT = 9;
+	static const int DEPTH_UNIT = 10;
+
+	// draw into the cleared G-buffer, sized to the viewport,
+	// false when the framebuffer cannot be created
+	bool BeginGeometryPass();
+	// draw into the framebuffer of the frame again
+	void EndGeometryPass();
+	// light the G-buffer into the frame, with the program of
+	// the lighting pass in use
+	void DrawLightingPass();
+
+	// bytes of memory used by the G-buffer textures
+	size_t GetBytes() const;
+
+private:
+	// textures of the G-buffer
+	enum TARGET
+	{
+		TARGET_ALBEDO = 0,
+		TARGET_NORMAL,
+		TARGET_DEPTH,
+		TARGET_COUNT
+	};
+
+	GLuint m_framebuffer;
+	GLuint m_textures[TARGET_COUNT];
+	// empty vertex array for the screen triangle, which is
+	// made from the vertex index
+	GLuint m_vertexArray;
+	int m_width;
+	int m_height;
+	// framebuffer and blending of the frame while the
+	// geometry pass draws
+	GLint m_frameFramebuffer;
+	GLboolean m_bFrameBlending;
+
+	// create the G-buffer textures for a viewport size
+	bool Resize(int width, int height);
+	// delete the framebuffer and its textures
+	void Release();
+};
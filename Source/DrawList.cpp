@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// drawlist.cpp
+// ============
+// precompiled, flat table of the objects that make up the 3D scene
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "DrawList.h"
+
+/***********************************************************
+ *  DrawList()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+DrawList::DrawList()
+{
+}
+
+/***********************************************************
+ *  ~DrawList()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+DrawList::~DrawList()
+{
+	Clear();
+}
+
+/***********************************************************
+ *  AddObject()
+ *
+ *  This method is used for appending an object to the end
+ *  of every column in the table.  The index of the new row
+ *  is returned so the caller can update it later.
+ ***********************************************************/
+int DrawList::AddObject(
+	MeshID mesh,
+	const glm::mat4& model,
+	int textureSlot,
+	const glm::vec4& color,
+	int materialID,
+	const glm::vec2& uvScale)
+{
+	m_meshIDs.push_back(mesh);
+	m_modelMatrices.push_back(model);
+	m_textureSlots.push_back(textureSlot);
+	m_colors.push_back(color);
+	m_materialIDs.push_back(materialID);
+	m_uvScales.push_back(uvScale);
+	m_staticFlags.push_back(0);
+	m_occluderFlags.push_back(0);
+
+	return((int)m_meshIDs.size() - 1);
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method is used for removing all the objects from
+ *  the table.
+ ***********************************************************/
+void DrawList::Clear()
+{
+	m_meshIDs.clear();
+	m_modelMatrices.clear();
+	m_textureSlots.clear();
+	m_colors.clear();
+	m_materialIDs.clear();
+	m_uvScales.clear();
+	m_staticFlags.clear();
+	m_occluderFlags.clear();
+}
+
+/***********************************************************
+ *  SetModelMatrix()
+ *
+ *  This method is used for replacing the cached model
+ *  matrix of a previously added object.
+ ***********************************************************/
+void DrawList::SetModelMatrix(int index, const glm::mat4& model)
+{
+	if ((index >= 0) && (index < (int)m_modelMatrices.size()))
+	{
+		m_modelMatrices[index] = model;
+	}
+}
+
+/***********************************************************
+ *  SetStatic()
+ *
+ *  This method is used for flagging a previously added
+ *  object as static, so it can be merged with the other
+ *  static objects instead of being drawn as an instance.
+ ***********************************************************/
+void DrawList::SetStatic(int index, bool bStatic)
+{
+	if ((index >= 0) && (index < (int)m_staticFlags.size()))
+	{
+		m_staticFlags[index] = bStatic ? 1 : 0;
+	}
+}
+
+/***********************************************************
+ *  SetOccluder()
+ *
+ *  This method is used for flagging a previously added
+ *  object as an occluder, whose triangles are drawn into
+ *  the occlusion buffer to hide the objects behind it.
+ ***********************************************************/
+void DrawList::SetOccluder(int index, bool bOccluder)
+{
+	if ((index >= 0) && (index < (int)m_occluderFlags.size()))
+	{
+		m_occluderFlags[index] = bOccluder ? 1 : 0;
+	}
+}
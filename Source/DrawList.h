@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////
+// drawlist.h
+// ============
+// precompiled, flat table of the objects that make up the 3D scene
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  DrawList
+ *
+ *  This class stores the compiled scene as a contiguous
+ *  structure-of-arrays table.  Each object in the scene is
+ *  one row, and each property of the objects is one column,
+ *  so the render loop only walks flat arrays.
+ ***********************************************************/
+class DrawList
+{
+public:
+	// the basic meshes that can be referenced by a draw
+	enum MeshID : uint8_t
+	{
+		MESH_PLANE = 0,
+		MESH_BOX,
+		MESH_CYLINDER,
+		MESH_TAPERED_CYLINDER,
+		MESH_TORUS,
+		MESH_SPHERE,
+		MESH_COUNT
+	};
+
+	// constructor
+	DrawList();
+	// destructor
+	~DrawList();
+
+	// add an object row to the table and return its index
+	int AddObject(
+		MeshID mesh,
+		const glm::mat4& model,
+		int textureSlot,
+		const glm::vec4& color,
+		int materialID,
+		const glm::vec2& uvScale);
+
+	// remove all the objects from the table
+	void Clear();
+
+	// replace the cached model matrix of an object
+	void SetModelMatrix(int index, const glm::mat4& model);
+	// flag an object as never moving after it is compiled
+	void SetStatic(int index, bool bStatic);
+	// flag an object as large enough to hide the objects behind it
+	void SetOccluder(int index, bool bOccluder);
+
+	// number of objects in the table
+	int GetObjectCount() const { return((int)m_meshIDs.size()); }
+
+	// read-only access to the table columns
+	const uint8_t* GetMeshIDs() const { return(m_meshIDs.data()); }
+	const glm::mat4* GetModelMatrices() const { return(m_modelMatrices.data()); }
+	const int* GetTextureSlots() const { return(m_textureSlots.data()); }
+	const glm::vec4* GetColors() const { return(m_colors.data()); }
+	const int* GetMaterialIDs() const { return(m_materialIDs.data()); }
+	const glm::vec2* GetUVScales() const { return(m_uvScales.data()); }
+	const uint8_t* GetStaticFlags() const { return(m_staticFlags.data()); }
+	const uint8_t* GetOccluderFlags() const { return(m_occluderFlags.data()); }
+
+private:
+	// mesh drawn for each object
+	std::vector<uint8_t> m_meshIDs;
+	// cached model matrix for each object
+	std::vector<glm::mat4> m_modelMatrices;
+	// texture slot for each object, -1 when drawn with a color
+	std::vector<int> m_textureSlots;
+	// solid color for each object without a texture
+	std::vector<glm::vec4> m_colors;
+	// index into the defined materials, -1 for none
+	std::vector<int> m_materialIDs;
+	// texture UV scale for each object
+	std::vector<glm::vec2> m_uvScales;
+	// set when the object is merged into a static batch
+	std::vector<uint8_t> m_staticFlags;
+	// set when the object is drawn into the occlusion buffer
+	std::vector<uint8_t> m_occluderFlags;
+};
@@ -0,0 +1,501 @@
+///////////////////////////////////////////////////////////////////////////////
+// indirectscene.cpp
+// ============
+// scene objects culled by a compute shader and drawn with one indirect call
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "IndirectScene.h"
+
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// declaration of the global variables and defines
+namespace
+{
+	// shader storage binding points used by the culling shader
+	const GLuint g_ObjectBinding = 0;
+	const GLuint g_MeshBinding = 1;
+	const GLuint g_CommandBinding = 2;
+	const GLuint g_InstanceBinding = 3;
+	const GLuint g_LODBinding = 4;
+	// invocations in one work group, must match local_size_x
+	const GLuint g_WorkGroupSize = 64;
+
+	/***********************************************************
+	 *  FindMesh()
+	 *
+	 *  This function is used for getting the generated geometry
+	 *  of the basic mesh associated with the passed in ID, at a
+	 *  tessellation level when the mesh has several.
+	 ***********************************************************/
+	const InstancedMeshes::GLMESH* FindMesh(const InstancedMeshes& meshes, uint8_t meshID, int lod)
+	{
+		switch (meshID)
+		{
+		case DrawList::MESH_PLANE:
+			return(&meshes.GetPlaneMesh());
+		case DrawList::MESH_BOX:
+			return(&meshes.GetBoxMesh());
+		case DrawList::MESH_CYLINDER:
+			return(&meshes.GetCylinderMesh(lod));
+		case DrawList::MESH_TAPERED_CYLINDER:
+			return(&meshes.GetTaperedCylinderMesh(lod));
+		case DrawList::MESH_TORUS:
+			return(&meshes.GetTorusMesh(lod));
+		case DrawList::MESH_SPHERE:
+			return(&meshes.GetSphereMesh(lod));
+		default:
+			return(NULL);
+		}
+	}
+
+	/***********************************************************
+	 *  GetMeshBounds()
+	 *
+	 *  This function is used for getting a sphere around the
+	 *  vertices of a mesh, centered on their bounding box, and
+	 *  the half extents of that box.
+	 ***********************************************************/
+	void GetMeshBounds(const InstancedMeshes::GLMESH& mesh, glm::vec4& sphere, glm::vec4& extent)
+	{
+		const int stride = InstancedMeshes::FLOATS_PER_VERTEX;
+		glm::vec3 boundsMin(0.0f);
+		glm::vec3 boundsMax(0.0f);
+
+		for (GLuint v = 0; v < mesh.nVertices; v++)
+		{
+			glm::vec3 position(mesh.vertices[v * stride], mesh.vertices[v * stride + 1], mesh.vertices[v * stride + 2]);
+			boundsMin = (v == 0) ? position : glm::min(boundsMin, position);
+			boundsMax = (v == 0) ? position : glm::max(boundsMax, position);
+		}
+
+		glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+		float radius = 0.0f;
+		for (GLuint v = 0; v < mesh.nVertices; v++)
+		{
+			glm::vec3 position(mesh.vertices[v * stride], mesh.vertices[v * stride + 1], mesh.vertices[v * stride + 2]);
+			radius = glm::max(radius, glm::length(position - center));
+		}
+
+		sphere = glm::vec4(center, radius);
+		extent = glm::vec4((boundsMax - boundsMin) * 0.5f, 0.0f);
+	}
+}
+
+/***********************************************************
+ *  IndirectScene()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+IndirectScene::IndirectScene()
+{
+	static_assert(sizeof(GPU_OBJECT) == 112, "Object is 112 bytes in std430");
+	static_assert(sizeof(DRAW_COMMAND) == 20, "DrawElementsIndirectCommand is 20 bytes");
+
+	m_program = 0;
+	m_objectCountLocation = -1;
+	m_occlusionLocation = -1;
+	m_occlusionPyramidLocation = -1;
+	m_lodScaleLocation = -1;
+	m_perspectiveLocation = -1;
+	m_lodRadiiLocation = -1;
+	m_lodHysteresisLocation = -1;
+	m_viewScale = 1.0f;
+	m_bPerspective = true;
+	m_occlusionTexture = 0;
+	m_objectBuffer = 0;
+	m_meshBuffer = 0;
+	m_commandTemplate = 0;
+	m_commandBuffer = 0;
+	m_instanceBuffer = 0;
+	m_lodBuffer = 0;
+	m_vao = 0;
+	m_commandCount = 0;
+	m_texturedCommand = 0;
+}
+
+/***********************************************************
+ *  ~IndirectScene()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+IndirectScene::~IndirectScene()
+{
+	DestroyBuffers();
+
+	if (m_program != 0)
+	{
+		glDeleteProgram(m_program);
+		m_program = 0;
+	}
+}
+
+/***********************************************************
+ *  IsSupported()
+ *
+ *  This method is used for checking that the driver has
+ *  everything the GPU culling path needs, which is core
+ *  from OpenGL 4.3 on.
+ ***********************************************************/
+bool IndirectScene::IsSupported()
+{
+	if (GLEW_VERSION_4_3)
+	{
+		return(true);
+	}
+
+	return((GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object &&
+		GLEW_ARB_multi_draw_indirect) ? true : false);
+}
+
+/***********************************************************
+ *  Create()
+ *
+ *  This method is used for compiling and linking the
+ *  culling compute shader from a GLSL file.
+ ***********************************************************/
+bool IndirectScene::Create(const char* computeShaderFile)
+{
+	std::ifstream file(computeShaderFile);
+	if (!file)
+	{
+		std::cout << "ERROR: could not open the culling shader " << computeShaderFile << std::endl;
+		return(false);
+	}
+	std::stringstream source;
+	source << file.rdbuf();
+	const std::string code = source.str();
+	const char* codeText = code.c_str();
+
+	GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(shader, 1, &codeText, NULL);
+	glCompileShader(shader);
+
+	GLint success = 0;
+	char infoLog[1024];
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(shader, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR: culling shader compilation failed\n" << infoLog << std::endl;
+		glDeleteShader(shader);
+		return(false);
+	}
+
+	m_program = glCreateProgram();
+	glAttachShader(m_program, shader);
+	glLinkProgram(m_program);
+	glDeleteShader(shader);
+
+	glGetProgramiv(m_program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog(m_program, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR: culling shader linking failed\n" << infoLog << std::endl;
+		glDeleteProgram(m_program);
+		m_program = 0;
+		return(false);
+	}
+
+	m_objectCountLocation = glGetUniformLocation(m_program, "objectCount");
+	m_occlusionLocation = glGetUniformLocation(m_program, "bOcclusionCulling");
+	m_occlusionPyramidLocation = glGetUniformLocation(m_program, "occlusionPyramid");
+	m_lodScaleLocation = glGetUniformLocation(m_program, "lodScale");
+	m_perspectiveLocation = glGetUniformLocation(m_program, "bPerspective");
+	m_lodRadiiLocation = glGetUniformLocation(m_program, "lodRadii");
+	m_lodHysteresisLocation = glGetUniformLocation(m_program, "lodHysteresis");
+
+	return(true);
+}
+
+/***********************************************************
+ *  Build()
+ *
+ *  This method is used for laying out the objects of the
+ *  draw list so that the objects of each mesh are next to
+ *  each other, the solid colored objects of every mesh
+ *  first and then the textured ones.  Every level of a mesh
+ *  gets one draw command in each group, whose base instance
+ *  is the start of its range in the visible instance
+ *  buffer, and bounds in mesh space, as a sphere for the
+ *  frustum test and a box for the occlusion test.  Any
+ *  object can be drawn with any level, so each range holds
+ *  all the objects of the mesh in the group.  The instance
+ *  counts of the commands are left at zero, for the culling
+ *  shader to fill in.
+ ***********************************************************/
+void IndirectScene::Build(const DrawList& drawList, InstancedMeshes& meshes, int maxMaterials)
+{
+	const int objectCount = drawList.GetObjectCount();
+	const uint8_t* meshIDs = drawList.GetMeshIDs();
+	const int* textureSlots = drawList.GetTextureSlots();
+
+	DestroyBuffers();
+	m_objectOrder.clear();
+
+	std::vector<DRAW_COMMAND> commands;
+	// a sphere and the half extents of a box for each command
+	std::vector<glm::vec4> bounds;
+	GLuint instanceCount = 0;
+	m_texturedCommand = 0;
+
+	// the meshes are walked once for each group
+	for (int groupMesh = 0; groupMesh < 2 * DrawList::MESH_COUNT; groupMesh++)
+	{
+		const int meshID = groupMesh % DrawList::MESH_COUNT;
+		const bool bTextured = (groupMesh >= DrawList::MESH_COUNT);
+		if (groupMesh == DrawList::MESH_COUNT)
+		{
+			m_texturedCommand = (int)commands.size();
+		}
+
+		const InstancedMeshes::GLMESH* mesh = FindMesh(meshes, (uint8_t)meshID, 0);
+		if ((mesh == NULL) || (mesh->nIndices == 0))
+		{
+			continue;
+		}
+
+		// the plane and the box return the same mesh at every level
+		int lodCount = 1;
+		while ((lodCount < InstancedMeshes::LOD_COUNT) && (FindMesh(meshes, (uint8_t)meshID, lodCount) != mesh))
+		{
+			lodCount++;
+		}
+
+		GPU_OBJECT object;
+		object.mesh = (uint32_t)commands.size();
+		object.lodCount = (uint32_t)lodCount;
+		object.padding[0] = 0;
+		object.padding[1] = 0;
+
+		const size_t firstObject = m_objectOrder.size();
+		for (int i = 0; i < objectCount; i++)
+		{
+			if ((meshIDs[i] == meshID) && ((textureSlots[i] >= 0) == bTextured))
+			{
+				m_objectOrder.push_back(i);
+				m_objects.push_back(object);
+			}
+		}
+		const GLuint meshObjectCount = (GLuint)(m_objectOrder.size() - firstObject);
+		if (meshObjectCount == 0)
+		{
+			continue;
+		}
+
+		// the vertices of every level lie on the same surface,
+		// so the bounds of the finest level hold them all
+		glm::vec4 sphere;
+		glm::vec4 extent;
+		GetMeshBounds(*mesh, sphere, extent);
+
+		for (int lod = 0; lod < lodCount; lod++)
+		{
+			const InstancedMeshes::GLMESH* levelMesh = FindMesh(meshes, (uint8_t)meshID, lod);
+
+			DRAW_COMMAND command;
+			command.count = levelMesh->nIndices;
+			command.instanceCount = 0;
+			command.firstIndex = levelMesh->firstIndex;
+			command.baseVertex = levelMesh->baseVertex;
+			command.baseInstance = instanceCount;
+			commands.push_back(command);
+			bounds.push_back(sphere);
+			bounds.push_back(extent);
+			instanceCount += meshObjectCount;
+		}
+	}
+
+	m_commandCount = (int)commands.size();
+	if (m_objects.empty())
+	{
+		return;
+	}
+	FillObjects(drawList, maxMaterials);
+
+	glGenBuffers(1, &m_objectBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_objectBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_objects.size() * sizeof(GPU_OBJECT), m_objects.data(), GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &m_meshBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_meshBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, bounds.size() * sizeof(glm::vec4), bounds.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_commandTemplate);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandTemplate);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, commands.size() * sizeof(DRAW_COMMAND), commands.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_commandBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, commands.size() * sizeof(DRAW_COMMAND), NULL, GL_DYNAMIC_COPY);
+
+	glGenBuffers(1, &m_instanceBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, instanceCount * sizeof(InstancedMeshes::INSTANCE_DATA), NULL, GL_DYNAMIC_COPY);
+
+	// every object starts at the coarsest level of its mesh
+	std::vector<GLuint> lods(m_objects.size(), InstancedMeshes::LOD_COUNT - 1);
+	glGenBuffers(1, &m_lodBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_lodBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, lods.size() * sizeof(GLuint), lods.data(), GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	m_vao = meshes.CreateVertexArray(m_instanceBuffer);
+}
+
+/***********************************************************
+ *  UpdateObjects()
+ *
+ *  This method is used for uploading the object records
+ *  again, once the transforms of the draw list changed.
+ ***********************************************************/
+void IndirectScene::UpdateObjects(const DrawList& drawList, int maxMaterials)
+{
+	if (m_objects.empty())
+	{
+		return;
+	}
+
+	FillObjects(drawList, maxMaterials);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_objectBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_objects.size() * sizeof(GPU_OBJECT), m_objects.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+/***********************************************************
+ *  FillObjects()
+ *
+ *  This method is used for copying the draw list columns
+ *  into the object records in the order of the buffer.
+ ***********************************************************/
+void IndirectScene::FillObjects(const DrawList& drawList, int maxMaterials)
+{
+	const glm::mat4* modelMatrices = drawList.GetModelMatrices();
+	const int* textureSlots = drawList.GetTextureSlots();
+	const glm::vec4* colors = drawList.GetColors();
+	const int* materialIDs = drawList.GetMaterialIDs();
+	const glm::vec2* uvScales = drawList.GetUVScales();
+
+	for (size_t i = 0; i < m_objects.size(); i++)
+	{
+		const int object = m_objectOrder[i];
+		InstancedMeshes::INSTANCE_DATA& instance = m_objects[i].instance;
+
+		instance.model = modelMatrices[object];
+		instance.color = colors[object];
+		instance.uvScale = uvScales[object];
+		instance.textureSlot = textureSlots[object];
+		instance.materialIndex = (materialIDs[object] < maxMaterials) ? materialIDs[object] : -1;
+	}
+}
+
+/***********************************************************
+ *  Cull()
+ *
+ *  This method is used for resetting the draw commands from
+ *  their template and running the culling shader over all
+ *  the objects, against the occlusion pyramid as well when
+ *  one is set.  The barrier makes the commands and the
+ *  visible instances written by the shader visible to the
+ *  indirect draw and its vertex fetch.
+ ***********************************************************/
+void IndirectScene::Cull()
+{
+	if ((m_program == 0) || m_objects.empty())
+	{
+		return;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, m_commandTemplate);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_commandBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_commandCount * sizeof(DRAW_COMMAND));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glUseProgram(m_program);
+	glUniform1ui(m_objectCountLocation, (GLuint)m_objects.size());
+	glUniform1i(m_occlusionLocation, (m_occlusionTexture != 0) ? 1 : 0);
+	glUniform1i(m_occlusionPyramidLocation, OCCLUSION_TEXTURE_UNIT);
+	glUniform1f(m_lodScaleLocation, m_viewScale);
+	glUniform1i(m_perspectiveLocation, m_bPerspective ? 1 : 0);
+	GLfloat lodRadii[InstancedMeshes::LOD_COUNT];
+	for (int lod = 0; lod < InstancedMeshes::LOD_COUNT; lod++)
+	{
+		lodRadii[lod] = InstancedMeshes::GetLODRadius(lod);
+	}
+	glUniform1fv(m_lodRadiiLocation, InstancedMeshes::LOD_COUNT, lodRadii);
+	glUniform1f(m_lodHysteresisLocation, InstancedMeshes::LOD_HYSTERESIS_PERCENT / 100.0f);
+	glActiveTexture(GL_TEXTURE0 + OCCLUSION_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, m_occlusionTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, g_ObjectBinding, m_objectBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, g_MeshBinding, m_meshBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, g_CommandBinding, m_commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, g_InstanceBinding, m_instanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, g_LODBinding, m_lodBuffer);
+
+	glDispatchCompute(((GLuint)m_objects.size() + g_WorkGroupSize - 1) / g_WorkGroupSize, 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+/***********************************************************
+ *  Draw()
+ *
+ *  This method is used for drawing the visible solid
+ *  colored or textured objects of the scene with one
+ *  multi-draw indirect call, one command per level of each
+ *  mesh.  A level with no visible object has an instance
+ *  count of zero and draws nothing.
+ ***********************************************************/
+void IndirectScene::Draw(bool bTextured)
+{
+	const int firstCommand = bTextured ? m_texturedCommand : 0;
+	const int commandCount = bTextured ? (m_commandCount - m_texturedCommand) : m_texturedCommand;
+	if ((m_vao == 0) || (commandCount == 0))
+	{
+		return;
+	}
+
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+		(void*)(sizeof(DRAW_COMMAND) * firstCommand), commandCount, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+/***********************************************************
+ *  DestroyBuffers()
+ *
+ *  This method is used for releasing the buffers and the
+ *  vertex array of the current build.
+ ***********************************************************/
+void IndirectScene::DestroyBuffers()
+{
+	GLuint* buffers[] = { &m_objectBuffer, &m_meshBuffer, &m_commandTemplate,
+		&m_commandBuffer, &m_instanceBuffer, &m_lodBuffer };
+	for (int i = 0; i < 6; i++)
+	{
+		if (*buffers[i] != 0)
+		{
+			glDeleteBuffers(1, buffers[i]);
+			*buffers[i] = 0;
+		}
+	}
+
+	if (m_vao != 0)
+	{
+		glDeleteVertexArrays(1, &m_vao);
+		m_vao = 0;
+	}
+
+	m_objects.clear();
+	m_commandCount = 0;
+	m_texturedCommand = 0;
+}
@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////
+// indirectscene.h
+// ============
+// scene objects culled by a compute shader and drawn with one indirect call
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "DrawList.h"
+#include "InstancedMeshes.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  IndirectScene
+ *
+ *  This class keeps every draw list object, static or not,
+ *  in shader storage buffers on the GPU.  Each frame a
+ *  compute shader tests the bounding sphere of each object
+ *  against the view frustum, and the box of its mesh
+ *  against the occlusion pyramid when one is set.  It picks
+ *  the tessellation level of each visible object with a
+ *  curved mesh, appends the object to the instance buffer
+ *  range of its mesh at that level and counts it in the
+ *  draw command of the level.  The solid colored objects
+ *  and the textured objects have separate commands, and
+ *  each group is drawn with a single multi-draw indirect
+ *  call over the shared mesh buffers, with its own shader
+ *  permutation, so the CPU cost of a frame does not grow
+ *  with the number of objects.
+ ***********************************************************/
+class IndirectScene
+{
+public:
+	// constructor
+	IndirectScene();
+	// destructor
+	~IndirectScene();
+
+	// texture unit the occlusion pyramid is bound to while culling
+	static const int OCCLUSION_TEXTURE_UNIT = 14;
+
+	// true when the driver has compute shaders, shader
+	// storage buffers and multi-draw indirect
+	static bool IsSupported();
+
+	// compile the culling compute shader, false when it fails
+	bool Create(const char* computeShaderFile);
+	// lay out the objects of the draw list by mesh and create
+	// the buffers, material indices from maxMaterials on are
+	// drawn as -1
+	void Build(const DrawList& drawList, InstancedMeshes& meshes, int maxMaterials);
+	// upload the object records again after objects moved
+	void UpdateObjects(const DrawList& drawList, int maxMaterials);
+
+	// set the pixels covered by one unit at unit distance from
+	// the camera, used to size the objects on screen
+	void SetViewScale(float viewScale, bool bPerspective) { m_viewScale = viewScale; m_bPerspective = bPerspective; }
+	// set the hierarchical-Z texture the objects are also
+	// tested against, 0 for frustum culling only
+	void SetOcclusionTexture(GLuint texture) { m_occlusionTexture = texture; }
+	// cull the objects and write the draw commands, leaving
+	// the culling program in use
+	void Cull();
+	// draw the visible solid colored or textured objects with
+	// one indirect call
+	void Draw(bool bTextured);
+
+	// culling program, to attach the camera block to
+	GLuint GetProgram() const { return(m_program); }
+	// number of objects tested each frame
+	int GetObjectCount() const { return((int)m_objects.size()); }
+
+private:
+	// std430 layout of one object in the shader
+	struct GPU_OBJECT
+	{
+		InstancedMeshes::INSTANCE_DATA instance;
+		// draw command of the finest level of the mesh
+		uint32_t mesh;
+		// number of levels of the mesh, with one command each
+		uint32_t lodCount;
+		uint32_t padding[2];
+	};
+
+	// layout of one glMultiDrawElementsIndirect command
+	struct DRAW_COMMAND
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// culling compute program
+	GLuint m_program;
+	GLint m_objectCountLocation;
+	GLint m_occlusionLocation;
+	GLint m_occlusionPyramidLocation;
+	GLint m_lodScaleLocation;
+	GLint m_perspectiveLocation;
+	GLint m_lodRadiiLocation;
+	GLint m_lodHysteresisLocation;
+	// size on screen of one unit at unit distance
+	float m_viewScale;
+	bool m_bPerspective;
+	// occlusion pyramid of the frame, 0 when not used
+	GLuint m_occlusionTexture;
+	// objects, mesh bounds, commands reset each frame, the
+	// commands written by the culling, the visible instances
+	// and the level each object was last drawn with
+	GLuint m_objectBuffer;
+	GLuint m_meshBuffer;
+	GLuint m_commandTemplate;
+	GLuint m_commandBuffer;
+	GLuint m_instanceBuffer;
+	GLuint m_lodBuffer;
+	// vertex array over the shared meshes and the visible instances
+	GLuint m_vao;
+	// objects in the order of the object buffer
+	std::vector<GPU_OBJECT> m_objects;
+	// draw list object of each object
+	std::vector<int> m_objectOrder;
+	int m_commandCount;
+	// first command of the textured objects
+	int m_texturedCommand;
+
+	// fill the object records from the draw list
+	void FillObjects(const DrawList& drawList, int maxMaterials);
+	// release the buffers and the vertex array
+	void DestroyBuffers();
+};
@@ -0,0 +1,818 @@
+///////////////////////////////////////////////////////////////////////////////
+// instancedmeshes.cpp
+// ============
+// basic 3D shape meshes that are drawn with per-instance attributes
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "InstancedMeshes.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+
+// declaration of the global variables and defines
+namespace
+{
+	const float g_Pi = 3.14159265358979f;
+
+	// vertex attribute locations used by the vertex shader
+	const GLuint g_PositionLocation = 0;
+	const GLuint g_NormalLocation = 1;
+	const GLuint g_TextureCoordinateLocation = 2;
+	const GLuint g_InstanceModelLocation = 3;		// uses 3 to 6
+	const GLuint g_InstanceColorLocation = 7;
+	const GLuint g_InstanceUVScaleLocation = 8;
+	const GLuint g_InstanceIndicesLocation = 9;
+
+	// binary cache of the generated meshes
+	const char* g_MeshCacheFile = "cache/meshes.bin";
+
+	// segments of each tessellation level of the curved meshes,
+	// from the foreground down to far clutter
+	const int g_CylinderSlices[InstancedMeshes::LOD_COUNT] = { 64, 36, 16, 8 };
+	const int g_TorusMainSegments[InstancedMeshes::LOD_COUNT] = { 64, 36, 18, 10 };
+	const int g_TorusTubeSegments[InstancedMeshes::LOD_COUNT] = { 24, 18, 9, 6 };
+	const int g_SphereSegments[InstancedMeshes::LOD_COUNT] = { 48, 30, 16, 8 };
+	// smallest radius on screen in pixels drawn with each level
+	const float g_LODRadii[InstancedMeshes::LOD_COUNT] = { 192.0f, 64.0f, 16.0f, 0.0f };
+
+	/***********************************************************
+	 *  AddVertex()
+	 *
+	 *  This function is used for appending one interleaved
+	 *  vertex to the passed in vertex array.
+	 ***********************************************************/
+	void AddVertex(
+		std::vector<float>& vertices,
+		glm::vec3 position,
+		glm::vec3 normal,
+		float u, float v)
+	{
+		vertices.push_back(position.x);
+		vertices.push_back(position.y);
+		vertices.push_back(position.z);
+		vertices.push_back(normal.x);
+		vertices.push_back(normal.y);
+		vertices.push_back(normal.z);
+		vertices.push_back(u);
+		vertices.push_back(v);
+	}
+
+	/***********************************************************
+	 *  AddBoxFace()
+	 *
+	 *  This function is used for appending one face of the unit
+	 *  box.  The tangent and bitangent must satisfy
+	 *  cross(tangent, bitangent) == normal so the triangles are
+	 *  wound counter-clockwise when seen from outside.
+	 ***********************************************************/
+	void AddBoxFace(
+		InstancedMeshes::GLMESH& mesh,
+		glm::vec3 normal,
+		glm::vec3 tangent,
+		glm::vec3 bitangent)
+	{
+		GLuint first = (GLuint)(mesh.vertices.size() / InstancedMeshes::FLOATS_PER_VERTEX);
+		glm::vec3 center = normal * 0.5f;
+
+		AddVertex(mesh.vertices, center - tangent * 0.5f - bitangent * 0.5f, normal, 0.0f, 0.0f);
+		AddVertex(mesh.vertices, center + tangent * 0.5f - bitangent * 0.5f, normal, 1.0f, 0.0f);
+		AddVertex(mesh.vertices, center + tangent * 0.5f + bitangent * 0.5f, normal, 1.0f, 1.0f);
+		AddVertex(mesh.vertices, center - tangent * 0.5f + bitangent * 0.5f, normal, 0.0f, 1.0f);
+
+		GLuint faceIndices[] = { 0, 1, 2, 0, 2, 3 };
+		for (int i = 0; i < 6; i++)
+		{
+			mesh.indices.push_back(first + faceIndices[i]);
+		}
+	}
+}
+
+/***********************************************************
+ *  InstancedMeshes()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+InstancedMeshes::InstancedMeshes()
+{
+	std::vector<GLMESH*> meshes;
+	CollectMeshes(meshes);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		meshes[i]->vao = 0;
+		meshes[i]->baseVertex = 0;
+		meshes[i]->firstIndex = 0;
+		meshes[i]->nVertices = 0;
+		meshes[i]->nIndices = 0;
+	}
+
+	m_instanceBase = 0;
+	m_bBaseInstance = false;
+	m_bCacheMissed = false;
+	m_optimizedTriangles = 0;
+	m_cacheMissesBefore = 0;
+	m_cacheMissesAfter = 0;
+
+	// the meshes of an earlier launch are copied from here
+	m_meshStore.OpenCache(g_MeshCacheFile);
+}
+
+/***********************************************************
+ *  ~InstancedMeshes()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+InstancedMeshes::~InstancedMeshes()
+{
+}
+
+/***********************************************************
+ *  GetLODRadius()
+ *
+ *  This method is used for getting the radius on screen, in
+ *  pixels, from which on an object is drawn with a level.
+ ***********************************************************/
+float InstancedMeshes::GetLODRadius(int lod)
+{
+	return(g_LODRadii[std::min(std::max(lod, 0), LOD_COUNT - 1)]);
+}
+
+/***********************************************************
+ *  SelectLOD()
+ *
+ *  This method is used for picking the tessellation level
+ *  of an object from its radius on screen.  The object only
+ *  moves to a finer level once its radius is clearly above
+ *  the switch radius of that level, and to a coarser one
+ *  once it is clearly below the switch radius of its
+ *  current level, so an object resting near a switch radius
+ *  does not flicker between the two levels.
+ ***********************************************************/
+int InstancedMeshes::SelectLOD(float screenRadius, int currentLOD)
+{
+	const float hysteresis = LOD_HYSTERESIS_PERCENT / 100.0f;
+	int lod = std::min(std::max(currentLOD, 0), LOD_COUNT - 1);
+
+	while ((lod > 0) && (screenRadius >= g_LODRadii[lod - 1] * (1.0f + hysteresis)))
+	{
+		lod--;
+	}
+	while ((lod < LOD_COUNT - 1) && (screenRadius < g_LODRadii[lod] * (1.0f - hysteresis)))
+	{
+		lod++;
+	}
+
+	return(lod);
+}
+
+/***********************************************************
+ *  CollectMeshes()
+ *
+ *  This method is used for getting every generated mesh,
+ *  with one entry for each level of the curved meshes.
+ ***********************************************************/
+void InstancedMeshes::CollectMeshes(std::vector<GLMESH*>& meshes)
+{
+	meshes.clear();
+	meshes.push_back(&m_planeMesh);
+	meshes.push_back(&m_boxMesh);
+	for (int lod = 0; lod < LOD_COUNT; lod++)
+	{
+		meshes.push_back(&m_cylinderMeshes[lod]);
+		meshes.push_back(&m_taperedCylinderMeshes[lod]);
+		meshes.push_back(&m_torusMeshes[lod]);
+		meshes.push_back(&m_sphereMeshes[lod]);
+	}
+}
+
+/***********************************************************
+ *  LoadPlaneMesh()
+ *
+ *  This method is used for generating a flat plane in the
+ *  XZ plane, from -1 to 1 on both axes, facing up.
+ ***********************************************************/
+void InstancedMeshes::LoadPlaneMesh()
+{
+	if (LoadCachedMesh(m_planeMesh, "plane"))
+	{
+		return;
+	}
+
+	glm::vec3 up(0.0f, 1.0f, 0.0f);
+
+	AddVertex(m_planeMesh.vertices, glm::vec3(-1.0f, 0.0f, 1.0f), up, 0.0f, 0.0f);
+	AddVertex(m_planeMesh.vertices, glm::vec3(1.0f, 0.0f, 1.0f), up, 1.0f, 0.0f);
+	AddVertex(m_planeMesh.vertices, glm::vec3(1.0f, 0.0f, -1.0f), up, 1.0f, 1.0f);
+	AddVertex(m_planeMesh.vertices, glm::vec3(-1.0f, 0.0f, -1.0f), up, 0.0f, 1.0f);
+
+	GLuint indices[] = { 0, 1, 2, 0, 2, 3 };
+	m_planeMesh.indices.assign(indices, indices + 6);
+
+	OptimizeMesh(m_planeMesh);
+	CreateMesh(m_planeMesh, "plane");
+}
+
+/***********************************************************
+ *  LoadBoxMesh()
+ *
+ *  This method is used for generating a unit box centered
+ *  on the origin, with separate vertices for each face so
+ *  that the normals are flat.
+ ***********************************************************/
+void InstancedMeshes::LoadBoxMesh()
+{
+	if (LoadCachedMesh(m_boxMesh, "box"))
+	{
+		return;
+	}
+
+	AddBoxFace(m_boxMesh, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	AddBoxFace(m_boxMesh, glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	AddBoxFace(m_boxMesh, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+	AddBoxFace(m_boxMesh, glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	AddBoxFace(m_boxMesh, glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	AddBoxFace(m_boxMesh, glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	OptimizeMesh(m_boxMesh);
+	CreateMesh(m_boxMesh, "box");
+}
+
+/***********************************************************
+ *  LoadCylinderMesh()
+ *
+ *  This method is used for generating every level of a
+ *  capped cylinder with a radius of 1, from 0 to 1 on the
+ *  Y axis.
+ ***********************************************************/
+void InstancedMeshes::LoadCylinderMesh()
+{
+	for (int lod = 0; lod < LOD_COUNT; lod++)
+	{
+		char name[MeshStore::MAX_NAME_LENGTH];
+		snprintf(name, sizeof(name), "cylinder%d", lod);
+		if (LoadCachedMesh(m_cylinderMeshes[lod], name))
+		{
+			continue;
+		}
+
+		BuildTaperedCylinder(m_cylinderMeshes[lod], 1.0f, 1.0f, g_CylinderSlices[lod]);
+		OptimizeMesh(m_cylinderMeshes[lod]);
+		CreateMesh(m_cylinderMeshes[lod], name);
+	}
+}
+
+/***********************************************************
+ *  LoadTaperedCylinderMesh()
+ *
+ *  This method is used for generating every level of a
+ *  capped cylinder with a bottom radius of 1 and a top
+ *  radius of 0.5, from 0 to 1 on the Y axis.
+ ***********************************************************/
+void InstancedMeshes::LoadTaperedCylinderMesh()
+{
+	for (int lod = 0; lod < LOD_COUNT; lod++)
+	{
+		char name[MeshStore::MAX_NAME_LENGTH];
+		snprintf(name, sizeof(name), "taperedCylinder%d", lod);
+		if (LoadCachedMesh(m_taperedCylinderMeshes[lod], name))
+		{
+			continue;
+		}
+
+		BuildTaperedCylinder(m_taperedCylinderMeshes[lod], 1.0f, 0.5f, g_CylinderSlices[lod]);
+		OptimizeMesh(m_taperedCylinderMeshes[lod]);
+		CreateMesh(m_taperedCylinderMeshes[lod], name);
+	}
+}
+
+/***********************************************************
+ *  LoadTorusMesh()
+ *
+ *  This method is used for generating every level of a
+ *  torus in the XY plane with a main radius of 1 and a tube
+ *  radius of 0.2.
+ ***********************************************************/
+void InstancedMeshes::LoadTorusMesh()
+{
+	for (int lod = 0; lod < LOD_COUNT; lod++)
+	{
+		char name[MeshStore::MAX_NAME_LENGTH];
+		snprintf(name, sizeof(name), "torus%d", lod);
+		if (LoadCachedMesh(m_torusMeshes[lod], name))
+		{
+			continue;
+		}
+
+		BuildTorus(m_torusMeshes[lod], g_TorusMainSegments[lod], g_TorusTubeSegments[lod]);
+		OptimizeMesh(m_torusMeshes[lod]);
+		CreateMesh(m_torusMeshes[lod], name);
+	}
+}
+
+/***********************************************************
+ *  LoadSphereMesh()
+ *
+ *  This method is used for generating every level of a
+ *  sphere with a radius of 1 centered on the origin.
+ ***********************************************************/
+void InstancedMeshes::LoadSphereMesh()
+{
+	for (int lod = 0; lod < LOD_COUNT; lod++)
+	{
+		char name[MeshStore::MAX_NAME_LENGTH];
+		snprintf(name, sizeof(name), "sphere%d", lod);
+		if (LoadCachedMesh(m_sphereMeshes[lod], name))
+		{
+			continue;
+		}
+
+		BuildSphere(m_sphereMeshes[lod], g_SphereSegments[lod], g_SphereSegments[lod]);
+		OptimizeMesh(m_sphereMeshes[lod]);
+		CreateMesh(m_sphereMeshes[lod], name);
+	}
+}
+
+/***********************************************************
+ *  BuildTorus()
+ *
+ *  This method is used for generating a torus in the XY
+ *  plane with a main radius of 1 and a tube radius of 0.2.
+ ***********************************************************/
+void InstancedMeshes::BuildTorus(GLMESH& mesh, int mainSegments, int tubeSegments)
+{
+	const float mainRadius = 1.0f;
+	const float tubeRadius = 0.2f;
+
+	for (int i = 0; i <= mainSegments; i++)
+	{
+		float theta = 2.0f * g_Pi * i / mainSegments;
+		glm::vec3 outward(std::cos(theta), std::sin(theta), 0.0f);
+
+		for (int j = 0; j <= tubeSegments; j++)
+		{
+			float phi = 2.0f * g_Pi * j / tubeSegments;
+			glm::vec3 normal = outward * std::cos(phi) + glm::vec3(0.0f, 0.0f, std::sin(phi));
+
+			AddVertex(
+				mesh.vertices,
+				outward * mainRadius + normal * tubeRadius,
+				normal,
+				(float)i / mainSegments,
+				(float)j / tubeSegments);
+		}
+	}
+
+	for (int i = 0; i < mainSegments; i++)
+	{
+		for (int j = 0; j < tubeSegments; j++)
+		{
+			GLuint a = i * (tubeSegments + 1) + j;
+			GLuint b = a + tubeSegments + 1;
+
+			mesh.indices.push_back(a);
+			mesh.indices.push_back(b);
+			mesh.indices.push_back(a + 1);
+			mesh.indices.push_back(a + 1);
+			mesh.indices.push_back(b);
+			mesh.indices.push_back(b + 1);
+		}
+	}
+}
+
+/***********************************************************
+ *  BuildSphere()
+ *
+ *  This method is used for generating a sphere with a
+ *  radius of 1 centered on the origin.
+ ***********************************************************/
+void InstancedMeshes::BuildSphere(GLMESH& mesh, int stacks, int slices)
+{
+	for (int j = 0; j <= stacks; j++)
+	{
+		float phi = g_Pi * j / stacks;
+
+		for (int i = 0; i <= slices; i++)
+		{
+			float theta = 2.0f * g_Pi * i / slices;
+			glm::vec3 normal(
+				std::sin(phi) * std::cos(theta),
+				std::cos(phi),
+				std::sin(phi) * std::sin(theta));
+
+			AddVertex(
+				mesh.vertices,
+				normal,
+				normal,
+				(float)i / slices,
+				1.0f - (float)j / stacks);
+		}
+	}
+
+	for (int j = 0; j < stacks; j++)
+	{
+		for (int i = 0; i < slices; i++)
+		{
+			GLuint a = j * (slices + 1) + i;
+			GLuint b = a + slices + 1;
+
+			mesh.indices.push_back(a);
+			mesh.indices.push_back(a + 1);
+			mesh.indices.push_back(b);
+			mesh.indices.push_back(a + 1);
+			mesh.indices.push_back(b + 1);
+			mesh.indices.push_back(b);
+		}
+	}
+}
+
+/***********************************************************
+ *  BuildTaperedCylinder()
+ *
+ *  This method is used for generating the side, the bottom
+ *  cap and, when the top radius is not zero, the top cap of
+ *  a cylinder from 0 to 1 on the Y axis.
+ ***********************************************************/
+void InstancedMeshes::BuildTaperedCylinder(GLMESH& mesh, float bottomRadius, float topRadius, int slices)
+{
+	// the side normals lean out by the change in radius
+	const float slope = bottomRadius - topRadius;
+
+	GLuint first = 0;
+	for (int i = 0; i <= slices; i++)
+	{
+		float theta = 2.0f * g_Pi * i / slices;
+		float c = std::cos(theta);
+		float s = std::sin(theta);
+		glm::vec3 normal = glm::normalize(glm::vec3(c, slope, s));
+
+		AddVertex(mesh.vertices, glm::vec3(c * bottomRadius, 0.0f, s * bottomRadius), normal, (float)i / slices, 0.0f);
+		AddVertex(mesh.vertices, glm::vec3(c * topRadius, 1.0f, s * topRadius), normal, (float)i / slices, 1.0f);
+	}
+	for (int i = 0; i < slices; i++)
+	{
+		GLuint bottom = first + i * 2;
+		GLuint top = bottom + 1;
+
+		mesh.indices.push_back(bottom);
+		mesh.indices.push_back(top);
+		mesh.indices.push_back(bottom + 2);
+		mesh.indices.push_back(bottom + 2);
+		mesh.indices.push_back(top);
+		mesh.indices.push_back(top + 2);
+	}
+
+	// the caps are generated with the top cap last
+	for (int cap = 0; cap < 2; cap++)
+	{
+		float radius = (cap == 0) ? bottomRadius : topRadius;
+		float y = (cap == 0) ? 0.0f : 1.0f;
+		glm::vec3 normal(0.0f, (cap == 0) ? -1.0f : 1.0f, 0.0f);
+
+		if (radius <= 0.0f)
+		{
+			continue;
+		}
+
+		GLuint center = (GLuint)(mesh.vertices.size() / FLOATS_PER_VERTEX);
+		AddVertex(mesh.vertices, glm::vec3(0.0f, y, 0.0f), normal, 0.5f, 0.5f);
+		for (int i = 0; i <= slices; i++)
+		{
+			float theta = 2.0f * g_Pi * i / slices;
+			float c = std::cos(theta);
+			float s = std::sin(theta);
+			AddVertex(mesh.vertices, glm::vec3(c * radius, y, s * radius), normal, 0.5f + 0.5f * c, 0.5f + 0.5f * s);
+		}
+		for (int i = 0; i < slices; i++)
+		{
+			GLuint ring = center + 1 + i;
+			mesh.indices.push_back(center);
+			mesh.indices.push_back((cap == 0) ? ring : ring + 1);
+			mesh.indices.push_back((cap == 0) ? ring + 1 : ring);
+		}
+	}
+}
+
+/***********************************************************
+ *  OptimizeMesh()
+ *
+ *  This method is used for reordering the triangles of a
+ *  generated mesh for the post-transform vertex cache, and
+ *  then its vertices in the order the triangles use them.
+ *  The cache misses before and after are added up, to
+ *  report the gain once all the meshes are loaded.
+ ***********************************************************/
+void InstancedMeshes::OptimizeMesh(GLMESH& mesh)
+{
+	const int vertexCount = (int)(mesh.vertices.size() / FLOATS_PER_VERTEX);
+	const int cacheSize = MeshOptimizer::FIFO_CACHE_SIZE;
+
+	m_optimizedTriangles += (int)(mesh.indices.size() / 3);
+	m_cacheMissesBefore += MeshOptimizer::CountCacheMisses(mesh.indices, vertexCount, cacheSize);
+
+	MeshOptimizer::OptimizeVertexCache(mesh.indices, vertexCount);
+	MeshOptimizer::OptimizeVertexFetch(mesh.vertices, FLOATS_PER_VERTEX, mesh.indices);
+
+	m_cacheMissesAfter += MeshOptimizer::CountCacheMisses(mesh.indices, vertexCount, cacheSize);
+}
+
+/***********************************************************
+ *  LoadCachedMesh()
+ *
+ *  This method is used for copying a mesh of an earlier
+ *  launch out of the mapped cache and adding it to the
+ *  shared buffers.  When the cache does not hold the mesh,
+ *  the cache is written again once all the meshes are
+ *  loaded.
+ ***********************************************************/
+bool InstancedMeshes::LoadCachedMesh(GLMESH& mesh, const char* name)
+{
+	if (m_meshStore.FindCachedMesh(name, mesh.vertices, mesh.indices) == false)
+	{
+		m_bCacheMissed = true;
+		return(false);
+	}
+
+	CreateMesh(mesh, name);
+	return(true);
+}
+
+/***********************************************************
+ *  CreateMesh()
+ *
+ *  This method is used for adding the generated vertices
+ *  and indices of a mesh to the shared buffers.  The range
+ *  of the mesh is known right away, while the upload and
+ *  the vertex array wait for UploadMeshes().
+ ***********************************************************/
+void InstancedMeshes::CreateMesh(GLMESH& mesh, const char* name)
+{
+	const int index = m_meshStore.AddMesh(name, mesh.vertices, mesh.indices);
+	const MeshStore::MESH& range = m_meshStore.GetMesh(index);
+
+	mesh.baseVertex = range.baseVertex;
+	mesh.firstIndex = range.firstIndex;
+	mesh.nVertices = range.nVertices;
+	mesh.nIndices = range.nIndices;
+}
+
+/***********************************************************
+ *  UploadMeshes()
+ *
+ *  This method is used for uploading the loaded meshes into
+ *  the shared buffers, and for adding the per-instance
+ *  attributes to the shared vertex array.  The cache is
+ *  written again when a mesh had to be generated, and the
+ *  average cache miss ratio of the generated meshes is
+ *  reported before and after their optimization.
+ ***********************************************************/
+void InstancedMeshes::UploadMeshes()
+{
+	// the cached meshes were copied out when they were found,
+	// and the file is unmapped before it is replaced, as a
+	// mapped file cannot be removed or renamed on Windows
+	m_meshStore.CloseCache();
+	if (m_bCacheMissed)
+	{
+		if (m_meshStore.SaveCache(g_MeshCacheFile) == false)
+		{
+			std::cout << "ERROR: could not write the mesh cache " << g_MeshCacheFile << std::endl;
+		}
+		m_bCacheMissed = false;
+	}
+
+	if (m_optimizedTriangles > 0)
+	{
+		std::cout << "INFO: optimized " << m_optimizedTriangles << " generated triangles, ACMR ("
+			<< MeshOptimizer::FIFO_CACHE_SIZE << " entry FIFO) before:"
+			<< (float)m_cacheMissesBefore / m_optimizedTriangles
+			<< ", after:" << (float)m_cacheMissesAfter / m_optimizedTriangles << std::endl;
+		m_optimizedTriangles = 0;
+		m_cacheMissesBefore = 0;
+		m_cacheMissesAfter = 0;
+	}
+
+	// the instance buffer is shared by all of the meshes
+	if (m_instanceStream.GetBuffer() == 0)
+	{
+		m_instanceStream.Reserve(sizeof(INSTANCE_DATA));
+		m_bBaseInstance = (GLEW_VERSION_4_2 || GLEW_ARB_base_instance) ? true : false;
+	}
+
+	// the store leaves its vertex array bound
+	m_meshStore.Upload();
+	EnableInstanceAttributes(m_instanceStream.GetBuffer());
+	glBindVertexArray(0);
+	std::cout << "INFO: mesh vertices:" << m_meshStore.GetVertexCount()
+		<< ", vertex bytes:" << m_meshStore.GetVertexCount() * m_meshStore.GetVertexStride()
+		<< (m_meshStore.IsCompressed() ? " (compressed)" : "") << std::endl;
+
+	std::vector<GLMESH*> meshes;
+	CollectMeshes(meshes);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		meshes[i]->vao = (meshes[i]->nIndices > 0) ? m_meshStore.GetVertexArray() : 0;
+	}
+}
+
+/***********************************************************
+ *  CreateVertexArray()
+ *
+ *  This method is used for creating a vertex array with the
+ *  same attributes as the shared one, whose per-instance
+ *  attributes read the records of another buffer.
+ ***********************************************************/
+GLuint InstancedMeshes::CreateVertexArray(GLuint instanceBuffer)
+{
+	GLuint vao = m_meshStore.CreateVertexArray();
+	EnableInstanceAttributes(instanceBuffer);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return(vao);
+}
+
+/***********************************************************
+ *  EnableInstanceAttributes()
+ *
+ *  This method is used for enabling the per-instance
+ *  attributes of the bound vertex array, which advance once
+ *  per instance, and pointing them at the first record of
+ *  a buffer.
+ ***********************************************************/
+void InstancedMeshes::EnableInstanceAttributes(GLuint instanceBuffer)
+{
+	for (GLuint column = 0; column < 4; column++)
+	{
+		glEnableVertexAttribArray(g_InstanceModelLocation + column);
+		glVertexAttribDivisor(g_InstanceModelLocation + column, 1);
+	}
+	glEnableVertexAttribArray(g_InstanceColorLocation);
+	glVertexAttribDivisor(g_InstanceColorLocation, 1);
+	glEnableVertexAttribArray(g_InstanceUVScaleLocation);
+	glVertexAttribDivisor(g_InstanceUVScaleLocation, 1);
+	glEnableVertexAttribArray(g_InstanceIndicesLocation);
+	glVertexAttribDivisor(g_InstanceIndicesLocation, 1);
+	SetInstanceAttributes(instanceBuffer, 0);
+}
+
+/***********************************************************
+ *  SetInstanceAttributes()
+ *
+ *  This method is used for pointing the per-instance
+ *  attributes at a byte offset in an instance buffer.  The
+ *  vertex array object must be bound.
+ ***********************************************************/
+void InstancedMeshes::SetInstanceAttributes(GLuint instanceBuffer, size_t byteOffset)
+{
+	const GLsizei stride = sizeof(INSTANCE_DATA);
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for (GLuint column = 0; column < 4; column++)
+	{
+		glVertexAttribPointer(g_InstanceModelLocation + column, 4, GL_FLOAT, GL_FALSE, stride,
+			(void*)(byteOffset + offsetof(INSTANCE_DATA, model) + sizeof(glm::vec4) * column));
+	}
+	glVertexAttribPointer(g_InstanceColorLocation, 4, GL_FLOAT, GL_FALSE, stride,
+		(void*)(byteOffset + offsetof(INSTANCE_DATA, color)));
+	glVertexAttribPointer(g_InstanceUVScaleLocation, 2, GL_FLOAT, GL_FALSE, stride,
+		(void*)(byteOffset + offsetof(INSTANCE_DATA, uvScale)));
+	glVertexAttribIPointer(g_InstanceIndicesLocation, 2, GL_INT, stride,
+		(void*)(byteOffset + offsetof(INSTANCE_DATA, textureSlot)));
+}
+
+/***********************************************************
+ *  ReserveInstances()
+ *
+ *  This method is used for growing the regions of the
+ *  instance stream to hold the passed in number of
+ *  instances.  When the stream gets a new buffer, the
+ *  per-instance attributes of the shared vertex array are
+ *  pointed at it.
+ ***********************************************************/
+void InstancedMeshes::ReserveInstances(int instanceCount)
+{
+	if (instanceCount < 1)
+	{
+		instanceCount = 1;
+	}
+
+	if (m_instanceStream.Reserve(sizeof(INSTANCE_DATA) * instanceCount) == false)
+	{
+		return;
+	}
+
+	if (m_meshStore.GetVertexArray() != 0)
+	{
+		glBindVertexArray(m_meshStore.GetVertexArray());
+		SetInstanceAttributes(m_instanceStream.GetBuffer(), 0);
+		glBindVertexArray(0);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_instanceBase = 0;
+}
+
+/***********************************************************
+ *  BeginInstances()
+ *
+ *  This method is used for getting the next free region of
+ *  the instance stream.  Filling the records needs no GL
+ *  calls, so the caller can spread the work over threads,
+ *  as long as EndInstances() is called on the GL thread.
+ ***********************************************************/
+InstancedMeshes::INSTANCE_DATA* InstancedMeshes::BeginInstances(int instanceCount)
+{
+	ReserveInstances(instanceCount);
+
+	return((INSTANCE_DATA*)m_instanceStream.BeginWrite(sizeof(INSTANCE_DATA) * instanceCount));
+}
+
+/***********************************************************
+ *  EndInstances()
+ *
+ *  This method is used for finishing the write of the
+ *  instance records.  The region size is a whole number of
+ *  records, so the region offset becomes a base instance
+ *  that is added to the first instance of every draw.
+ ***********************************************************/
+void InstancedMeshes::EndInstances(int instanceCount)
+{
+	size_t offset = m_instanceStream.EndWrite(sizeof(INSTANCE_DATA) * instanceCount);
+
+	m_instanceBase = (int)(offset / sizeof(INSTANCE_DATA));
+}
+
+/***********************************************************
+ *  FenceInstances()
+ *
+ *  This method is used for protecting the current records
+ *  until the draws issued this frame have read them.  It is
+ *  called once per frame after the instanced draws.
+ ***********************************************************/
+void InstancedMeshes::FenceInstances()
+{
+	m_instanceStream.Fence();
+}
+
+/***********************************************************
+ *  DrawBoundMeshInstanced()
+ *
+ *  This method is used for drawing a range of instances of
+ *  a mesh with one draw call, when the caller has already
+ *  bound the shared vertex array.  The base vertex and the
+ *  first index select the mesh in the shared buffers.
+ *  Without base instance support the per-instance
+ *  attributes are moved to the first instance instead.
+ ***********************************************************/
+void InstancedMeshes::DrawBoundMeshInstanced(const GLMESH& mesh, int firstInstance, int instanceCount)
+{
+	if ((mesh.vao == 0) || (instanceCount <= 0))
+	{
+		return;
+	}
+
+	if (m_bBaseInstance)
+	{
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_INT,
+			(void*)(sizeof(GLuint) * mesh.firstIndex), instanceCount, mesh.baseVertex,
+			m_instanceBase + firstInstance);
+	}
+	else
+	{
+		SetInstanceAttributes(m_instanceStream.GetBuffer(), sizeof(INSTANCE_DATA) * (m_instanceBase + firstInstance));
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_INT,
+			(void*)(sizeof(GLuint) * mesh.firstIndex), instanceCount, mesh.baseVertex);
+	}
+}
+
+/***********************************************************
+ *  DrawBoundMeshInstanced()
+ *
+ *  This method is used for drawing a range of the records
+ *  of an instance buffer the caller owns, through a vertex
+ *  array made by CreateVertexArray() for that buffer.  The
+ *  records are not in the instance stream, so no stream
+ *  offset is added to the first instance.
+ ***********************************************************/
+void InstancedMeshes::DrawBoundMeshInstanced(const GLMESH& mesh, GLuint instanceBuffer, int firstInstance, int instanceCount)
+{
+	if ((mesh.vao == 0) || (instanceCount <= 0))
+	{
+		return;
+	}
+
+	if (m_bBaseInstance)
+	{
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_INT,
+			(void*)(sizeof(GLuint) * mesh.firstIndex), instanceCount, mesh.baseVertex, firstInstance);
+	}
+	else
+	{
+		SetInstanceAttributes(instanceBuffer, sizeof(INSTANCE_DATA) * firstInstance);
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_INT,
+			(void*)(sizeof(GLuint) * mesh.firstIndex), instanceCount, mesh.baseVertex);
+	}
+}
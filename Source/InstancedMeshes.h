@@ -0,0 +1,187 @@
+///////////////////////////////////////////////////////////////////////////////
+// instancedmeshes.h
+// ============
+// basic 3D shape meshes that are drawn with per-instance attributes
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "MeshStore.h"
+#include "StreamBuffer.h"
+
+#include <vector>
+
+/***********************************************************
+ *  InstancedMeshes
+ *
+ *  This class generates the same basic shapes as the
+ *  ShapeMeshes class, with the same vertex layout, and adds
+ *  instanced draw calls.  Each instance reads its model
+ *  matrix, color, UV scale, texture and material from a
+ *  shared per-instance stream buffer, so every copy of a
+ *  mesh in the scene can be drawn with a single draw call.
+ *  The records of a frame are written straight into the
+ *  mapped stream buffer and found through the base
+ *  instance of the draws.
+ *
+ *  The curved meshes are generated at several tessellation
+ *  levels, from a fine one for objects that fill a large
+ *  part of the screen down to a coarse one for far clutter.
+ *  SelectLOD() picks the level of an object from its radius
+ *  on screen, with some hysteresis between the levels.
+ *
+ *  All the meshes share the buffers and the vertex array of
+ *  a mesh store and are drawn with a base vertex and a first
+ *  index.  A generated mesh has its triangles reordered for
+ *  the post-transform vertex cache and its vertices for the
+ *  vertex fetch, and is kept in a binary cache, so later
+ *  launches copy it out of the cache instead of tessellating
+ *  and optimizing it again.
+ ***********************************************************/
+class InstancedMeshes
+{
+public:
+	// constructor
+	InstancedMeshes();
+	// destructor
+	~InstancedMeshes();
+
+	// per-instance values read by the vertex shader
+	struct INSTANCE_DATA
+	{
+		glm::mat4 model;
+		glm::vec4 color;
+		glm::vec2 uvScale;
+		int textureSlot;
+		int materialIndex;
+	};
+
+	// stores the GL data relative to a given mesh
+	struct GLMESH
+	{
+		// vertex array shared by all the meshes
+		GLuint vao;
+		// range of the mesh in the shared buffers
+		GLint baseVertex;
+		GLuint firstIndex;
+		GLuint nVertices;
+		GLuint nIndices;
+		// CPU copy of the interleaved vertices and the indices
+		std::vector<float> vertices;
+		std::vector<GLuint> indices;
+	};
+
+	// number of floats in one vertex - position, normal, UV
+	static const int FLOATS_PER_VERTEX = MeshStore::FLOATS_PER_VERTEX;
+	// number of tessellation levels of the curved meshes, from
+	// the finest at level 0 to the coarsest
+	static const int LOD_COUNT = 4;
+	// how far past a switch radius an object has to be before
+	// it changes level, in percent of the radius
+	static const int LOD_HYSTERESIS_PERCENT = 15;
+
+	// smallest radius on screen in pixels that is drawn with a
+	// level, 0 for the coarsest one
+	static float GetLODRadius(int lod);
+	// level to draw an object of the passed in radius on screen
+	// with, given the level it was drawn with last
+	static int SelectLOD(float screenRadius, int currentLOD);
+
+	void LoadPlaneMesh();
+	void LoadBoxMesh();
+	void LoadCylinderMesh();
+	void LoadTaperedCylinderMesh();
+	void LoadTorusMesh();
+	void LoadSphereMesh();
+	// choose between the compressed and the float vertex
+	// layout, before the meshes are uploaded
+	void SetVertexCompression(bool bCompressed) { m_meshStore.SetCompressed(bCompressed); }
+	// upload the loaded meshes into the shared buffers, called
+	// once all the meshes are loaded
+	void UploadMeshes();
+	// create a vertex array over the shared mesh buffers that
+	// reads the per-instance attributes from another buffer of
+	// INSTANCE_DATA records, the caller owns it
+	GLuint CreateVertexArray(GLuint instanceBuffer);
+
+	// read-only access to the generated geometry, the curved
+	// meshes at one of their tessellation levels
+	const GLMESH& GetPlaneMesh() const { return(m_planeMesh); }
+	const GLMESH& GetBoxMesh() const { return(m_boxMesh); }
+	const GLMESH& GetCylinderMesh(int lod = 0) const { return(m_cylinderMeshes[lod]); }
+	const GLMESH& GetTaperedCylinderMesh(int lod = 0) const { return(m_taperedCylinderMeshes[lod]); }
+	const GLMESH& GetTorusMesh(int lod = 0) const { return(m_torusMeshes[lod]); }
+	const GLMESH& GetSphereMesh(int lod = 0) const { return(m_sphereMeshes[lod]); }
+
+	// make room for the passed in number of instances
+	void ReserveInstances(int instanceCount);
+	// get the records to fill with this frame's per-instance
+	// values, they can be written from any thread
+	INSTANCE_DATA* BeginInstances(int instanceCount);
+	// make the written records the ones read by the draws
+	void EndInstances(int instanceCount);
+	// mark the records as used by the draws issued so far
+	void FenceInstances();
+
+	// draw a range of the uploaded instances of a mesh whose
+	// vertex array is already bound
+	void DrawBoundMeshInstanced(const GLMESH& mesh, int firstInstance, int instanceCount);
+	// draw a range of the records of another instance buffer,
+	// with a vertex array created for it already bound
+	void DrawBoundMeshInstanced(const GLMESH& mesh, GLuint instanceBuffer, int firstInstance, int instanceCount);
+
+private:
+	GLMESH m_planeMesh;
+	GLMESH m_boxMesh;
+	GLMESH m_cylinderMeshes[LOD_COUNT];
+	GLMESH m_taperedCylinderMeshes[LOD_COUNT];
+	GLMESH m_torusMeshes[LOD_COUNT];
+	GLMESH m_sphereMeshes[LOD_COUNT];
+
+	// shared buffers holding the geometry of all the meshes
+	MeshStore m_meshStore;
+	// true when a mesh was generated because the cache did
+	// not hold it
+	bool m_bCacheMissed;
+	// triangles of the generated meshes, and the vertices a
+	// FIFO cache transforms for them before and after the
+	// optimization
+	int m_optimizedTriangles;
+	int m_cacheMissesBefore;
+	int m_cacheMissesAfter;
+
+	// ring buffer holding the per-instance values for all meshes
+	StreamBuffer m_instanceStream;
+	// index of the first record written in the current frame
+	int m_instanceBase;
+	// true when the driver supports a base instance offset
+	bool m_bBaseInstance;
+
+	// generate the side and caps of a cylinder whose radius
+	// changes linearly from the bottom to the top
+	void BuildTaperedCylinder(GLMESH& mesh, float bottomRadius, float topRadius, int slices);
+	// generate a torus with the passed in number of segments
+	// around the main ring and around the tube
+	void BuildTorus(GLMESH& mesh, int mainSegments, int tubeSegments);
+	// generate a sphere with the passed in number of stacks
+	// from pole to pole and slices around the Y axis
+	void BuildSphere(GLMESH& mesh, int stacks, int slices);
+	// get every mesh, each level of the curved meshes included
+	void CollectMeshes(std::vector<GLMESH*>& meshes);
+	// reorder the triangles and vertices of a generated mesh
+	void OptimizeMesh(GLMESH& mesh);
+	// copy a mesh out of the cache, false when it must be
+	// generated
+	bool LoadCachedMesh(GLMESH& mesh, const char* name);
+	// add the geometry of a mesh to the shared buffers
+	void CreateMesh(GLMESH& mesh, const char* name);
+	// enable the per-instance attributes of the bound vertex
+	// array and point them at a buffer
+	void EnableInstanceAttributes(GLuint instanceBuffer);
+	// point the per-instance attributes at a byte offset
+	void SetInstanceAttributes(GLuint instanceBuffer, size_t byteOffset);
+};
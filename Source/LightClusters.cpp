@@ -0,0 +1,360 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.cpp
+// ============
+// small point lights binned into a 3D grid of view frustum clusters
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// declaration of the global variables and defines
+namespace
+{
+	// view depth range split into the slices, the near and far
+	// planes of the view projection - must match CLUSTER_NEAR
+	// and CLUSTER_FAR in the fragment shader
+	const float g_NearDepth = 0.1f;
+	const float g_FarDepth = 100.0f;
+	// texel format and texture unit of each table
+	const GLenum g_TableFormats[] = { GL_RG32UI, GL_R16UI, GL_RGBA32F };
+	const int g_TableUnits[] =
+	{
+		LightClusters::CLUSTER_TABLE_UNIT,
+		LightClusters::LIGHT_INDEX_UNIT,
+		LightClusters::LIGHT_TABLE_UNIT
+	};
+}
+
+/***********************************************************
+ *  LightClusters()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+LightClusters::LightClusters()
+{
+	m_bLightsDirty = true;
+	m_view = glm::mat4(1.0f);
+	m_projection = glm::mat4(1.0f);
+	m_bAssigned = false;
+	for (int i = 0; i < TABLE_COUNT; i++)
+	{
+		m_buffers[i] = 0;
+		m_textures[i] = 0;
+	}
+}
+
+/***********************************************************
+ *  ~LightClusters()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+LightClusters::~LightClusters()
+{
+	for (int i = 0; i < TABLE_COUNT; i++)
+	{
+		if (m_textures[i] != 0)
+		{
+			glDeleteTextures(1, &m_textures[i]);
+			m_textures[i] = 0;
+		}
+		if (m_buffers[i] != 0)
+		{
+			glDeleteBuffers(1, &m_buffers[i]);
+			m_buffers[i] = 0;
+		}
+	}
+}
+
+/***********************************************************
+ *  AddLight()
+ *
+ *  This method is used for adding a light to the scene.
+ ***********************************************************/
+int LightClusters::AddLight(const POINT_LIGHT& light)
+{
+	if ((int)m_lights.size() >= MAX_LIGHTS)
+	{
+		return(-1);
+	}
+
+	m_lights.push_back(light);
+	m_bLightsDirty = true;
+
+	return((int)m_lights.size() - 1);
+}
+
+/***********************************************************
+ *  SetLight()
+ *
+ *  This method is used for replacing the values of a light,
+ *  so the lists are built again on the next update.
+ ***********************************************************/
+void LightClusters::SetLight(int index, const POINT_LIGHT& light)
+{
+	if ((index < 0) || (index >= (int)m_lights.size()))
+	{
+		return;
+	}
+
+	m_lights[index] = light;
+	m_bLightsDirty = true;
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method is used for removing all the lights.
+ ***********************************************************/
+void LightClusters::Clear()
+{
+	m_lights.clear();
+	m_bLightsDirty = true;
+}
+
+/***********************************************************
+ *  Update()
+ *
+ *  This method is used for building the light list of every
+ *  cluster for the passed in view.  The lists are counted
+ *  first, so they can be laid out one after the other with
+ *  no gaps, and then filled.  Nothing is done when neither
+ *  the view nor any light has changed, or when there are no
+ *  lights and the empty lists are already uploaded.
+ ***********************************************************/
+void LightClusters::Update(const glm::mat4& view, const glm::mat4& projection)
+{
+	if (m_textures[TABLE_CLUSTERS] == 0)
+	{
+		CreateTables();
+	}
+
+	const bool bViewChanged = (m_bAssigned == false) ||
+		(memcmp(&view, &m_view, sizeof(view)) != 0) ||
+		(memcmp(&projection, &m_projection, sizeof(projection)) != 0);
+	if ((bViewChanged == false) && (m_bLightsDirty == false))
+	{
+		return;
+	}
+
+	const bool bWasEmpty = m_bAssigned && m_lightIndices.empty();
+	m_view = view;
+	m_projection = projection;
+	m_bAssigned = true;
+
+	if (m_bLightsDirty == true)
+	{
+		std::vector<glm::vec4> texels;
+		texels.reserve(m_lights.size() * 2 + 2);
+		for (size_t i = 0; i < m_lights.size(); i++)
+		{
+			texels.push_back(glm::vec4(m_lights[i].position, m_lights[i].radius));
+			texels.push_back(glm::vec4(m_lights[i].color, 0.0f));
+		}
+		if (texels.empty())
+		{
+			texels.resize(2, glm::vec4(0.0f));
+		}
+		UploadTable(TABLE_LIGHTS, texels.size() * sizeof(glm::vec4), texels.data());
+		m_bLightsDirty = false;
+	}
+
+	if (m_lights.empty() && bWasEmpty)
+	{
+		return;
+	}
+
+	// count the lights of every cluster in the second value
+	m_clusterTable.assign(CLUSTER_COUNT * 2, 0);
+	m_lightCells.resize(m_lights.size() * 2);
+	for (size_t i = 0; i < m_lights.size(); i++)
+	{
+		glm::ivec3& minCell = m_lightCells[i * 2];
+		glm::ivec3& maxCell = m_lightCells[i * 2 + 1];
+		if (FindLightCells(m_lights[i], view, projection, minCell, maxCell) == false)
+		{
+			minCell.x = -1;
+			continue;
+		}
+
+		for (int z = minCell.z; z <= maxCell.z; z++)
+		{
+			for (int y = minCell.y; y <= maxCell.y; y++)
+			{
+				for (int x = minCell.x; x <= maxCell.x; x++)
+				{
+					m_clusterTable[(x + GRID_X * (y + GRID_Y * z)) * 2 + 1]++;
+				}
+			}
+		}
+	}
+
+	// lay the lists out, and count again while filling them
+	GLuint offset = 0;
+	for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+	{
+		m_clusterTable[cluster * 2] = offset;
+		offset += m_clusterTable[cluster * 2 + 1];
+		m_clusterTable[cluster * 2 + 1] = 0;
+	}
+	m_lightIndices.resize(offset);
+
+	for (size_t i = 0; i < m_lights.size(); i++)
+	{
+		const glm::ivec3& minCell = m_lightCells[i * 2];
+		const glm::ivec3& maxCell = m_lightCells[i * 2 + 1];
+		if (minCell.x < 0)
+		{
+			continue;
+		}
+
+		for (int z = minCell.z; z <= maxCell.z; z++)
+		{
+			for (int y = minCell.y; y <= maxCell.y; y++)
+			{
+				for (int x = minCell.x; x <= maxCell.x; x++)
+				{
+					GLuint* cluster = &m_clusterTable[(x + GRID_X * (y + GRID_Y * z)) * 2];
+					m_lightIndices[cluster[0] + cluster[1]] = (uint16_t)i;
+					cluster[1]++;
+				}
+			}
+		}
+	}
+
+	UploadTable(TABLE_CLUSTERS, m_clusterTable.size() * sizeof(GLuint), m_clusterTable.data());
+	if (m_lightIndices.empty())
+	{
+		const uint16_t noLight = 0;
+		UploadTable(TABLE_LIGHT_INDICES, sizeof(noLight), &noLight);
+	}
+	else
+	{
+		UploadTable(TABLE_LIGHT_INDICES, m_lightIndices.size() * sizeof(uint16_t), m_lightIndices.data());
+	}
+}
+
+/***********************************************************
+ *  FindLightCells()
+ *
+ *  This method is used for finding the range of clusters
+ *  that the sphere of a light reaches.  The slices come
+ *  from the view depth of the sphere, and the tiles from
+ *  the rectangle of the corners of its box projected on
+ *  screen, which holds the projected sphere.  A sphere that
+ *  reaches in front of the near plane covers every tile.
+ ***********************************************************/
+bool LightClusters::FindLightCells(
+	const POINT_LIGHT& light,
+	const glm::mat4& view,
+	const glm::mat4& projection,
+	glm::ivec3& minCell,
+	glm::ivec3& maxCell)
+{
+	const glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+	const float depth = -center.z;
+
+	if ((depth + light.radius < g_NearDepth) || (depth - light.radius > g_FarDepth))
+	{
+		return(false);
+	}
+
+	minCell.z = FindSlice(std::max(depth - light.radius, g_NearDepth));
+	maxCell.z = FindSlice(depth + light.radius);
+	minCell.x = 0;
+	minCell.y = 0;
+	maxCell.x = GRID_X - 1;
+	maxCell.y = GRID_Y - 1;
+
+	if (depth - light.radius < g_NearDepth)
+	{
+		return(true);
+	}
+
+	glm::vec2 rectMin(0.0f);
+	glm::vec2 rectMax(0.0f);
+	for (int corner = 0; corner < 8; corner++)
+	{
+		const glm::vec3 offset(
+			((corner & 1) != 0) ? light.radius : -light.radius,
+			((corner & 2) != 0) ? light.radius : -light.radius,
+			((corner & 4) != 0) ? light.radius : -light.radius);
+		const glm::vec4 clip = projection * glm::vec4(center + offset, 1.0f);
+		const glm::vec2 screen = glm::vec2(clip) / clip.w;
+		rectMin = (corner == 0) ? screen : glm::min(rectMin, screen);
+		rectMax = (corner == 0) ? screen : glm::max(rectMax, screen);
+	}
+
+	if ((rectMax.x < -1.0f) || (rectMax.y < -1.0f) || (rectMin.x > 1.0f) || (rectMin.y > 1.0f))
+	{
+		return(false);
+	}
+
+	minCell.x = std::max(0, (int)floorf((rectMin.x * 0.5f + 0.5f) * GRID_X));
+	minCell.y = std::max(0, (int)floorf((rectMin.y * 0.5f + 0.5f) * GRID_Y));
+	maxCell.x = std::min(GRID_X - 1, (int)floorf((rectMax.x * 0.5f + 0.5f) * GRID_X));
+	maxCell.y = std::min(GRID_Y - 1, (int)floorf((rectMax.y * 0.5f + 0.5f) * GRID_Y));
+
+	return(true);
+}
+
+/***********************************************************
+ *  FindSlice()
+ *
+ *  This method is used for getting the slice of a view
+ *  depth.  The slices grow exponentially from the near to
+ *  the far plane, so the clusters stay roughly cube shaped,
+ *  and the shader finds the slice the same way.
+ ***********************************************************/
+int LightClusters::FindSlice(float depth)
+{
+	const float scale = GRID_Z / logf(g_FarDepth / g_NearDepth);
+	const int slice = (int)floorf(logf(std::max(depth, g_NearDepth) / g_NearDepth) * scale);
+
+	return(std::min(std::max(slice, 0), GRID_Z - 1));
+}
+
+/***********************************************************
+ *  CreateTables()
+ *
+ *  This method is used for creating the texture buffers.
+ *  The texture units are reserved for the tables, so the
+ *  bindings stay in place once they are made, and an
+ *  upload only replaces the contents of a buffer.
+ ***********************************************************/
+void LightClusters::CreateTables()
+{
+	glGenBuffers(TABLE_COUNT, m_buffers);
+	glGenTextures(TABLE_COUNT, m_textures);
+
+	const GLuint emptyTable[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < TABLE_COUNT; i++)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(emptyTable), emptyTable, GL_STREAM_DRAW);
+
+		glActiveTexture(GL_TEXTURE0 + g_TableUnits[i]);
+		glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, g_TableFormats[i], m_buffers[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+/***********************************************************
+ *  UploadTable()
+ *
+ *  This method is used for replacing the contents of a
+ *  table.  The buffer is given new storage each time, so
+ *  the upload never waits for draws still reading the old
+ *  lists.
+ ***********************************************************/
+void LightClusters::UploadTable(TABLE table, size_t bytes, const void* data)
+{
+	glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[table]);
+	glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
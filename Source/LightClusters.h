@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.h
+// ============
+// small point lights binned into a 3D grid of view frustum clusters
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  LightClusters
+ *
+ *  This class holds any number of point lights with a
+ *  limited range, for clustered forward shading.  The view
+ *  frustum is split into a grid of clusters, in tiles on
+ *  screen and in slices of view depth that grow with the
+ *  distance, and each light is added to the list of every
+ *  cluster its range reaches.  The fragment shader finds
+ *  the cluster of a fragment and only lights it with the
+ *  lights of that list.
+ *
+ *  The lists are rebuilt on the CPU when the camera or a
+ *  light has changed.  The cluster table, the light lists
+ *  and the light values are stored in texture buffers,
+ *  which GLSL 330 can read where storage buffers are not
+ *  available, each bound to its own reserved texture unit.
+ ***********************************************************/
+class LightClusters
+{
+public:
+	// constructor
+	LightClusters();
+	// destructor
+	~LightClusters();
+
+	// clusters of the grid across, up and in depth, must match
+	// CLUSTER_GRID_X, CLUSTER_GRID_Y and CLUSTER_GRID_Z in the
+	// fragment shader
+	static const int GRID_X = 16;
+	static const int GRID_Y = 8;
+	static const int GRID_Z = 24;
+	static const int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+	// most lights, so a light index fits in 16 bits
+	static const int MAX_LIGHTS = 65535;
+	// texture units the cluster table, the light lists and the
+	// light values are bound to
+	static const int CLUSTER_TABLE_UNIT = 11;
+	static const int LIGHT_INDEX_UNIT = 12;
+	static const int LIGHT_TABLE_UNIT = 13;
+
+	// a point light whose light fades out at its radius
+	struct POINT_LIGHT
+	{
+		glm::vec3 position;
+		float radius;
+		glm::vec3 color;
+	};
+
+	// add a light and return its index, -1 when there are
+	// already MAX_LIGHTS lights
+	int AddLight(const POINT_LIGHT& light);
+	// replace the values of a light
+	void SetLight(int index, const POINT_LIGHT& light);
+	// remove all the lights
+	void Clear();
+
+	// assign the lights to the clusters of the view and upload
+	// the lists, only when the view or a light has changed
+	void Update(const glm::mat4& view, const glm::mat4& projection);
+
+	// number of lights
+	int GetLightCount() const { return((int)m_lights.size()); }
+	// number of light references in all the cluster lists
+	int GetAssignedCount() const { return((int)m_lightIndices.size()); }
+
+private:
+	// buffers of the texture buffers
+	enum TABLE
+	{
+		TABLE_CLUSTERS = 0,
+		TABLE_LIGHT_INDICES,
+		TABLE_LIGHTS,
+		TABLE_COUNT
+	};
+
+	std::vector<POINT_LIGHT> m_lights;
+	// true when a light has changed since the last upload
+	bool m_bLightsDirty;
+	// view the lists were last built for
+	glm::mat4 m_view;
+	glm::mat4 m_projection;
+	bool m_bAssigned;
+	// first light index and light count of every cluster
+	std::vector<GLuint> m_clusterTable;
+	// light indices of all the clusters, cluster by cluster
+	std::vector<uint16_t> m_lightIndices;
+	// first and last cluster of every light on each axis, -1
+	// in x when the light cannot be seen
+	std::vector<glm::ivec3> m_lightCells;
+	GLuint m_buffers[TABLE_COUNT];
+	GLuint m_textures[TABLE_COUNT];
+
+	// find the clusters the range of a light reaches, false
+	// when it is behind the camera or beyond the far slice
+	static bool FindLightCells(
+		const POINT_LIGHT& light,
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		glm::ivec3& minCell,
+		glm::ivec3& maxCell);
+	// slice of a view depth
+	static int FindSlice(float depth);
+	// create the texture buffers on their texture units
+	void CreateTables();
+	// replace the contents of a table
+	void UploadTable(TABLE table, size_t bytes, const void* data);
+};
@@ -9,6 +9,7 @@
 
 #include <iostream>         // error handling and output
 #include <cstdlib>          // EXIT_FAILURE
+#include <cstring>          // strcmp
 
 #include <GL/glew.h>        // GLEW library
 #include "GLFW/glfw3.h"     // GLFW library
@@ -20,8 +21,10 @@
 
 #include "SceneManager.h"
 #include "ViewManager.h"
-#include "ShapeMeshes.h"
 #include "ShaderManager.h"
+#include "UniformCache.h"
+#include "UniformBuffers.h"
+#include "TransformKernel.h"
 
 // Namespace for declaring global variables
 namespace
@@ -36,14 +39,33 @@ namespace
 	SceneManager* g_SceneManager = nullptr;
 	// shader manager object for dynamic interaction with the shader code
 	ShaderManager* g_ShaderManager = nullptr;
+	// uniform locations of the linked shader program
+	UniformCache* g_UniformCache = nullptr;
+	// camera and light values shared by the shader programs
+	UniformBuffers* g_UniformBuffers = nullptr;
 	// view manager object for managing the 3D view setup and projection to 2D
 	ViewManager* g_ViewManager = nullptr;
+
+	// frames the shading benchmark skips while the shaders
+	// compile and the textures stream in, then the frames it
+	// times with each shading path
+	const int BENCHMARK_WARMUP_FRAMES = 20;
+	const int BENCHMARK_FRAMES = 100;
+	// overlapping objects and small lights of the benchmark
+	// scene, unless others are given
+	const int BENCHMARK_OBJECTS = 400;
+	const int BENCHMARK_LIGHTS = 256;
+	// timer query of the benchmark, and the GPU time spent by
+	// the forward and the deferred frames
+	GLuint g_BenchmarkQuery = 0;
+	GLuint64 g_BenchmarkTimes[2] = { 0, 0 };
 }
 
 // Function declarations - all functions that are called manually
 // need to be pre-declared at the beginning of the source code.
 bool InitializeGLFW();
 bool InitializeGLEW();
+bool RecordBenchmarkFrame(int frameCount, int objectCount, int lightCount);
 
 
 /***********************************************************
@@ -54,6 +76,128 @@ bool InitializeGLEW();
  ***********************************************************/
 int main(int argc, char* argv[])
 {
+	// check the batched transform kernel against the glm path
+	// and measure its throughput, without opening a window.  The
+	// count is not a multiple of the SIMD width, so the objects
+	// left over after the last full group are checked too
+	if ((argc > 1) && (strcmp(argv[1], "--benchmark-transforms") == 0))
+	{
+		bool bPassed = TransformKernel::RunBenchmark(100003, 50);
+		return(bPassed ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	// print the render state change counters while running
+	bool bPrintRenderStats = false;
+	// megabytes of texture memory the streamed levels may use,
+	// 0 keeps the default budget
+	int textureBudget = 0;
+	// false keeps the scene on the CPU culled batches even when
+	// the driver can cull and draw it on the GPU
+	bool bGPUCulling = true;
+	// false culls the objects by the view frustum only
+	bool bOcclusionCulling = true;
+	// true draws the occluded objects as wireframes on top
+	bool bShowOccluded = false;
+	// false uploads the mesh vertices as floats
+	bool bVertexCompression = true;
+	// false draws everything with the general shader
+	bool bShaderPermutations = true;
+	// small point lights scattered over the desk
+	int scatteredLights = 0;
+	// true lights the scene in a pass over a G-buffer
+	bool bDeferredShading = false;
+	// overlapping objects scattered over the desk
+	int scatteredObjects = 0;
+	// true draws the depth of the scene before shading it
+	bool bDepthPrepass = false;
+	// true times the forward and the deferred shading on
+	// alternate frames, then exits
+	bool bBenchmarkShading = false;
+	// true when a frame of the benchmark meant to be deferred
+	// was shaded forward
+	bool bBenchmarkFailed = false;
+	// false lights the scene without shadows
+	bool bShadows = true;
+	// false draws every caster into the shadow maps each frame
+	bool bShadowCache = true;
+	// true moves the coffee cup around the desk every frame
+	bool bMoveCup = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--render-stats") == 0)
+		{
+			bPrintRenderStats = true;
+		}
+		else if ((strcmp(argv[i], "--texture-budget") == 0) && (i + 1 < argc))
+		{
+			textureBudget = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--no-gpu-culling") == 0)
+		{
+			bGPUCulling = false;
+		}
+		else if (strcmp(argv[i], "--no-occlusion-culling") == 0)
+		{
+			bOcclusionCulling = false;
+		}
+		else if (strcmp(argv[i], "--show-occluded") == 0)
+		{
+			bShowOccluded = true;
+		}
+		else if (strcmp(argv[i], "--no-vertex-compression") == 0)
+		{
+			bVertexCompression = false;
+		}
+		else if (strcmp(argv[i], "--no-shader-permutations") == 0)
+		{
+			bShaderPermutations = false;
+		}
+		else if ((strcmp(argv[i], "--scatter-lights") == 0) && (i + 1 < argc))
+		{
+			scatteredLights = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--deferred-shading") == 0)
+		{
+			bDeferredShading = true;
+		}
+		else if ((strcmp(argv[i], "--scatter-objects") == 0) && (i + 1 < argc))
+		{
+			scatteredObjects = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--depth-prepass") == 0)
+		{
+			bDepthPrepass = true;
+		}
+		else if (strcmp(argv[i], "--benchmark-shading") == 0)
+		{
+			bBenchmarkShading = true;
+		}
+		else if (strcmp(argv[i], "--no-shadows") == 0)
+		{
+			bShadows = false;
+		}
+		else if (strcmp(argv[i], "--no-shadow-cache") == 0)
+		{
+			bShadowCache = false;
+		}
+		else if (strcmp(argv[i], "--move-cup") == 0)
+		{
+			bMoveCup = true;
+		}
+	}
+	if (bBenchmarkShading == true)
+	{
+		// the deferred frames are drawn with the permutations of
+		// the geometry and lighting passes
+		if (bShaderPermutations == false)
+		{
+			std::cout << "ERROR: --benchmark-shading cannot be used with --no-shader-permutations" << std::endl;
+			return(EXIT_FAILURE);
+		}
+		scatteredObjects = (scatteredObjects > 0) ? scatteredObjects : BENCHMARK_OBJECTS;
+		scatteredLights = (scatteredLights > 0) ? scatteredLights : BENCHMARK_LIGHTS;
+	}
+
 	// if GLFW fails initialization, then terminate the application
 	if (InitializeGLFW() == false)
 	{
@@ -62,9 +206,14 @@ int main(int argc, char* argv[])
 
 	// try to create a new shader manager object
 	g_ShaderManager = new ShaderManager();
+	// the uniform locations are read once the shaders are linked
+	g_UniformCache = new UniformCache();
+	// the uniform buffers are created once GLEW is initialized
+	g_UniformBuffers = new UniformBuffers();
 	// try to create a new view manager object
 	g_ViewManager = new ViewManager(
-		g_ShaderManager);
+		g_ShaderManager,
+		g_UniformBuffers);
 
 	// try to create the main display window
 	g_Window = g_ViewManager->CreateDisplayWindow(WINDOW_TITLE);
@@ -80,13 +229,34 @@ int main(int argc, char* argv[])
 		"shaders/vertexShader.glsl",
 		"shaders/fragmentShader.glsl");
 	g_ShaderManager->use();
+	g_UniformCache->LoadProgram();
+	g_UniformBuffers->Create();
+	g_UniformBuffers->BindProgram(g_UniformCache->GetProgram());
 
 	// try to create a new scene manager object and prepare the 3D scene
-	g_SceneManager = new SceneManager(g_ShaderManager);
+	g_SceneManager = new SceneManager(g_ShaderManager, g_UniformCache, g_UniformBuffers);
+	if (textureBudget > 0)
+	{
+		g_SceneManager->SetTextureBudget((size_t)textureBudget * 1024 * 1024);
+	}
+	g_SceneManager->SetGPUCulling(bGPUCulling);
+	g_SceneManager->SetOcclusionCulling(bOcclusionCulling);
+	g_SceneManager->SetShowOccluded(bShowOccluded);
+	g_SceneManager->SetVertexCompression(bVertexCompression);
+	g_SceneManager->SetShaderPermutations(bShaderPermutations);
+	g_SceneManager->SetScatteredLightCount(scatteredLights);
+	g_SceneManager->SetScatteredObjectCount(scatteredObjects);
+	g_SceneManager->SetDeferredShading(bDeferredShading);
+	g_SceneManager->SetDepthPrepass(bDepthPrepass);
+	g_SceneManager->SetMeasureOverdraw(bPrintRenderStats);
+	g_SceneManager->SetShadows(bShadows);
+	g_SceneManager->SetShadowCache(bShadowCache);
+	g_SceneManager->SetMoveCup(bMoveCup);
 	g_SceneManager->PrepareScene();
 
 	// loop will keep running until the application is closed 
 	// or until an error has occurred
+	int frameCount = 0;
 	while (!glfwWindowShouldClose(g_Window))
 	{
 		// Enable z-depth
@@ -99,8 +269,71 @@ int main(int argc, char* argv[])
 		// convert from 3D object space to 2D view
 		g_ViewManager->PrepareSceneView();
 
-		// refresh the 3D scene
-		g_SceneManager->RenderScene();
+		// refresh the 3D scene, with the draws ordered from the
+		// current camera position
+		g_SceneManager->SetViewPosition(g_ViewManager->GetViewPosition());
+		g_SceneManager->SetViewScale(g_ViewManager->GetViewScale(), g_ViewManager->IsPerspective());
+		g_SceneManager->SetViewProjection(g_ViewManager->GetViewProjection());
+		if (bBenchmarkShading == true)
+		{
+			// the odd frames are shaded deferred
+			if (g_BenchmarkQuery == 0)
+			{
+				glGenQueries(1, &g_BenchmarkQuery);
+			}
+			g_SceneManager->SetDeferredShading((frameCount % 2) != 0);
+			glBeginQuery(GL_TIME_ELAPSED, g_BenchmarkQuery);
+			g_SceneManager->RenderScene();
+			glEndQuery(GL_TIME_ELAPSED);
+			// the scene falls back to forward shading when the
+			// deferred passes cannot be used, which would time
+			// the forward path twice
+			if (((frameCount % 2) != 0) && (g_SceneManager->IsDeferredFrame() == false))
+			{
+				std::cout << "ERROR: the deferred shading could not be used, the shading benchmark is stopped" << std::endl;
+				bBenchmarkFailed = true;
+				glfwSetWindowShouldClose(g_Window, GLFW_TRUE);
+			}
+			else if (RecordBenchmarkFrame(frameCount, scatteredObjects, scatteredLights) == true)
+			{
+				glfwSetWindowShouldClose(g_Window, GLFW_TRUE);
+			}
+		}
+		else
+		{
+			g_SceneManager->RenderScene();
+		}
+
+		// report how many binds the sorted render queue avoided
+		if ((bPrintRenderStats == true) && ((frameCount % 120) == 0))
+		{
+			const RenderQueue::STATS& stats = g_SceneManager->GetRenderStats();
+			std::cout << "INFO: draws:" << stats.draws
+				<< ", state changes unsorted:" << stats.unsortedStateChanges
+				<< ", sorted:" << stats.sortedStateChanges
+				<< ", binds skipped:" << stats.bindsSkipped
+				<< ", uniform buffer bytes:" << g_UniformBuffers->GetUploadedBytes()
+				<< ", texture bytes:" << g_SceneManager->GetTextureBytes()
+				<< ", visible:" << g_SceneManager->GetVisibleObjectCount()
+				<< ", culled:" << g_SceneManager->GetCulledObjectCount()
+				<< ", occluded:" << g_SceneManager->GetOccludedObjectCount()
+				<< " (" << (int)(g_SceneManager->GetOccludedScreenArea() * 100.0f + 0.5f) << "% of the screen not shaded)"
+				<< ", objects per level:" << g_SceneManager->GetLODObjectCount(0)
+				<< "/" << g_SceneManager->GetLODObjectCount(1)
+				<< "/" << g_SceneManager->GetLODObjectCount(2)
+				<< "/" << g_SceneManager->GetLODObjectCount(3)
+				<< ", indirect objects:" << g_SceneManager->GetIndirectObjectCount()
+				<< ", shader permutations:" << g_SceneManager->GetShaderPermutationCount()
+				<< ", clustered lights:" << g_SceneManager->GetClusteredLightCount()
+				<< " (" << g_SceneManager->GetAssignedLightCount() << " cluster entries)"
+				<< ", G-buffer bytes:" << g_SceneManager->GetGBufferBytes()
+				<< ", shaded fragments per covered pixel:" << g_SceneManager->GetOverdraw()
+				<< ", shadow map bytes:" << g_SceneManager->GetShadowMapBytes()
+				<< ", shadow layers drawn static/dynamic:" << g_SceneManager->GetStaticShadowLayerDraws()
+				<< "/" << g_SceneManager->GetDynamicShadowLayerDraws() << std::endl;
+		}
+		g_UniformBuffers->ResetUploadedBytes();
+		frameCount++;
 
 
 		// Flips the the back buffer with the front buffer every frame.
@@ -111,6 +344,11 @@ int main(int argc, char* argv[])
 	}
 
 	// clear the allocated manager objects from memory
+	if (0 != g_BenchmarkQuery)
+	{
+		glDeleteQueries(1, &g_BenchmarkQuery);
+		g_BenchmarkQuery = 0;
+	}
 	if (NULL != g_SceneManager)
 	{
 		delete g_SceneManager;
@@ -121,14 +359,25 @@ int main(int argc, char* argv[])
 		delete g_ViewManager;
 		g_ViewManager = NULL;
 	}
+	if (NULL != g_UniformBuffers)
+	{
+		delete g_UniformBuffers;
+		g_UniformBuffers = NULL;
+	}
+	if (NULL != g_UniformCache)
+	{
+		delete g_UniformCache;
+		g_UniformCache = NULL;
+	}
 	if (NULL != g_ShaderManager)
 	{
 		delete g_ShaderManager;
 		g_ShaderManager = NULL;
 	}
 
-	// Terminates the program successfully
-	exit(EXIT_SUCCESS); 
+	// Terminates the program, successfully unless the shading
+	// benchmark could not compare the two paths
+	exit(bBenchmarkFailed ? EXIT_FAILURE : EXIT_SUCCESS); 
 }
 
 /***********************************************************
@@ -183,4 +432,36 @@ bool InitializeGLEW()
 	std::cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << "\n" << std::endl;
 
 	return(true);
-}
\ No newline at end of file
+}
+
+/***********************************************************
+ *	RecordBenchmarkFrame()
+ *
+ *  This function is used for adding the GPU time of a frame
+ *  of the shading benchmark to its shading path, waiting
+ *  for the timer query so each frame is timed on its own.
+ *  The averages are printed after the last frame, and true
+ *  is returned then.
+ ***********************************************************/
+bool RecordBenchmarkFrame(int frameCount, int objectCount, int lightCount)
+{
+	const int lastFrame = BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES * 2 - 1;
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v(g_BenchmarkQuery, GL_QUERY_RESULT, &nanoseconds);
+	if ((frameCount < BENCHMARK_WARMUP_FRAMES) || (frameCount > lastFrame))
+	{
+		return(false);
+	}
+	g_BenchmarkTimes[frameCount % 2] += nanoseconds;
+
+	if (frameCount < lastFrame)
+	{
+		return(false);
+	}
+
+	std::cout << "INFO: shading benchmark, " << objectCount << " objects and " << lightCount << " small lights"
+		<< ", forward:" << g_BenchmarkTimes[0] / (BENCHMARK_FRAMES * 1.0e6) << " ms"
+		<< ", deferred:" << g_BenchmarkTimes[1] / (BENCHMARK_FRAMES * 1.0e6) << " ms of GPU time per frame"
+		<< std::endl;
+	return(true);
+}
@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+// mappedfile.cpp
+// ============
+// read-only memory mapping of a whole file
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/***********************************************************
+ *  MappedFile()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+MappedFile::MappedFile()
+{
+	m_pData = NULL;
+	m_size = 0;
+#ifdef _WIN32
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+#else
+	m_file = -1;
+#endif
+}
+
+/***********************************************************
+ *  ~MappedFile()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+/***********************************************************
+ *  Open()
+ *
+ *  This method is used for mapping a whole file read-only.
+ *  An empty file is treated as a failure, since it can not
+ *  be mapped.
+ ***********************************************************/
+bool MappedFile::Open(const char* filename)
+{
+	Close();
+
+#ifdef _WIN32
+	m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		return(false);
+	}
+
+	LARGE_INTEGER fileSize;
+	if ((GetFileSizeEx(m_file, &fileSize) == FALSE) || (fileSize.QuadPart == 0))
+	{
+		Close();
+		return(false);
+	}
+
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping == NULL)
+	{
+		Close();
+		return(false);
+	}
+
+	m_pData = (const unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	m_size = (size_t)fileSize.QuadPart;
+#else
+	m_file = open(filename, O_RDONLY);
+	if (m_file < 0)
+	{
+		return(false);
+	}
+
+	struct stat fileStatus;
+	if ((fstat(m_file, &fileStatus) != 0) || (fileStatus.st_size == 0))
+	{
+		Close();
+		return(false);
+	}
+
+	void* pData = mmap(NULL, (size_t)fileStatus.st_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+	m_pData = (pData == MAP_FAILED) ? NULL : (const unsigned char*)pData;
+	m_size = (size_t)fileStatus.st_size;
+#endif
+
+	if (m_pData == NULL)
+	{
+		Close();
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  Close()
+ *
+ *  This method is used for releasing the mapping and the
+ *  file.
+ ***********************************************************/
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (m_pData != NULL)
+	{
+		UnmapViewOfFile(m_pData);
+	}
+	if (m_mapping != NULL)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = NULL;
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_pData != NULL)
+	{
+		munmap((void*)m_pData, m_size);
+	}
+	if (m_file >= 0)
+	{
+		close(m_file);
+		m_file = -1;
+	}
+#endif
+
+	m_pData = NULL;
+	m_size = 0;
+}
@@ -0,0 +1,50 @@
+///////////////////////////////////////////////////////////////////////////////
+// mappedfile.h
+// ============
+// read-only memory mapping of a whole file
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+
+/***********************************************************
+ *  MappedFile
+ *
+ *  This class maps a file into memory for reading, so its
+ *  contents can be copied straight from the page cache
+ *  without a read into a separate buffer.  The mapping is
+ *  released when the object is closed or destroyed.
+ ***********************************************************/
+class MappedFile
+{
+public:
+	// constructor
+	MappedFile();
+	// destructor
+	~MappedFile();
+
+	// map the whole file, false when it cannot be opened
+	bool Open(const char* filename);
+	// release the mapping
+	void Close();
+
+	// start and size of the mapped contents
+	const unsigned char* GetData() const { return(m_pData); }
+	size_t GetSize() const { return(m_size); }
+
+private:
+	const unsigned char* m_pData;
+	size_t m_size;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#else
+	int m_file;
+#endif
+
+	// a mapping can not be copied
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
@@ -0,0 +1,191 @@
+///////////////////////////////////////////////////////////////////////////////
+// materialregistry.cpp
+// ============
+// material definitions addressed by integer handles, stored on the GPU
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MaterialRegistry.h"
+
+// declaration of the global variables and defines
+namespace
+{
+	// room for materials allocated with the first upload
+	const int g_InitialCapacity = 64;
+}
+
+/***********************************************************
+ *  MaterialRegistry()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+MaterialRegistry::MaterialRegistry()
+{
+	m_buffer = 0;
+	m_texture = 0;
+	m_capacity = 0;
+	m_dirtyFirst = 0;
+	m_dirtyEnd = 0;
+}
+
+/***********************************************************
+ *  ~MaterialRegistry()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+MaterialRegistry::~MaterialRegistry()
+{
+	if (m_texture != 0)
+	{
+		glDeleteTextures(1, &m_texture);
+		m_texture = 0;
+	}
+	if (m_buffer != 0)
+	{
+		glDeleteBuffers(1, &m_buffer);
+		m_buffer = 0;
+	}
+}
+
+/***********************************************************
+ *  Define()
+ *
+ *  This method is used for adding a material under a tag
+ *  and returning its handle.  Defining a tag again keeps
+ *  its handle and only replaces the values, so the objects
+ *  that already use it pick up the change.
+ ***********************************************************/
+int MaterialRegistry::Define(const std::string& tag, const MATERIAL& material)
+{
+	int handle = Find(tag);
+
+	if (handle == INVALID_HANDLE)
+	{
+		handle = (int)m_materials.size();
+		m_materials.push_back(material);
+		m_handles[tag] = handle;
+	}
+	else
+	{
+		m_materials[handle] = material;
+	}
+
+	if (m_dirtyFirst >= m_dirtyEnd)
+	{
+		m_dirtyFirst = handle;
+		m_dirtyEnd = handle + 1;
+	}
+	else
+	{
+		m_dirtyFirst = (handle < m_dirtyFirst) ? handle : m_dirtyFirst;
+		m_dirtyEnd = (handle + 1 > m_dirtyEnd) ? handle + 1 : m_dirtyEnd;
+	}
+
+	return(handle);
+}
+
+/***********************************************************
+ *  Find()
+ *
+ *  This method is used for getting the handle of a defined
+ *  tag.  It is meant for compiling the scene, not for the
+ *  draws.
+ ***********************************************************/
+int MaterialRegistry::Find(const std::string& tag) const
+{
+	std::unordered_map<std::string, int>::const_iterator found = m_handles.find(tag);
+
+	if (found == m_handles.end())
+	{
+		return(INVALID_HANDLE);
+	}
+
+	return(found->second);
+}
+
+/***********************************************************
+ *  Get()
+ *
+ *  This method is used for getting the values of a material
+ *  by handle.
+ ***********************************************************/
+bool MaterialRegistry::Get(int handle, MATERIAL& material) const
+{
+	if ((handle < 0) || (handle >= (int)m_materials.size()))
+	{
+		return(false);
+	}
+
+	material = m_materials[handle];
+
+	return(true);
+}
+
+/***********************************************************
+ *  Upload()
+ *
+ *  This method is used for copying the changed materials
+ *  into the texture buffer.  Each material is two texels,
+ *  the diffuse color with the shininess, then the specular
+ *  color.  The buffer doubles in size when it is full, and
+ *  is otherwise only written over the changed range, so
+ *  calling this every frame costs nothing when no material
+ *  has changed.
+ ***********************************************************/
+void MaterialRegistry::Upload()
+{
+	const int materialCount = (int)m_materials.size();
+	const GLsizeiptr materialSize = sizeof(glm::vec4) * TEXELS_PER_MATERIAL;
+
+	if ((m_texture != 0) && (m_dirtyFirst >= m_dirtyEnd) && (materialCount <= m_capacity))
+	{
+		return;
+	}
+
+	if (m_texture == 0)
+	{
+		glGenBuffers(1, &m_buffer);
+		glGenTextures(1, &m_texture);
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+
+	if ((m_capacity == 0) || (materialCount > m_capacity))
+	{
+		m_capacity = (m_capacity == 0) ? g_InitialCapacity : m_capacity;
+		while (m_capacity < materialCount)
+		{
+			m_capacity *= 2;
+		}
+
+		glBufferData(GL_TEXTURE_BUFFER, materialSize * m_capacity, NULL, GL_STATIC_DRAW);
+		m_dirtyFirst = 0;
+		m_dirtyEnd = materialCount;
+
+		// the texture unit is reserved for the material table,
+		// so the binding stays in place once it is made
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_buffer);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	if (m_dirtyFirst < m_dirtyEnd)
+	{
+		std::vector<glm::vec4> texels;
+		texels.reserve((m_dirtyEnd - m_dirtyFirst) * TEXELS_PER_MATERIAL);
+
+		for (int i = m_dirtyFirst; i < m_dirtyEnd; i++)
+		{
+			texels.push_back(glm::vec4(m_materials[i].diffuseColor, m_materials[i].shininess));
+			texels.push_back(glm::vec4(m_materials[i].specularColor, 0.0f));
+		}
+
+		glBufferSubData(GL_TEXTURE_BUFFER, materialSize * m_dirtyFirst,
+			sizeof(glm::vec4) * texels.size(), texels.data());
+		m_dirtyFirst = 0;
+		m_dirtyEnd = 0;
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////
+// materialregistry.h
+// ============
+// material definitions addressed by integer handles, stored on the GPU
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/***********************************************************
+ *  MaterialRegistry
+ *
+ *  This class hands out a compact integer handle for every
+ *  material when it is defined.  The tags are only looked
+ *  up while the scene is compiled, the draws carry the
+ *  handle.  All of the material values live in one texture
+ *  buffer, so the shader fetches a material by handle and
+ *  no material is uploaded per draw.  A texture buffer is
+ *  used, since it holds thousands of materials and is read
+ *  by GLSL 330, where storage buffers are not available.
+ ***********************************************************/
+class MaterialRegistry
+{
+public:
+	// constructor
+	MaterialRegistry();
+	// destructor
+	~MaterialRegistry();
+
+	// handle of a tag that was never defined
+	static const int INVALID_HANDLE = -1;
+	// texture unit the material table is bound to
+	static const int TEXTURE_UNIT = 15;
+	// number of RGBA32F texels in one material
+	static const int TEXELS_PER_MATERIAL = 2;
+
+	// values of a material
+	struct MATERIAL
+	{
+		glm::vec3 diffuseColor;
+		glm::vec3 specularColor;
+		float shininess;
+	};
+
+	// define a material, or replace the values of a tag that
+	// was already defined, and return its handle
+	int Define(const std::string& tag, const MATERIAL& material);
+	// get the handle of a tag, INVALID_HANDLE when not defined
+	int Find(const std::string& tag) const;
+	// get the values of a material, false for a bad handle
+	bool Get(int handle, MATERIAL& material) const;
+
+	// upload the materials defined or changed since the last
+	// upload, the table is bound to TEXTURE_UNIT
+	void Upload();
+
+	// number of defined materials
+	int GetMaterialCount() const { return((int)m_materials.size()); }
+
+private:
+	// values of every material, by handle
+	std::vector<MATERIAL> m_materials;
+	// handle of every tag
+	std::unordered_map<std::string, int> m_handles;
+	GLuint m_buffer;
+	GLuint m_texture;
+	// number of materials the buffer has room for
+	int m_capacity;
+	// range of handles that changed since the last upload
+	int m_dirtyFirst;
+	int m_dirtyEnd;
+};
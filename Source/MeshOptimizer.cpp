@@ -0,0 +1,347 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshoptimizer.cpp
+// ============
+// vertex cache and fetch ordering of indexed meshes, and vertex quantization
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// declaration of the global variables and defines
+namespace
+{
+	// entries of the LRU cache modelled while ordering
+	const int g_ModelCacheSize = 32;
+	// score of a vertex in the cache by position, the three
+	// vertices of the last triangle all get the same score
+	const float g_LastTriangleScore = 0.75f;
+	const float g_CacheDecayPower = 1.5f;
+	// bonus for vertices with few triangles left, so that
+	// lone triangles are not left behind
+	const float g_ValenceBoostScale = 2.0f;
+	const float g_ValenceBoostPower = -0.5f;
+
+	/***********************************************************
+	 *  ScoreVertex()
+	 *
+	 *  This function is used for scoring a vertex from its
+	 *  position in the modelled cache, -1 when it is not in
+	 *  the cache, and the number of its triangles still to be
+	 *  drawn.
+	 ***********************************************************/
+	float ScoreVertex(int cachePosition, int remainingTriangles)
+	{
+		if (remainingTriangles == 0)
+		{
+			return(-1.0f);
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				score = g_LastTriangleScore;
+			}
+			else
+			{
+				const float scale = 1.0f / (g_ModelCacheSize - 3);
+				score = powf(1.0f - (cachePosition - 3) * scale, g_CacheDecayPower);
+			}
+		}
+
+		return(score + g_ValenceBoostScale * powf((float)remainingTriangles, g_ValenceBoostPower));
+	}
+}
+
+/***********************************************************
+ *  OptimizeVertexCache()
+ *
+ *  This method is used for reordering the triangles so that
+ *  each one reuses as many vertices of the ones before it
+ *  as possible.  Every vertex is scored from its place in a
+ *  modelled LRU cache and from how many of its triangles are
+ *  left, and the next triangle is the best scored one that
+ *  touches the cache.  When none does, the best remaining
+ *  triangle of the whole mesh is taken.
+ ***********************************************************/
+void MeshOptimizer::OptimizeVertexCache(std::vector<GLuint>& indices, int vertexCount)
+{
+	const int triangleCount = (int)indices.size() / 3;
+	if ((triangleCount < 2) || (vertexCount <= 0))
+	{
+		return;
+	}
+
+	// the triangles of each vertex, as ranges of one array
+	std::vector<int> triangleStarts(vertexCount + 1, 0);
+	std::vector<int> remaining(vertexCount, 0);
+	for (int i = 0; i < triangleCount * 3; i++)
+	{
+		remaining[indices[i]]++;
+	}
+	for (int v = 0; v < vertexCount; v++)
+	{
+		triangleStarts[v + 1] = triangleStarts[v] + remaining[v];
+	}
+	std::vector<int> vertexTriangles(triangleStarts[vertexCount]);
+	std::vector<int> fill(triangleStarts.begin(), triangleStarts.end() - 1);
+	for (int t = 0; t < triangleCount; t++)
+	{
+		for (int corner = 0; corner < 3; corner++)
+		{
+			const GLuint v = indices[t * 3 + corner];
+			vertexTriangles[fill[v]++] = t;
+		}
+	}
+
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (int v = 0; v < vertexCount; v++)
+	{
+		vertexScores[v] = ScoreVertex(-1, remaining[v]);
+	}
+	std::vector<float> triangleScores(triangleCount);
+	for (int t = 0; t < triangleCount; t++)
+	{
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] +
+			vertexScores[indices[t * 3 + 2]];
+	}
+
+	std::vector<uint8_t> added(triangleCount, 0);
+	std::vector<GLuint> ordered;
+	ordered.reserve(indices.size());
+	std::vector<int> cache;
+	std::vector<int> nextCache;
+	cache.reserve(g_ModelCacheSize + 3);
+	nextCache.reserve(g_ModelCacheSize + 3);
+
+	int bestTriangle = 0;
+	int nextUnadded = 0;
+	for (int i = 0; i < triangleCount; i++)
+	{
+		// nothing in the cache was usable, so search the mesh
+		if (bestTriangle < 0)
+		{
+			float bestScore = -1.0f;
+			for (int t = nextUnadded; t < triangleCount; t++)
+			{
+				if ((added[t] == 0) && (triangleScores[t] > bestScore))
+				{
+					bestScore = triangleScores[t];
+					bestTriangle = t;
+				}
+			}
+		}
+
+		// draw the triangle and take it out of its vertices
+		added[bestTriangle] = 1;
+		while ((nextUnadded < triangleCount) && (added[nextUnadded] != 0))
+		{
+			nextUnadded++;
+		}
+		nextCache.clear();
+		for (int corner = 0; corner < 3; corner++)
+		{
+			const int v = (int)indices[bestTriangle * 3 + corner];
+			ordered.push_back((GLuint)v);
+			nextCache.push_back(v);
+
+			int* first = &vertexTriangles[triangleStarts[v]];
+			int* last = first + remaining[v];
+			*std::find(first, last, bestTriangle) = *(last - 1);
+			remaining[v]--;
+		}
+
+		// the vertices of the triangle move to the front of the
+		// cache, and the ones pushed past its end drop out
+		for (size_t c = 0; c < cache.size(); c++)
+		{
+			const int v = cache[c];
+			if ((v != nextCache[0]) && (v != nextCache[1]) && (v != nextCache[2]))
+			{
+				nextCache.push_back(v);
+			}
+		}
+		for (size_t c = 0; c < nextCache.size(); c++)
+		{
+			const int v = nextCache[c];
+			cachePositions[v] = (c < (size_t)g_ModelCacheSize) ? (int)c : -1;
+			vertexScores[v] = ScoreVertex(cachePositions[v], remaining[v]);
+		}
+
+		// only the triangles of the vertices that moved in the
+		// cache have changed score, and the best of them is
+		// drawn next
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (size_t c = 0; c < nextCache.size(); c++)
+		{
+			const int v = nextCache[c];
+			for (int k = triangleStarts[v]; k < triangleStarts[v] + remaining[v]; k++)
+			{
+				const int t = vertexTriangles[k];
+				triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] +
+					vertexScores[indices[t * 3 + 2]];
+				if (triangleScores[t] > bestScore)
+				{
+					bestScore = triangleScores[t];
+					bestTriangle = t;
+				}
+			}
+		}
+
+		if (nextCache.size() > (size_t)g_ModelCacheSize)
+		{
+			nextCache.resize(g_ModelCacheSize);
+		}
+		std::swap(cache, nextCache);
+	}
+
+	// a partial triangle at the end is kept as it was
+	ordered.insert(ordered.end(), indices.begin() + triangleCount * 3, indices.end());
+	indices.swap(ordered);
+}
+
+/***********************************************************
+ *  OptimizeVertexFetch()
+ *
+ *  This method is used for moving the vertices into the
+ *  order the triangles first use them, so that the vertex
+ *  fetch reads the buffer mostly forward.  Vertices that no
+ *  triangle uses are kept after the used ones.
+ ***********************************************************/
+void MeshOptimizer::OptimizeVertexFetch(std::vector<float>& vertices, int floatsPerVertex, std::vector<GLuint>& indices)
+{
+	const int vertexCount = (int)(vertices.size() / floatsPerVertex);
+	std::vector<int> remap(vertexCount, -1);
+	int nextVertex = 0;
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		if (remap[indices[i]] < 0)
+		{
+			remap[indices[i]] = nextVertex++;
+		}
+		indices[i] = (GLuint)remap[indices[i]];
+	}
+	for (int v = 0; v < vertexCount; v++)
+	{
+		if (remap[v] < 0)
+		{
+			remap[v] = nextVertex++;
+		}
+	}
+
+	std::vector<float> ordered(vertices.size());
+	for (int v = 0; v < vertexCount; v++)
+	{
+		memcpy(&ordered[(size_t)remap[v] * floatsPerVertex], &vertices[(size_t)v * floatsPerVertex],
+			sizeof(float) * floatsPerVertex);
+	}
+	vertices.swap(ordered);
+}
+
+/***********************************************************
+ *  CountCacheMisses()
+ *
+ *  This method is used for counting the vertices a FIFO
+ *  post-transform cache has to transform for the triangles
+ *  of an index buffer.  Divided by the number of triangles
+ *  it gives the average cache miss ratio, or ACMR, which is
+ *  3 without any reuse and about 0.5 for a regular grid.
+ ***********************************************************/
+int MeshOptimizer::CountCacheMisses(const std::vector<GLuint>& indices, int vertexCount, int cacheSize)
+{
+	// a vertex is in the cache while fewer than cacheSize
+	// misses have happened since it was last missed
+	std::vector<int> missTimes(vertexCount, -cacheSize - 1);
+	int misses = 0;
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		if (misses - missTimes[indices[i]] > cacheSize)
+		{
+			missTimes[indices[i]] = misses;
+			misses++;
+		}
+	}
+
+	return(misses);
+}
+
+/***********************************************************
+ *  PackHalf()
+ *
+ *  This method is used for converting a float into a half
+ *  float, rounding the mantissa to the nearest value.  The
+ *  values too small for a normal half become zero, and the
+ *  values too large become infinity.
+ ***********************************************************/
+uint16_t MeshOptimizer::PackHalf(float value)
+{
+	uint32_t bits = 0;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const uint32_t sign = (bits >> 16) & 0x8000u;
+	const int exponent = (int)((bits >> 23) & 0xFFu) - 127 + 15;
+	const uint32_t mantissa = bits & 0x7FFFFFu;
+
+	if (exponent <= 0)
+	{
+		return((uint16_t)sign);
+	}
+	if (exponent >= 31)
+	{
+		return((uint16_t)(sign | 0x7C00u));
+	}
+
+	// a carry out of the mantissa moves into the exponent
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	if ((mantissa & 0x1000u) != 0)
+	{
+		half++;
+	}
+	return((uint16_t)half);
+}
+
+/***********************************************************
+ *  PackNormal()
+ *
+ *  This method is used for packing a unit vector into the
+ *  GL_INT_2_10_10_10_REV layout, read back as a normalized
+ *  signed vector.  The fragment shader normalizes the
+ *  interpolated normal, so the rounding of the length does
+ *  not show.
+ ***********************************************************/
+uint32_t MeshOptimizer::PackNormal(const glm::vec3& normal)
+{
+	const float components[3] = { normal.x, normal.y, normal.z };
+	uint32_t packed = 0;
+
+	for (int i = 0; i < 3; i++)
+	{
+		const float clamped = std::min(std::max(components[i], -1.0f), 1.0f);
+		const int value = (int)floorf(clamped * 511.0f + 0.5f);
+		packed |= ((uint32_t)value & 0x3FFu) << (10 * i);
+	}
+
+	return(packed);
+}
+
+/***********************************************************
+ *  PackUnorm16()
+ *
+ *  This method is used for packing a value from 0 to 1 into
+ *  an unsigned normalized 16-bit integer.
+ ***********************************************************/
+uint16_t MeshOptimizer::PackUnorm16(float value)
+{
+	const float clamped = std::min(std::max(value, 0.0f), 1.0f);
+
+	return((uint16_t)floorf(clamped * 65535.0f + 0.5f));
+}
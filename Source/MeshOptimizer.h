@@ -0,0 +1,53 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshoptimizer.h
+// ============
+// vertex cache and fetch ordering of indexed meshes, and vertex quantization
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  MeshOptimizer
+ *
+ *  This class holds the optimization steps applied to the
+ *  generated meshes before they are added to the shared
+ *  buffers.  The triangles are reordered so the vertices
+ *  they share are still in the post-transform cache of the
+ *  GPU, after Tom Forsyth's linear-speed vertex cache
+ *  optimization, and the vertices are then renumbered in
+ *  the order the triangles first use them, so the vertex
+ *  fetch walks the buffer forward.
+ *
+ *  The packing functions quantize the vertex attributes
+ *  into the compressed layout uploaded by the mesh store.
+ ***********************************************************/
+class MeshOptimizer
+{
+public:
+	// entries of the FIFO cache that the ACMR is measured with
+	static const int FIFO_CACHE_SIZE = 16;
+
+	// reorder the triangles of a mesh for the post-transform
+	// vertex cache
+	static void OptimizeVertexCache(std::vector<GLuint>& indices, int vertexCount);
+	// renumber the vertices in the order the indices first use
+	// them, moving the interleaved vertices to match
+	static void OptimizeVertexFetch(std::vector<float>& vertices, int floatsPerVertex, std::vector<GLuint>& indices);
+	// number of vertices transformed by a FIFO cache of the
+	// passed in size, for the triangles of an index buffer
+	static int CountCacheMisses(const std::vector<GLuint>& indices, int vertexCount, int cacheSize);
+
+	// float as a 16-bit half float
+	static uint16_t PackHalf(float value);
+	// unit vector as signed normalized 10:10:10:2, with w 0
+	static uint32_t PackNormal(const glm::vec3& normal);
+	// value from 0 to 1 as unsigned normalized 16 bits
+	static uint16_t PackUnorm16(float value);
+};
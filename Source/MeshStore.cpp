@@ -0,0 +1,367 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshstore.cpp
+// ============
+// shared vertex and index buffers for all the basic meshes, with a binary cache
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MeshStore.h"
+#include "MeshOptimizer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// declaration of the global variables and defines
+namespace
+{
+	// vertex attribute locations used by the vertex shader
+	const GLuint g_PositionLocation = 0;
+	const GLuint g_NormalLocation = 1;
+	const GLuint g_TextureCoordinateLocation = 2;
+
+	// "MSH1" at the start of every cache file
+	const uint32_t g_CacheMagic = 0x3148534Du;
+	// bumped whenever the file layout or a mesh generator changes
+	const uint32_t g_CacheVersion = 2;
+	// directory the cache file is written to
+	const char* g_CacheDirectory = "cache";
+}
+
+/***********************************************************
+ *  MeshStore()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+MeshStore::MeshStore()
+{
+	m_vao = 0;
+	m_vbos[0] = 0;
+	m_vbos[1] = 0;
+	m_bCompressed = true;
+	m_bUploadedCompressed = false;
+}
+
+/***********************************************************
+ *  ~MeshStore()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+MeshStore::~MeshStore()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  OpenCache()
+ *
+ *  This method is used for mapping a cache file and checking
+ *  that it was written by this version, and that the table
+ *  of meshes and the data it points to fit in the file.
+ ***********************************************************/
+bool MeshStore::OpenCache(const char* filename)
+{
+	if (m_cache.Open(filename) == false)
+	{
+		return(false);
+	}
+
+	const CACHE_HEADER* header = (const CACHE_HEADER*)m_cache.GetData();
+	if ((m_cache.GetSize() < sizeof(CACHE_HEADER)) ||
+		(header->magic != g_CacheMagic) ||
+		(header->version != g_CacheVersion) ||
+		(header->floatsPerVertex != FLOATS_PER_VERTEX) ||
+		(m_cache.GetSize() != sizeof(CACHE_HEADER) +
+			sizeof(CACHE_ENTRY) * (size_t)header->meshCount +
+			sizeof(float) * FLOATS_PER_VERTEX * (size_t)header->vertexCount +
+			sizeof(GLuint) * (size_t)header->indexCount))
+	{
+		m_cache.Close();
+		return(false);
+	}
+
+	const CACHE_ENTRY* entries = (const CACHE_ENTRY*)(header + 1);
+	for (uint32_t i = 0; i < header->meshCount; i++)
+	{
+		if (((size_t)entries[i].firstVertex + entries[i].nVertices > header->vertexCount) ||
+			((size_t)entries[i].firstIndex + entries[i].nIndices > header->indexCount) ||
+			(entries[i].name[MAX_NAME_LENGTH - 1] != '\0'))
+		{
+			m_cache.Close();
+			return(false);
+		}
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  FindCachedMesh()
+ *
+ *  This method is used for copying the vertices and indices
+ *  of a named mesh out of the mapped cache file.
+ ***********************************************************/
+bool MeshStore::FindCachedMesh(
+	const char* name,
+	std::vector<float>& vertices,
+	std::vector<GLuint>& indices) const
+{
+	if (m_cache.GetData() == NULL)
+	{
+		return(false);
+	}
+
+	const CACHE_HEADER* header = (const CACHE_HEADER*)m_cache.GetData();
+	const CACHE_ENTRY* entries = (const CACHE_ENTRY*)(header + 1);
+	const float* cachedVertices = (const float*)(entries + header->meshCount);
+	const GLuint* cachedIndices = (const GLuint*)(cachedVertices + (size_t)header->vertexCount * FLOATS_PER_VERTEX);
+
+	for (uint32_t i = 0; i < header->meshCount; i++)
+	{
+		if (strcmp(entries[i].name, name) == 0)
+		{
+			const float* firstVertex = cachedVertices + (size_t)entries[i].firstVertex * FLOATS_PER_VERTEX;
+			const GLuint* firstIndex = cachedIndices + entries[i].firstIndex;
+
+			vertices.assign(firstVertex, firstVertex + (size_t)entries[i].nVertices * FLOATS_PER_VERTEX);
+			indices.assign(firstIndex, firstIndex + entries[i].nIndices);
+			return(true);
+		}
+	}
+
+	return(false);
+}
+
+/***********************************************************
+ *  SaveCache()
+ *
+ *  This method is used for writing every added mesh to a
+ *  cache file, as a header, a table of the meshes and then
+ *  the vertices and indices just as they are uploaded.  The
+ *  file is written under a temporary name and renamed, so a
+ *  partly written cache is never mapped.
+ ***********************************************************/
+bool MeshStore::SaveCache(const char* filename) const
+{
+#ifdef _WIN32
+	_mkdir(g_CacheDirectory);
+#else
+	mkdir(g_CacheDirectory, 0755);
+#endif
+
+	CACHE_HEADER header;
+	header.magic = g_CacheMagic;
+	header.version = g_CacheVersion;
+	header.floatsPerVertex = FLOATS_PER_VERTEX;
+	header.meshCount = (uint32_t)m_meshes.size();
+	header.vertexCount = (uint32_t)(m_vertices.size() / FLOATS_PER_VERTEX);
+	header.indexCount = (uint32_t)m_indices.size();
+
+	std::vector<CACHE_ENTRY> entries(m_meshes.size());
+	for (size_t i = 0; i < m_meshes.size(); i++)
+	{
+		memset(&entries[i], 0, sizeof(CACHE_ENTRY));
+		strncpy(entries[i].name, m_names[i].c_str(), MAX_NAME_LENGTH - 1);
+		entries[i].firstVertex = (uint32_t)m_meshes[i].baseVertex;
+		entries[i].nVertices = m_meshes[i].nVertices;
+		entries[i].firstIndex = m_meshes[i].firstIndex;
+		entries[i].nIndices = m_meshes[i].nIndices;
+	}
+
+	const std::string temporaryName = std::string(filename) + ".tmp";
+	{
+		std::ofstream file(temporaryName.c_str(), std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			return(false);
+		}
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)entries.data(), (std::streamsize)(entries.size() * sizeof(CACHE_ENTRY)));
+		file.write((const char*)m_vertices.data(), (std::streamsize)(m_vertices.size() * sizeof(float)));
+		file.write((const char*)m_indices.data(), (std::streamsize)(m_indices.size() * sizeof(GLuint)));
+		if (!file)
+		{
+			file.close();
+			std::remove(temporaryName.c_str());
+			return(false);
+		}
+	}
+
+	std::remove(filename);
+	if (std::rename(temporaryName.c_str(), filename) != 0)
+	{
+		std::remove(temporaryName.c_str());
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  AddMesh()
+ *
+ *  This method is used for appending the vertices and the
+ *  indices of a mesh after the ones added before it.  The
+ *  indices stay relative to the mesh, and the base vertex
+ *  of the draw moves them to its range.
+ ***********************************************************/
+int MeshStore::AddMesh(
+	const char* name,
+	const std::vector<float>& vertices,
+	const std::vector<GLuint>& indices)
+{
+	MESH mesh;
+	mesh.baseVertex = (GLint)(m_vertices.size() / FLOATS_PER_VERTEX);
+	mesh.firstIndex = (GLuint)m_indices.size();
+	mesh.nVertices = (GLuint)(vertices.size() / FLOATS_PER_VERTEX);
+	mesh.nIndices = (GLuint)indices.size();
+
+	m_vertices.insert(m_vertices.end(), vertices.begin(), vertices.end());
+	m_indices.insert(m_indices.end(), indices.begin(), indices.end());
+	m_meshes.push_back(mesh);
+	m_names.push_back(name);
+
+	return((int)m_meshes.size() - 1);
+}
+
+/***********************************************************
+ *  Upload()
+ *
+ *  This method is used for uploading all the added meshes
+ *  into the shared buffers and setting up the per-vertex
+ *  attributes of the shared vertex array.  The vertices are
+ *  packed into the compressed layout when it is chosen and
+ *  every UV fits its 0 to 1 range.  The vertex array is left
+ *  bound, so the caller can add its own attributes.
+ ***********************************************************/
+void MeshStore::Upload()
+{
+	if (m_vao == 0)
+	{
+		glGenBuffers(2, m_vbos);
+	}
+
+	const size_t vertexCount = m_vertices.size() / FLOATS_PER_VERTEX;
+	m_bUploadedCompressed = m_bCompressed;
+	for (size_t v = 0; (v < vertexCount) && m_bUploadedCompressed; v++)
+	{
+		const float* uv = &m_vertices[v * FLOATS_PER_VERTEX + 6];
+		if ((uv[0] < 0.0f) || (uv[0] > 1.0f) || (uv[1] < 0.0f) || (uv[1] > 1.0f))
+		{
+			m_bUploadedCompressed = false;
+		}
+	}
+
+	// the buffers keep their names, so the vertex arrays
+	// created over them stay valid
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbos[0]);
+	if (m_bUploadedCompressed)
+	{
+		std::vector<PACKED_VERTEX> packed(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			const float* vertex = &m_vertices[v * FLOATS_PER_VERTEX];
+			for (int i = 0; i < 3; i++)
+			{
+				packed[v].position[i] = MeshOptimizer::PackHalf(vertex[i]);
+			}
+			packed[v].position[3] = MeshOptimizer::PackHalf(1.0f);
+			packed[v].normal = MeshOptimizer::PackNormal(glm::vec3(vertex[3], vertex[4], vertex[5]));
+			packed[v].uv[0] = MeshOptimizer::PackUnorm16(vertex[6]);
+			packed[v].uv[1] = MeshOptimizer::PackUnorm16(vertex[7]);
+		}
+		glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PACKED_VERTEX), packed.data(), GL_STATIC_DRAW);
+	}
+	else
+	{
+		glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(float), m_vertices.data(), GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_vbos[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(GLuint), m_indices.data(), GL_STATIC_DRAW);
+
+	if (m_vao == 0)
+	{
+		m_vao = CreateVertexArray();
+	}
+	glBindVertexArray(m_vao);
+}
+
+/***********************************************************
+ *  CreateVertexArray()
+ *
+ *  This method is used for creating a vertex array that
+ *  reads the vertices and indices of the shared buffers,
+ *  in the layout they were uploaded with, for draws that
+ *  take their per-instance attributes from another buffer.
+ *  The caller owns the vertex array.
+ ***********************************************************/
+GLuint MeshStore::CreateVertexArray() const
+{
+	const GLsizei stride = GetVertexStride();
+	GLuint vao = 0;
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbos[0]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_vbos[1]);
+
+	if (m_bUploadedCompressed)
+	{
+		glVertexAttribPointer(g_PositionLocation, 3, GL_HALF_FLOAT, GL_FALSE, stride,
+			(void*)offsetof(PACKED_VERTEX, position));
+		glVertexAttribPointer(g_NormalLocation, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+			(void*)offsetof(PACKED_VERTEX, normal));
+		glVertexAttribPointer(g_TextureCoordinateLocation, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+			(void*)offsetof(PACKED_VERTEX, uv));
+	}
+	else
+	{
+		glVertexAttribPointer(g_PositionLocation, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+		glVertexAttribPointer(g_NormalLocation, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 3));
+		glVertexAttribPointer(g_TextureCoordinateLocation, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 6));
+	}
+	glEnableVertexAttribArray(g_PositionLocation);
+	glEnableVertexAttribArray(g_NormalLocation);
+	glEnableVertexAttribArray(g_TextureCoordinateLocation);
+
+	return(vao);
+}
+
+/***********************************************************
+ *  GetVertexStride()
+ *
+ *  This method is used for getting the size in bytes of
+ *  one vertex in the layout of the last upload.
+ ***********************************************************/
+int MeshStore::GetVertexStride() const
+{
+	if (m_bUploadedCompressed)
+	{
+		return((int)sizeof(PACKED_VERTEX));
+	}
+
+	return((int)(sizeof(float) * FLOATS_PER_VERTEX));
+}
+
+/***********************************************************
+ *  Destroy()
+ *
+ *  This method is used for releasing the GL objects.
+ ***********************************************************/
+void MeshStore::Destroy()
+{
+	if (m_vao != 0)
+	{
+		glDeleteVertexArrays(1, &m_vao);
+		glDeleteBuffers(2, m_vbos);
+		m_vao = 0;
+	}
+}
@@ -0,0 +1,149 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshstore.h
+// ============
+// shared vertex and index buffers for all the basic meshes, with a binary cache
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  MeshStore
+ *
+ *  This class suballocates the vertices and indices of all
+ *  the meshes into one vertex buffer and one index buffer
+ *  behind a single vertex array object.  Each mesh keeps
+ *  the base vertex and first index of its range, so the
+ *  draws of different meshes need no vertex array switch.
+ *
+ *  The vertices are kept as floats on the CPU, and are
+ *  uploaded in a compressed layout of half float positions,
+ *  10:10:10:2 normals and 16-bit UVs, half the size of the
+ *  float layout, unless it is turned off or a mesh has UVs
+ *  outside of 0 to 1.
+ *
+ *  The meshes can also be written to a binary cache file,
+ *  which is mapped on the next launch, so the generated
+ *  meshes are copied out of it instead of being
+ *  tessellated again.
+ ***********************************************************/
+class MeshStore
+{
+public:
+	// constructor
+	MeshStore();
+	// destructor
+	~MeshStore();
+
+	// range of one mesh in the shared buffers
+	struct MESH
+	{
+		GLint baseVertex;
+		GLuint firstIndex;
+		GLuint nVertices;
+		GLuint nIndices;
+	};
+
+	// number of floats in one vertex - position, normal, UV
+	static const int FLOATS_PER_VERTEX = 8;
+	// longest mesh name stored in the cache, with the terminator
+	static const int MAX_NAME_LENGTH = 24;
+
+	// map a cache file written by SaveCache(), false when it
+	// is missing or was written by another version
+	bool OpenCache(const char* filename);
+	// copy a mesh out of the mapped cache, false when the cache
+	// does not hold it
+	bool FindCachedMesh(
+		const char* name,
+		std::vector<float>& vertices,
+		std::vector<GLuint>& indices) const;
+	// write every added mesh to a cache file
+	bool SaveCache(const char* filename) const;
+	// release the mapping of the cache file
+	void CloseCache() { m_cache.Close(); }
+
+	// append a mesh to the shared buffers and return its index
+	int AddMesh(
+		const char* name,
+		const std::vector<float>& vertices,
+		const std::vector<GLuint>& indices);
+	// choose the compressed vertex layout for the next upload
+	void SetCompressed(bool bCompressed) { m_bCompressed = bCompressed; }
+	// upload the added meshes into the shared buffers
+	void Upload();
+	// create another vertex array over the shared buffers,
+	// with the per-vertex attributes set up, and leave it bound
+	GLuint CreateVertexArray() const;
+
+	// range of a mesh
+	const MESH& GetMesh(int mesh) const { return(m_meshes[mesh]); }
+	// number of added meshes
+	int GetMeshCount() const { return((int)m_meshes.size()); }
+	// vertex array shared by all the meshes
+	GLuint GetVertexArray() const { return(m_vao); }
+	// number of added vertices
+	int GetVertexCount() const { return((int)(m_vertices.size() / FLOATS_PER_VERTEX)); }
+	// bytes of one uploaded vertex, and whether it is compressed
+	int GetVertexStride() const;
+	bool IsCompressed() const { return(m_bUploadedCompressed); }
+
+private:
+	// start of a cache file
+	struct CACHE_HEADER
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t floatsPerVertex;
+		uint32_t meshCount;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+	};
+
+	// vertex as uploaded in the compressed layout
+	struct PACKED_VERTEX
+	{
+		// half floats, the last one is padding
+		uint16_t position[4];
+		// signed normalized 10:10:10:2
+		uint32_t normal;
+		// unsigned normalized
+		uint16_t uv[2];
+	};
+
+	// one mesh in a cache file
+	struct CACHE_ENTRY
+	{
+		char name[MAX_NAME_LENGTH];
+		uint32_t firstVertex;
+		uint32_t nVertices;
+		uint32_t firstIndex;
+		uint32_t nIndices;
+	};
+
+	GLuint m_vao;
+	GLuint m_vbos[2];
+	std::vector<MESH> m_meshes;
+	std::vector<std::string> m_names;
+	// vertices and indices of every added mesh, indices are
+	// relative to the base vertex of their mesh
+	std::vector<float> m_vertices;
+	std::vector<GLuint> m_indices;
+	// cache file read at startup
+	MappedFile m_cache;
+	// compressed layout asked for, and the layout uploaded
+	bool m_bCompressed;
+	bool m_bUploadedCompressed;
+
+	// release the GL objects
+	void Destroy();
+};
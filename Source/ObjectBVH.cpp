@@ -0,0 +1,423 @@
+///////////////////////////////////////////////////////////////////////////////
+// objectbvh.cpp
+// ============
+// bounding volume hierarchy over the scene objects, for frustum culling
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ObjectBVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(OBJECT_BVH_SSE)
+#include <xmmintrin.h>
+#endif
+
+/***********************************************************
+ *  ObjectBVH()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ObjectBVH::ObjectBVH()
+{
+}
+
+/***********************************************************
+ *  Build()
+ *
+ *  This method is used for calculating the world bounds of
+ *  every object and building the hierarchy over them from
+ *  the top down, splitting the objects of each node at the
+ *  median of their centers along the longest axis.  An
+ *  object without mesh bounds is kept as a point at the
+ *  origin of its model matrix.
+ ***********************************************************/
+void ObjectBVH::Build(
+	const uint8_t* meshIDs,
+	const glm::mat4* modelMatrices,
+	int objectCount,
+	const AABB* meshBounds,
+	int meshCount)
+{
+	m_meshBounds.assign(meshBounds, meshBounds + meshCount);
+	m_meshIDs.assign(meshIDs, meshIDs + objectCount);
+	m_objectBounds.resize(objectCount);
+	m_objectLeaves.assign(objectCount, -1);
+	m_leafObjects.resize(objectCount);
+	m_nodes.clear();
+
+	for (int i = 0; i < objectCount; i++)
+	{
+		if (meshIDs[i] < meshCount)
+		{
+			m_objectBounds[i] = TransformBounds(m_meshBounds[meshIDs[i]], modelMatrices[i]);
+		}
+		else
+		{
+			m_objectBounds[i].min = glm::vec3(modelMatrices[i][3]);
+			m_objectBounds[i].max = glm::vec3(modelMatrices[i][3]);
+		}
+		m_leafObjects[i] = i;
+	}
+
+	if (objectCount == 0)
+	{
+		return;
+	}
+
+	m_nodes.reserve(2 * objectCount);
+	NODE root;
+	root.first = 0;
+	root.count = objectCount;
+	root.parent = -1;
+	m_nodes.push_back(root);
+	Subdivide(0, 0, objectCount);
+}
+
+/***********************************************************
+ *  Subdivide()
+ *
+ *  This method is used for turning a node into a leaf when
+ *  it holds few enough objects, or else for splitting its
+ *  objects in two halves and subdividing each of them.
+ ***********************************************************/
+void ObjectBVH::Subdivide(int node, int first, int count)
+{
+	if (count <= MAX_LEAF_OBJECTS)
+	{
+		m_nodes[node].first = first;
+		m_nodes[node].count = count;
+		for (int i = first; i < first + count; i++)
+		{
+			m_objectLeaves[m_leafObjects[i]] = node;
+		}
+		m_nodes[node].bounds = CalculateBounds(m_nodes[node]);
+		return;
+	}
+
+	// split along the axis where the centers spread the most
+	glm::vec3 centerMin = m_objectBounds[m_leafObjects[first]].min + m_objectBounds[m_leafObjects[first]].max;
+	glm::vec3 centerMax = centerMin;
+	for (int i = first + 1; i < first + count; i++)
+	{
+		glm::vec3 center = m_objectBounds[m_leafObjects[i]].min + m_objectBounds[m_leafObjects[i]].max;
+		centerMin = glm::min(centerMin, center);
+		centerMax = glm::max(centerMax, center);
+	}
+	glm::vec3 spread = centerMax - centerMin;
+	int axis = 0;
+	if (spread.y > spread[axis])
+	{
+		axis = 1;
+	}
+	if (spread.z > spread[axis])
+	{
+		axis = 2;
+	}
+
+	const std::vector<AABB>& bounds = m_objectBounds;
+	const int half = count / 2;
+	std::nth_element(
+		m_leafObjects.begin() + first,
+		m_leafObjects.begin() + first + half,
+		m_leafObjects.begin() + first + count,
+		[&bounds, axis](int a, int b)
+		{
+			return((bounds[a].min[axis] + bounds[a].max[axis]) < (bounds[b].min[axis] + bounds[b].max[axis]));
+		});
+
+	// the children are added before recursing, so that they
+	// stay next to each other
+	const int left = (int)m_nodes.size();
+	NODE child;
+	child.first = 0;
+	child.count = 0;
+	child.parent = node;
+	m_nodes.push_back(child);
+	m_nodes.push_back(child);
+	m_nodes[node].first = left;
+	m_nodes[node].count = 0;
+
+	Subdivide(left, first, half);
+	Subdivide(left + 1, first + half, count - half);
+	m_nodes[node].bounds = CalculateBounds(m_nodes[node]);
+}
+
+/***********************************************************
+ *  CalculateBounds()
+ *
+ *  This method is used for getting the box around the
+ *  objects of a leaf, or around the two children of an
+ *  inner node.
+ ***********************************************************/
+ObjectBVH::AABB ObjectBVH::CalculateBounds(const NODE& node) const
+{
+	AABB bounds;
+
+	if (node.count > 0)
+	{
+		bounds = m_objectBounds[m_leafObjects[node.first]];
+		for (int i = node.first + 1; i < node.first + node.count; i++)
+		{
+			bounds.min = glm::min(bounds.min, m_objectBounds[m_leafObjects[i]].min);
+			bounds.max = glm::max(bounds.max, m_objectBounds[m_leafObjects[i]].max);
+		}
+	}
+	else
+	{
+		bounds.min = glm::min(m_nodes[node.first].bounds.min, m_nodes[node.first + 1].bounds.min);
+		bounds.max = glm::max(m_nodes[node.first].bounds.max, m_nodes[node.first + 1].bounds.max);
+	}
+
+	return(bounds);
+}
+
+/***********************************************************
+ *  UpdateObject()
+ *
+ *  This method is used for moving the box of an object to
+ *  its new transform and refitting the nodes above it.  The
+ *  refit stops at the first node whose box did not change,
+ *  as the nodes above it cannot change either.
+ ***********************************************************/
+void ObjectBVH::UpdateObject(int object, const glm::mat4& model)
+{
+	if ((object < 0) || (object >= (int)m_objectBounds.size()))
+	{
+		return;
+	}
+
+	if (m_meshIDs[object] < m_meshBounds.size())
+	{
+		m_objectBounds[object] = TransformBounds(m_meshBounds[m_meshIDs[object]], model);
+	}
+	else
+	{
+		m_objectBounds[object].min = glm::vec3(model[3]);
+		m_objectBounds[object].max = glm::vec3(model[3]);
+	}
+
+	int node = m_objectLeaves[object];
+	while (node >= 0)
+	{
+		AABB bounds = CalculateBounds(m_nodes[node]);
+		if ((bounds.min == m_nodes[node].bounds.min) && (bounds.max == m_nodes[node].bounds.max))
+		{
+			break;
+		}
+		m_nodes[node].bounds = bounds;
+		node = m_nodes[node].parent;
+	}
+}
+
+/***********************************************************
+ *  Cull()
+ *
+ *  This method is used for walking the hierarchy against
+ *  the view frustum.  A node outside of a plane is skipped
+ *  with all of its objects, and a node inside of all the
+ *  planes flags all of its objects without testing them.
+ *  The objects of a leaf that crosses a plane are tested
+ *  one by one.
+ ***********************************************************/
+int ObjectBVH::Cull(const glm::mat4& viewProjection, uint8_t* visibleFlags)
+{
+	const int objectCount = (int)m_objectBounds.size();
+	if (objectCount == 0)
+	{
+		return(0);
+	}
+	memset(visibleFlags, 0, objectCount);
+
+	FRUSTUM frustum;
+	ExtractFrustum(viewProjection, frustum);
+
+	int visibleCount = 0;
+	m_stack.clear();
+	m_stack.push_back(0);
+	while (!m_stack.empty())
+	{
+		const int node = m_stack.back();
+		m_stack.pop_back();
+
+		const CULL_RESULT result = TestBounds(frustum, m_nodes[node].bounds);
+		if (result == CULL_OUTSIDE)
+		{
+			continue;
+		}
+		if (result == CULL_INSIDE)
+		{
+			visibleCount += FlagSubtree(node, visibleFlags);
+			continue;
+		}
+
+		const NODE& current = m_nodes[node];
+		if (current.count == 0)
+		{
+			m_stack.push_back(current.first);
+			m_stack.push_back(current.first + 1);
+			continue;
+		}
+
+		for (int i = current.first; i < current.first + current.count; i++)
+		{
+			const int object = m_leafObjects[i];
+			if (TestBounds(frustum, m_objectBounds[object]) != CULL_OUTSIDE)
+			{
+				visibleFlags[object] = 1;
+				visibleCount++;
+			}
+		}
+	}
+
+	return(visibleCount);
+}
+
+/***********************************************************
+ *  FlagSubtree()
+ *
+ *  This method is used for flagging every object below a
+ *  node as visible and returning how many there are.
+ ***********************************************************/
+int ObjectBVH::FlagSubtree(int node, uint8_t* visibleFlags)
+{
+	const NODE& current = m_nodes[node];
+
+	if (current.count == 0)
+	{
+		return(FlagSubtree(current.first, visibleFlags) + FlagSubtree(current.first + 1, visibleFlags));
+	}
+
+	for (int i = current.first; i < current.first + current.count; i++)
+	{
+		visibleFlags[m_leafObjects[i]] = 1;
+	}
+
+	return(current.count);
+}
+
+/***********************************************************
+ *  TransformBounds()
+ *
+ *  This method is used for getting the box around a
+ *  transformed box.  The center is transformed as a point,
+ *  and each new half extent adds up the absolute values of
+ *  the matrix row times the old half extents.
+ ***********************************************************/
+ObjectBVH::AABB ObjectBVH::TransformBounds(const AABB& bounds, const glm::mat4& model)
+{
+	const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+	const glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+
+	const glm::vec3 newCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+	const glm::vec3 newExtent =
+		glm::abs(glm::vec3(model[0])) * extent.x +
+		glm::abs(glm::vec3(model[1])) * extent.y +
+		glm::abs(glm::vec3(model[2])) * extent.z;
+
+	AABB result;
+	result.min = newCenter - newExtent;
+	result.max = newCenter + newExtent;
+	return(result);
+}
+
+/***********************************************************
+ *  ExtractFrustum()
+ *
+ *  This method is used for getting the six planes of the
+ *  frustum from the rows of the view-projection matrix, as
+ *  sums and differences of the fourth row with the others.
+ *  The planes point inward and are not normalized, since
+ *  only the sign of the distances is used.
+ ***********************************************************/
+void ObjectBVH::ExtractFrustum(const glm::mat4& viewProjection, FRUSTUM& frustum)
+{
+	const glm::mat4 rows = glm::transpose(viewProjection);
+
+	for (int plane = 0; plane < 8; plane++)
+	{
+		glm::vec4 equation(0.0f, 0.0f, 0.0f, 1.0f);
+		if (plane < 6)
+		{
+			const float sign = ((plane & 1) == 0) ? 1.0f : -1.0f;
+			equation = rows[3] + rows[plane / 2] * sign;
+		}
+
+		frustum.normalX[plane] = equation.x;
+		frustum.normalY[plane] = equation.y;
+		frustum.normalZ[plane] = equation.z;
+		frustum.distance[plane] = equation.w;
+	}
+}
+
+/***********************************************************
+ *  TestBounds()
+ *
+ *  This method is used for testing a box against all the
+ *  planes.  The box is outside when its corner nearest to
+ *  the inside of a plane is behind it, and inside when its
+ *  farthest corner is in front of every plane.  Four planes
+ *  are tested at a time when SSE is available.
+ ***********************************************************/
+ObjectBVH::CULL_RESULT ObjectBVH::TestBounds(const FRUSTUM& frustum, const AABB& bounds)
+{
+	const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+	const glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+
+#if defined(OBJECT_BVH_SSE)
+	const __m128 centerX = _mm_set1_ps(center.x);
+	const __m128 centerY = _mm_set1_ps(center.y);
+	const __m128 centerZ = _mm_set1_ps(center.z);
+	const __m128 extentX = _mm_set1_ps(extent.x);
+	const __m128 extentY = _mm_set1_ps(extent.y);
+	const __m128 extentZ = _mm_set1_ps(extent.z);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	int crossing = 0;
+	for (int group = 0; group < 8; group += 4)
+	{
+		const __m128 normalX = _mm_loadu_ps(&frustum.normalX[group]);
+		const __m128 normalY = _mm_loadu_ps(&frustum.normalY[group]);
+		const __m128 normalZ = _mm_loadu_ps(&frustum.normalZ[group]);
+
+		// signed distance of the center, and the reach of the
+		// box along each plane normal
+		__m128 distance = _mm_add_ps(_mm_loadu_ps(&frustum.distance[group]), _mm_mul_ps(normalX, centerX));
+		distance = _mm_add_ps(distance, _mm_mul_ps(normalY, centerY));
+		distance = _mm_add_ps(distance, _mm_mul_ps(normalZ, centerZ));
+		__m128 radius = _mm_mul_ps(_mm_andnot_ps(signMask, normalX), extentX);
+		radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(signMask, normalY), extentY));
+		radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(signMask, normalZ), extentZ));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero)) != 0)
+		{
+			return(CULL_OUTSIDE);
+		}
+		crossing |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero));
+	}
+#else
+	int crossing = 0;
+	for (int plane = 0; plane < 8; plane++)
+	{
+		const float distance = frustum.distance[plane] +
+			frustum.normalX[plane] * center.x +
+			frustum.normalY[plane] * center.y +
+			frustum.normalZ[plane] * center.z;
+		const float radius =
+			fabsf(frustum.normalX[plane]) * extent.x +
+			fabsf(frustum.normalY[plane]) * extent.y +
+			fabsf(frustum.normalZ[plane]) * extent.z;
+
+		if (distance + radius < 0.0f)
+		{
+			return(CULL_OUTSIDE);
+		}
+		crossing |= (distance - radius < 0.0f) ? 1 : 0;
+	}
+#endif
+
+	return((crossing != 0) ? CULL_INTERSECTS : CULL_INSIDE);
+}
@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////////
+// objectbvh.h
+// ============
+// bounding volume hierarchy over the scene objects, for frustum culling
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// select the vector instructions used by the frustum test
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#define OBJECT_BVH_SSE
+#endif
+
+/***********************************************************
+ *  ObjectBVH
+ *
+ *  This class keeps a world space bounding box for every
+ *  draw list object, found by transforming the bounds of
+ *  its mesh, and arranges the boxes in a binary hierarchy.
+ *  A moved object only refits the boxes on the path from
+ *  its leaf to the root, so the hierarchy is built once.
+ *
+ *  Culling walks the hierarchy against the six planes of
+ *  the view frustum, testing four planes at a time, and
+ *  skips the plane tests below a node that is completely
+ *  inside the frustum.
+ ***********************************************************/
+class ObjectBVH
+{
+public:
+	// constructor
+	ObjectBVH();
+
+	// axis aligned bounding box
+	struct AABB
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
+	// most objects stored in one leaf
+	static const int MAX_LEAF_OBJECTS = 2;
+
+	// build the hierarchy over objects whose mesh bounds are
+	// selected by meshIDs and transformed by modelMatrices
+	void Build(
+		const uint8_t* meshIDs,
+		const glm::mat4* modelMatrices,
+		int objectCount,
+		const AABB* meshBounds,
+		int meshCount);
+	// move the box of an object and refit the nodes above it
+	void UpdateObject(int object, const glm::mat4& model);
+
+	// flag the objects that intersect the frustum of the
+	// passed in view-projection and return how many are visible
+	int Cull(const glm::mat4& viewProjection, uint8_t* visibleFlags);
+
+	// number of objects in the hierarchy
+	int GetObjectCount() const { return((int)m_objectBounds.size()); }
+	// number of nodes in the hierarchy
+	int GetNodeCount() const { return((int)m_nodes.size()); }
+	// world bounds of an object
+	const AABB& GetObjectBounds(int object) const { return(m_objectBounds[object]); }
+
+	// bounds of a box after a transform, as a box again
+	static AABB TransformBounds(const AABB& bounds, const glm::mat4& model);
+
+private:
+	// one node, the children of an inner node are next to each
+	// other and a leaf references a range of m_leafObjects
+	struct NODE
+	{
+		AABB bounds;
+		// first child of an inner node, or first object of a leaf
+		int first;
+		// number of objects of a leaf, 0 for an inner node
+		int count;
+		int parent;
+	};
+
+	// the six frustum planes as four component arrays, padded
+	// to eight with planes that every box is inside of
+	struct FRUSTUM
+	{
+		float normalX[8];
+		float normalY[8];
+		float normalZ[8];
+		float distance[8];
+	};
+
+	// result of testing a box against the frustum
+	enum CULL_RESULT
+	{
+		CULL_OUTSIDE = 0,
+		CULL_INTERSECTS,
+		CULL_INSIDE
+	};
+
+	std::vector<NODE> m_nodes;
+	// objects in leaf order
+	std::vector<int> m_leafObjects;
+	// world bounds and leaf node of every object
+	std::vector<AABB> m_objectBounds;
+	std::vector<int> m_objectLeaves;
+	// local bounds of every mesh, copied at build time
+	std::vector<AABB> m_meshBounds;
+	std::vector<uint8_t> m_meshIDs;
+	// nodes still to visit during culling
+	std::vector<int> m_stack;
+
+	// split the objects of a node into two children
+	void Subdivide(int node, int first, int count);
+	// bounds of the objects of a leaf, or the two children
+	AABB CalculateBounds(const NODE& node) const;
+	// flag every object below a node as visible
+	int FlagSubtree(int node, uint8_t* visibleFlags);
+
+	// extract the frustum planes of a view-projection matrix
+	static void ExtractFrustum(const glm::mat4& viewProjection, FRUSTUM& frustum);
+	// test a box against all the planes of the frustum
+	static CULL_RESULT TestBounds(const FRUSTUM& frustum, const AABB& bounds);
+};
@@ -0,0 +1,314 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusionbuffer.cpp
+// ============
+// software depth buffer of the large occluders, with a hierarchical-Z pyramid
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OcclusionBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// declaration of the global variables and defines
+namespace
+{
+	// depth difference below which a box counts as visible, so
+	// a face lying on the bounds of its object never hides it
+	const float g_DepthBias = 0.00001f;
+	// smallest clip space w of a vertex in front of the eye
+	const float g_MinClipW = 0.0001f;
+
+	/***********************************************************
+	 *  EdgeFunction()
+	 *
+	 *  This function is used for getting twice the signed area
+	 *  of the triangle a, b, p, positive when p is to the left
+	 *  of the edge from a to b.
+	 ***********************************************************/
+	float EdgeFunction(const glm::vec3& a, const glm::vec3& b, float px, float py)
+	{
+		return(((b.x - a.x) * (py - a.y)) - ((b.y - a.y) * (px - a.x)));
+	}
+}
+
+/***********************************************************
+ *  OcclusionBuffer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+OcclusionBuffer::OcclusionBuffer()
+{
+	for (int level = 0; level < LEVEL_COUNT; level++)
+	{
+		const int size = SIZE >> level;
+		m_levels[level].assign(size * size, 1.0f);
+	}
+	m_viewProjection = glm::mat4(1.0f);
+	m_texture = 0;
+}
+
+/***********************************************************
+ *  ~OcclusionBuffer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+OcclusionBuffer::~OcclusionBuffer()
+{
+	if (m_texture != 0)
+	{
+		glDeleteTextures(1, &m_texture);
+		m_texture = 0;
+	}
+}
+
+/***********************************************************
+ *  Begin()
+ *
+ *  This method is used for clearing the depth buffer to the
+ *  far plane before the occluders of a frame are drawn.
+ ***********************************************************/
+void OcclusionBuffer::Begin(const glm::mat4& viewProjection)
+{
+	m_viewProjection = viewProjection;
+	std::fill(m_levels[0].begin(), m_levels[0].end(), 1.0f);
+}
+
+/***********************************************************
+ *  RasterizeMesh()
+ *
+ *  This method is used for drawing the triangles of a mesh
+ *  into the depth buffer.  A triangle that reaches past the
+ *  near plane is left out rather than clipped, which only
+ *  makes the buffer hide less than it could.
+ ***********************************************************/
+void OcclusionBuffer::RasterizeMesh(
+	const float* vertices,
+	int floatsPerVertex,
+	const GLuint* indices,
+	int indexCount,
+	const glm::mat4& model)
+{
+	const glm::mat4 transform = m_viewProjection * model;
+
+	for (int i = 0; i + 2 < indexCount; i += 3)
+	{
+		glm::vec3 corners[3];
+		bool bInFront = true;
+
+		for (int v = 0; v < 3; v++)
+		{
+			const float* position = &vertices[indices[i + v] * floatsPerVertex];
+			glm::vec4 clip = transform * glm::vec4(position[0], position[1], position[2], 1.0f);
+			if ((clip.w < g_MinClipW) || (clip.z < -clip.w))
+			{
+				bInFront = false;
+				break;
+			}
+
+			corners[v].x = (clip.x / clip.w * 0.5f + 0.5f) * SIZE;
+			corners[v].y = (clip.y / clip.w * 0.5f + 0.5f) * SIZE;
+			corners[v].z = clip.z / clip.w * 0.5f + 0.5f;
+		}
+
+		if (bInFront)
+		{
+			RasterizeTriangle(corners[0], corners[1], corners[2]);
+		}
+	}
+}
+
+/***********************************************************
+ *  RasterizeTriangle()
+ *
+ *  This method is used for filling the texels whose centers
+ *  are inside a triangle, keeping the nearest depth.  Both
+ *  windings are drawn, as the back faces of a closed mesh
+ *  are always behind its front faces anyway.
+ ***********************************************************/
+void OcclusionBuffer::RasterizeTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+	float area = EdgeFunction(a, b, c.x, c.y);
+	if (fabsf(area) < 0.000001f)
+	{
+		return;
+	}
+	if (area < 0.0f)
+	{
+		std::swap(b, c);
+		area = -area;
+	}
+
+	const int minX = std::max(0, (int)floorf(std::min(a.x, std::min(b.x, c.x))));
+	const int maxX = std::min(SIZE - 1, (int)ceilf(std::max(a.x, std::max(b.x, c.x))));
+	const int minY = std::max(0, (int)floorf(std::min(a.y, std::min(b.y, c.y))));
+	const int maxY = std::min(SIZE - 1, (int)ceilf(std::max(a.y, std::max(b.y, c.y))));
+	std::vector<float>& depth = m_levels[0];
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		const float py = y + 0.5f;
+		for (int x = minX; x <= maxX; x++)
+		{
+			const float px = x + 0.5f;
+			const float weightA = EdgeFunction(b, c, px, py);
+			const float weightB = EdgeFunction(c, a, px, py);
+			const float weightC = EdgeFunction(a, b, px, py);
+			if ((weightA < 0.0f) || (weightB < 0.0f) || (weightC < 0.0f))
+			{
+				continue;
+			}
+
+			// the depth divided by w is linear on screen
+			const float z = (weightA * a.z + weightB * b.z + weightC * c.z) / area;
+			float& texel = depth[y * SIZE + x];
+			texel = std::min(texel, z);
+		}
+	}
+}
+
+/***********************************************************
+ *  BuildPyramid()
+ *
+ *  This method is used for reducing each level of the
+ *  pyramid from the one below it, keeping the farthest of
+ *  each 2x2 block of depths.
+ ***********************************************************/
+void OcclusionBuffer::BuildPyramid()
+{
+	for (int level = 1; level < LEVEL_COUNT; level++)
+	{
+		const int size = SIZE >> level;
+		const std::vector<float>& source = m_levels[level - 1];
+		std::vector<float>& destination = m_levels[level];
+
+		for (int y = 0; y < size; y++)
+		{
+			const float* row0 = &source[(2 * y) * (2 * size)];
+			const float* row1 = row0 + (2 * size);
+			for (int x = 0; x < size; x++)
+			{
+				destination[y * size + x] = std::max(
+					std::max(row0[2 * x], row0[2 * x + 1]),
+					std::max(row1[2 * x], row1[2 * x + 1]));
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  IsOccluded()
+ *
+ *  This method is used for testing a world space box against
+ *  the pyramid.  The rectangle of the projected box is grown
+ *  by one texel, to cover the texels its edges only cross
+ *  partly, and the level where it spans at most two texels
+ *  in each direction is read.  A box that reaches behind the
+ *  eye is always visible.
+ ***********************************************************/
+bool OcclusionBuffer::IsOccluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax, float* pScreenArea) const
+{
+	glm::vec2 rectMin(0.0f);
+	glm::vec2 rectMax(0.0f);
+	float nearest = 1.0f;
+
+	if (pScreenArea != NULL)
+	{
+		*pScreenArea = 0.0f;
+	}
+
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec4 position(
+			((corner & 1) != 0) ? boundsMax.x : boundsMin.x,
+			((corner & 2) != 0) ? boundsMax.y : boundsMin.y,
+			((corner & 4) != 0) ? boundsMax.z : boundsMin.z,
+			1.0f);
+		glm::vec4 clip = m_viewProjection * position;
+		if ((clip.w < g_MinClipW) || (clip.z < -clip.w))
+		{
+			return(false);
+		}
+
+		glm::vec2 screen = glm::vec2(clip) / clip.w * 0.5f + 0.5f;
+		rectMin = (corner == 0) ? screen : glm::min(rectMin, screen);
+		rectMax = (corner == 0) ? screen : glm::max(rectMax, screen);
+		nearest = std::min(nearest, clip.z / clip.w * 0.5f + 0.5f);
+	}
+
+	rectMin = glm::clamp(rectMin, 0.0f, 1.0f);
+	rectMax = glm::clamp(rectMax, 0.0f, 1.0f);
+	if ((rectMin.x >= rectMax.x) || (rectMin.y >= rectMax.y))
+	{
+		return(false);
+	}
+
+	const int minX = std::max(0, (int)(rectMin.x * SIZE) - 1);
+	const int minY = std::max(0, (int)(rectMin.y * SIZE) - 1);
+	const int maxX = std::min(SIZE - 1, (int)(rectMax.x * SIZE) + 1);
+	const int maxY = std::min(SIZE - 1, (int)(rectMax.y * SIZE) + 1);
+
+	int level = 0;
+	while ((level < LEVEL_COUNT - 1) &&
+		(((maxX >> level) - (minX >> level) > 1) || ((maxY >> level) - (minY >> level) > 1)))
+	{
+		level++;
+	}
+
+	const int size = SIZE >> level;
+	float farthest = 0.0f;
+	for (int y = (minY >> level); y <= (maxY >> level); y++)
+	{
+		for (int x = (minX >> level); x <= (maxX >> level); x++)
+		{
+			farthest = std::max(farthest, m_levels[level][y * size + x]);
+		}
+	}
+
+	if (nearest <= farthest + g_DepthBias)
+	{
+		return(false);
+	}
+
+	if (pScreenArea != NULL)
+	{
+		*pScreenArea = (rectMax.x - rectMin.x) * (rectMax.y - rectMin.y);
+	}
+	return(true);
+}
+
+/***********************************************************
+ *  Upload()
+ *
+ *  This method is used for copying every level of the
+ *  pyramid into the matching level of its texture.  The
+ *  texture is created on the first upload.
+ ***********************************************************/
+void OcclusionBuffer::Upload()
+{
+	if (m_texture == 0)
+	{
+		glGenTextures(1, &m_texture);
+		glBindTexture(GL_TEXTURE_2D, m_texture);
+		for (int level = 0; level < LEVEL_COUNT; level++)
+		{
+			glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, SIZE >> level, SIZE >> level, 0, GL_RED, GL_FLOAT, NULL);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, LEVEL_COUNT - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	else
+	{
+		glBindTexture(GL_TEXTURE_2D, m_texture);
+	}
+
+	for (int level = 0; level < LEVEL_COUNT; level++)
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, SIZE >> level, SIZE >> level, GL_RED, GL_FLOAT, m_levels[level].data());
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusionbuffer.h
+// ============
+// software depth buffer of the large occluders, with a hierarchical-Z pyramid
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  OcclusionBuffer
+ *
+ *  This class rasterizes the triangles of a few large
+ *  occluders into a small depth buffer on the CPU, and
+ *  reduces it into a pyramid whose texels keep the farthest
+ *  depth of the texels below them.  A box is hidden when
+ *  its nearest depth is behind the farthest depth of the
+ *  few pyramid texels that cover its rectangle on screen.
+ *
+ *  The buffer covers the whole viewport whatever its aspect
+ *  ratio, so the pixels of the buffer need not be square.
+ *  The pyramid can also be uploaded into a mipmapped float
+ *  texture, for the same test in the culling compute shader.
+ ***********************************************************/
+class OcclusionBuffer
+{
+public:
+	// constructor
+	OcclusionBuffer();
+	// destructor
+	~OcclusionBuffer();
+
+	// size of the depth buffer, the base of the pyramid
+	static const int SIZE = 256;
+	// number of levels of the pyramid, down to one texel
+	static const int LEVEL_COUNT = 9;
+
+	// clear the buffer for a new frame seen through viewProjection
+	void Begin(const glm::mat4& viewProjection);
+	// rasterize the triangles of an indexed mesh, whose
+	// vertices start with their position
+	void RasterizeMesh(
+		const float* vertices,
+		int floatsPerVertex,
+		const GLuint* indices,
+		int indexCount,
+		const glm::mat4& model);
+	// reduce the buffer into the pyramid
+	void BuildPyramid();
+
+	// true when the box is hidden by the rasterized occluders,
+	// pScreenArea receives the fraction of the viewport it covers
+	bool IsOccluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax, float* pScreenArea) const;
+
+	// copy the pyramid into its texture, created on first use
+	void Upload();
+	// mipmapped GL_R32F texture of the pyramid
+	GLuint GetTexture() const { return(m_texture); }
+
+private:
+	// one level of the pyramid, SIZE >> level texels square
+	std::vector<float> m_levels[LEVEL_COUNT];
+	glm::mat4 m_viewProjection;
+	GLuint m_texture;
+
+	// rasterize one triangle given in buffer coordinates,
+	// with the depth in z
+	void RasterizeTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c);
+};
@@ -0,0 +1,178 @@
+///////////////////////////////////////////////////////////////////////////////
+// overdrawcounter.cpp
+// ============
+// counts of the shaded fragments and covered pixels of a frame, read back late
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OverdrawCounter.h"
+
+/***********************************************************
+ *  OverdrawCounter()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+OverdrawCounter::OverdrawCounter()
+{
+	for (int frame = 0; frame < FRAME_COUNT; frame++)
+	{
+		for (int i = 0; i < QUERY_COUNT; i++)
+		{
+			m_queries[frame][i] = 0;
+		}
+		m_bIssued[frame] = false;
+	}
+	m_frame = 0;
+	m_bShading = false;
+	m_bShadingCounted = false;
+	m_vertexArray = 0;
+	m_shadedFragments = 0;
+	m_coveredPixels = 0;
+}
+
+/***********************************************************
+ *  ~OverdrawCounter()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+OverdrawCounter::~OverdrawCounter()
+{
+	if (m_queries[0][0] != 0)
+	{
+		glDeleteQueries(FRAME_COUNT * QUERY_COUNT, &m_queries[0][0]);
+		m_queries[0][0] = 0;
+	}
+	if (m_vertexArray != 0)
+	{
+		glDeleteVertexArrays(1, &m_vertexArray);
+		m_vertexArray = 0;
+	}
+}
+
+/***********************************************************
+ *  BeginShading()
+ *
+ *  This method is used for starting the count of the
+ *  shaded fragments of a frame.  The queries are created
+ *  on first use, and the counts of the frame whose queries
+ *  are reused are read first.
+ ***********************************************************/
+void OverdrawCounter::BeginShading()
+{
+	if (m_queries[0][0] == 0)
+	{
+		glGenQueries(FRAME_COUNT * QUERY_COUNT, &m_queries[0][0]);
+		glGenVertexArrays(1, &m_vertexArray);
+	}
+
+	ReadResults();
+	glBeginQuery(GL_SAMPLES_PASSED, m_queries[m_frame][QUERY_SHADED]);
+	m_bShading = true;
+	m_bShadingCounted = true;
+}
+
+/***********************************************************
+ *  EndShading()
+ *
+ *  This method is used for ending the count of the shaded
+ *  fragments.
+ ***********************************************************/
+void OverdrawCounter::EndShading()
+{
+	if (m_bShading == true)
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		m_bShading = false;
+	}
+}
+
+/***********************************************************
+ *  CountCoverage()
+ *
+ *  This method is used for counting the covered pixels.
+ *  The depth range puts every fragment of the screen
+ *  triangle on the far plane, so the greater test passes
+ *  only where the scene is nearer.  Nothing is written,
+ *  and the queries of the next frame are used next.  A
+ *  frame that drew nothing counts no shaded fragments.
+ ***********************************************************/
+void OverdrawCounter::CountCoverage()
+{
+	if (m_bShadingCounted == false)
+	{
+		BeginShading();
+	}
+	EndShading();
+	m_bShadingCounted = false;
+
+	GLint depthFunction = GL_LESS;
+	GLboolean bDepthWrites = GL_TRUE;
+	GLboolean colorWrites[4] = { GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE };
+	GLfloat depthRange[2] = { 0.0f, 1.0f };
+	glGetIntegerv(GL_DEPTH_FUNC, &depthFunction);
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &bDepthWrites);
+	glGetBooleanv(GL_COLOR_WRITEMASK, colorWrites);
+	glGetFloatv(GL_DEPTH_RANGE, depthRange);
+
+	glDepthFunc(GL_GREATER);
+	glDepthMask(GL_FALSE);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthRange(1.0, 1.0);
+
+	glBeginQuery(GL_SAMPLES_PASSED, m_queries[m_frame][QUERY_COVERED]);
+	glBindVertexArray(m_vertexArray);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glEndQuery(GL_SAMPLES_PASSED);
+
+	glDepthRange(depthRange[0], depthRange[1]);
+	glColorMask(colorWrites[0], colorWrites[1], colorWrites[2], colorWrites[3]);
+	glDepthMask(bDepthWrites);
+	glDepthFunc((GLenum)depthFunction);
+
+	m_bIssued[m_frame] = true;
+	m_frame = (m_frame + 1) % FRAME_COUNT;
+}
+
+/***********************************************************
+ *  GetOverdraw()
+ *
+ *  This method is used for getting the average number of
+ *  times a covered pixel was shaded.
+ ***********************************************************/
+float OverdrawCounter::GetOverdraw() const
+{
+	if (m_coveredPixels == 0)
+	{
+		return(0.0f);
+	}
+
+	return((float)((double)m_shadedFragments / (double)m_coveredPixels));
+}
+
+/***********************************************************
+ *  ReadResults()
+ *
+ *  This method is used for reading the counts of the frame
+ *  whose queries are about to be issued again.  They were
+ *  issued FRAME_COUNT frames ago, so they are normally
+ *  ready, and the last counts are kept when they are not.
+ ***********************************************************/
+void OverdrawCounter::ReadResults()
+{
+	if (m_bIssued[m_frame] == false)
+	{
+		return;
+	}
+	m_bIssued[m_frame] = false;
+
+	GLuint available = GL_FALSE;
+	glGetQueryObjectuiv(m_queries[m_frame][QUERY_COVERED], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available == GL_FALSE)
+	{
+		return;
+	}
+
+	glGetQueryObjectui64v(m_queries[m_frame][QUERY_SHADED], GL_QUERY_RESULT, &m_shadedFragments);
+	glGetQueryObjectui64v(m_queries[m_frame][QUERY_COVERED], GL_QUERY_RESULT, &m_coveredPixels);
+}
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// overdrawcounter.h
+// ============
+// counts of the shaded fragments and covered pixels of a frame, read back late
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+/***********************************************************
+ *  OverdrawCounter
+ *
+ *  This class measures how many times each covered pixel of
+ *  the scene is shaded.  A samples passed query counts the
+ *  fragments that pass the depth test while the scene is
+ *  shaded, and a second one counts the pixels the scene
+ *  covers, with one triangle over the screen that is only
+ *  drawn where the depth is nearer than the far plane.
+ *
+ *  The queries of the last few frames are kept, so their
+ *  results are read once the GPU has them, and the frame
+ *  never waits on them.
+ ***********************************************************/
+class OverdrawCounter
+{
+public:
+	// constructor
+	OverdrawCounter();
+	// destructor
+	~OverdrawCounter();
+
+	// start and stop counting the fragments that are shaded
+	void BeginShading();
+	void EndShading();
+	// count the pixels covered by the scene, with a program
+	// that covers the screen and writes no depth in use
+	void CountCoverage();
+
+	// fragments shaded and pixels covered in the latest frame
+	// whose counts are ready
+	GLuint64 GetShadedFragments() const { return(m_shadedFragments); }
+	GLuint64 GetCoveredPixels() const { return(m_coveredPixels); }
+	// fragments shaded per covered pixel, 1 when each pixel is
+	// only shaded once, and 0 before any count is ready
+	float GetOverdraw() const;
+
+private:
+	// frames whose queries can be waiting for the GPU
+	static const int FRAME_COUNT = 3;
+	// queries of a frame
+	enum QUERY
+	{
+		QUERY_SHADED = 0,
+		QUERY_COVERED,
+		QUERY_COUNT
+	};
+
+	GLuint m_queries[FRAME_COUNT][QUERY_COUNT];
+	// true when both queries of a frame have been issued
+	bool m_bIssued[FRAME_COUNT];
+	// frame whose queries are issued next
+	int m_frame;
+	// true while the shaded fragments are counted, and once
+	// they have been counted for the frame
+	bool m_bShading;
+	bool m_bShadingCounted;
+	// empty vertex array for the screen triangle
+	GLuint m_vertexArray;
+	GLuint64 m_shadedFragments;
+	GLuint64 m_coveredPixels;
+
+	// read the counts of the frame about to be reused, when
+	// the GPU has them
+	void ReadResults();
+};
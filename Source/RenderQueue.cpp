@@ -0,0 +1,306 @@
+///////////////////////////////////////////////////////////////////////////////
+// renderqueue.cpp
+// ============
+// per-frame list of draws sorted by packed state keys
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "RenderQueue.h"
+
+#include <cstring>
+
+// declaration of the global variables and defines
+namespace
+{
+	// bit position and width of each key field
+	const int g_DepthShift = 0;
+	const int g_DepthBits = 20;
+	const int g_MeshShift = 20;
+	const int g_MeshBits = 8;
+	const int g_PermutationShift = 28;
+	const int g_PermutationBits = 11;
+	const int g_PassShift = 39;
+	const int g_PassBits = 4;
+
+	// number of states compared by ApplyState()
+	const int g_TrackedStates = 2;
+
+	/***********************************************************
+	 *  PackField()
+	 *
+	 *  This function is used for clamping a value to the width
+	 *  of a key field and shifting it into place.
+	 ***********************************************************/
+	uint64_t PackField(uint32_t value, int shift, int bits)
+	{
+		const uint32_t maxValue = (1u << bits) - 1u;
+		if (value > maxValue)
+		{
+			value = maxValue;
+		}
+		return((uint64_t)value << shift);
+	}
+
+	/***********************************************************
+	 *  UnpackField()
+	 *
+	 *  This function is used for reading a field of a key.
+	 ***********************************************************/
+	uint32_t UnpackField(uint64_t key, int shift, int bits)
+	{
+		return((uint32_t)((key >> shift) & ((1ull << bits) - 1ull)));
+	}
+
+	/***********************************************************
+	 *  CountBits()
+	 *
+	 *  This function is used for counting the set bits of a
+	 *  state change mask.
+	 ***********************************************************/
+	int CountBits(int mask)
+	{
+		int count = 0;
+		while (mask != 0)
+		{
+			count += mask & 1;
+			mask >>= 1;
+		}
+		return(count);
+	}
+}
+
+/***********************************************************
+ *  RenderQueue()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+RenderQueue::RenderQueue()
+{
+	ResetState(m_boundState);
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/***********************************************************
+ *  ~RenderQueue()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+RenderQueue::~RenderQueue()
+{
+}
+
+/***********************************************************
+ *  MakeKey()
+ *
+ *  This method is used for packing the state of a draw into
+ *  a sort key.  The depth is the bit pattern of
+ *  the positive float distance, which increases with the
+ *  value, so the top bits give a front to back order
+ *  without choosing a depth range.
+ ***********************************************************/
+uint64_t RenderQueue::MakeKey(
+	PASS pass,
+	int permutation,
+	int mesh,
+	float viewDepth)
+{
+	uint32_t depthBits = 0;
+	if (viewDepth > 0.0f)
+	{
+		memcpy(&depthBits, &viewDepth, sizeof(depthBits));
+	}
+
+	uint64_t key = 0;
+	key |= PackField((uint32_t)pass, g_PassShift, g_PassBits);
+	key |= PackField((uint32_t)permutation, g_PermutationShift, g_PermutationBits);
+	key |= PackField((uint32_t)mesh, g_MeshShift, g_MeshBits);
+	key |= PackField(depthBits >> (32 - g_DepthBits), g_DepthShift, g_DepthBits);
+
+	return(key);
+}
+
+RenderQueue::PASS RenderQueue::GetPass(uint64_t key)
+{
+	return((PASS)UnpackField(key, g_PassShift, g_PassBits));
+}
+
+int RenderQueue::GetPermutation(uint64_t key)
+{
+	return((int)UnpackField(key, g_PermutationShift, g_PermutationBits));
+}
+
+int RenderQueue::GetMesh(uint64_t key)
+{
+	return((int)UnpackField(key, g_MeshShift, g_MeshBits));
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method is used for removing all the draws, so the
+ *  queue can be filled for the next frame.  The allocated
+ *  memory is kept.
+ ***********************************************************/
+void RenderQueue::Clear()
+{
+	m_items.clear();
+}
+
+/***********************************************************
+ *  Submit()
+ *
+ *  This method is used for adding a draw to the queue.  The
+ *  command value is not used by the queue, it only tells
+ *  the caller what to draw when the queue is replayed.
+ ***********************************************************/
+void RenderQueue::Submit(uint64_t key, uint32_t command)
+{
+	ITEM item;
+	item.key = key;
+	item.command = command;
+	m_items.push_back(item);
+}
+
+/***********************************************************
+ *  Sort()
+ *
+ *  This method is used for sorting the draws with a least
+ *  significant digit radix sort, one byte of the key per
+ *  pass.  The sort is stable, so draws with equal keys keep
+ *  their submission order, and a pass is skipped when every
+ *  key has the same value in that byte, which is common for
+ *  the pass and permutation bytes.
+ ***********************************************************/
+void RenderQueue::Sort()
+{
+	const size_t count = m_items.size();
+
+	m_stats.draws = (int)count;
+	m_stats.unsortedStateChanges = CountStateChanges();
+	m_stats.sortedStateChanges = 0;
+	m_stats.bindsSkipped = 0;
+	ResetState(m_boundState);
+
+	if (count > 1)
+	{
+		m_sortBuffer.resize(count);
+		ITEM* source = m_items.data();
+		ITEM* destination = m_sortBuffer.data();
+
+		for (int shift = 0; shift < 64; shift += 8)
+		{
+			size_t offsets[256];
+			memset(offsets, 0, sizeof(offsets));
+			for (size_t i = 0; i < count; i++)
+			{
+				offsets[(source[i].key >> shift) & 0xFF]++;
+			}
+
+			// all the keys share this byte, so the order is unchanged
+			if (offsets[(source[0].key >> shift) & 0xFF] == count)
+			{
+				continue;
+			}
+
+			size_t total = 0;
+			for (int digit = 0; digit < 256; digit++)
+			{
+				size_t digitCount = offsets[digit];
+				offsets[digit] = total;
+				total += digitCount;
+			}
+
+			for (size_t i = 0; i < count; i++)
+			{
+				destination[offsets[(source[i].key >> shift) & 0xFF]++] = source[i];
+			}
+
+			ITEM* swap = source;
+			source = destination;
+			destination = swap;
+		}
+
+		// an odd number of passes leaves the result in the scratch buffer
+		if (source != m_items.data())
+		{
+			m_items.swap(m_sortBuffer);
+		}
+	}
+}
+
+/***********************************************************
+ *  BeginDraw()
+ *
+ *  This method is used for finding the states of a draw
+ *  that differ from the bound state.  The first draw of a
+ *  frame changes every state it uses, because the state
+ *  left by other code is not known.
+ ***********************************************************/
+int RenderQueue::BeginDraw(int index)
+{
+	const int changes = ApplyState(m_boundState, m_items[index].key);
+	const int changeCount = CountBits(changes);
+
+	m_stats.sortedStateChanges += changeCount;
+	m_stats.bindsSkipped += g_TrackedStates - changeCount;
+
+	return(changes);
+}
+
+/***********************************************************
+ *  CountStateChanges()
+ *
+ *  This method is used for counting the state changes that
+ *  walking the draws in their current order would need.
+ ***********************************************************/
+int RenderQueue::CountStateChanges() const
+{
+	BOUND_STATE state;
+	int changes = 0;
+
+	ResetState(state);
+	for (size_t i = 0; i < m_items.size(); i++)
+	{
+		changes += CountBits(ApplyState(state, m_items[i].key));
+	}
+
+	return(changes);
+}
+
+/***********************************************************
+ *  ResetState()
+ *
+ *  This method is used for marking every state as unknown.
+ ***********************************************************/
+void RenderQueue::ResetState(BOUND_STATE& state)
+{
+	state.permutation = -1;
+	state.mesh = -1;
+}
+
+/***********************************************************
+ *  ApplyState()
+ *
+ *  This method is used for building the STATE_CHANGE bits
+ *  of the fields of a key that differ from the bound state,
+ *  and for updating the bound state.
+ ***********************************************************/
+int RenderQueue::ApplyState(BOUND_STATE& state, uint64_t key)
+{
+	const int permutation = GetPermutation(key);
+	const int mesh = GetMesh(key);
+	int changes = CHANGED_NONE;
+
+	if (permutation != state.permutation)
+	{
+		changes |= CHANGED_PERMUTATION;
+		state.permutation = permutation;
+	}
+	if (mesh != state.mesh)
+	{
+		changes |= CHANGED_MESH;
+		state.mesh = mesh;
+	}
+
+	return(changes);
+}
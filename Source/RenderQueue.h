@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////////
+// renderqueue.h
+// ============
+// per-frame list of draws sorted by packed state keys
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  RenderQueue
+ *
+ *  This class collects the draws of a frame, each with a
+ *  64-bit key that packs the render state it needs, from
+ *  the most expensive state change in the high bits to the
+ *  view depth in the low bits.  The keys are radix sorted
+ *  so draws that share state are replayed next to each
+ *  other, and the replay reports which states really
+ *  changed so redundant binds can be skipped.
+ *
+ *  Key layout, from the most significant used bit:
+ *    pass 4 | permutation 11 | mesh 8 | depth 20
+ *
+ *  The textures and materials are selected per instance
+ *  from the texture arrays and the material table, so they
+ *  are not part of the draw state.
+ ***********************************************************/
+class RenderQueue
+{
+public:
+	// constructor
+	RenderQueue();
+	// destructor
+	~RenderQueue();
+
+	// the passes are drawn in this order, the depth pass only
+	// lays down the depth of the opaque draws
+	enum PASS
+	{
+		PASS_DEPTH = 0,
+		PASS_OPAQUE,
+		PASS_TRANSPARENT,
+		PASS_COUNT
+	};
+
+	// the states that are tracked while replaying the queue
+	enum STATE_CHANGE
+	{
+		CHANGED_NONE = 0,
+		CHANGED_PERMUTATION = 1,
+		CHANGED_MESH = 2
+	};
+
+	// counters for the last replayed frame
+	struct STATS
+	{
+		// number of draws submitted
+		int draws;
+		// state changes needed in submission order
+		int unsortedStateChanges;
+		// state changes needed in sorted order
+		int sortedStateChanges;
+		// binds skipped because the state was already set
+		int bindsSkipped;
+	};
+
+	// pack the draw state into a sort key
+	static uint64_t MakeKey(
+		PASS pass,
+		int permutation,
+		int mesh,
+		float viewDepth);
+
+	// unpack the state values of a key
+	static PASS GetPass(uint64_t key);
+	static int GetPermutation(uint64_t key);
+	static int GetMesh(uint64_t key);
+
+	// remove all the draws
+	void Clear();
+	// add a draw, the command is returned by GetCommand()
+	void Submit(uint64_t key, uint32_t command);
+	// sort the draws by key and reset the replay state
+	void Sort();
+
+	// number of draws in the queue
+	int GetCount() const { return((int)m_items.size()); }
+	// key and command of a sorted draw
+	uint64_t GetKey(int index) const { return(m_items[index].key); }
+	uint32_t GetCommand(int index) const { return(m_items[index].command); }
+
+	// compare the state of a draw with the previous draw and
+	// return the STATE_CHANGE bits the caller has to apply
+	int BeginDraw(int index);
+
+	// counters for the last sorted frame
+	const STATS& GetStats() const { return(m_stats); }
+
+private:
+	// a draw and its sort key
+	struct ITEM
+	{
+		uint64_t key;
+		uint32_t command;
+	};
+
+	// the state values that are currently bound
+	struct BOUND_STATE
+	{
+		int permutation;
+		int mesh;
+	};
+
+	std::vector<ITEM> m_items;
+	// scratch buffer for the radix sort passes
+	std::vector<ITEM> m_sortBuffer;
+	// state left by the previously replayed draw
+	BOUND_STATE m_boundState;
+	STATS m_stats;
+
+	// count the state changes needed to walk the draws in order
+	int CountStateChanges() const;
+	// forget the bound state so the next draw sets everything
+	static void ResetState(BOUND_STATE& state);
+	// update the bound state for a key and return the changes
+	static int ApplyState(BOUND_STATE& state, uint64_t key);
+};
@@ -9,21 +9,42 @@
 
 #include "SceneManager.h"
 
-#ifndef STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-#endif
-
 #include <glm/gtx/transform.hpp>
 
+#include <algorithm>
+
 // declaration of global variables
 namespace
 {
-	const char* g_ModelName = "model";
-	const char* g_ColorValueName = "objectColor";
-	const char* g_TextureValueName = "objectTexture";
-	const char* g_UseTextureName = "bUseTexture";
-	const char* g_UseLightingName = "bUseLighting";
+	// uniforms set by the scene, resolved at compile time
+	constexpr UniformId g_TextureArraysUniform = UniformCache::MakeId("textureArrays[]");
+	constexpr UniformId g_UseLightingUniform = UniformCache::MakeId("bUseLighting");
+	constexpr UniformId g_MaterialTableUniform = UniformCache::MakeId("materialTable");
+	constexpr UniformId g_ClusterTableUniform = UniformCache::MakeId("clusterTable");
+	constexpr UniformId g_ClusterLightIndicesUniform = UniformCache::MakeId("clusterLightIndices");
+	constexpr UniformId g_ClusterLightsUniform = UniformCache::MakeId("clusterLights");
+	constexpr UniformId g_GBufferAlbedoUniform = UniformCache::MakeId("gBufferAlbedo");
+	constexpr UniformId g_GBufferNormalUniform = UniformCache::MakeId("gBufferNormal");
+	constexpr UniformId g_GBufferDepthUniform = UniformCache::MakeId("gBufferDepth");
+	constexpr UniformId g_ShadowMapsUniform = UniformCache::MakeId("shadowMaps");
+
+	// render queue commands with this bit set draw a static batch,
+	// the other commands draw an instance batch
+	const uint32_t g_StaticBatchCommand = 0x80000000u;
+
+	// culling result of a draw list object
+	const uint8_t g_ObjectCulled = 0;
+	const uint8_t g_ObjectVisible = 1;
+	const uint8_t g_ObjectOccluded = 2;
+
+	// tessellation level the curved dynamic casters are drawn
+	// into the shadow maps with
+	const int g_ShadowCasterLOD = 1;
+	// start of the coffee cup, and the radius and angle per
+	// frame of the circle it is moved around when asked
+	const glm::vec3 g_CupPosition(-8.7f, 0.0f, -4.6f);
+	const float g_CupPathRadius = 1.0f;
+	const float g_CupPathStep = 0.03f;
 }
 
 /***********************************************************
@@ -31,17 +52,51 @@ namespace
  *
  *  The constructor for the class
  ***********************************************************/
-SceneManager::SceneManager(ShaderManager *pShaderManager)
+SceneManager::SceneManager(ShaderManager *pShaderManager, UniformCache* pUniformCache, UniformBuffers* pUniformBuffers)
 {
 	m_pShaderManager = pShaderManager;
-	m_basicMeshes = new ShapeMeshes();
-	// initialize the texture collection
-	for (int i = 0; i < 16; i++)
-{
-	m_textureIDs[i].tag = "/0";
-	m_textureIDs[i].ID = -1;
-}
-	m_loadedTextures = 0;
+	m_pUniformCache = pUniformCache;
+	m_pUniformBuffers = pUniformBuffers;
+	m_basicMeshes = new InstancedMeshes();
+	m_bInstancesDirty = true;
+	m_bStaticBatchesDirty = false;
+	m_viewPosition = glm::vec3(0.0f, 0.0f, 0.0f);
+	m_viewScale = 1.0f;
+	m_bPerspective = true;
+	m_visibleObjectCount = 0;
+	for (int meshID = 0; meshID < DrawList::MESH_COUNT; meshID++)
+	{
+		m_meshCenters[meshID] = glm::vec3(0.0f);
+		m_meshRadii[meshID] = 0.0f;
+	}
+	for (int lod = 0; lod < InstancedMeshes::LOD_COUNT; lod++)
+	{
+		m_lodObjectCounts[lod] = 0;
+	}
+	m_bOcclusionCulling = true;
+	m_bShowOccluded = false;
+	m_occludedObjectCount = 0;
+	m_occludedScreenArea = 0.0f;
+	m_viewProjection = glm::mat4(1.0f);
+	m_bAllowGPUCulling = true;
+	m_bGPUCulling = false;
+	m_bIndirectDirty = false;
+	m_bShaderPermutations = true;
+	m_bUseLighting = false;
+	m_lightPermutation = 0;
+	m_scatteredLightCount = 0;
+	m_bDeferredShading = false;
+	m_scenePermutation = 0;
+	m_scatteredObjectCount = 0;
+	m_bDepthPrepass = false;
+	m_bDepthPrepassFrame = false;
+	m_bMeasureOverdraw = false;
+	m_bShadows = true;
+	m_bShadowCache = true;
+	m_bShadowCastersDirty = true;
+	m_cupNode = -1;
+	m_bMoveCup = false;
+	m_cupFrame = 0;
 }
 
 /***********************************************************
@@ -53,415 +108,1401 @@ SceneManager::~SceneManager()
 {
 	// free the allocated objects
 	m_pShaderManager = NULL;
+	m_pUniformCache = NULL;
+	m_pUniformBuffers = NULL;
 	if (NULL != m_basicMeshes)
 	{
 		delete m_basicMeshes;
 		m_basicMeshes = NULL;
 	}
-
-	// free the allocated OpenGL textures
-	DestroyGLTextures();
 }
 /***********************************************************
  *  CreateGLTexture()
  *
- *  This method is used for loading textures from image files,
- *  configuring the texture mapping parameters in OpenGL,
- *  generating the mipmaps, and loading the read texture into
- *  the next available texture slot in memory.
+ *  This method is used for reserving the next free layer of
+ *  the texture array for the size of an image file.  The
+ *  image is decoded in the background and shows a
+ *  placeholder until it is resident.
  ***********************************************************/
 bool SceneManager::CreateGLTexture(const char* filename, std::string tag)
 {
-	int width = 0;
-	int height = 0;
-	int colorChannels = 0;
-	GLuint textureID = 0;
-
-	// indicate to always flip images vertically when loaded
-	stbi_set_flip_vertically_on_load(true);
-
-	// try to parse the image data from the specified image file
-	unsigned char* image = stbi_load(
-		filename,
-		&width,
-		&height,
-		&colorChannels,
-		0);
-
-	// if the image was successfully read from the image file
-	if (image)
-	{
-		std::cout << "Successfully loaded image:" << filename << ", width:" << width << ", height:" << height << ", channels:" << colorChannels << std::endl;
-
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-
-		// set the texture wrapping parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		// set texture filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		// if the loaded image is in RGB format
-		if (colorChannels == 3)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-		// if the loaded image is in RGBA format - it supports transparency
-		else if (colorChannels == 4)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-		else
-		{
-			std::cout << "Not implemented to handle image with " << colorChannels << " channels" << std::endl;
-			return false;
-		}
+	return(m_textures.LoadTexture(filename, tag) != TextureManager::INVALID_TEXTURE);
+}
+
+/***********************************************************
+ *  BindGLTextures()
+ *
+ *  This method is used for creating the texture arrays and
+ *  binding each one to its own texture unit.  The
+ *  bindings never change while rendering, so the shader
+ *  sampler of each array is set only once.
+ ***********************************************************/
+void SceneManager::BindGLTextures()
+{
+	m_textures.Upload();
 
-		// generate the texture mipmaps for mapping textures to lower resolutions
-		glGenerateMipmap(GL_TEXTURE_2D);
+	for (int i = 0; i < TextureManager::MAX_TEXTURE_ARRAYS; i++)
+	{
+		m_pUniformCache->SetInt(g_TextureArraysUniform, TextureManager::FIRST_TEXTURE_UNIT + i, i);
+		m_shaderPermutations.SetConstantInt(g_TextureArraysUniform, TextureManager::FIRST_TEXTURE_UNIT + i, i);
+	}
+}
 
-		// free the image data from local memory
-		stbi_image_free(image);
-		glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+//Method to set the texturs into the scence
+void SceneManager::LoadSceneTextures()
+{
+
+	{
+		bool bReturn = false;
+
+		bReturn = CreateGLTexture("textures/Desk texture.jpg", "DeskTexture");
+		bReturn = CreateGLTexture("textures/BlackBezzle.jpg", "BlackBezzle");
+		bReturn = CreateGLTexture("textures/Steel.jpg", "Steel");
+		bReturn = CreateGLTexture("textures/coffeecuptexture.jpg", "CupTexture");
 
-		// register the loaded texture and associate it with the special tag string
-		m_textureIDs[m_loadedTextures].ID = textureID;
-		m_textureIDs[m_loadedTextures].tag = tag;
-		m_loadedTextures++;
 
-		return true;
 	}
 
-	std::cout << "Could not load image:" << filename << std::endl;
 
-	// Error loading the image
-	return false;
+	// after the texture image data is loaded into memory, the
+	// loaded textures are packed into texture arrays, each one
+	// bound to its own texture unit
+	BindGLTextures();
+}
+
+//Creating the material for the light to reflect
+
+void SceneManager::DefineObjectMaterials()
+{
+	// each definition returns the handle that the draw list
+	// objects store in place of the tag
+	MaterialRegistry::MATERIAL goldMaterial;
+	goldMaterial.diffuseColor = glm::vec3(0.4f, 0.4f, 0.4f);
+	goldMaterial.specularColor = glm::vec3(0.7f, 0.7f, 0.6f);
+	goldMaterial.shininess = 60.0;
+
+	m_materials.Define("metal", goldMaterial);
+
+	MaterialRegistry::MATERIAL woodMaterial;
+	woodMaterial.diffuseColor = glm::vec3(0.2f, 0.2f, 0.3f);
+	woodMaterial.specularColor = glm::vec3(0.0f, 0.0f, 0.0f);
+	woodMaterial.shininess = 0.1;
+
+	m_materials.Define("wood", woodMaterial);
+
+	MaterialRegistry::MATERIAL glassMaterial;
+	glassMaterial.diffuseColor = glm::vec3(0.7f, 0.7f, 0.7f);
+	glassMaterial.specularColor = glm::vec3(1.0f, 1.0f, 1.0f);
+	glassMaterial.shininess = 90.0;
+
+	m_materials.Define("glass", glassMaterial);
+
+	// the material table is uploaded once, the shader fetches
+	// each material from it by handle
+	m_materials.Upload();
+	m_pUniformCache->SetInt(g_MaterialTableUniform, MaterialRegistry::TEXTURE_UNIT);
+	m_shaderPermutations.SetConstantInt(g_MaterialTableUniform, MaterialRegistry::TEXTURE_UNIT);
+
+}
+
+//setting up the lights for the scene
+void SceneManager::SetupSceneLights()
+{
+	// Enable custom lighting
+	m_bUseLighting = true;
+	m_pUniformCache->SetBool(g_UseLightingUniform, m_bUseLighting);
+
+	// Directional light 
+	UniformBuffers::DIRECTIONAL_LIGHT directionalLight;
+	directionalLight.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+	directionalLight.ambient = glm::vec3(0.1f, 0.1f, 0.1f);
+	directionalLight.diffuse = glm::vec3(0.4f, 0.4f, 0.4f);
+	directionalLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+	directionalLight.bActive = true;
+	m_pUniformBuffers->SetDirectionalLight(directionalLight);
+
+	// the three point lights only differ by position
+	UniformBuffers::POINT_LIGHT pointLight;
+	pointLight.ambient = glm::vec3(0.1f, 0.1f, 0.1f);
+	pointLight.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+	pointLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+	pointLight.bActive = true;
+
+	// Point light 1 
+	pointLight.position = glm::vec3(0.0f, 55.0f, 0.0f);
+	m_pUniformBuffers->SetPointLight(0, pointLight);
+
+	// Point light 2
+	pointLight.position = glm::vec3(-15.0f, 55.0f, 0.0f);
+	m_pUniformBuffers->SetPointLight(1, pointLight);
+
+	// Point light 3 
+	pointLight.position = glm::vec3(0.0f, 55.0f, -5.0f);
+	m_pUniformBuffers->SetPointLight(2, pointLight);
+
+	// the whole light table is uploaded with one call
+	m_pUniformBuffers->UploadLights();
+
+	// the cluster tables stay bound to their own texture units
+	m_pUniformCache->SetInt(g_ClusterTableUniform, LightClusters::CLUSTER_TABLE_UNIT);
+	m_pUniformCache->SetInt(g_ClusterLightIndicesUniform, LightClusters::LIGHT_INDEX_UNIT);
+	m_pUniformCache->SetInt(g_ClusterLightsUniform, LightClusters::LIGHT_TABLE_UNIT);
+	m_shaderPermutations.SetConstantInt(g_ClusterTableUniform, LightClusters::CLUSTER_TABLE_UNIT);
+	m_shaderPermutations.SetConstantInt(g_ClusterLightIndicesUniform, LightClusters::LIGHT_INDEX_UNIT);
+	m_shaderPermutations.SetConstantInt(g_ClusterLightsUniform, LightClusters::LIGHT_TABLE_UNIT);
+	// and so do the shadow maps, once they are drawn
+	m_pUniformCache->SetInt(g_ShadowMapsUniform, ShadowMaps::SHADOW_UNIT);
+	m_shaderPermutations.SetConstantInt(g_ShadowMapsUniform, ShadowMaps::SHADOW_UNIT);
+
+	// small lights scattered in rows over the desk, each with
+	// its own color, the golden angle spreads the hues apart
+	const int columns = (int)ceilf(sqrtf(m_scatteredLightCount * 2.0f));
+	const int rows = (columns > 0) ? (m_scatteredLightCount + columns - 1) / columns : 0;
+	for (int i = 0; i < m_scatteredLightCount; i++)
+	{
+		const float x = -28.0f + 56.0f * ((i % columns) + 0.5f) / columns;
+		const float z = -13.0f + 26.0f * ((i / columns) + 0.5f) / rows;
+		const float hue = i * 2.39996f;
+		glm::vec3 color(
+			0.5f + 0.5f * cosf(hue),
+			0.5f + 0.5f * cosf(hue - 2.09440f),
+			0.5f + 0.5f * cosf(hue + 2.09440f));
+		AddClusteredLight(glm::vec3(x, 0.6f, z), color * 3.0f, 3.0f);
+	}
 }
 
 /***********************************************************
- *  BindGLTextures()
+ *  AddClusteredLight()
  *
- *  This method is used for binding the loaded textures to
- *  OpenGL texture memory slots.  There are up to 16 slots.
+ *  This method is used for adding a small point light.  It
+ *  only lights the fragments closer than its radius, so
+ *  the scene can hold hundreds of them.
  ***********************************************************/
-void SceneManager::BindGLTextures()
+int SceneManager::AddClusteredLight(glm::vec3 position, glm::vec3 color, float radius)
+{
+	LightClusters::POINT_LIGHT light;
+	light.position = position;
+	light.radius = radius;
+	light.color = color;
+
+	return(m_lightClusters.AddLight(light));
+}
+
+/***********************************************************
+ *  AddTexturedObject()
+ *
+ *  This method is used for compiling a textured object into
+ *  the draw list.  The transformation values are stored once
+ *  in a transform node, and the texture slot and material
+ *  index are resolved here so that no string lookups are
+ *  needed when the scene is rendered.
+ ***********************************************************/
+int SceneManager::AddTexturedObject(
+	DrawList::MeshID mesh,
+	glm::vec3 scaleXYZ,
+	float XrotationDegrees,
+	float YrotationDegrees,
+	float ZrotationDegrees,
+	glm::vec3 positionXYZ,
+	std::string textureTag,
+	std::string materialTag,
+	glm::vec2 uvScale,
+	int parentNode)
+{
+	int node = m_transformGraph.CreateNode(
+		parentNode,
+		scaleXYZ,
+		XrotationDegrees,
+		YrotationDegrees,
+		ZrotationDegrees,
+		positionXYZ);
+
+	// the model matrix is filled in by the next transform update
+	int object = m_drawList.AddObject(
+		mesh,
+		glm::mat4(1.0f),
+		m_textures.Find(textureTag),
+		glm::vec4(1.0f),
+		m_materials.Find(materialTag),
+		uvScale);
+
+	m_nodeObjects.resize(m_transformGraph.GetNodeCount(), -1);
+	m_nodeObjects[node] = object;
+
+	return(node);
+}
+
+/***********************************************************
+ *  AddColoredObject()
+ *
+ *  This method is used for compiling a solid colored object
+ *  into the draw list.
+ ***********************************************************/
+int SceneManager::AddColoredObject(
+	DrawList::MeshID mesh,
+	glm::vec3 scaleXYZ,
+	float XrotationDegrees,
+	float YrotationDegrees,
+	float ZrotationDegrees,
+	glm::vec3 positionXYZ,
+	glm::vec4 color,
+	std::string materialTag,
+	int parentNode)
+{
+	int node = m_transformGraph.CreateNode(
+		parentNode,
+		scaleXYZ,
+		XrotationDegrees,
+		YrotationDegrees,
+		ZrotationDegrees,
+		positionXYZ);
+
+	// the model matrix is filled in by the next transform update
+	int object = m_drawList.AddObject(
+		mesh,
+		glm::mat4(1.0f),
+		-1,
+		color,
+		m_materials.Find(materialTag),
+		glm::vec2(1.0f, 1.0f));
+
+	m_nodeObjects.resize(m_transformGraph.GetNodeCount(), -1);
+	m_nodeObjects[node] = object;
+
+	return(node);
+}
+
+/***********************************************************
+ *  CreateGroupNode()
+ *
+ *  This method is used for creating a transform node that
+ *  is not drawn itself, but that composite objects can be
+ *  attached to so they are all moved together.
+ ***********************************************************/
+int SceneManager::CreateGroupNode(glm::vec3 positionXYZ, int parentNode)
 {
-	for (int i = 0; i < m_loadedTextures; i++)
+	int node = m_transformGraph.CreateNode(
+		parentNode,
+		glm::vec3(1.0f, 1.0f, 1.0f),
+		0.0f, 0.0f, 0.0f,
+		positionXYZ);
+
+	m_nodeObjects.resize(m_transformGraph.GetNodeCount(), -1);
+
+	return(node);
+}
+
+/***********************************************************
+ *  CollectNodeObjects()
+ *
+ *  This method is used for getting the draw list objects of
+ *  a node and of all the nodes below it.  A parent is always
+ *  created before its children, so one pass in creation
+ *  order finds every descendant.
+ ***********************************************************/
+void SceneManager::CollectNodeObjects(int node, std::vector<int>& objects)
+{
+	const int nodeCount = m_transformGraph.GetNodeCount();
+	std::vector<uint8_t> bInSubtree(nodeCount, 0);
+
+	objects.clear();
+	if ((node < 0) || (node >= nodeCount))
+	{
+		return;
+	}
+
+	bInSubtree[node] = 1;
+	for (int i = node; i < nodeCount; i++)
 	{
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, m_textureIDs[i].ID);
+		const int parent = m_transformGraph.GetParentNode(i);
+		if ((i != node) && (parent >= 0) && (bInSubtree[parent] != 0))
+		{
+			bInSubtree[i] = 1;
+		}
+
+		if ((bInSubtree[i] != 0) && (m_nodeObjects[i] >= 0))
+		{
+			objects.push_back(m_nodeObjects[i]);
+		}
 	}
 }
 
 /***********************************************************
- *  DestroyGLTextures()
+ *  SetStaticNode()
  *
- *  This method is used for freeing the memory in all the
- *  used texture memory slots.
+ *  This method is used for flagging the object of a node,
+ *  and the objects of all the nodes below it, as static.
+ *  Static objects are merged into a few pre-transformed
+ *  buffers when the scene is compiled.
  ***********************************************************/
-void SceneManager::DestroyGLTextures()
+void SceneManager::SetStaticNode(int node)
 {
-	for (int i = 0; i < m_loadedTextures; i++)
+	std::vector<int> objects;
+	CollectNodeObjects(node, objects);
+
+	for (size_t i = 0; i < objects.size(); i++)
 	{
-		glGenTextures(1, &m_textureIDs[i].ID);
+		m_drawList.SetStatic(objects[i], true);
 	}
 }
 
 /***********************************************************
- *  FindTextureID()
+ *  SetOccluderNode()
  *
- *  This method is used for getting an ID for the previously
- *  loaded texture bitmap associated with the passed in tag.
+ *  This method is used for flagging the object of a node,
+ *  and the objects of all the nodes below it, as occluders.
+ *  Their triangles are drawn into the occlusion buffer each
+ *  frame, so they should be few, large and solid.
  ***********************************************************/
-int SceneManager::FindTextureID(std::string tag)
+void SceneManager::SetOccluderNode(int node)
 {
-	int textureID = -1;
-	int index = 0;
-	bool bFound = false;
+	std::vector<int> objects;
+	CollectNodeObjects(node, objects);
 
-	while ((index < m_loadedTextures) && (bFound == false))
+	for (size_t i = 0; i < objects.size(); i++)
 	{
-		if (m_textureIDs[index].tag.compare(tag) == 0)
+		m_drawList.SetOccluder(objects[i], true);
+	}
+}
+
+/***********************************************************
+ *  UpdateTransforms()
+ *
+ *  This method is used for recalculating the world matrices
+ *  of the changed transform nodes and copying them into the
+ *  draw list.  Objects that have not moved are not touched.
+ ***********************************************************/
+void SceneManager::UpdateTransforms()
+{
+	if (m_transformGraph.UpdateWorldTransforms() == 0)
+	{
+		return;
+	}
+
+	const std::vector<int>& updatedNodes = m_transformGraph.GetUpdatedNodes();
+	for (size_t i = 0; i < updatedNodes.size(); i++)
+	{
+		int object = m_nodeObjects[updatedNodes[i]];
+		if (object >= 0)
 		{
-			textureID = m_textureIDs[index].ID;
-			bFound = true;
+			m_drawList.SetModelMatrix(object, m_transformGraph.GetWorldMatrix(updatedNodes[i]));
+			m_objectBVH.UpdateObject(object, m_transformGraph.GetWorldMatrix(updatedNodes[i]));
+			m_bIndirectDirty = true;
+			// a moved static object is baked into its batch, so
+			// the static batches have to be merged again
+			if (m_drawList.GetStaticFlags()[object] != 0)
+			{
+				m_bStaticBatchesDirty = true;
+			}
+			else
+			{
+				m_bInstancesDirty = true;
+				m_bShadowCastersDirty = true;
+			}
 		}
-		else
-			index++;
 	}
+}
 
-	return(textureID);
+/***********************************************************
+ *  BuildStaticBatches()
+ *
+ *  This method is used for merging the static objects into
+ *  pre-transformed buffers, using their current world
+ *  matrices.  It is called once the transforms have been
+ *  updated, so the world matrices are final.  The shadow
+ *  maps of the static casters are drawn again from them.
+ ***********************************************************/
+void SceneManager::BuildStaticBatches()
+{
+	m_staticBatches.Build(m_drawList, *m_basicMeshes, m_materials.GetMaterialCount());
+	m_bStaticBatchesDirty = false;
+	m_shadowMaps.InvalidateStatic();
 }
 
 /***********************************************************
- *  FindTextureSlot()
+ *  BuildInstanceBatches()
  *
- *  This method is used for getting a slot index for the previously
- *  loaded texture bitmap associated with the passed in tag.
+ *  This method is used for ordering the objects that are not
+ *  static so that all the copies of a mesh are next to each
+ *  other in the instance buffer.  Each instance selects its
+ *  own texture array layer, so the textured copies of a
+ *  mesh become one batch that is drawn with a single
+ *  instanced draw call, whatever their textures are, and
+ *  the solid colored copies another, as the two are drawn
+ *  with different shader permutations.
  ***********************************************************/
-int SceneManager::FindTextureSlot(std::string tag)
+void SceneManager::BuildInstanceBatches()
 {
-	int textureSlot = -1;
-	int index = 0;
-	bool bFound = false;
+	const int objectCount = m_drawList.GetObjectCount();
+	const uint8_t* meshIDs = m_drawList.GetMeshIDs();
+	const int* textureSlots = m_drawList.GetTextureSlots();
+	const uint8_t* staticFlags = m_drawList.GetStaticFlags();
 
-	while ((index < m_loadedTextures) && (bFound == false))
+	m_instanceOrder.clear();
+	m_instanceBatches.clear();
+
+	for (int groupMesh = 0; groupMesh < 2 * DrawList::MESH_COUNT; groupMesh++)
 	{
-		if (m_textureIDs[index].tag.compare(tag) == 0)
+		const int mesh = groupMesh / 2;
+		INSTANCE_BATCH batch;
+		batch.meshID = (uint8_t)mesh;
+		batch.bTextured = ((groupMesh % 2) != 0);
+		batch.firstInstance = (int)m_instanceOrder.size();
+		batch.instanceCount = 0;
+		batch.visibleCount = 0;
+		batch.occludedCount = 0;
+		for (int lod = 0; lod < InstancedMeshes::LOD_COUNT; lod++)
 		{
-			textureSlot = index;
-			bFound = true;
+			batch.lodCounts[lod] = 0;
+		}
+
+		for (int i = 0; i < objectCount; i++)
+		{
+			if ((meshIDs[i] == mesh) && (staticFlags[i] == 0) && ((textureSlots[i] >= 0) == batch.bTextured))
+			{
+				m_instanceOrder.push_back(i);
+				batch.instanceCount++;
+			}
+		}
+
+		// the copies of each texture follow each other
+		std::stable_sort(
+			m_instanceOrder.begin() + batch.firstInstance,
+			m_instanceOrder.end(),
+			[textureSlots](int a, int b) { return(textureSlots[a] < textureSlots[b]); });
+
+		if (batch.instanceCount > 0)
+		{
+			m_instanceBatches.push_back(batch);
 		}
-		else
-			index++;
 	}
 
-	return(textureSlot);
+	m_basicMeshes->ReserveInstances((int)m_instanceOrder.size());
+	m_bInstancesDirty = true;
 }
 
 /***********************************************************
- *  FindMaterial()
+ *  UpdateInstanceData()
  *
- *  This method is used for getting a material from the previously
- *  defined materials list that is associated with the passed in tag.
+ *  This method is used for writing the draw list columns
+ *  of the visible objects in batch order straight into the
+ *  next region of the instance stream.  It is skipped when
+ *  no object has moved and the visible objects and their
+ *  levels are the same as at the last write, and the draws
+ *  keep reading the region written then.
  ***********************************************************/
-bool SceneManager::FindMaterial(std::string tag, OBJECT_MATERIAL& material)
+void SceneManager::UpdateInstanceData()
 {
-	if (m_objectMaterials.size() == 0)
+	if (m_bInstancesDirty == false)
 	{
-		return(false);
+		return;
 	}
 
-	int index = 0;
-	bool bFound = false;
-	while ((index < m_objectMaterials.size()) && (bFound == false))
+	const glm::mat4* modelMatrices = m_drawList.GetModelMatrices();
+	const int* textureSlots = m_drawList.GetTextureSlots();
+	const glm::vec4* colors = m_drawList.GetColors();
+	const int* materialIDs = m_drawList.GetMaterialIDs();
+	const glm::vec2* uvScales = m_drawList.GetUVScales();
+	const int materialCount = m_materials.GetMaterialCount();
+
+	const int instanceCount = (int)m_instanceOrder.size();
+	InstancedMeshes::INSTANCE_DATA* instances = m_basicMeshes->BeginInstances(instanceCount);
+	if (NULL == instances)
 	{
-		if (m_objectMaterials[index].tag.compare(tag) == 0)
+		return;
+	}
+
+	// the culled instances are left out, so the visible ones
+	// of each batch are packed from its first instance on, one
+	// pass per level, followed by the occluded ones for the
+	// debug view
+	const int passCount = InstancedMeshes::LOD_COUNT + (m_bShowOccluded ? 1 : 0);
+	for (size_t b = 0; b < m_instanceBatches.size(); b++)
+	{
+		INSTANCE_BATCH& batch = m_instanceBatches[b];
+		int written = batch.firstInstance;
+
+		for (int pass = 0; pass < passCount; pass++)
 		{
-			bFound = true;
-			material.diffuseColor = m_objectMaterials[index].diffuseColor;
-			material.specularColor = m_objectMaterials[index].specularColor;
-			material.shininess = m_objectMaterials[index].shininess;
+			const bool bOccludedPass = (pass == InstancedMeshes::LOD_COUNT);
+			const int passFirst = written;
+
+			for (int i = batch.firstInstance; i < batch.firstInstance + batch.instanceCount; i++)
+			{
+				const int object = m_instanceOrder[i];
+				if (bOccludedPass ? (m_visibleFlags[object] != g_ObjectOccluded) :
+					((m_visibleFlags[object] != g_ObjectVisible) || (m_objectLODs[object] != pass)))
+				{
+					continue;
+				}
+				InstancedMeshes::INSTANCE_DATA& instance = instances[written++];
+
+				instance.model = modelMatrices[object];
+				instance.color = colors[object];
+				instance.uvScale = uvScales[object];
+				instance.textureSlot = textureSlots[object];
+				instance.materialIndex = (materialIDs[object] < materialCount) ? materialIDs[object] : -1;
+			}
+
+			if (bOccludedPass == false)
+			{
+				batch.lodCounts[pass] = written - passFirst;
+				batch.visibleCount = written - batch.firstInstance;
+			}
 		}
-		else
+
+		batch.occludedCount = written - batch.firstInstance - batch.visibleCount;
+	}
+
+	m_basicMeshes->EndInstances(instanceCount);
+	m_bInstancesDirty = false;
+}
+
+/***********************************************************
+ *  BuildObjectBVH()
+ *
+ *  This method is used for finding the bounds of each basic
+ *  mesh from its vertices and building the hierarchy of the
+ *  world bounds of all the draw list objects.  Every object
+ *  starts out visible, until the first frame is culled, and
+ *  at the coarsest level of its mesh.  The vertices of all
+ *  the levels of a curved mesh lie on the same surface, so
+ *  the bounds of the finest level hold every level.
+ ***********************************************************/
+void SceneManager::BuildObjectBVH()
+{
+	ObjectBVH::AABB meshBounds[DrawList::MESH_COUNT];
+
+	for (int meshID = 0; meshID < DrawList::MESH_COUNT; meshID++)
+	{
+		const InstancedMeshes::GLMESH* mesh = FindMesh((uint8_t)meshID);
+		const int stride = InstancedMeshes::FLOATS_PER_VERTEX;
+
+		meshBounds[meshID].min = glm::vec3(0.0f);
+		meshBounds[meshID].max = glm::vec3(0.0f);
+		for (size_t v = 0; (mesh != NULL) && (v < mesh->vertices.size() / stride); v++)
 		{
-			index++;
+			glm::vec3 position(mesh->vertices[v * stride], mesh->vertices[v * stride + 1], mesh->vertices[v * stride + 2]);
+			meshBounds[meshID].min = (v == 0) ? position : glm::min(meshBounds[meshID].min, position);
+			meshBounds[meshID].max = (v == 0) ? position : glm::max(meshBounds[meshID].max, position);
+		}
+
+		// the sphere used to size the objects on screen
+		m_meshCenters[meshID] = (meshBounds[meshID].min + meshBounds[meshID].max) * 0.5f;
+		m_meshRadii[meshID] = 0.0f;
+		for (size_t v = 0; (mesh != NULL) && (v < mesh->vertices.size() / stride); v++)
+		{
+			glm::vec3 position(mesh->vertices[v * stride], mesh->vertices[v * stride + 1], mesh->vertices[v * stride + 2]);
+			m_meshRadii[meshID] = glm::max(m_meshRadii[meshID], glm::length(position - m_meshCenters[meshID]));
 		}
 	}
 
-	return(true);
+	const int objectCount = m_drawList.GetObjectCount();
+	m_objectBVH.Build(m_drawList.GetMeshIDs(), m_drawList.GetModelMatrices(), objectCount,
+		meshBounds, DrawList::MESH_COUNT);
+	m_visibleFlags.assign(objectCount, g_ObjectVisible);
+	m_previousVisibleFlags.assign(objectCount, g_ObjectVisible);
+	m_visibleObjectCount = objectCount;
+
+	const uint8_t* meshIDs = m_drawList.GetMeshIDs();
+	m_objectLODs.resize(objectCount);
+	for (int i = 0; i < objectCount; i++)
+	{
+		const bool bLevels = (FindMesh(meshIDs[i], 1) != FindMesh(meshIDs[i], 0));
+		m_objectLODs[i] = (uint8_t)(bLevels ? InstancedMeshes::LOD_COUNT - 1 : 0);
+	}
+	m_occludedObjectCount = 0;
+	m_occludedScreenArea = 0.0f;
 }
 
 /***********************************************************
- *  SetTransformations()
+ *  CullObjects()
  *
- *  This method is used for setting the transform buffer
- *  using the passed in transformation values.
+ *  This method is used for flagging the objects whose world
+ *  bounds intersect the view frustum, and then the ones of
+ *  them hidden by the occluders, and for picking the level
+ *  of the visible ones.  The instance data is only written
+ *  again when the set of visible objects or their levels
+ *  have changed since the last frame.
  ***********************************************************/
-void SceneManager::SetTransformations(
-	glm::vec3 scaleXYZ,
-	float XrotationDegrees,
-	float YrotationDegrees,
-	float ZrotationDegrees,
-	glm::vec3 positionXYZ)
+void SceneManager::CullObjects()
 {
-	// variables for this method
-	glm::mat4 modelView;
-	glm::mat4 scale;
-	glm::mat4 rotationX;
-	glm::mat4 rotationY;
-	glm::mat4 rotationZ;
-	glm::mat4 translation;
-
-	// set the scale value in the transform buffer
-	scale = glm::scale(scaleXYZ);
-	// set the rotation values in the transform buffer
-	rotationX = glm::rotate(glm::radians(XrotationDegrees), glm::vec3(1.0f, 0.0f, 0.0f));
-	rotationY = glm::rotate(glm::radians(YrotationDegrees), glm::vec3(0.0f, 1.0f, 0.0f));
-	rotationZ = glm::rotate(glm::radians(ZrotationDegrees), glm::vec3(0.0f, 0.0f, 1.0f));
-	// set the translation value in the transform buffer
-	translation = glm::translate(positionXYZ);
+	std::swap(m_visibleFlags, m_previousVisibleFlags);
+	m_visibleObjectCount = m_objectBVH.Cull(m_viewProjection, m_visibleFlags.data());
+	m_occludedObjectCount = 0;
+	m_occludedScreenArea = 0.0f;
 
-	modelView = translation * rotationZ * rotationY * rotationX * scale;
+	if (m_bOcclusionCulling == true)
+	{
+		RasterizeOccluders(m_visibleFlags.data());
+		CullOccludedObjects();
+	}
+	SelectObjectLODs();
 
-	if (NULL != m_pShaderManager)
+	if (m_visibleFlags != m_previousVisibleFlags)
 	{
-		m_pShaderManager->setMat4Value(g_ModelName, modelView);
+		m_bInstancesDirty = true;
 	}
 }
 
 /***********************************************************
- *  SetShaderColor()
+ *  RasterizeOccluders()
  *
- *  This method is used for setting the passed in color
- *  into the shader for the next draw command
+ *  This method is used for drawing the triangles of the
+ *  occluders into the occlusion buffer from the current
+ *  view, and reducing it into the depth pyramid.
  ***********************************************************/
-void SceneManager::SetShaderColor(
-	float redColorValue,
-	float greenColorValue,
-	float blueColorValue,
-	float alphaValue)
+void SceneManager::RasterizeOccluders(const uint8_t* visibleFlags)
 {
-	// variables for this method
-	glm::vec4 currentColor;
+	const int objectCount = m_drawList.GetObjectCount();
+	const uint8_t* meshIDs = m_drawList.GetMeshIDs();
+	const glm::mat4* modelMatrices = m_drawList.GetModelMatrices();
+	const uint8_t* occluderFlags = m_drawList.GetOccluderFlags();
+
+	m_occlusionBuffer.Begin(m_viewProjection);
+	for (int i = 0; i < objectCount; i++)
+	{
+		if ((occluderFlags[i] == 0) || ((visibleFlags != NULL) && (visibleFlags[i] != g_ObjectVisible)))
+		{
+			continue;
+		}
 
-	currentColor.r = redColorValue;
-	currentColor.g = greenColorValue;
-	currentColor.b = blueColorValue;
-	currentColor.a = alphaValue;
+		const InstancedMeshes::GLMESH* mesh = FindMesh(meshIDs[i]);
+		if ((mesh != NULL) && !mesh->indices.empty())
+		{
+			m_occlusionBuffer.RasterizeMesh(mesh->vertices.data(), InstancedMeshes::FLOATS_PER_VERTEX,
+				mesh->indices.data(), (int)mesh->indices.size(), modelMatrices[i]);
+		}
+	}
+	m_occlusionBuffer.BuildPyramid();
+}
+
+/***********************************************************
+ *  CullOccludedObjects()
+ *
+ *  This method is used for testing the bounds of every
+ *  object left by the frustum culling against the depth
+ *  pyramid.  The fraction of the viewport covered by the
+ *  hidden objects estimates the fragment shading avoided.
+ ***********************************************************/
+void SceneManager::CullOccludedObjects()
+{
+	const int objectCount = m_drawList.GetObjectCount();
 
-	if (NULL != m_pShaderManager)
+	for (int i = 0; i < objectCount; i++)
 	{
-		m_pShaderManager->setIntValue(g_UseTextureName, false);
-		m_pShaderManager->setVec4Value(g_ColorValueName, currentColor);
+		if (m_visibleFlags[i] != g_ObjectVisible)
+		{
+			continue;
+		}
+
+		const ObjectBVH::AABB& bounds = m_objectBVH.GetObjectBounds(i);
+		float screenArea = 0.0f;
+		if (m_occlusionBuffer.IsOccluded(bounds.min, bounds.max, &screenArea))
+		{
+			m_visibleFlags[i] = g_ObjectOccluded;
+			m_visibleObjectCount--;
+			m_occludedObjectCount++;
+			m_occludedScreenArea += screenArea;
+		}
 	}
 }
 
 /***********************************************************
- *  SetShaderTexture()
+ *  SelectObjectLODs()
  *
- *  This method is used for setting the texture data
- *  associated with the passed in ID into the shader.
+ *  This method is used for sizing every visible object with
+ *  a curved mesh on screen, as the radius in pixels of the
+ *  sphere around its mesh, and picking the level it is drawn
+ *  with.  The culling shader sizes the objects the same way.
  ***********************************************************/
-void SceneManager::SetShaderTexture(
-	std::string textureTag)
+void SceneManager::SelectObjectLODs()
 {
-	if (NULL != m_pShaderManager)
+	const int objectCount = m_drawList.GetObjectCount();
+	const uint8_t* meshIDs = m_drawList.GetMeshIDs();
+	const glm::mat4* modelMatrices = m_drawList.GetModelMatrices();
+
+	for (int lod = 0; lod < InstancedMeshes::LOD_COUNT; lod++)
+	{
+		m_lodObjectCounts[lod] = 0;
+	}
+
+	for (int i = 0; i < objectCount; i++)
 	{
-		m_pShaderManager->setIntValue(g_UseTextureName, true);
+		const uint8_t meshID = meshIDs[i];
+		if ((m_visibleFlags[i] != g_ObjectVisible) || (FindMesh(meshID, 1) == FindMesh(meshID, 0)))
+		{
+			continue;
+		}
+
+		const glm::mat4& model = modelMatrices[i];
+		float scale = glm::length(glm::vec3(model[0]));
+		scale = glm::max(scale, glm::length(glm::vec3(model[1])));
+		scale = glm::max(scale, glm::length(glm::vec3(model[2])));
 
-		int textureID = -1;
-		textureID = FindTextureSlot(textureTag);
-		m_pShaderManager->setSampler2DValue(g_TextureValueName, textureID);
+		float pixels = m_meshRadii[meshID] * scale * m_viewScale;
+		if (m_bPerspective)
+		{
+			glm::vec3 center = glm::vec3(model * glm::vec4(m_meshCenters[meshID], 1.0f));
+			pixels /= glm::max(glm::length(center - m_viewPosition), 0.1f);
+		}
+
+		const int lod = InstancedMeshes::SelectLOD(pixels, m_objectLODs[i]);
+		if (lod != m_objectLODs[i])
+		{
+			m_objectLODs[i] = (uint8_t)lod;
+			m_bInstancesDirty = true;
+		}
+		m_lodObjectCounts[lod]++;
 	}
 }
 
 /***********************************************************
- *  SetTextureUVScale()
+ *  BuildIndirectScene()
  *
- *  This method is used for setting the texture UV scale
- *  values into the shader.
+ *  This method is used for handing the whole draw list to
+ *  the indirect scene, static objects included, when the
+ *  driver can cull and draw it on the GPU.  The culling
+ *  shader reads the camera block, so it is attached to the
+ *  shared camera buffer.  Otherwise the scene keeps being
+ *  drawn from the static and instanced batches.
  ***********************************************************/
-void SceneManager::SetTextureUVScale(float u, float v)
+void SceneManager::BuildIndirectScene()
 {
-	if (NULL != m_pShaderManager)
+	// the debug view of the occluded objects draws them from
+	// the CPU culling results
+	if ((m_bAllowGPUCulling == false) || (m_bShowOccluded == true) || (IndirectScene::IsSupported() == false))
+	{
+		m_bGPUCulling = false;
+		return;
+	}
+
+	if (m_indirectScene.GetProgram() == 0)
 	{
-		m_pShaderManager->setVec2Value("UVscale", glm::vec2(u, v));
+		if (m_indirectScene.Create("shaders/cullingShader.glsl") == false)
+		{
+			m_bAllowGPUCulling = false;
+			m_bGPUCulling = false;
+			return;
+		}
+		m_pUniformBuffers->BindProgram(m_indirectScene.GetProgram());
 	}
+
+	m_indirectScene.Build(m_drawList, *m_basicMeshes, m_materials.GetMaterialCount());
+	m_bGPUCulling = true;
+	m_bIndirectDirty = false;
 }
 
-//Method to set the texturs into the scence
-void SceneManager::LoadSceneTextures()
+/***********************************************************
+ *  RequestTextureLevels()
+ *
+ *  This method is used for estimating how many pixels one
+ *  repeat of the texture of each object covers on screen.
+ *  The basic meshes span about one unit, so the size of an
+ *  object is the largest scale of its model matrix, and it
+ *  shrinks with the distance from the camera under a
+ *  perspective projection.  Only the visible objects ask
+ *  for a level, so the textures of the culled and occluded
+ *  ones go unused and are evicted.  The CPU path culls
+ *  later in the frame, so its flags of the last frame are
+ *  used.  The GPU culling path keeps the visibility on the
+ *  GPU, so the objects are tested against the view frustum
+ *  here instead, and its occluded objects still ask.
+ ***********************************************************/
+void SceneManager::RequestTextureLevels()
 {
+	const int objectCount = m_drawList.GetObjectCount();
+	const glm::mat4* modelMatrices = m_drawList.GetModelMatrices();
+	const int* textureSlots = m_drawList.GetTextureSlots();
+	const glm::vec2* uvScales = m_drawList.GetUVScales();
 
+	if (m_bGPUCulling == true)
 	{
-		bool bReturn = false;
+		m_objectBVH.Cull(m_viewProjection, m_visibleFlags.data());
+	}
 
-		bReturn = CreateGLTexture("textures/Desk texture.jpg", "DeskTexture");
-		bReturn = CreateGLTexture("textures/BlackBezzle.jpg", "BlackBezzle");
-		bReturn = CreateGLTexture("textures/Steel.jpg", "Steel");
-		bReturn = CreateGLTexture("textures/coffeecuptexture.jpg", "CupTexture");
+	for (int i = 0; i < objectCount; i++)
+	{
+		if ((textureSlots[i] == TextureManager::INVALID_TEXTURE) || (m_visibleFlags[i] != g_ObjectVisible))
+		{
+			continue;
+		}
+
+		const glm::mat4& model = modelMatrices[i];
+		float size = glm::length(glm::vec3(model[0]));
+		size = glm::max(size, glm::length(glm::vec3(model[1])));
+		size = glm::max(size, glm::length(glm::vec3(model[2])));
+
+		float pixels = size * m_viewScale;
+		if (m_bPerspective)
+		{
+			pixels /= glm::max(glm::length(glm::vec3(model[3]) - m_viewPosition), 0.1f);
+		}
 
+		const float repeats = glm::max(glm::max(uvScales[i].x, uvScales[i].y), 0.001f);
+		m_textures.RequestTexture(textureSlots[i], pixels / repeats);
+	}
+}
 
+/***********************************************************
+ *  FindMesh()
+ *
+ *  This method is used for getting the basic mesh that is
+ *  associated with the passed in mesh ID.  The plane and the
+ *  box have a single level, returned for any level.
+ ***********************************************************/
+const InstancedMeshes::GLMESH* SceneManager::FindMesh(uint8_t meshID, int lod)
+{
+	switch (meshID)
+	{
+	case DrawList::MESH_PLANE:
+		return(&m_basicMeshes->GetPlaneMesh());
+	case DrawList::MESH_BOX:
+		return(&m_basicMeshes->GetBoxMesh());
+	case DrawList::MESH_CYLINDER:
+		return(&m_basicMeshes->GetCylinderMesh(lod));
+	case DrawList::MESH_TAPERED_CYLINDER:
+		return(&m_basicMeshes->GetTaperedCylinderMesh(lod));
+	case DrawList::MESH_TORUS:
+		return(&m_basicMeshes->GetTorusMesh(lod));
+	case DrawList::MESH_SPHERE:
+		return(&m_basicMeshes->GetSphereMesh(lod));
+	default:
+		return(NULL);
 	}
+}
 
+/***********************************************************
+ *  SubmitDraws()
+ *
+ *  This method is used for adding one draw for each static
+ *  batch and each instance batch to the render queue.  The
+ *  static batches use mesh IDs after the basic meshes, since
+ *  each one has its own vertex array.  The depth of a static
+ *  batch is the distance from the camera to the center of
+ *  its bounds, and of an instance batch the distance to its
+ *  nearest visible object.  The textures are selected per
+ *  instance from the texture arrays, but the shader
+ *  permutation of a draw depends on whether it is textured.
+ ***********************************************************/
+void SceneManager::SubmitDraws()
+{
+	m_renderQueue.Clear();
 
-	// after the texture image data is loaded into memory, the
-	// loaded textures need to be bound to texture slots - there
-	// are a total of 16 available slots for scene textures
-	BindGLTextures();
+	for (int i = 0; i < m_staticBatches.GetBatchCount(); i++)
+	{
+		if (m_staticBatches.GetFlaggedObjectCount(i, m_visibleFlags.data(), g_ObjectVisible) == 0)
+		{
+			continue;
+		}
+		float distance = glm::length(m_staticBatches.GetCenter(i) - m_viewPosition);
+
+		uint64_t key = RenderQueue::MakeKey(
+			RenderQueue::PASS_OPAQUE,
+			m_scenePermutation | (m_staticBatches.IsTextured(i) ? ShaderPermutations::PERMUTATION_TEXTURED : 0),
+			DrawList::MESH_COUNT + i,
+			distance);
+		m_renderQueue.Submit(key, g_StaticBatchCommand | (uint32_t)i);
+		if (m_bDepthPrepassFrame == true)
+		{
+			key = RenderQueue::MakeKey(
+				RenderQueue::PASS_DEPTH,
+				ShaderPermutations::PERMUTATION_DEPTH_PASS,
+				DrawList::MESH_COUNT + i,
+				distance);
+			m_renderQueue.Submit(key, g_StaticBatchCommand | (uint32_t)i);
+		}
+	}
+
+	// the instance records are in write-combined memory, so
+	// the distances are read from the draw list instead
+	const glm::mat4* modelMatrices = m_drawList.GetModelMatrices();
+
+	for (size_t i = 0; i < m_instanceBatches.size(); i++)
+	{
+		const INSTANCE_BATCH& batch = m_instanceBatches[i];
+		if (batch.visibleCount == 0)
+		{
+			continue;
+		}
+		float distance = -1.0f;
+
+		for (int instance = 0; instance < batch.instanceCount; instance++)
+		{
+			const int object = m_instanceOrder[batch.firstInstance + instance];
+			if (m_visibleFlags[object] != g_ObjectVisible)
+			{
+				continue;
+			}
+			float instanceDistance = glm::length(glm::vec3(modelMatrices[object][3]) - m_viewPosition);
+			if ((distance < 0.0f) || (instanceDistance < distance))
+			{
+				distance = instanceDistance;
+			}
+		}
+
+		uint64_t key = RenderQueue::MakeKey(
+			RenderQueue::PASS_OPAQUE,
+			m_scenePermutation | (batch.bTextured ? ShaderPermutations::PERMUTATION_TEXTURED : 0),
+			batch.meshID,
+			distance);
+		m_renderQueue.Submit(key, (uint32_t)i);
+		if (m_bDepthPrepassFrame == true)
+		{
+			key = RenderQueue::MakeKey(
+				RenderQueue::PASS_DEPTH,
+				ShaderPermutations::PERMUTATION_DEPTH_PASS,
+				batch.meshID,
+				distance);
+			m_renderQueue.Submit(key, (uint32_t)i);
+		}
+	}
 }
 
+/***********************************************************
+ *  ExecuteDraws()
+ *
+ *  This method is used for sorting the render queue and
+ *  drawing it in key order.  The basic meshes share one
+ *  vertex array, so it is only bound again after a static
+ *  batch.  The material is read per instance, so it never
+ *  needs to be bound here, and the shader program is only
+ *  changed when the permutation of the key changes.  The
+ *  depth pass, when there is one, is drawn first.
+ ***********************************************************/
+void SceneManager::ExecuteDraws()
+{
+	m_renderQueue.Sort();
+
+	GLuint boundVertexArray = 0;
+	int pass = -1;
+
+	for (int i = 0; i < m_renderQueue.GetCount(); i++)
+	{
+		const uint32_t command = m_renderQueue.GetCommand(i);
+		if (RenderQueue::GetPass(m_renderQueue.GetKey(i)) != pass)
+		{
+			pass = RenderQueue::GetPass(m_renderQueue.GetKey(i));
+			BeginDrawPass((RenderQueue::PASS)pass);
+		}
+		if ((m_renderQueue.BeginDraw(i) & RenderQueue::CHANGED_PERMUTATION) != 0)
+		{
+			UsePermutation(RenderQueue::GetPermutation(m_renderQueue.GetKey(i)));
+		}
+
+		if ((command & g_StaticBatchCommand) != 0)
+		{
+			const int batch = (int)(command & ~g_StaticBatchCommand);
+			if (boundVertexArray != m_staticBatches.GetVertexArray(batch))
+			{
+				boundVertexArray = m_staticBatches.GetVertexArray(batch);
+				glBindVertexArray(boundVertexArray);
+			}
+			m_staticBatches.DrawBoundBatch(batch, m_visibleFlags.data(), g_ObjectVisible);
+		}
+		else
+		{
+			// the visible instances are packed by level, and each
+			// level is drawn with its own mesh
+			const INSTANCE_BATCH& batch = m_instanceBatches[command];
+			int firstInstance = batch.firstInstance;
+			for (int lod = 0; lod < InstancedMeshes::LOD_COUNT; lod++)
+			{
+				const InstancedMeshes::GLMESH* mesh = FindMesh(batch.meshID, lod);
+				if ((mesh != NULL) && (batch.lodCounts[lod] > 0))
+				{
+					if (boundVertexArray != mesh->vao)
+					{
+						boundVertexArray = mesh->vao;
+						glBindVertexArray(boundVertexArray);
+					}
+					m_basicMeshes->DrawBoundMeshInstanced(*mesh, firstInstance, batch.lodCounts[lod]);
+				}
+				firstInstance += batch.lodCounts[lod];
+			}
+		}
+	}
+
+	glBindVertexArray(0);
+}
 
 /***********************************************************
- *  SetShaderMaterial()
+ *  DrawOccludedObjects()
  *
- *  This method is used for passing the material values
- *  into the shader.
+ *  This method is used for showing which objects the
+ *  occlusion culling left out, by drawing them as wireframes
+ *  over the finished frame with the depth test turned off.
+ *  The general shader draws the textured and the solid
+ *  colored objects alike.
  ***********************************************************/
-void SceneManager::SetShaderMaterial(
-	std::string materialTag)
+void SceneManager::DrawOccludedObjects()
 {
-	if (m_objectMaterials.size() > 0)
+	if (m_occludedObjectCount == 0)
 	{
-		OBJECT_MATERIAL material;
-		bool bReturn = false;
+		return;
+	}
+
+	m_pShaderManager->use();
+
+	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	glDisable(GL_DEPTH_TEST);
 
-		bReturn = FindMaterial(materialTag, material);
-		if (bReturn == true)
+	for (int i = 0; i < m_staticBatches.GetBatchCount(); i++)
+	{
+		if (m_staticBatches.GetFlaggedObjectCount(i, m_visibleFlags.data(), g_ObjectOccluded) > 0)
 		{
-			m_pShaderManager->setVec3Value("material.diffuseColor", material.diffuseColor);
-			m_pShaderManager->setVec3Value("material.specularColor", material.specularColor);
-			m_pShaderManager->setFloatValue("material.shininess", material.shininess);
+			glBindVertexArray(m_staticBatches.GetVertexArray(i));
+			m_staticBatches.DrawBoundBatch(i, m_visibleFlags.data(), g_ObjectOccluded);
 		}
 	}
+
+	for (size_t i = 0; i < m_instanceBatches.size(); i++)
+	{
+		const INSTANCE_BATCH& batch = m_instanceBatches[i];
+		const InstancedMeshes::GLMESH* mesh = FindMesh(batch.meshID);
+		if ((mesh != NULL) && (batch.occludedCount > 0))
+		{
+			glBindVertexArray(mesh->vao);
+			m_basicMeshes->DrawBoundMeshInstanced(*mesh, batch.firstInstance + batch.visibleCount, batch.occludedCount);
+		}
+	}
+
+	glBindVertexArray(0);
+	glEnable(GL_DEPTH_TEST);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 }
 
-//Creating the material for the light to reflect
+/***********************************************************
+ *  UsePermutation()
+ *
+ *  This method is used for making the program of a shader
+ *  permutation current, compiling it on first use.  The
+ *  general program, which decides the same state per
+ *  fragment, is used when permutations are turned off or
+ *  the permutation does not compile.
+ ***********************************************************/
+void SceneManager::UsePermutation(int permutation)
+{
+	if ((m_bShaderPermutations == false) || (m_shaderPermutations.Use(permutation) == false))
+	{
+		m_pShaderManager->use();
+	}
+}
 
-void SceneManager::DefineObjectMaterials()
+/***********************************************************
+ *  BeginScenePass()
+ *
+ *  This method is used for selecting how the draws of the
+ *  frame are shaded.  The deferred shading needs the
+ *  programs of the geometry and lighting passes, which are
+ *  permutations, so the scene is shaded forward when they
+ *  cannot be used, or when the G-buffer cannot be created.
+ *  The depth pre-pass is drawn with a permutation that
+ *  only writes the depth, and is left out when it cannot
+ *  be used.
+ ***********************************************************/
+void SceneManager::BeginScenePass()
 {
-	OBJECT_MATERIAL goldMaterial;
-	goldMaterial.diffuseColor = glm::vec3(0.4f, 0.4f, 0.4f);
-	goldMaterial.specularColor = glm::vec3(0.7f, 0.7f, 0.6f);
-	goldMaterial.shininess = 60.0;
-	goldMaterial.tag = "metal";
+	m_bDepthPrepassFrame = (m_bDepthPrepass == true) && (m_bShaderPermutations == true) &&
+		(m_shaderPermutations.Use(ShaderPermutations::PERMUTATION_DEPTH_PASS) == true);
+	m_scenePermutation = m_lightPermutation;
+	if ((m_bDeferredShading == false) || (m_bShaderPermutations == false))
+	{
+		return;
+	}
 
-	m_objectMaterials.push_back(goldMaterial);
+	const int geometryPermutation = ShaderPermutations::PERMUTATION_GEOMETRY_PASS |
+		(m_bUseLighting ? ShaderPermutations::PERMUTATION_LIGHTING : 0);
+	if ((m_shaderPermutations.Use(geometryPermutation) == false) ||
+		(m_shaderPermutations.Use(ShaderPermutations::PERMUTATION_LIGHTING_PASS | m_lightPermutation) == false) ||
+		(m_deferredRenderer.BeginGeometryPass() == false))
+	{
+		m_bDeferredShading = false;
+		return;
+	}
+	m_scenePermutation = geometryPermutation;
+}
 
-	OBJECT_MATERIAL woodMaterial;
-	woodMaterial.diffuseColor = glm::vec3(0.2f, 0.2f, 0.3f);
-	woodMaterial.specularColor = glm::vec3(0.0f, 0.0f, 0.0f);
-	woodMaterial.shininess = 0.1;
-	woodMaterial.tag = "wood";
+/***********************************************************
+ *  EndScenePass()
+ *
+ *  This method is used for ending the scene draws.  The
+ *  pixels the scene covers are counted when the overdraw is
+ *  measured, the depth writes of a depth pre-pass frame are
+ *  turned back on, and the G-buffer is lit after the
+ *  geometry pass, once per pixel on screen, with the
+ *  lighting pass permutation of the lights of the frame.
+ ***********************************************************/
+void SceneManager::EndScenePass()
+{
+	if (m_bMeasureOverdraw == true)
+	{
+		if (m_shaderPermutations.Use(ShaderPermutations::PERMUTATION_DEPTH_PASS | ShaderPermutations::PERMUTATION_LIGHTING_PASS) == true)
+		{
+			m_overdrawCounter.CountCoverage();
+		}
+		else
+		{
+			m_overdrawCounter.EndShading();
+		}
+	}
+	if (m_bDepthPrepassFrame == true)
+	{
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+	}
 
-	m_objectMaterials.push_back(woodMaterial);
+	if ((m_scenePermutation & ShaderPermutations::PERMUTATION_GEOMETRY_PASS) == 0)
+	{
+		return;
+	}
 
-	OBJECT_MATERIAL glassMaterial;
-	glassMaterial.diffuseColor = glm::vec3(0.7f, 0.7f, 0.7f);
-	glassMaterial.specularColor = glm::vec3(1.0f, 1.0f, 1.0f);
-	glassMaterial.shininess = 90.0;
-	glassMaterial.tag = "glass";
+	m_deferredRenderer.EndGeometryPass();
+	UsePermutation(ShaderPermutations::PERMUTATION_LIGHTING_PASS | m_lightPermutation);
+	m_deferredRenderer.DrawLightingPass();
+}
 
-	m_objectMaterials.push_back(glassMaterial);
+/***********************************************************
+ *  BeginDrawPass()
+ *
+ *  This method is used for setting the depth and color
+ *  writes of a pass of the scene draws.  The depth pass
+ *  only writes the depth, and after it the color pass
+ *  keeps the depth and shades just the fragments that
+ *  match it, so each pixel is shaded once.  The shaded
+ *  fragments are counted from the start of the color pass.
+ ***********************************************************/
+void SceneManager::BeginDrawPass(RenderQueue::PASS pass)
+{
+	if (pass == RenderQueue::PASS_DEPTH)
+	{
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		return;
+	}
+	if (pass != RenderQueue::PASS_OPAQUE)
+	{
+		return;
+	}
 
+	if (m_bDepthPrepassFrame == true)
+	{
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_FALSE);
+		glDepthFunc(GL_LEQUAL);
+	}
+	if (m_bMeasureOverdraw == true)
+	{
+		m_overdrawCounter.BeginShading();
+	}
 }
 
-//setting up the lights for the scene
-void SceneManager::SetupSceneLights()
+/***********************************************************
+ *  UpdateShadowMaps()
+ *
+ *  This method is used for bringing the shadow maps up to
+ *  date with the lights and casters of the frame.  The
+ *  static layers are only drawn after a static object or a
+ *  light changed, fitted around the current bounds of the
+ *  scene, and the layers the shaders read are only drawn
+ *  again, over a copy of their static layer, when a
+ *  dynamic caster moved, so a still scene draws nothing.
+ *  Without the cache every caster is drawn into every
+ *  layer each frame.  The casters are drawn with the depth
+ *  pass permutation, with the camera block set to each
+ *  layer, and the camera of the frame is set back after.
+ *  The scene is lit without shadows when that permutation
+ *  cannot be used.
+ ***********************************************************/
+void SceneManager::UpdateShadowMaps()
 {
-	// Enable custom lighting
-	m_pShaderManager->setBoolValue(g_UseLightingName, true);
+	m_shadowMaps.ResetLayerDraws();
+	UniformBuffers::SHADOW_BLOCK shadows = UniformBuffers::SHADOW_BLOCK();
+	if ((m_bShadows == false) || (m_bUseLighting == false) || (m_bShaderPermutations == false) ||
+		(m_shaderPermutations.Use(ShaderPermutations::PERMUTATION_DEPTH_PASS) == false))
+	{
+		m_pUniformBuffers->SetShadows(shadows);
+		return;
+	}
 
-	// Directional light 
-	m_pShaderManager->setVec3Value("directionalLight.direction", 0.0f, -1.0f, 0.0f); 
-	m_pShaderManager->setVec3Value("directionalLight.ambient", 0.1f, 0.1f, 0.1f);   
-	m_pShaderManager->setVec3Value("directionalLight.diffuse", 0.4f, 0.4f, 0.4f);   
-	m_pShaderManager->setVec3Value("directionalLight.specular", 1.0f, 1.0f, 1.0f); 
-	m_pShaderManager->setBoolValue("directionalLight.bActive", true);
+	// a moved static object is merged again first, as the
+	// static layers are drawn from the static batches
+	if (m_bStaticBatchesDirty == true)
+	{
+		BuildStaticBatches();
+	}
+	m_shadowMaps.SetLights(m_pUniformBuffers->GetLights());
+	const bool bStatic = (m_shadowMaps.IsStaticValid() == false);
+	if ((bStatic == false) && (m_bShadowCastersDirty == false) && (m_bShadowCache == true))
+	{
+		return;
+	}
 
-	// Point light 1 
-	m_pShaderManager->setVec3Value("pointLights[0].position", 0.0f, 55.0f, 0.0f); 
-	m_pShaderManager->setVec3Value("pointLights[0].ambient", 0.1f, 0.1f, 0.1f); 
-	m_pShaderManager->setVec3Value("pointLights[0].diffuse", 1.0f, 1.0f, 1.0f); 
-	m_pShaderManager->setVec3Value("pointLights[0].specular", 1.0f, 1.0f, 1.0f); 
-	m_pShaderManager->setVec3Value("pointLights[0].attenuation", 1.0f, 0.1f, 0.05f); 
-	m_pShaderManager->setBoolValue("pointLights[0].bActive", true);
+	if (bStatic == true)
+	{
+		ObjectBVH::AABB bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+		for (int i = 0; i < m_objectBVH.GetObjectCount(); i++)
+		{
+			const ObjectBVH::AABB& objectBounds = m_objectBVH.GetObjectBounds(i);
+			bounds.min = (i == 0) ? objectBounds.min : glm::min(bounds.min, objectBounds.min);
+			bounds.max = (i == 0) ? objectBounds.max : glm::max(bounds.max, objectBounds.max);
+		}
+		m_shadowMaps.FitLayers(bounds.min, bounds.max);
+	}
+	if (m_shadowMaps.BeginUpdate() == false)
+	{
+		m_bShadows = false;
+		m_pUniformBuffers->SetShadows(shadows);
+		return;
+	}
+	if ((bStatic == true) || (m_bShadowCastersDirty == true))
+	{
+		BuildShadowCasters();
+	}
 
-	// Point light 2
-	m_pShaderManager->setVec3Value("pointLights[1].position", -15.0f, 55.0f, 0.0f); 
-	m_pShaderManager->setVec3Value("pointLights[1].ambient", 0.1f, 0.1f, 0.1f); 
-	m_pShaderManager->setVec3Value("pointLights[1].diffuse", 1.0f, 1.0f, 1.0f);
-	m_pShaderManager->setVec3Value("pointLights[1].specular", 1.0f, 1.0f, 1.0f); 
-	m_pShaderManager->setVec3Value("pointLights[1].attenuation", 1.0f, 0.1f, 0.05f); 
-	m_pShaderManager->setBoolValue("pointLights[1].bActive", true);
+	const UniformBuffers::CAMERA_BLOCK camera = m_pUniformBuffers->GetCamera();
+	const int layerCount = m_shadowMaps.GetLayerCount();
+	if (m_bShadowCache == true)
+	{
+		for (int layer = 0; (bStatic == true) && (layer < layerCount); layer++)
+		{
+			m_shadowMaps.BeginStaticLayer(layer);
+			m_pUniformBuffers->SetCamera(m_shadowMaps.GetLayerView(layer),
+				m_shadowMaps.GetLayerProjection(layer), m_shadowMaps.GetLayerPosition(layer));
+			DrawShadowCasters(layer, true, false);
+		}
+		for (int layer = 0; layer < layerCount; layer++)
+		{
+			const bool bCasters = (m_shadowLayerStarts[layer + 1] > m_shadowLayerStarts[layer]);
+			if ((m_shadowMaps.BeginDynamicLayer(layer, bCasters) == true) && (bCasters == true))
+			{
+				m_pUniformBuffers->SetCamera(m_shadowMaps.GetLayerView(layer),
+					m_shadowMaps.GetLayerProjection(layer), m_shadowMaps.GetLayerPosition(layer));
+				DrawShadowCasters(layer, false, true);
+			}
+		}
+	}
+	else
+	{
+		for (int layer = 0; layer < layerCount; layer++)
+		{
+			m_shadowMaps.BeginUncachedLayer(layer);
+			m_pUniformBuffers->SetCamera(m_shadowMaps.GetLayerView(layer),
+				m_shadowMaps.GetLayerProjection(layer), m_shadowMaps.GetLayerPosition(layer));
+			DrawShadowCasters(layer, true, true);
+		}
+	}
+	if (bStatic == true)
+	{
+		m_shadowMaps.EndStatic();
+	}
 
-	// Point light 3 
-	m_pShaderManager->setVec3Value("pointLights[2].position", 0.0f, 55.0f, -5.0f); 
-	m_pShaderManager->setVec3Value("pointLights[2].ambient", 0.1f, 0.1f, 0.1f); 
-	m_pShaderManager->setVec3Value("pointLights[2].diffuse", 1.0f, 1.0f, 1.0f);
-	m_pShaderManager->setVec3Value("pointLights[2].specular", 1.0f, 1.0f, 1.0f); 
-	m_pShaderManager->setVec3Value("pointLights[2].attenuation", 1.0f, 0.1f, 0.05f); 
-	m_pShaderManager->setBoolValue("pointLights[2].bActive", true);
+	glBindVertexArray(0);
+	m_shadowMaps.EndUpdate();
+	m_pUniformBuffers->SetCamera(camera.view, camera.projection, camera.viewPosition);
+	m_shadowMaps.FillShadowBlock(shadows);
+	m_pUniformBuffers->SetShadows(shadows);
+	m_bShadowCastersDirty = false;
+}
+
+/***********************************************************
+ *  BuildShadowCasters()
+ *
+ *  This method is used for finding the dynamic casters of
+ *  every shadow map layer.  The bounding volume hierarchy
+ *  culls the objects against the frustum of the layer, and
+ *  the records of the ones left are written mesh by mesh,
+ *  in the order of the instance batches, so each mesh is
+ *  drawn into a layer with one call.  A layer no dynamic
+ *  caster reaches gets no batch, and keeps its static
+ *  layer alone.
+ ***********************************************************/
+void SceneManager::BuildShadowCasters()
+{
+	const glm::mat4* modelMatrices = m_drawList.GetModelMatrices();
+	const int* textureSlots = m_drawList.GetTextureSlots();
+	const glm::vec4* colors = m_drawList.GetColors();
+	const int* materialIDs = m_drawList.GetMaterialIDs();
+	const glm::vec2* uvScales = m_drawList.GetUVScales();
+	const int materialCount = m_materials.GetMaterialCount();
+
+	m_shadowCasters.clear();
+	m_shadowBatches.clear();
+	m_shadowLayerStarts.assign(1, 0);
+	m_shadowFlags.resize(m_drawList.GetObjectCount());
+
+	for (int layer = 0; layer < m_shadowMaps.GetLayerCount(); layer++)
+	{
+		m_objectBVH.Cull(m_shadowMaps.GetLayerProjection(layer) * m_shadowMaps.GetLayerView(layer), m_shadowFlags.data());
+
+		for (size_t b = 0; b < m_instanceBatches.size(); b++)
+		{
+			const INSTANCE_BATCH& batch = m_instanceBatches[b];
+			SHADOW_BATCH shadowBatch;
+			shadowBatch.meshID = batch.meshID;
+			shadowBatch.firstInstance = (int)m_shadowCasters.size();
+			shadowBatch.instanceCount = 0;
+
+			for (int i = batch.firstInstance; i < batch.firstInstance + batch.instanceCount; i++)
+			{
+				const int object = m_instanceOrder[i];
+				if (m_shadowFlags[object] == g_ObjectCulled)
+				{
+					continue;
+				}
+				InstancedMeshes::INSTANCE_DATA instance;
+				instance.model = modelMatrices[object];
+				instance.color = colors[object];
+				instance.uvScale = uvScales[object];
+				instance.textureSlot = textureSlots[object];
+				instance.materialIndex = (materialIDs[object] < materialCount) ? materialIDs[object] : -1;
+				m_shadowCasters.push_back(instance);
+				shadowBatch.instanceCount++;
+			}
+
+			if (shadowBatch.instanceCount > 0)
+			{
+				m_shadowBatches.push_back(shadowBatch);
+			}
+		}
+		m_shadowLayerStarts.push_back((int)m_shadowBatches.size());
+	}
+
+	m_shadowMaps.UploadCasters(*m_basicMeshes, m_shadowCasters.data(), (int)m_shadowCasters.size());
+}
+
+/***********************************************************
+ *  DrawShadowCasters()
+ *
+ *  This method is used for drawing the casters of a shadow
+ *  map layer, with the depth pass program in use.  Every
+ *  static batch is drawn whole, as the static layers are
+ *  seldom drawn, and the dynamic casters of the layer are
+ *  drawn from their own records with one call per mesh.
+ ***********************************************************/
+void SceneManager::DrawShadowCasters(int layer, bool bStatic, bool bDynamic)
+{
+	for (int i = 0; (bStatic == true) && (i < m_staticBatches.GetBatchCount()); i++)
+	{
+		glBindVertexArray(m_staticBatches.GetVertexArray(i));
+		m_staticBatches.DrawBoundBatch(i);
+	}
+
+	if (bDynamic == false)
+	{
+		return;
+	}
+	glBindVertexArray(m_shadowMaps.GetCasterVertexArray());
+	for (int b = m_shadowLayerStarts[layer]; b < m_shadowLayerStarts[layer + 1]; b++)
+	{
+		const SHADOW_BATCH& batch = m_shadowBatches[b];
+		const InstancedMeshes::GLMESH* mesh = FindMesh(batch.meshID, g_ShadowCasterLOD);
+		if (mesh != NULL)
+		{
+			m_basicMeshes->DrawBoundMeshInstanced(*mesh, m_shadowMaps.GetCasterBuffer(),
+				batch.firstInstance, batch.instanceCount);
+		}
+	}
 }
 
 /**************************************************************/
@@ -481,6 +1522,17 @@ void SceneManager::SetupSceneLights()
  ***********************************************************/
 void SceneManager::PrepareScene()
 {
+	// the specialised shaders are compiled from the same files
+	// as the general program, each one on its first draw
+	if ((m_bShaderPermutations == true) &&
+		(m_shaderPermutations.Create("shaders/vertexShader.glsl", "shaders/fragmentShader.glsl", m_pUniformBuffers) == false))
+	{
+		m_bShaderPermutations = false;
+	}
+	// the lighting pass reads the G-buffer from its own units
+	m_shaderPermutations.SetConstantInt(g_GBufferAlbedoUniform, DeferredRenderer::ALBEDO_UNIT);
+	m_shaderPermutations.SetConstantInt(g_GBufferNormalUniform, DeferredRenderer::NORMAL_UNIT);
+	m_shaderPermutations.SetConstantInt(g_GBufferDepthUniform, DeferredRenderer::DEPTH_UNIT);
 
 	// load the textures for the 3D scene
 	LoadSceneTextures();
@@ -498,315 +1550,347 @@ void SceneManager::PrepareScene()
 	m_basicMeshes->LoadTorusMesh();
 	m_basicMeshes->LoadSphereMesh();
 	m_basicMeshes->LoadCylinderMesh();
+	// all the meshes share one set of buffers, uploaded once
+	m_basicMeshes->UploadMeshes();
+
+	// compile the scene objects once so that rendering
+	// only needs to walk the draw list
+	CompileScene();
+}
+
+/***********************************************************
+ *  CompileScene()
+ *
+ *  This method is used for compiling the 3D scene objects
+ *  into the draw list and the transform graph.  It is called
+ *  once when the scene is prepared, and the textures, colors
+ *  and materials are resolved for each object at that time.
+ *  Composite objects are attached to a group node so they
+ *  can be moved together by changing a single node.
+ ***********************************************************/
+void SceneManager::CompileScene()
+{
+	m_drawList.Clear();
+	m_transformGraph.Clear();
+	m_nodeObjects.clear();
+
+	// desk surface
+	int deskNode = AddTexturedObject(
+		DrawList::MESH_PLANE,
+		glm::vec3(30.0f, 2.0f, 15.0f),
+		0.0f, 0.0f, 0.0f,
+		glm::vec3(0.0f, 0.0f, 0.0f),
+		"DeskTexture", "wood", glm::vec2(1.0f, 1.0f));
+
+	// back plane to create the backdrop of the scene
+	int backdropNode = AddColoredObject(
+		DrawList::MESH_PLANE,
+		glm::vec3(30.0f, 2.0f, 15.0f),
+		90.0f, 0.0f, 0.0f,
+		glm::vec3(0.0f, 15.0f, -15.0f),
+		glm::vec4(0.9f, 0.9f, 0.9f, 1.0f), "wood");
+
+	// the computer monitor parts are positioned relative to
+	// the monitor node
+	int monitorNode = CreateGroupNode(glm::vec3(0.0f, 0.0f, -7.0f));
+
+	// first layer of the computer monitor (black bezzle)
+	AddTexturedObject(
+		DrawList::MESH_BOX,
+		glm::vec3(18.0f, 0.5f, 11.0f),
+		90.0f, 0.0f, 0.0f,
+		glm::vec3(0.0f, 8.0f, 0.0f),
+		"BlackBezzle", "metal", glm::vec2(1.0f, 1.0f), monitorNode);
+
+	// inner white part of the monitor
+	AddColoredObject(
+		DrawList::MESH_BOX,
+		glm::vec3(16.0f, 0.7f, 9.0f),
+		90.0f, 0.0f, 0.0f,
+		glm::vec3(0.0f, 8.0f, 0.0f),
+		glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), "metal", monitorNode);
+
+	// lower edge of the monitor
+	AddTexturedObject(
+		DrawList::MESH_BOX,
+		glm::vec3(18.0f, 0.7f, 1.0f),
+		90.0f, 0.0f, 0.0f,
+		glm::vec3(0.0f, 2.4f, 0.0f),
+		"Steel", "metal", glm::vec2(1.0f, 1.0f), monitorNode);
+
+	// back of the monitor
+	AddColoredObject(
+		DrawList::MESH_BOX,
+		glm::vec3(18.0f, 0.5f, 11.0f),
+		90.0f, 0.0f, 0.0f,
+		glm::vec3(0.0f, 8.0f, -0.5f),
+		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), "metal", monitorNode);
+
+	// stand for the monitor
+	AddTexturedObject(
+		DrawList::MESH_BOX,
+		glm::vec3(5.0f, 0.5f, 6.0f),
+		90.0f, 0.0f, 0.0f,
+		glm::vec3(0.0f, 0.0f, 0.0f),
+		"Steel", "metal", glm::vec2(1.0f, 1.0f), monitorNode);
+
+	// base of the monitor stand
+	AddTexturedObject(
+		DrawList::MESH_BOX,
+		glm::vec3(8.0f, 4.5f, 1.5f),
+		90.0f, 0.0f, 0.0f,
+		glm::vec3(0.0f, 0.0f, 1.0f),
+		"Steel", "metal", glm::vec2(1.0f, 1.0f), monitorNode);
+
+	// the coffee cup body and handle move together
+	int cupNode = CreateGroupNode(g_CupPosition);
+	m_cupNode = cupNode;
+
+	// tapered cup body
+	AddTexturedObject(
+		DrawList::MESH_TAPERED_CYLINDER,
+		glm::vec3(1.8f, 2.8f, 1.8f),
+		180.0f, 0.0f, 0.0f,
+		glm::vec3(0.0f, 3.0f, 0.0f),
+		"CupTexture", "glass", glm::vec2(1.0f, 1.0f), cupNode);
+
+	// cup handle
+	AddTexturedObject(
+		DrawList::MESH_TORUS,
+		glm::vec3(0.8f, 0.8f, 0.3f),
+		0.0f, 0.0f, 0.0f,
+		glm::vec3(1.8f, 1.3f, 0.0f),
+		"CupTexture", "glass", glm::vec2(0.0f, 0.0f), cupNode);
+
+	// keyboard
+	int keyboardNode = AddColoredObject(
+		DrawList::MESH_BOX,
+		glm::vec3(11.8f, 0.8f, 3.8f),
+		0.0f, 0.0f, 0.0f,
+		glm::vec3(-2.2f, 0.0f, 0.0f),
+		glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), "glass");
+
+	// mouse
+	AddColoredObject(
+		DrawList::MESH_SPHERE,
+		glm::vec3(1.6f, 1.0f, 0.2f),
+		0.0f, 90.0f, 90.0f,
+		glm::vec3(6.2f, 0.3f, 0.0f),
+		glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), "glass");
+
+	// the pencils are positioned relative to the pencil cup
+	int pencilCupNode = CreateGroupNode(glm::vec3(11.2f, 0.0f, -5.3f));
+
+	// pencil cup
+	AddColoredObject(
+		DrawList::MESH_TAPERED_CYLINDER,
+		glm::vec3(1.8f, 2.8f, 1.8f),
+		180.0f, 0.0f, 0.0f,
+		glm::vec3(0.0f, 2.8f, 0.0f),
+		glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), "glass", pencilCupNode);
+
+	// pencil 1
+	AddColoredObject(
+		DrawList::MESH_CYLINDER,
+		glm::vec3(0.2f, 3.5f, 0.2f),
+		5.0f, 15.0f, 0.0f,
+		glm::vec3(0.0f, 1.0f, 0.0f),
+		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), "glass", pencilCupNode);
+
+	// pencil 2
+	AddColoredObject(
+		DrawList::MESH_CYLINDER,
+		glm::vec3(0.2f, 3.8f, 0.2f),
+		-13.0f, -10.0f, 0.0f,
+		glm::vec3(-0.4f, 1.3f, 0.1f),
+		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), "glass", pencilCupNode);
+
+	// pencil 3
+	AddColoredObject(
+		DrawList::MESH_CYLINDER,
+		glm::vec3(0.2f, 3.2f, 0.2f),
+		7.0f, -5.0f, 0.0f,
+		glm::vec3(-1.1f, 1.9f, -0.1f),
+		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), "glass", pencilCupNode);
+
+	// the books are stacked relative to the bottom book
+	int bookStackNode = CreateGroupNode(glm::vec3(-13.0f, 0.0f, -5.0f));
+
+	// book 1
+	AddColoredObject(
+		DrawList::MESH_BOX,
+		glm::vec3(3.5f, 0.5f, 2.5f),
+		0.0f, -5.0f, 0.0f,
+		glm::vec3(0.0f, 0.25f, 0.0f),
+		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), "glass", bookStackNode);
+
+	// book 2
+	AddColoredObject(
+		DrawList::MESH_BOX,
+		glm::vec3(3.3f, 0.4f, 2.4f),
+		0.0f, 3.0f, 0.0f,
+		glm::vec3(0.1f, 0.75f, -0.2f),
+		glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), "glass", bookStackNode);
+
+	// book 3
+	AddColoredObject(
+		DrawList::MESH_BOX,
+		glm::vec3(3.2f, 0.3f, 2.3f),
+		0.0f, -7.0f, 0.0f,
+		glm::vec3(-0.2f, 1.1f, 0.2f),
+		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), "glass", bookStackNode);
+
+	// overlapping spheres in rows over the front of the desk,
+	// each with its own color, to compare the shading paths
+	const int columns = (int)ceilf(sqrtf(m_scatteredObjectCount * 2.0f));
+	const int rows = (columns > 0) ? (m_scatteredObjectCount + columns - 1) / columns : 0;
+	for (int i = 0; i < m_scatteredObjectCount; i++)
+	{
+		const float x = -14.0f + 28.0f * ((i % columns) + 0.5f) / columns;
+		const float z = -3.0f + 12.0f * ((i / columns) + 0.5f) / rows;
+		const float hue = i * 2.39996f;
+		AddColoredObject(
+			DrawList::MESH_SPHERE,
+			glm::vec3(1.2f, 1.2f, 1.2f),
+			0.0f, 0.0f, 0.0f,
+			glm::vec3(x, 1.2f + (i % 3) * 0.8f, z),
+			glm::vec4(
+				0.5f + 0.5f * cosf(hue),
+				0.5f + 0.5f * cosf(hue - 2.09440f),
+				0.5f + 0.5f * cosf(hue + 2.09440f),
+				1.0f), "glass");
+	}
+
+	// the desk, the backdrop, the monitor, the keyboard and the
+	// books never move, so they are merged into static batches
+	SetStaticNode(deskNode);
+	SetStaticNode(backdropNode);
+	SetStaticNode(monitorNode);
+	SetStaticNode(keyboardNode);
+	SetStaticNode(bookStackNode);
+
+	// the large solid objects hide the objects behind them
+	SetOccluderNode(backdropNode);
+	SetOccluderNode(monitorNode);
+	SetOccluderNode(bookStackNode);
+
+	// calculate the initial world matrices of all the objects
+	UpdateTransforms();
+
+	// bake the static objects into their batches, and group the
+	// copies of each mesh for instanced drawing
+	BuildStaticBatches();
+	BuildInstanceBatches();
+	BuildObjectBVH();
+	BuildIndirectScene();
+	m_bShadowCastersDirty = true;
 }
 
 /***********************************************************
  *  RenderScene()
  *
  *  This method is used for rendering the 3D scene by 
- *  transforming and drawing the basic 3D shapes
+ *  drawing each static batch, and each instanced batch of
+ *  the precompiled draw list, with one draw call in render
+ *  state order
  ***********************************************************/
 void SceneManager::RenderScene()
 {
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
-
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** This same ordering of code should be used for transforming ***/
-	/*** and drawing all the basic 3D shapes.						***/
-	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(30.0f, 2.0f, 15.0f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(0.0f, 0.0f, 0.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
+	if ((NULL == m_pShaderManager) || (NULL == m_pUniformCache) || (NULL == m_pUniformBuffers))
+	{
+		return;
+	}
+
+	// the light and material tables are only uploaded again
+	// after a change
+	m_pUniformBuffers->UploadLights();
+	m_materials.Upload();
+	// the small lights are binned for the current camera, and
+	// the lights select the permutation of every draw
+	m_lightClusters.Update(m_pUniformBuffers->GetCamera().view, m_pUniformBuffers->GetCamera().projection);
+	m_lightPermutation = ShaderPermutations::MakeLightPermutation(
+		m_bUseLighting,
+		m_pUniformBuffers->IsDirectionalLightActive(),
+		m_pUniformBuffers->GetActivePointLightCount(),
+		m_pUniformBuffers->IsSpotLightActive(),
+		m_lightClusters.GetLightCount() > 0);
+	// only the nodes that were moved since the last
+	// frame have their world matrices recalculated
+	if ((m_bMoveCup == true) && (m_cupNode >= 0))
+	{
+		const float angle = (m_cupFrame++) * g_CupPathStep;
+		m_transformGraph.SetLocalPosition(m_cupNode, g_CupPosition +
+			glm::vec3(1.0f - cosf(angle), 0.0f, sinf(angle)) * g_CupPathRadius);
+	}
+	UpdateTransforms();
+
+	// textures decoded since the last frame are copied into
+	// their layers, and the levels the objects need on screen
+	// are streamed in within the upload and memory budgets
+	RequestTextureLevels();
+	m_textures.Update();
+
+	// the shadow maps are only drawn again for the casters and
+	// lights that changed
+	UpdateShadowMaps();
+
+	// the GPU culling path tests every object in a compute
+	// shader and draws the visible ones with one indirect call
+	if (m_bGPUCulling == true)
+	{
+		if (m_bIndirectDirty == true)
+		{
+			m_indirectScene.UpdateObjects(m_drawList, m_materials.GetMaterialCount());
+			m_bIndirectDirty = false;
+		}
+		// the occluders are drawn on the CPU, and the culling
+		// shader tests the objects against their depth pyramid
+		if (m_bOcclusionCulling == true)
+		{
+			RasterizeOccluders(NULL);
+			m_occlusionBuffer.Upload();
+			m_indirectScene.SetOcclusionTexture(m_occlusionBuffer.GetTexture());
+		}
+		m_indirectScene.SetViewScale(m_viewScale, m_bPerspective);
+		m_indirectScene.Cull();
+		BeginScenePass();
+		if (m_bDepthPrepassFrame == true)
+		{
+			BeginDrawPass(RenderQueue::PASS_DEPTH);
+			UsePermutation(ShaderPermutations::PERMUTATION_DEPTH_PASS);
+			m_indirectScene.Draw(false);
+			m_indirectScene.Draw(true);
+		}
+		BeginDrawPass(RenderQueue::PASS_OPAQUE);
+		UsePermutation(m_scenePermutation);
+		m_indirectScene.Draw(false);
+		UsePermutation(m_scenePermutation | ShaderPermutations::PERMUTATION_TEXTURED);
+		m_indirectScene.Draw(true);
+		EndScenePass();
+		return;
+	}
+
+	// only the objects inside the view frustum are written to
+	// the instance stream and drawn
+	CullObjects();
+	UpdateInstanceData();
+	if (m_bStaticBatchesDirty == true)
+	{
+		BuildStaticBatches();
+	}
+
+	// the draws are sorted by state each frame so that batches
+	// sharing a permutation or a mesh are drawn together
+	BeginScenePass();
+	SubmitDraws();
+	ExecuteDraws();
+	EndScenePass();
+	if (m_bShowOccluded == true)
+	{
+		DrawOccludedObjects();
+	}
 
-	SetShaderTexture("DeskTexture");
-	SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("wood");
-	//SetShaderColor(1, 1, 1, 1);
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawPlaneMesh();
-
-	//Settingup the back planeto create the backdrop of the of the scene
-	SetTransformations(
-		scaleXYZ = glm::vec3(30.0f, 2.0f, 15.0),
-		XrotationDegrees = 90,
-		YrotationDegrees = 0,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(0.0f, 15.f, -15.0f));
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	SetShaderColor(0.9, 0.9, 0.9, 1);
-	m_basicMeshes->DrawPlaneMesh();
-
-	//this is the first layer of the computer monitor (black bezzle) 
-	SetTransformations(
-		scaleXYZ = glm::vec3(18.0f, 0.5f, 11.0f),
-		XrotationDegrees = 90,
-		YrotationDegrees = 0,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(0.0f, 8.0f, -7.0f));
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	
-	//texture loading
-	SetShaderTexture("BlackBezzle");
-	SetShaderMaterial("metal");
-	SetTextureUVScale(1.0, 1.0);
-	
-	//SetShaderColor(0.0, 0.0, 0.0, 1);
-	m_basicMeshes->DrawBoxMesh();
-
-	//This is the inner white part of the monitor
-	SetTransformations(
-		scaleXYZ = glm::vec3(16.0f, 0.7f, 9.0f),
-		XrotationDegrees = 90,
-		YrotationDegrees = 0,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(0.0f, 8.0f, -7.0f));
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	SetShaderColor(1, 1, 1, 1); 
-	
-	m_basicMeshes->DrawBoxMesh();
-
-	SetTransformations(
-		scaleXYZ = glm::vec3(18.0f, 0.7f, 1.0f),
-		XrotationDegrees = 90,
-		YrotationDegrees = 0,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(0.0f, 2.4f, -7.0f));
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	
-	//Texture
-	SetShaderTexture("Steel");
-	SetShaderMaterial("metal");
-	SetTextureUVScale(1.0, 1.0);
-	
-	//SetShaderColor(0.55, 0.55, 0.55, 1);
-	m_basicMeshes->DrawBoxMesh();
-
-	//this box is to make the back of the monitor black
-	SetTransformations(
-		scaleXYZ = glm::vec3(18.0f, 0.5f, 11.0f),
-		XrotationDegrees = 90,
-		YrotationDegrees = 0,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(0.0f, 8.0f, -7.5f));
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	SetShaderColor(0.0, 0.0, 0.0, 1);
-	m_basicMeshes->DrawBoxMesh();
-
-	//this is the stand for the monitor
-	SetTransformations(
-		scaleXYZ = glm::vec3(5.0f, 0.5f, 6.0f),
-		XrotationDegrees = 90,
-		YrotationDegrees = 0,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(0.0f, 0.0f, -7.0f));
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	
-	SetShaderTexture("Steel");
-	SetTextureUVScale(1.0, 1.0);
-	
-	//SetShaderColor(0.55, 0.55, 0.55, 1);
-	m_basicMeshes->DrawBoxMesh();
-
-	SetTransformations(
-		scaleXYZ = glm::vec3(8.0f, 4.5f, 1.5f),
-		XrotationDegrees = 90,
-		YrotationDegrees = 0,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(0.0f, 0.0f, -6.0f));
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	
-	//Texture loading
-	SetShaderTexture("Steel");
-	SetShaderMaterial("metal");
-	SetTextureUVScale(1.0, 1.0);
-	
-	//SetShaderColor(0.55, 0.55, 0.55, 1);
-	m_basicMeshes->DrawBoxMesh();
-
-	// Tapered Cup Body
-	SetTransformations(
-		scaleXYZ = glm::vec3(1.8f, 2.8f, 1.8f), 
-		XrotationDegrees = 180,
-		YrotationDegrees = 0,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(-8.7f, 3.0f, -4.6f));
-
-	//Texture
-	SetShaderTexture("CupTexture");
-	SetShaderMaterial("glass");
-	SetTextureUVScale(1.0, 1.0);
-	
-	//SetShaderColor(0.2, 0.2, 0.2, 1);
-	m_basicMeshes->DrawTaperedCylinderMesh();
-
-	// Cup Handle 
-	SetTransformations(
-		scaleXYZ = glm::vec3(0.8f, 0.8f, 0.3f), 
-		XrotationDegrees = 0,  
-		YrotationDegrees = 0,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(-6.9f, 1.3f, -4.6f));
-
-	//Texture
-	SetShaderTexture("CupTexture");
-	SetShaderMaterial("glass");
-	SetTextureUVScale(0.0, 0.0);
-	
-	//SetShaderColor(0.2, 0.2, 0.2, 1);
-	m_basicMeshes->DrawTorusMesh();
-
-	//Keyboard
-	SetTransformations(
-		scaleXYZ = glm::vec3(11.8f, 0.8f, 3.8f),
-		XrotationDegrees = 0,
-		YrotationDegrees = 0,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(-2.2f,0.0f, 0.0f));
-	
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-
-	//color
-	SetShaderColor(1, 1, 1, 1);
-	m_basicMeshes->DrawBoxMesh();
-
-	//Texture
-	//SetShaderTexture("CupTexture");
-	//SetShaderMaterial("glass");
-	//SetTextureUVScale(1.0, 1.0);
-
-
-	//mouse
-	SetTransformations(
-		scaleXYZ = glm::vec3(1.6f, 1.0f, 0.2),
-		XrotationDegrees = 0,
-		YrotationDegrees = 90,
-		ZrotationDegrees = 90,
-		positionXYZ = glm::vec3(6.2f, 0.3f, 0.0f));
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-
-	//color
-	SetShaderColor(1, 1, 1, 1);
-	m_basicMeshes->DrawSphereMesh();
-
-
-	//pencil cup
-	SetTransformations(
-		scaleXYZ = glm::vec3(1.8f, 2.8f, 1.8f),
-		XrotationDegrees =180,
-		YrotationDegrees = 0,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(11.2f, 2.8f, -5.3f));
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-
-	//color
-	SetShaderColor(1, 1, 1, 1);
-	m_basicMeshes->DrawTaperedCylinderMesh();
-
-
-	// Pencil 1
-	SetTransformations(
-		scaleXYZ = glm::vec3(0.2f, 3.5f, 0.2f), 
-		XrotationDegrees = 5,  
-		YrotationDegrees = 15,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(11.2f, 1.0f, -5.3f));  
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	SetShaderColor(0, 0, 0, 1); 
-	m_basicMeshes->DrawCylinderMesh();  
-
-	// Pencil 2
-	SetTransformations(
-		scaleXYZ = glm::vec3(0.2f, 3.8f, 0.2f),
-		XrotationDegrees = -13,  
-		YrotationDegrees = -10,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(10.8f, 1.3f, -5.2f));
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	SetShaderColor(0, 0, 0, 1);
-	m_basicMeshes->DrawCylinderMesh();
-
-	// Pencil 3
-	SetTransformations(
-		scaleXYZ = glm::vec3(0.2f, 3.2f, 0.2f),
-		XrotationDegrees = 7,
-		YrotationDegrees = -5,
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(10.1f, 1.9f, -5.4f));
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	SetShaderColor(0, 0, 0, 1);
-	m_basicMeshes->DrawCylinderMesh();
-
-	// Book 1 
-	SetTransformations(
-		scaleXYZ = glm::vec3(3.5f, 0.5f, 2.5f),  
-		XrotationDegrees = 0,
-		YrotationDegrees = -5,  
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(-13.0f, 0.25f, -5.0f));  
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	SetShaderColor(0.0f, 0.0f, 0.0f, 1);
-	m_basicMeshes->DrawBoxMesh();
-
-	// Book 2 
-	SetTransformations(
-		scaleXYZ = glm::vec3(3.3f, 0.4f, 2.4f),  
-		XrotationDegrees = 0,
-		YrotationDegrees = 3,  
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(-12.9f, 0.75f, -5.2f));  
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	SetShaderColor(1, 1, 1, 1);  
-	m_basicMeshes->DrawBoxMesh();
-
-	// Book 3 
-	SetTransformations(
-		scaleXYZ = glm::vec3(3.2f, 0.3f, 2.3f),
-		XrotationDegrees = 0,
-		YrotationDegrees = -7,  
-		ZrotationDegrees = 0,
-		positionXYZ = glm::vec3(-13.2f, 1.1f, -4.8f)); 
-
-	SetTransformations(scaleXYZ, XrotationDegrees, YrotationDegrees, ZrotationDegrees, positionXYZ);
-	SetShaderColor(0.0f, 0.0f, 0.0f, 1);  
-	m_basicMeshes->DrawBoxMesh();
-
-
-
-	/****************************************************************/
+	// the instance records stay untouched until these draws
+	// have completed
+	m_basicMeshes->FenceInstances();
 }
@@ -10,7 +10,23 @@
 #pragma once
 
 #include "ShaderManager.h"
-#include "ShapeMeshes.h"
+#include "UniformCache.h"
+#include "UniformBuffers.h"
+#include "InstancedMeshes.h"
+#include "DrawList.h"
+#include "TransformGraph.h"
+#include "StaticBatches.h"
+#include "RenderQueue.h"
+#include "MaterialRegistry.h"
+#include "TextureManager.h"
+#include "IndirectScene.h"
+#include "LightClusters.h"
+#include "DeferredRenderer.h"
+#include "OverdrawCounter.h"
+#include "ShadowMaps.h"
+#include "ObjectBVH.h"
+#include "OcclusionBuffer.h"
+#include "ShaderPermutations.h"
 
 #include <string>
 #include <vector>
@@ -25,80 +41,260 @@ class SceneManager
 {
 public:
 	// constructor
-	SceneManager(ShaderManager *pShaderManager);
+	SceneManager(ShaderManager *pShaderManager, UniformCache* pUniformCache, UniformBuffers* pUniformBuffers);
 	// destructor
 	~SceneManager();
 
-	struct TEXTURE_INFO
-	{
-		std::string tag;
-		uint32_t ID;
-	};
-
-	struct OBJECT_MATERIAL
-	{
-		glm::vec3 diffuseColor;
-		glm::vec3 specularColor;
-		float shininess;
-		std::string tag;
-	};
-
 private:
 	// pointer to shader manager object
 	ShaderManager* m_pShaderManager;
+	// pointer to the uniform locations of the shader program
+	UniformCache* m_pUniformCache;
+	// pointer to the shared camera and light uniform buffers
+	UniformBuffers* m_pUniformBuffers;
 	// pointer to basic shapes object
-	ShapeMeshes* m_basicMeshes;
-	// total number of loaded textures
-	int m_loadedTextures;
-	// loaded textures info
-	TEXTURE_INFO m_textureIDs[16];
-	// defined object materials
-	std::vector<OBJECT_MATERIAL> m_objectMaterials;
+	InstancedMeshes* m_basicMeshes;
+	// loaded textures, packed into texture arrays by size
+	TextureManager m_textures;
+	// defined object materials, addressed by handle
+	MaterialRegistry m_materials;
+	// precompiled table of the scene objects
+	DrawList m_drawList;
+	// hierarchy of the scene object transforms
+	TransformGraph m_transformGraph;
+	// draw list object for each transform node, -1 for a group node
+	std::vector<int> m_nodeObjects;
+
+	// a run of instances that share a mesh and are either all
+	// textured or all solid colored
+	struct INSTANCE_BATCH
+	{
+		uint8_t meshID;
+		bool bTextured;
+		int firstInstance;
+		int instanceCount;
+		// instances left after culling, from firstInstance on
+		int visibleCount;
+		// visible instances drawn with each tessellation level,
+		// packed in level order
+		int lodCounts[InstancedMeshes::LOD_COUNT];
+		// occluded instances after the visible ones, only
+		// written for the debug view
+		int occludedCount;
+	};
+	// draw list objects in the order of the instance buffer
+	std::vector<int> m_instanceOrder;
+	// instanced draws for the current scene
+	std::vector<INSTANCE_BATCH> m_instanceBatches;
+	// true when the per-instance values need to be uploaded
+	bool m_bInstancesDirty;
+	// static objects merged into pre-transformed buffers
+	StaticBatches m_staticBatches;
+	// true when a static object has moved since the last merge
+	bool m_bStaticBatchesDirty;
+	// draws of the current frame sorted by render state
+	RenderQueue m_renderQueue;
+	// camera position used to sort the draws by distance
+	glm::vec3 m_viewPosition;
+	// pixels covered by one unit at unit distance from the camera
+	float m_viewScale;
+	// false when the size on screen does not depend on distance
+	bool m_bPerspective;
+	// world bounds of the draw list objects, for culling on the CPU
+	ObjectBVH m_objectBVH;
+	// culling result of every draw list object this frame and
+	// the last, culled, visible or occluded
+	std::vector<uint8_t> m_visibleFlags;
+	std::vector<uint8_t> m_previousVisibleFlags;
+	int m_visibleObjectCount;
+	// center and radius of a sphere around each basic mesh,
+	// the size on screen of an object selects its level
+	glm::vec3 m_meshCenters[DrawList::MESH_COUNT];
+	float m_meshRadii[DrawList::MESH_COUNT];
+	// tessellation level each object was last drawn with
+	std::vector<uint8_t> m_objectLODs;
+	// visible objects drawn with each level in the last frame
+	int m_lodObjectCounts[InstancedMeshes::LOD_COUNT];
+	// depth of the occluders, to cull the objects behind them
+	OcclusionBuffer m_occlusionBuffer;
+	// false when the objects are only culled by the frustum
+	bool m_bOcclusionCulling;
+	// true to draw the occluded objects as a wireframe overlay
+	bool m_bShowOccluded;
+	// objects hidden by the occluders in the last frame, and
+	// the fraction of the viewport their bounds cover
+	int m_occludedObjectCount;
+	float m_occludedScreenArea;
+	// projection times view of the frame being rendered
+	glm::mat4 m_viewProjection;
+	// every object culled by a compute shader and drawn with
+	// one indirect call, when the driver supports it
+	IndirectScene m_indirectScene;
+	// false when the GPU culling path must not be used
+	bool m_bAllowGPUCulling;
+	// true when the scene is drawn by the indirect scene
+	bool m_bGPUCulling;
+	// true when an object has moved since the last upload of
+	// the indirect scene objects
+	bool m_bIndirectDirty;
+	// variants of the scene shaders specialised for the
+	// texturing and lighting of a draw
+	ShaderPermutations m_shaderPermutations;
+	// false when every draw uses the general shader
+	bool m_bShaderPermutations;
+	// true when the objects are lit by the scene lights
+	bool m_bUseLighting;
+	// permutation bits of the lights of the current frame
+	int m_lightPermutation;
+	// small point lights, binned into view frustum clusters
+	LightClusters m_lightClusters;
+	// number of small lights scattered over the desk
+	int m_scatteredLightCount;
+	// G-buffer of the deferred shading path
+	DeferredRenderer m_deferredRenderer;
+	// true to light the scene in a pass over the G-buffer
+	// instead of in every draw
+	bool m_bDeferredShading;
+	// permutation bits every draw of the scene pass shares,
+	// the lights when shading forward, or the geometry pass
+	int m_scenePermutation;
+	// number of overlapping objects scattered over the desk
+	int m_scatteredObjectCount;
+	// true to lay down the depth of the scene before shading
+	// it, and true when the current frame does
+	bool m_bDepthPrepass;
+	bool m_bDepthPrepassFrame;
+	// fragments shaded per covered pixel, measured when
+	// m_bMeasureOverdraw is true
+	OverdrawCounter m_overdrawCounter;
+	bool m_bMeasureOverdraw;
+	// depth maps of the directional and point lights, with the
+	// static casters cached between frames
+	ShadowMaps m_shadowMaps;
+	// false when no light casts shadows, and false to draw
+	// every caster into the shadow maps each frame
+	bool m_bShadows;
+	bool m_bShadowCache;
+	// true when a dynamic caster has moved since the shadow
+	// maps were last drawn
+	bool m_bShadowCastersDirty;
+	// dynamic casters of a shadow map layer that share a mesh
+	struct SHADOW_BATCH
+	{
+		uint8_t meshID;
+		int firstInstance;
+		int instanceCount;
+	};
+	// batches of every layer, starting at the layer's entry in
+	// m_shadowLayerStarts, and the records they draw
+	std::vector<SHADOW_BATCH> m_shadowBatches;
+	std::vector<int> m_shadowLayerStarts;
+	std::vector<InstancedMeshes::INSTANCE_DATA> m_shadowCasters;
+	// culling result of the draw list objects for one layer
+	std::vector<uint8_t> m_shadowFlags;
+	// node of the coffee cup, which is moved around the desk
+	// every frame when m_bMoveCup is true
+	int m_cupNode;
+	bool m_bMoveCup;
+	int m_cupFrame;
 
 	// load texture images and convert to OpenGL texture data
 	bool CreateGLTexture(const char* filename, std::string tag);
-	// bind loaded OpenGL textures to slots in memory
+	// upload the loaded textures and bind the texture arrays
 	void BindGLTextures();
-	// free the loaded OpenGL textures
-	void DestroyGLTextures();
-	// find a loaded texture by tag
-	int FindTextureID(std::string tag);
-	int FindTextureSlot(std::string tag);
-	// find a defined material by tag
-	bool FindMaterial(std::string tag, OBJECT_MATERIAL& material);
-
-	// set the transformation values 
-	// into the transform buffer
-	void SetTransformations(
+
+	void DefineObjectMaterials();
+
+	void SetupSceneLights();
+	// add a small point light whose light ends at radius
+	int AddClusteredLight(glm::vec3 position, glm::vec3 color, float radius);
+
+	// add a textured object to the precompiled draw list
+	int AddTexturedObject(
+		DrawList::MeshID mesh,
 		glm::vec3 scaleXYZ,
 		float XrotationDegrees,
 		float YrotationDegrees,
 		float ZrotationDegrees,
-		glm::vec3 positionXYZ);
-
-	// set the color values into the shader
-	void SetShaderColor(
-		float redColorValue,
-		float greenColorValue,
-		float blueColorValue,
-		float alphaValue);
-
-	// set the texture data into the shader
-	void SetShaderTexture(
-		std::string textureTag);
-
-	// set the UV scale for the texture mapping
-	void SetTextureUVScale(
-		float u, float v);
-
+		glm::vec3 positionXYZ,
+		std::string textureTag,
+		std::string materialTag,
+		glm::vec2 uvScale,
+		int parentNode = -1);
 
-	// set the object material into the shader
-	void SetShaderMaterial(
-		std::string materialTag);
+	// add a solid colored object to the precompiled draw list
+	int AddColoredObject(
+		DrawList::MeshID mesh,
+		glm::vec3 scaleXYZ,
+		float XrotationDegrees,
+		float YrotationDegrees,
+		float ZrotationDegrees,
+		glm::vec3 positionXYZ,
+		glm::vec4 color,
+		std::string materialTag,
+		int parentNode = -1);
 
-	void DefineObjectMaterials();
+	// create a transform node that only groups other objects
+	int CreateGroupNode(glm::vec3 positionXYZ, int parentNode = -1);
+	// get the objects of a node and all of its children
+	void CollectNodeObjects(int node, std::vector<int>& objects);
+	// flag the objects of a node and all of its children as static
+	void SetStaticNode(int node);
+	// flag the objects of a node and all of its children as occluders
+	void SetOccluderNode(int node);
+	// copy the recalculated world matrices into the draw list
+	void UpdateTransforms();
+	// merge the static draw list objects into static batches
+	void BuildStaticBatches();
+	// group the other draw list objects into instanced batches
+	void BuildInstanceBatches();
+	// upload the per-instance values of the draw list
+	void UpdateInstanceData();
+	// build the bounding volume hierarchy over the draw list
+	void BuildObjectBVH();
+	// flag the draw list objects inside the view frustum
+	void CullObjects();
+	// draw the occluders into the occlusion buffer, only the
+	// ones flagged as visible when visibleFlags is not NULL
+	void RasterizeOccluders(const uint8_t* visibleFlags);
+	// flag the visible objects hidden by the occluders
+	void CullOccludedObjects();
+	// pick the tessellation level of every visible object with
+	// a curved mesh from its size on screen
+	void SelectObjectLODs();
+	// lay out the draw list for the GPU culling path, when it
+	// is allowed and supported
+	void BuildIndirectScene();
+	// report the size on screen of every textured object to
+	// the texture streaming
+	void RequestTextureLevels();
 
-	void SetupSceneLights();
+	// find the basic mesh associated with the passed in ID, at
+	// a tessellation level when the mesh has several
+	const InstancedMeshes::GLMESH* FindMesh(uint8_t meshID, int lod = 0);
+	// submit the static and instanced batches to the render queue
+	void SubmitDraws();
+	// replay the sorted render queue, skipping redundant binds
+	void ExecuteDraws();
+	// draw the occluded objects as a wireframe overlay
+	void DrawOccludedObjects();
+	// make the program of a shader permutation current, or the
+	// general program when it cannot be used
+	void UsePermutation(int permutation);
+	// start drawing the scene, into the G-buffer when shading
+	// deferred
+	void BeginScenePass();
+	// light the G-buffer into the frame when shading deferred
+	void EndScenePass();
+	// set the depth and color writes of a pass of the scene
+	void BeginDrawPass(RenderQueue::PASS pass);
+	// draw the casters that changed into the shadow maps
+	void UpdateShadowMaps();
+	// cull the dynamic casters for every shadow map layer and
+	// upload their records
+	void BuildShadowCasters();
+	// draw the static or the dynamic casters of a layer
+	void DrawShadowCasters(int layer, bool bStatic, bool bDynamic);
 
 public:
 
@@ -106,6 +302,94 @@ public:
 	// customize for their own 3D scene
 	void PrepareScene();
 	void RenderScene();
+	// set the camera position used to order the draws
+	void SetViewPosition(glm::vec3 viewPosition) { m_viewPosition = viewPosition; }
+	// set the view-projection the objects are culled against
+	void SetViewProjection(const glm::mat4& viewProjection) { m_viewProjection = viewProjection; }
+	// set the projection scale used to size the objects on screen
+	void SetViewScale(float viewScale, bool bPerspective) { m_viewScale = viewScale; m_bPerspective = bPerspective; }
+	// set the most bytes of texture memory the streamed levels may use
+	void SetTextureBudget(size_t bytes) { m_textures.SetBudget(bytes); }
+	// bytes of texture memory used by the resident levels
+	size_t GetTextureBytes() const { return(m_textures.GetResidentBytes()); }
+	// allow or forbid the GPU culling path, before the scene
+	// is prepared
+	void SetGPUCulling(bool bAllow) { m_bAllowGPUCulling = bAllow; }
+	// objects drawn and culled by the CPU culling in the last
+	// frame, both 0 when the GPU culling path is used
+	int GetVisibleObjectCount() const { return(m_bGPUCulling ? 0 : m_visibleObjectCount); }
+	int GetCulledObjectCount() const { return(m_bGPUCulling ? 0 : m_drawList.GetObjectCount() - m_visibleObjectCount - m_occludedObjectCount); }
+	// allow or forbid culling the objects hidden by the occluders
+	void SetOcclusionCulling(bool bEnabled) { m_bOcclusionCulling = bEnabled; }
+	// draw the occluded objects on top of the scene, which uses
+	// the CPU culling path, before the scene is prepared
+	void SetShowOccluded(bool bShow) { m_bShowOccluded = bShow; }
+	// objects hidden by the occluders in the last frame, and
+	// the fraction of the viewport their bounds cover, both 0
+	// when the GPU culling path is used
+	int GetOccludedObjectCount() const { return(m_bGPUCulling ? 0 : m_occludedObjectCount); }
+	float GetOccludedScreenArea() const { return(m_bGPUCulling ? 0.0f : m_occludedScreenArea); }
+	// upload the mesh vertices compressed or as floats, before
+	// the scene is prepared
+	void SetVertexCompression(bool bCompressed) { m_basicMeshes->SetVertexCompression(bCompressed); }
+	// draw with specialised shader permutations, or with the
+	// general shader
+	void SetShaderPermutations(bool bEnabled) { m_bShaderPermutations = bEnabled; }
+	// scatter a number of small lights over the desk, before
+	// the scene is prepared
+	void SetScatteredLightCount(int count) { m_scatteredLightCount = count; }
+	// light the scene in a pass over the G-buffer, or in every
+	// draw, which can change between frames
+	void SetDeferredShading(bool bEnabled) { m_bDeferredShading = bEnabled; }
+	// true when the last frame was lit over the G-buffer, which
+	// is false when the deferred shading could not be used and
+	// the frame was shaded forward instead
+	bool IsDeferredFrame() const { return((m_scenePermutation & ShaderPermutations::PERMUTATION_GEOMETRY_PASS) != 0); }
+	// lay down the depth of the scene in a pass of its own, so
+	// each pixel is shaded once, which can change between frames
+	void SetDepthPrepass(bool bEnabled) { m_bDepthPrepass = bEnabled; }
+	// count the fragments shaded per covered pixel every frame
+	void SetMeasureOverdraw(bool bEnabled) { m_bMeasureOverdraw = bEnabled; }
+	// fragments shaded per covered pixel a few frames ago, 0
+	// when the overdraw is not measured
+	float GetOverdraw() const { return(m_overdrawCounter.GetOverdraw()); }
+	// let the directional and point lights cast shadows, which
+	// can change between frames
+	void SetShadows(bool bEnabled) { m_bShadows = bEnabled; }
+	// keep the static casters of the shadow maps between
+	// frames, or draw every caster each frame, before the
+	// scene is prepared
+	void SetShadowCache(bool bEnabled) { m_bShadowCache = bEnabled; }
+	// move the coffee cup around the desk every frame, so its
+	// shadows change
+	void SetMoveCup(bool bMove) { m_bMoveCup = bMove; }
+	// bytes of memory used by the shadow maps, and the layers
+	// drawn with the static and the dynamic casters in the
+	// last frame
+	size_t GetShadowMapBytes() const { return(m_shadowMaps.GetBytes()); }
+	int GetStaticShadowLayerDraws() const { return(m_shadowMaps.GetStaticLayerDraws()); }
+	int GetDynamicShadowLayerDraws() const { return(m_shadowMaps.GetDynamicLayerDraws()); }
+	// scatter a number of overlapping objects over the desk,
+	// before the scene is prepared
+	void SetScatteredObjectCount(int count) { m_scatteredObjectCount = count; }
+	// bytes of memory used by the G-buffer, 0 until the scene
+	// is first shaded deferred
+	size_t GetGBufferBytes() const { return(m_deferredRenderer.GetBytes()); }
+	// number of small point lights, and of their references in
+	// the cluster lists of the last update
+	int GetClusteredLightCount() const { return(m_lightClusters.GetLightCount()); }
+	int GetAssignedLightCount() const { return(m_lightClusters.GetAssignedCount()); }
+	// number of shader permutations compiled so far
+	int GetShaderPermutationCount() const { return(m_shaderPermutations.GetCompiledCount()); }
+	// visible objects with a curved mesh drawn with a level in
+	// the last frame, 0 when the GPU culling path is used
+	int GetLODObjectCount(int lod) const { return(m_bGPUCulling ? 0 : m_lodObjectCounts[lod]); }
+	// number of objects culled on the GPU, 0 when the CPU path is used
+	int GetIndirectObjectCount() const { return(m_bGPUCulling ? m_indirectScene.GetObjectCount() : 0); }
+	// state change counters of the last rendered frame
+	const RenderQueue::STATS& GetRenderStats() const { return(m_renderQueue.GetStats()); }
+	// compile the scene objects into the draw list
+	void CompileScene();
 	//loading the textures for the scene
 	void LoadSceneTextures();
 
@@ -0,0 +1,366 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderpermutations.cpp
+// ============
+// specialised variants of the scene shaders, compiled on first use
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderPermutations.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// declaration of the global variables and defines
+namespace
+{
+	/***********************************************************
+	 *  ReadFile()
+	 *
+	 *  This function is used for reading a whole shader file
+	 *  into a string, false when it cannot be opened.
+	 ***********************************************************/
+	bool ReadFile(const char* filename, std::string& text)
+	{
+		std::ifstream file(filename);
+		if (!file)
+		{
+			std::cout << "ERROR: could not open the shader " << filename << std::endl;
+			return(false);
+		}
+
+		std::stringstream source;
+		source << file.rdbuf();
+		text = source.str();
+		return(true);
+	}
+
+	/***********************************************************
+	 *  MakeDefines()
+	 *
+	 *  This function is used for writing the defines that
+	 *  select a permutation in the fragment shader.
+	 ***********************************************************/
+	std::string MakeDefines(int permutation)
+	{
+		std::stringstream defines;
+
+		defines << "#define PERMUTATION\n";
+		defines << "#define TEXTURED " <<
+			(((permutation & ShaderPermutations::PERMUTATION_TEXTURED) != 0) ? "true" : "false") << "\n";
+		defines << "#define LIGHTING " <<
+			(((permutation & ShaderPermutations::PERMUTATION_LIGHTING) != 0) ? "true" : "false") << "\n";
+		defines << "#define DIRECTIONAL_LIGHT " <<
+			(((permutation & ShaderPermutations::PERMUTATION_DIRECTIONAL_LIGHT) != 0) ? "true" : "false") << "\n";
+		defines << "#define POINT_LIGHT_COUNT " << (permutation >> ShaderPermutations::POINT_LIGHT_SHIFT) << "\n";
+		defines << "#define SPOT_LIGHT " <<
+			(((permutation & ShaderPermutations::PERMUTATION_SPOT_LIGHT) != 0) ? "true" : "false") << "\n";
+		defines << "#define CLUSTERED_LIGHTS " <<
+			(((permutation & ShaderPermutations::PERMUTATION_CLUSTERED_LIGHTS) != 0) ? "true" : "false") << "\n";
+		if ((permutation & ShaderPermutations::PERMUTATION_GEOMETRY_PASS) != 0)
+		{
+			defines << "#define GEOMETRY_PASS\n";
+		}
+		if ((permutation & ShaderPermutations::PERMUTATION_LIGHTING_PASS) != 0)
+		{
+			defines << "#define LIGHTING_PASS\n";
+		}
+		if ((permutation & ShaderPermutations::PERMUTATION_DEPTH_PASS) != 0)
+		{
+			defines << "#define DEPTH_PASS\n";
+		}
+
+		return(defines.str());
+	}
+}
+
+/***********************************************************
+ *  ShaderPermutations()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShaderPermutations::ShaderPermutations()
+{
+	m_vertexShader = 0;
+	m_screenVertexShader = 0;
+	for (int i = 0; i < PERMUTATION_COUNT; i++)
+	{
+		m_programs[i] = 0;
+		m_bFailed[i] = false;
+	}
+	m_compiledCount = 0;
+	m_pUniformBuffers = NULL;
+}
+
+/***********************************************************
+ *  ~ShaderPermutations()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ShaderPermutations::~ShaderPermutations()
+{
+	for (int i = 0; i < PERMUTATION_COUNT; i++)
+	{
+		if (m_programs[i] != 0)
+		{
+			glDeleteProgram(m_programs[i]);
+			m_programs[i] = 0;
+		}
+	}
+
+	if (m_vertexShader != 0)
+	{
+		glDeleteShader(m_vertexShader);
+		m_vertexShader = 0;
+	}
+	if (m_screenVertexShader != 0)
+	{
+		glDeleteShader(m_screenVertexShader);
+		m_screenVertexShader = 0;
+	}
+	m_pUniformBuffers = NULL;
+}
+
+/***********************************************************
+ *  MakeLightPermutation()
+ *
+ *  This method is used for packing the lighting state into
+ *  the bits of a permutation.  The lights are all left out
+ *  when lighting is not used, so the unlit objects share
+ *  one permutation whatever lights are active.
+ ***********************************************************/
+int ShaderPermutations::MakeLightPermutation(
+	bool bLighting,
+	bool bDirectionalLight,
+	int pointLightCount,
+	bool bSpotLight,
+	bool bClusteredLights)
+{
+	if (bLighting == false)
+	{
+		return(0);
+	}
+
+	int permutation = PERMUTATION_LIGHTING;
+	if (bDirectionalLight == true)
+	{
+		permutation |= PERMUTATION_DIRECTIONAL_LIGHT;
+	}
+	if (bSpotLight == true)
+	{
+		permutation |= PERMUTATION_SPOT_LIGHT;
+	}
+	if (bClusteredLights == true)
+	{
+		permutation |= PERMUTATION_CLUSTERED_LIGHTS;
+	}
+	if (pointLightCount > UniformBuffers::TOTAL_POINT_LIGHTS)
+	{
+		pointLightCount = UniformBuffers::TOTAL_POINT_LIGHTS;
+	}
+	permutation |= pointLightCount << POINT_LIGHT_SHIFT;
+
+	return(permutation);
+}
+
+/***********************************************************
+ *  Create()
+ *
+ *  This method is used for reading the shader sources and
+ *  compiling the vertex shader, which is the same for every
+ *  permutation.  The fragment shaders are compiled when
+ *  their permutation is first used.
+ ***********************************************************/
+bool ShaderPermutations::Create(const char* vertexShaderFile, const char* fragmentShaderFile, UniformBuffers* pUniformBuffers)
+{
+	m_pUniformBuffers = pUniformBuffers;
+
+	if ((ReadFile(vertexShaderFile, m_vertexSource) == false) ||
+		(ReadFile(fragmentShaderFile, m_fragmentSource) == false))
+	{
+		return(false);
+	}
+
+	m_vertexShader = CompileShader(GL_VERTEX_SHADER, m_vertexSource, std::string());
+	return(m_vertexShader != 0);
+}
+
+/***********************************************************
+ *  SetConstantInt()
+ *
+ *  This method is used for setting an integer uniform in
+ *  every permutation.  The value is kept for the ones that
+ *  are compiled later, and the ones already compiled are
+ *  set right away, leaving the current program in use.
+ ***********************************************************/
+void ShaderPermutations::SetConstantInt(UniformId id, int value, int element)
+{
+	bool bFound = false;
+	for (size_t i = 0; i < m_constants.size(); i++)
+	{
+		if ((m_constants[i].id.slot == id.slot) && (m_constants[i].element == element))
+		{
+			m_constants[i].value = value;
+			bFound = true;
+		}
+	}
+	if (bFound == false)
+	{
+		CONSTANT constant = { id, element, value };
+		m_constants.push_back(constant);
+	}
+
+	if (m_compiledCount == 0)
+	{
+		return;
+	}
+
+	GLint currentProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &currentProgram);
+	for (int i = 0; i < PERMUTATION_COUNT; i++)
+	{
+		if (m_programs[i] != 0)
+		{
+			glUseProgram(m_programs[i]);
+			m_uniforms.LoadProgram();
+			m_uniforms.SetInt(id, value, element);
+		}
+	}
+	glUseProgram((GLuint)currentProgram);
+}
+
+/***********************************************************
+ *  Use()
+ *
+ *  This method is used for making the program of a
+ *  permutation current.  A permutation that failed once is
+ *  not compiled again, and the caller falls back to the
+ *  general shader for it.
+ ***********************************************************/
+bool ShaderPermutations::Use(int permutation)
+{
+	if ((permutation < 0) || (permutation >= PERMUTATION_COUNT) ||
+		(m_vertexShader == 0) || (m_bFailed[permutation] == true))
+	{
+		return(false);
+	}
+
+	if (m_programs[permutation] == 0)
+	{
+		m_programs[permutation] = CompileProgram(permutation);
+		if (m_programs[permutation] == 0)
+		{
+			m_bFailed[permutation] = true;
+			return(false);
+		}
+		m_compiledCount++;
+	}
+
+	glUseProgram(m_programs[permutation]);
+	return(true);
+}
+
+/***********************************************************
+ *  CompileProgram()
+ *
+ *  This method is used for compiling the fragment shader of
+ *  a permutation and linking it with the shared vertex
+ *  shader, or for the lighting pass with the vertex shader
+ *  that covers the screen, compiled the first time it is
+ *  needed.  The new program is attached to the uniform
+ *  blocks and given the constant uniforms, and is left in
+ *  use.
+ ***********************************************************/
+GLuint ShaderPermutations::CompileProgram(int permutation)
+{
+	GLuint vertexShader = m_vertexShader;
+	if ((permutation & PERMUTATION_LIGHTING_PASS) != 0)
+	{
+		if (m_screenVertexShader == 0)
+		{
+			m_screenVertexShader = CompileShader(GL_VERTEX_SHADER, m_vertexSource, "#define LIGHTING_PASS\n");
+			if (m_screenVertexShader == 0)
+			{
+				return(0);
+			}
+		}
+		vertexShader = m_screenVertexShader;
+	}
+
+	GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, m_fragmentSource, MakeDefines(permutation));
+	if (fragmentShader == 0)
+	{
+		return(0);
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	glLinkProgram(program);
+	glDetachShader(program, vertexShader);
+	glDetachShader(program, fragmentShader);
+	glDeleteShader(fragmentShader);
+
+	GLint success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		char infoLog[1024];
+		glGetProgramInfoLog(program, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR: shader permutation " << permutation << " linking failed\n" << infoLog << std::endl;
+		glDeleteProgram(program);
+		return(0);
+	}
+
+	if (m_pUniformBuffers != NULL)
+	{
+		m_pUniformBuffers->BindProgram(program);
+	}
+
+	glUseProgram(program);
+	m_uniforms.LoadProgram();
+	for (size_t i = 0; i < m_constants.size(); i++)
+	{
+		m_uniforms.SetInt(m_constants[i].id, m_constants[i].value, m_constants[i].element);
+	}
+
+	return(program);
+}
+
+/***********************************************************
+ *  CompileShader()
+ *
+ *  This method is used for compiling a shader with the
+ *  defines inserted after its version line.  A #line
+ *  directive follows them, so the compile errors report
+ *  the lines of the file.
+ ***********************************************************/
+GLuint ShaderPermutations::CompileShader(GLenum type, const std::string& source, const std::string& defines)
+{
+	const size_t versionEnd = source.find('\n');
+	const std::string version = (versionEnd == std::string::npos) ? source : source.substr(0, versionEnd + 1);
+	const std::string header = defines + "#line 2\n";
+	const char* parts[3] =
+	{
+		version.c_str(),
+		header.c_str(),
+		(versionEnd == std::string::npos) ? "" : source.c_str() + versionEnd + 1
+	};
+
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 3, parts, NULL);
+	glCompileShader(shader);
+
+	GLint success = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		char infoLog[1024];
+		glGetShaderInfoLog(shader, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR: shader permutation compilation failed\n" << defines << infoLog << std::endl;
+		glDeleteShader(shader);
+		return(0);
+	}
+
+	return(shader);
+}
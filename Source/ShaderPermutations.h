@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderpermutations.h
+// ============
+// specialised variants of the scene shaders, compiled on first use
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "UniformBuffers.h"
+#include "UniformCache.h"
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  ShaderPermutations
+ *
+ *  This class compiles variants of the scene shaders with
+ *  the state that the general fragment shader branches on
+ *  defined after the version line: whether the object is
+ *  textured, whether lighting is used, which of the
+ *  directional and spot lights are active, how many point
+ *  lights are active, and whether there are clustered
+ *  lights.  The compiler removes the branches and the unused
+ *  lights, so each fragment only pays for the lights it is
+ *  really lit by.  The passes of the deferred shading are
+ *  permutations of the same files, so both paths share one
+ *  copy of the lighting code.
+ *
+ *  A permutation is a small integer, used as the shader key
+ *  of the render queue.  Its program is compiled and linked
+ *  the first time it is used, attached to the uniform
+ *  blocks, and given the constant uniforms, like the
+ *  sampler units, that were set for every permutation.
+ ***********************************************************/
+class ShaderPermutations
+{
+public:
+	// constructor
+	ShaderPermutations();
+	// destructor
+	~ShaderPermutations();
+
+	// bits of a permutation, the number of active point lights
+	// is stored from POINT_LIGHT_SHIFT on; the geometry pass
+	// writes the G-buffer of the deferred shading instead of a
+	// color, the lighting pass lights it over the screen, and
+	// the depth pass only writes the depth
+	enum PERMUTATION_BIT
+	{
+		PERMUTATION_TEXTURED = 1,
+		PERMUTATION_LIGHTING = 2,
+		PERMUTATION_DIRECTIONAL_LIGHT = 4,
+		PERMUTATION_SPOT_LIGHT = 8,
+		PERMUTATION_CLUSTERED_LIGHTS = 16,
+		PERMUTATION_GEOMETRY_PASS = 32,
+		PERMUTATION_LIGHTING_PASS = 64,
+		PERMUTATION_DEPTH_PASS = 128
+	};
+	static const int POINT_LIGHT_SHIFT = 8;
+	// number of different permutations
+	static const int PERMUTATION_COUNT = (UniformBuffers::TOTAL_POINT_LIGHTS + 1) << POINT_LIGHT_SHIFT;
+
+	// permutation of the lighting state, without the texture
+	// bit, no light is used when bLighting is false
+	static int MakeLightPermutation(
+		bool bLighting,
+		bool bDirectionalLight,
+		int pointLightCount,
+		bool bSpotLight,
+		bool bClusteredLights);
+
+	// read the shader files and compile the vertex shader that
+	// every permutation shares, false when it fails
+	bool Create(const char* vertexShaderFile, const char* fragmentShaderFile, UniformBuffers* pUniformBuffers);
+	// set an integer uniform, like a sampler unit, in every
+	// permutation compiled now or later
+	void SetConstantInt(UniformId id, int value, int element = 0);
+
+	// make the program of a permutation current, compiling it
+	// first when needed, false when it cannot be compiled
+	bool Use(int permutation);
+
+	// number of permutations compiled so far
+	int GetCompiledCount() const { return(m_compiledCount); }
+
+private:
+	// an integer uniform set in every permutation
+	struct CONSTANT
+	{
+		UniformId id;
+		int element;
+		int value;
+	};
+
+	// sources the permutations are compiled from
+	std::string m_vertexSource;
+	std::string m_fragmentSource;
+	// vertex shader attached to every program, and the one
+	// covering the screen for the lighting pass
+	GLuint m_vertexShader;
+	GLuint m_screenVertexShader;
+	// program of each permutation, 0 until it is compiled
+	GLuint m_programs[PERMUTATION_COUNT];
+	// true for a permutation that failed to compile
+	bool m_bFailed[PERMUTATION_COUNT];
+	int m_compiledCount;
+	std::vector<CONSTANT> m_constants;
+	// locations of the program being set up
+	UniformCache m_uniforms;
+	UniformBuffers* m_pUniformBuffers;
+
+	// compile and link the program of a permutation
+	GLuint CompileProgram(int permutation);
+	// compile one shader from its source, with the defines
+	// inserted after the version line
+	static GLuint CompileShader(GLenum type, const std::string& source, const std::string& defines);
+};
@@ -0,0 +1,532 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadowmaps.cpp
+// ============
+// depth maps of the scene lights, with the static casters cached between frames
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShadowMaps.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <iostream>
+
+// declaration of the global variables and defines
+namespace
+{
+	// looking direction and up vector of each cube face
+	const glm::vec3 g_FaceDirections[ShadowMaps::CUBE_FACES] =
+	{
+		glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+		glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+	};
+	const glm::vec3 g_FaceUps[ShadowMaps::CUBE_FACES] =
+	{
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+	};
+
+	// the layers hold 16-bit depths, which is enough for the
+	// tight depth ranges the layers are fitted to
+	const size_t g_TexelBytes = 2;
+
+	// closest a point light layer starts from its light
+	const float g_MinimumNear = 0.5f;
+}
+
+/***********************************************************
+ *  ShadowMaps()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShadowMaps::ShadowMaps()
+{
+	m_staticTexture = 0;
+	m_liveTexture = 0;
+	m_allocatedLayers = 0;
+	m_framebuffer = 0;
+	m_readFramebuffer = 0;
+	m_bCopyImage = false;
+	m_casterBuffer = 0;
+	m_casterVertexArray = 0;
+	m_casterCapacity = 0;
+	m_lightDirection = glm::vec3(0.0f, -1.0f, 0.0f);
+	m_bDirectionalLight = false;
+	for (int i = 0; i < UniformBuffers::TOTAL_POINT_LIGHTS; i++)
+	{
+		m_pointPositions[i] = glm::vec3(0.0f);
+	}
+	// no lights have been set yet
+	m_pointLightCount = -1;
+	m_layerCount = 1;
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		m_views[layer] = glm::mat4(1.0f);
+		m_projections[layer] = glm::mat4(1.0f);
+		m_positions[layer] = glm::vec3(0.0f);
+		m_bStaticOnly[layer] = false;
+	}
+	m_directionalTexelSize = 0.0f;
+	m_bStaticValid = false;
+	m_frameFramebuffer = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		m_frameViewport[i] = 0;
+	}
+	m_staticLayerDraws = 0;
+	m_dynamicLayerDraws = 0;
+}
+
+/***********************************************************
+ *  ~ShadowMaps()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ShadowMaps::~ShadowMaps()
+{
+	Release();
+
+	if (m_casterVertexArray != 0)
+	{
+		glDeleteVertexArrays(1, &m_casterVertexArray);
+		m_casterVertexArray = 0;
+	}
+	if (m_casterBuffer != 0)
+	{
+		glDeleteBuffers(1, &m_casterBuffer);
+		m_casterBuffer = 0;
+	}
+}
+
+/***********************************************************
+ *  SetLights()
+ *
+ *  This method is used for taking the lights that cast
+ *  shadows from the light table.  The active point lights
+ *  are kept in the order the table is uploaded in, so the
+ *  shaders find the layers of a light from its index.  The
+ *  colors of the lights do not change the shadows, so only
+ *  their directions and positions are compared.
+ ***********************************************************/
+bool ShadowMaps::SetLights(const UniformBuffers::LIGHT_BLOCK& lights)
+{
+	const bool bDirectionalLight = (lights.directionalLight.bActive != 0);
+	glm::vec3 pointPositions[UniformBuffers::TOTAL_POINT_LIGHTS];
+	int pointLightCount = 0;
+	for (int i = 0; i < UniformBuffers::TOTAL_POINT_LIGHTS; i++)
+	{
+		if (lights.pointLights[i].bActive != 0)
+		{
+			pointPositions[pointLightCount++] = lights.pointLights[i].position;
+		}
+	}
+
+	bool bChanged = (bDirectionalLight != m_bDirectionalLight) || (pointLightCount != m_pointLightCount) ||
+		((bDirectionalLight == true) && (lights.directionalLight.direction != m_lightDirection));
+	for (int i = 0; (bChanged == false) && (i < pointLightCount); i++)
+	{
+		bChanged = (pointPositions[i] != m_pointPositions[i]);
+	}
+	if (bChanged == false)
+	{
+		return(false);
+	}
+
+	m_bDirectionalLight = bDirectionalLight;
+	m_lightDirection = lights.directionalLight.direction;
+	m_pointLightCount = pointLightCount;
+	for (int i = 0; i < pointLightCount; i++)
+	{
+		m_pointPositions[i] = pointPositions[i];
+	}
+	m_layerCount = 1 + CUBE_FACES * pointLightCount;
+	m_bStaticValid = false;
+
+	return(true);
+}
+
+/***********************************************************
+ *  FitLayers()
+ *
+ *  This method is used for fitting the projection of every
+ *  layer around the scene bounds.  The directional layer
+ *  covers the bounds as seen along the light, and the cube
+ *  faces of a point light reach from near the bounds to
+ *  their farthest corner, which keeps the depth precision
+ *  where the casters are.
+ ***********************************************************/
+void ShadowMaps::FitLayers(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	glm::vec3 corners[8];
+	for (int i = 0; i < 8; i++)
+	{
+		corners[i] = glm::vec3(
+			((i & 1) != 0) ? boundsMax.x : boundsMin.x,
+			((i & 2) != 0) ? boundsMax.y : boundsMin.y,
+			((i & 4) != 0) ? boundsMax.z : boundsMin.z);
+	}
+
+	// the directional light looks at the center of the bounds
+	// from outside them
+	glm::vec3 direction = m_lightDirection;
+	direction = (glm::length(direction) > 0.0f) ? glm::normalize(direction) : glm::vec3(0.0f, -1.0f, 0.0f);
+	const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	const float radius = glm::length(boundsMax - boundsMin) * 0.5f + 1.0f;
+	const glm::vec3 up = (fabsf(direction.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, -1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+	m_positions[0] = center - direction * radius;
+	m_views[0] = glm::lookAt(m_positions[0], center, up);
+	glm::vec3 viewMin(0.0f);
+	glm::vec3 viewMax(0.0f);
+	for (int i = 0; i < 8; i++)
+	{
+		const glm::vec3 corner = glm::vec3(m_views[0] * glm::vec4(corners[i], 1.0f));
+		viewMin = (i == 0) ? corner : glm::min(viewMin, corner);
+		viewMax = (i == 0) ? corner : glm::max(viewMax, corner);
+	}
+	m_projections[0] = glm::ortho(viewMin.x, viewMax.x, viewMin.y, viewMax.y, -viewMax.z - 0.1f, -viewMin.z + 0.1f);
+	m_directionalTexelSize = glm::max(viewMax.x - viewMin.x, viewMax.y - viewMin.y) / MAP_SIZE;
+
+	for (int light = 0; light < m_pointLightCount; light++)
+	{
+		const glm::vec3& position = m_pointPositions[light];
+		const glm::vec3 closest = glm::min(glm::max(position, boundsMin), boundsMax);
+		float farPlane = 0.0f;
+		for (int i = 0; i < 8; i++)
+		{
+			farPlane = glm::max(farPlane, glm::length(corners[i] - position));
+		}
+		const float nearPlane = glm::max(glm::length(closest - position) * 0.5f, g_MinimumNear);
+		farPlane = glm::max(farPlane * 1.01f, nearPlane + 1.0f);
+
+		for (int face = 0; face < CUBE_FACES; face++)
+		{
+			const int layer = 1 + CUBE_FACES * light + face;
+			m_positions[layer] = position;
+			m_views[layer] = glm::lookAt(position, position + g_FaceDirections[face], g_FaceUps[face]);
+			m_projections[layer] = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
+		}
+	}
+
+	m_bStaticValid = false;
+}
+
+/***********************************************************
+ *  FillShadowBlock()
+ *
+ *  This method is used for filling the shadow values read
+ *  by the shaders, with the matrix of each layer from world
+ *  space to its clip space.  A cube face texel covers twice
+ *  its distance from the light divided by the map size.
+ ***********************************************************/
+void ShadowMaps::FillShadowBlock(UniformBuffers::SHADOW_BLOCK& shadows) const
+{
+	shadows = UniformBuffers::SHADOW_BLOCK();
+	for (int layer = 0; layer < m_layerCount; layer++)
+	{
+		shadows.shadowMatrices[layer] = m_projections[layer] * m_views[layer];
+	}
+	shadows.directionalTexelSize = m_directionalTexelSize;
+	shadows.pointTexelSize = 2.0f / MAP_SIZE;
+	shadows.bDirectionalShadow = m_bDirectionalLight ? 1 : 0;
+	shadows.pointShadowCount = (m_pointLightCount > 0) ? m_pointLightCount : 0;
+}
+
+/***********************************************************
+ *  BeginUpdate()
+ *
+ *  This method is used for starting to draw the layers.
+ *  The arrays are created again when the number of layers
+ *  changed, and the framebuffer of the frame and its
+ *  viewport are kept to be restored.  The casters are drawn
+ *  with a depth offset that grows with their slope, which
+ *  keeps the lit surfaces from shadowing themselves.
+ ***********************************************************/
+bool ShadowMaps::BeginUpdate()
+{
+	if ((m_liveTexture == 0) || (m_allocatedLayers != m_layerCount))
+	{
+		if (CreateTextures(m_layerCount) == false)
+		{
+			return(false);
+		}
+	}
+
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_frameFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, m_frameViewport);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+	glViewport(0, 0, MAP_SIZE, MAP_SIZE);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+
+	return(true);
+}
+
+/***********************************************************
+ *  BeginStaticLayer()
+ *
+ *  This method is used for clearing a static layer and
+ *  attaching it, so the static casters are drawn into it.
+ ***********************************************************/
+void ShadowMaps::BeginStaticLayer(int layer)
+{
+	BindLayer(m_staticTexture, layer, true);
+	m_staticLayerDraws++;
+}
+
+/***********************************************************
+ *  EndStatic()
+ *
+ *  This method is used for marking the static layers as up
+ *  to date.  The layers the shaders read still hold the
+ *  old static casters, so each of them is copied again.
+ ***********************************************************/
+void ShadowMaps::EndStatic()
+{
+	m_bStaticValid = true;
+	for (int layer = 0; layer < LAYER_COUNT; layer++)
+	{
+		m_bStaticOnly[layer] = false;
+	}
+}
+
+/***********************************************************
+ *  BeginDynamicLayer()
+ *
+ *  This method is used for restoring a layer the shaders
+ *  read from its static layer, and attaching it, so the
+ *  dynamic casters are drawn on top.  A layer that held no
+ *  dynamic casters since its last copy, and still has
+ *  none, is already right and is skipped.
+ ***********************************************************/
+bool ShadowMaps::BeginDynamicLayer(int layer, bool bCasters)
+{
+	if ((bCasters == false) && (m_bStaticOnly[layer] == true))
+	{
+		return(false);
+	}
+
+	if (m_bCopyImage == true)
+	{
+		glCopyImageSubData(
+			m_staticTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer,
+			m_liveTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer,
+			MAP_SIZE, MAP_SIZE, 1);
+		BindLayer(m_liveTexture, layer, false);
+	}
+	else
+	{
+		GLint frameReadFramebuffer = 0;
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &frameReadFramebuffer);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, m_readFramebuffer);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_staticTexture, 0, layer);
+		BindLayer(m_liveTexture, layer, false);
+		glBlitFramebuffer(0, 0, MAP_SIZE, MAP_SIZE, 0, 0, MAP_SIZE, MAP_SIZE, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, (GLuint)frameReadFramebuffer);
+	}
+
+	m_bStaticOnly[layer] = !bCasters;
+	if (bCasters == true)
+	{
+		m_dynamicLayerDraws++;
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  BeginUncachedLayer()
+ *
+ *  This method is used for clearing a layer the shaders
+ *  read and attaching it, so every caster is drawn into it
+ *  again, as shadow maps without a cache are.
+ ***********************************************************/
+void ShadowMaps::BeginUncachedLayer(int layer)
+{
+	BindLayer(m_liveTexture, layer, true);
+	m_bStaticOnly[layer] = false;
+	m_staticLayerDraws++;
+	m_dynamicLayerDraws++;
+}
+
+/***********************************************************
+ *  EndUpdate()
+ *
+ *  This method is used for drawing into the framebuffer of
+ *  the frame again, with its viewport, and without the
+ *  depth offset of the casters.
+ ***********************************************************/
+void ShadowMaps::EndUpdate()
+{
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(0.0f, 0.0f);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)m_frameFramebuffer);
+	glViewport(m_frameViewport[0], m_frameViewport[1], m_frameViewport[2], m_frameViewport[3]);
+}
+
+/***********************************************************
+ *  UploadCasters()
+ *
+ *  This method is used for replacing the records of the
+ *  dynamic casters.  The buffer only grows, and is orphaned
+ *  before each write, so the draws of the last update keep
+ *  their records.  The vertex array is created with the
+ *  buffer, and keeps reading it when it grows.
+ ***********************************************************/
+void ShadowMaps::UploadCasters(InstancedMeshes& meshes, const InstancedMeshes::INSTANCE_DATA* casters, int casterCount)
+{
+	if (m_casterBuffer == 0)
+	{
+		glGenBuffers(1, &m_casterBuffer);
+	}
+
+	const size_t bytes = sizeof(InstancedMeshes::INSTANCE_DATA) * ((casterCount > 0) ? casterCount : 1);
+	glBindBuffer(GL_ARRAY_BUFFER, m_casterBuffer);
+	if (bytes > m_casterCapacity)
+	{
+		m_casterCapacity = bytes;
+	}
+	glBufferData(GL_ARRAY_BUFFER, m_casterCapacity, NULL, GL_DYNAMIC_DRAW);
+	if (casterCount > 0)
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(InstancedMeshes::INSTANCE_DATA) * casterCount, casters);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (m_casterVertexArray == 0)
+	{
+		m_casterVertexArray = meshes.CreateVertexArray(m_casterBuffer);
+	}
+}
+
+/***********************************************************
+ *  GetBytes()
+ *
+ *  This method is used for getting the memory used by the
+ *  static layers and the layers the shaders read.
+ ***********************************************************/
+size_t ShadowMaps::GetBytes() const
+{
+	return((size_t)2 * MAP_SIZE * MAP_SIZE * g_TexelBytes * m_allocatedLayers);
+}
+
+/***********************************************************
+ *  CreateTextures()
+ *
+ *  This method is used for creating the static array and
+ *  the array the shaders read, with the passed in number of
+ *  layers.  The one the shaders read compares the depths
+ *  with linear filtering, which blends the results of four
+ *  texels, and stays bound to its texture unit.  The static
+ *  layers are copied into it, directly when the driver can
+ *  copy images, and through a second framebuffer when not.
+ ***********************************************************/
+bool ShadowMaps::CreateTextures(int layerCount)
+{
+	Release();
+
+	glGenTextures(1, &m_staticTexture);
+	glGenTextures(1, &m_liveTexture);
+	glActiveTexture(GL_TEXTURE0 + SHADOW_UNIT);
+
+	const GLuint textures[2] = { m_staticTexture, m_liveTexture };
+	for (int i = 0; i < 2; i++)
+	{
+		const bool bLive = (textures[i] == m_liveTexture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textures[i]);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT16, MAP_SIZE, MAP_SIZE, layerCount, 0,
+			GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, bLive ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, bLive ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		if (bLive == true)
+		{
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		}
+	}
+	glActiveTexture(GL_TEXTURE0);
+	m_allocatedLayers = layerCount;
+
+	GLint frameFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &frameFramebuffer);
+	glGenFramebuffers(1, &m_framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_liveTexture, 0, 0);
+	glDrawBuffer(GL_NONE);
+	const GLenum status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)frameFramebuffer);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR: the shadow map framebuffer is incomplete, status 0x" << std::hex << status << std::dec << std::endl;
+		Release();
+		return(false);
+	}
+
+	m_bCopyImage = (GLEW_VERSION_4_3 || GLEW_ARB_copy_image) ? true : false;
+	if (m_bCopyImage == false)
+	{
+		GLint frameReadFramebuffer = 0;
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &frameReadFramebuffer);
+		glGenFramebuffers(1, &m_readFramebuffer);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, m_readFramebuffer);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, (GLuint)frameReadFramebuffer);
+	}
+
+	m_bStaticValid = false;
+	return(true);
+}
+
+/***********************************************************
+ *  BindLayer()
+ *
+ *  This method is used for attaching a layer of one of the
+ *  arrays to the framebuffer, and clearing it to the far
+ *  plane when asked.
+ ***********************************************************/
+void ShadowMaps::BindLayer(GLuint texture, int layer, bool bClear)
+{
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+	if (bClear == true)
+	{
+		const GLfloat farDepth = 1.0f;
+		glClearBufferfv(GL_DEPTH, 0, &farDepth);
+	}
+}
+
+/***********************************************************
+ *  Release()
+ *
+ *  This method is used for deleting the arrays and the
+ *  framebuffers.
+ ***********************************************************/
+void ShadowMaps::Release()
+{
+	if (m_framebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &m_framebuffer);
+		m_framebuffer = 0;
+	}
+	if (m_readFramebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &m_readFramebuffer);
+		m_readFramebuffer = 0;
+	}
+	if (m_staticTexture != 0)
+	{
+		glDeleteTextures(1, &m_staticTexture);
+		m_staticTexture = 0;
+	}
+	if (m_liveTexture != 0)
+	{
+		glDeleteTextures(1, &m_liveTexture);
+		m_liveTexture = 0;
+	}
+	m_allocatedLayers = 0;
+}
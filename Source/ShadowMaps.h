@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadowmaps.h
+// ============
+// depth maps of the scene lights, with the static casters cached between frames
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "InstancedMeshes.h"
+#include "UniformBuffers.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+/***********************************************************
+ *  ShadowMaps
+ *
+ *  This class owns the shadow maps of the directional light
+ *  and of the active point lights, as the layers of one
+ *  depth texture array, so the shaders read every shadow
+ *  through a single sampler.  Layer 0 is seen from the
+ *  directional light with an orthographic projection fitted
+ *  around the scene, and each point light has six layers
+ *  after it, one per cube face, in the +X, -X, +Y, -Y, +Z,
+ *  -Z order.
+ *
+ *  The static casters are drawn into a second array that
+ *  is kept between frames, and only drawn again when a
+ *  static object or a light changes.  A layer the shaders
+ *  read is made by copying its static layer and drawing
+ *  the dynamic casters on top, and is left alone while the
+ *  casters that reach it do not move.
+ ***********************************************************/
+class ShadowMaps
+{
+public:
+	// constructor
+	ShadowMaps();
+	// destructor
+	~ShadowMaps();
+
+	// texture unit the shadow maps are read from
+	static const int SHADOW_UNIT = 16;
+	// width and height of every layer in texels
+	static const int MAP_SIZE = 1024;
+	// layers of a point light
+	static const int CUBE_FACES = 6;
+
+	// replace the lights that cast shadows, true when they
+	// differ from the ones the static layers were drawn for,
+	// which are then out of date
+	bool SetLights(const UniformBuffers::LIGHT_BLOCK& lights);
+	// fit the projections of the layers around the scene
+	// bounds, which puts the static layers out of date
+	void FitLayers(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	// put the static layers out of date after a static
+	// object changed
+	void InvalidateStatic() { m_bStaticValid = false; }
+	// true when the static layers hold the current static
+	// casters as seen from the current lights
+	bool IsStaticValid() const { return(m_bStaticValid); }
+
+	// number of layers used by the current lights
+	int GetLayerCount() const { return(m_layerCount); }
+	// camera values to draw the casters of a layer with
+	const glm::mat4& GetLayerView(int layer) const { return(m_views[layer]); }
+	const glm::mat4& GetLayerProjection(int layer) const { return(m_projections[layer]); }
+	const glm::vec3& GetLayerPosition(int layer) const { return(m_positions[layer]); }
+	// fill the shadow values read by the shaders
+	void FillShadowBlock(UniformBuffers::SHADOW_BLOCK& shadows) const;
+
+	// start drawing into the layers, creating the arrays for
+	// the current lights, false when they cannot be created
+	bool BeginUpdate();
+	// draw the static casters of a layer into its cleared
+	// static layer
+	void BeginStaticLayer(int layer);
+	// mark the static layers as drawn for the current lights
+	void EndStatic();
+	// draw the dynamic casters of a layer on top of a copy of
+	// its static layer, false when the layer already holds
+	// the static layer alone and has no casters to add
+	bool BeginDynamicLayer(int layer, bool bCasters);
+	// draw every caster of a layer into it from scratch, when
+	// the static layers are not cached
+	void BeginUncachedLayer(int layer);
+	// draw into the framebuffer of the frame again
+	void EndUpdate();
+
+	// upload the records of the dynamic casters, drawn with
+	// the caster vertex array bound
+	void UploadCasters(InstancedMeshes& meshes, const InstancedMeshes::INSTANCE_DATA* casters, int casterCount);
+	GLuint GetCasterBuffer() const { return(m_casterBuffer); }
+	GLuint GetCasterVertexArray() const { return(m_casterVertexArray); }
+
+	// layers drawn with static and with dynamic casters since
+	// the counters were reset
+	int GetStaticLayerDraws() const { return(m_staticLayerDraws); }
+	int GetDynamicLayerDraws() const { return(m_dynamicLayerDraws); }
+	void ResetLayerDraws() { m_staticLayerDraws = 0; m_dynamicLayerDraws = 0; }
+	// bytes of memory used by the two arrays
+	size_t GetBytes() const;
+
+private:
+	static const int LAYER_COUNT = UniformBuffers::TOTAL_SHADOW_LAYERS;
+
+	// static layers, and the layers the shaders read
+	GLuint m_staticTexture;
+	GLuint m_liveTexture;
+	// layers allocated in both arrays
+	int m_allocatedLayers;
+	// framebuffer a layer is attached to while it is drawn,
+	// and the one a static layer is read from when images
+	// cannot be copied directly
+	GLuint m_framebuffer;
+	GLuint m_readFramebuffer;
+	bool m_bCopyImage;
+	// records of the dynamic casters, and a vertex array over
+	// the shared meshes that reads them
+	GLuint m_casterBuffer;
+	GLuint m_casterVertexArray;
+	size_t m_casterCapacity;
+
+	// lights the layers are seen from
+	glm::vec3 m_lightDirection;
+	bool m_bDirectionalLight;
+	glm::vec3 m_pointPositions[UniformBuffers::TOTAL_POINT_LIGHTS];
+	int m_pointLightCount;
+	int m_layerCount;
+	// camera values of every layer
+	glm::mat4 m_views[LAYER_COUNT];
+	glm::mat4 m_projections[LAYER_COUNT];
+	glm::vec3 m_positions[LAYER_COUNT];
+	float m_directionalTexelSize;
+	// true when the static layers are up to date, and for each
+	// layer true when it holds its static layer alone
+	bool m_bStaticValid;
+	bool m_bStaticOnly[LAYER_COUNT];
+
+	// framebuffer and viewport of the frame while the layers
+	// are drawn
+	GLint m_frameFramebuffer;
+	GLint m_frameViewport[4];
+	int m_staticLayerDraws;
+	int m_dynamicLayerDraws;
+
+	// create the two arrays with the layers of the lights
+	bool CreateTextures(int layerCount);
+	// attach a layer of an array and clear it when asked
+	void BindLayer(GLuint texture, int layer, bool bClear);
+	// delete the arrays and the framebuffers
+	void Release();
+};
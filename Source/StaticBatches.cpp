@@ -0,0 +1,426 @@
+///////////////////////////////////////////////////////////////////////////////
+// staticbatches.cpp
+// ============
+// immovable scene objects merged into pre-transformed vertex buffers
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "StaticBatches.h"
+
+#include <cstring>
+
+// declaration of the global variables and defines
+namespace
+{
+	// vertex attribute locations used by the vertex shader
+	const GLuint g_PositionLocation = 0;
+	const GLuint g_NormalLocation = 1;
+	const GLuint g_TextureCoordinateLocation = 2;
+	const GLuint g_InstanceModelLocation = 3;		// uses 3 to 6
+	const GLuint g_InstanceColorLocation = 7;
+	const GLuint g_InstanceUVScaleLocation = 8;
+	const GLuint g_InstanceIndicesLocation = 9;
+
+	/***********************************************************
+	 *  PackInt()
+	 *
+	 *  This function is used for storing the bits of an integer
+	 *  in the float vertex data, for an integer attribute.
+	 ***********************************************************/
+	float PackInt(int value)
+	{
+		float packed;
+		memcpy(&packed, &value, sizeof(packed));
+		return(packed);
+	}
+
+	/***********************************************************
+	 *  FindMesh()
+	 *
+	 *  This function is used for getting the generated geometry
+	 *  of the basic mesh associated with the passed in ID.
+	 ***********************************************************/
+	const InstancedMeshes::GLMESH* FindMesh(const InstancedMeshes& meshes, uint8_t meshID)
+	{
+		switch (meshID)
+		{
+		case DrawList::MESH_PLANE:
+			return(&meshes.GetPlaneMesh());
+		case DrawList::MESH_BOX:
+			return(&meshes.GetBoxMesh());
+		case DrawList::MESH_CYLINDER:
+			return(&meshes.GetCylinderMesh());
+		case DrawList::MESH_TAPERED_CYLINDER:
+			return(&meshes.GetTaperedCylinderMesh());
+		case DrawList::MESH_TORUS:
+			return(&meshes.GetTorusMesh());
+		case DrawList::MESH_SPHERE:
+			return(&meshes.GetSphereMesh());
+		default:
+			return(NULL);
+		}
+	}
+}
+
+/***********************************************************
+ *  StaticBatches()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+StaticBatches::StaticBatches()
+{
+	m_objectCount = 0;
+}
+
+/***********************************************************
+ *  ~StaticBatches()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+StaticBatches::~StaticBatches()
+{
+	Clear();
+}
+
+/***********************************************************
+ *  Build()
+ *
+ *  This method is used for merging the static objects of
+ *  the draw list.  Every vertex carries the texture layer
+ *  and the material of its object, so the static objects
+ *  are merged whatever their textures and materials are,
+ *  into one batch of solid colored objects and one of
+ *  textured objects, and their geometry is uploaded once.
+ *  Any batches from a previous build are released first.
+ ***********************************************************/
+int StaticBatches::Build(const DrawList& drawList, const InstancedMeshes& meshes, int maxMaterials)
+{
+	const int objectCount = drawList.GetObjectCount();
+	const uint8_t* meshIDs = drawList.GetMeshIDs();
+	const glm::mat4* modelMatrices = drawList.GetModelMatrices();
+	const int* textureSlots = drawList.GetTextureSlots();
+	const glm::vec4* colors = drawList.GetColors();
+	const int* materialIDs = drawList.GetMaterialIDs();
+	const glm::vec2* uvScales = drawList.GetUVScales();
+	const uint8_t* staticFlags = drawList.GetStaticFlags();
+
+	Clear();
+
+	for (int textured = 0; textured < 2; textured++)
+	{
+		std::vector<float> vertices;
+		std::vector<GLuint> indices;
+		const int firstRange = (int)m_ranges.size();
+
+		for (int i = 0; i < objectCount; i++)
+		{
+			// a baked object cannot change level, so curved meshes
+			// are merged at their finest level
+			const InstancedMeshes::GLMESH* mesh = FindMesh(meshes, meshIDs[i]);
+			const int materialIndex = (materialIDs[i] < maxMaterials) ? materialIDs[i] : -1;
+			const int objectTextured = (textureSlots[i] >= 0) ? 1 : 0;
+
+			if ((staticFlags[i] != 0) && (mesh != NULL) && (objectTextured == textured))
+			{
+				OBJECT_RANGE range;
+				range.object = i;
+				range.firstIndex = (GLuint)indices.size();
+				AppendObject(*mesh, modelMatrices[i], uvScales[i], colors[i],
+					textureSlots[i], materialIndex, vertices, indices);
+				range.nIndices = (GLuint)indices.size() - range.firstIndex;
+				m_ranges.push_back(range);
+				m_objectCount++;
+			}
+		}
+
+		if ((int)m_ranges.size() > firstRange)
+		{
+			BATCH batch;
+			batch.vao = 0;
+			batch.vbos[0] = 0;
+			batch.vbos[1] = 0;
+			batch.nVertices = 0;
+			batch.nIndices = 0;
+			batch.center = glm::vec3(0.0f);
+			batch.firstRange = firstRange;
+			batch.rangeCount = (int)m_ranges.size() - firstRange;
+			batch.bTextured = (textured != 0);
+
+			CreateBatch(batch, vertices, indices);
+			m_batches.push_back(batch);
+		}
+	}
+
+	return((int)m_batches.size());
+}
+
+/***********************************************************
+ *  AppendObject()
+ *
+ *  This method is used for transforming a copy of the mesh
+ *  vertices into world space.  The normals are transformed
+ *  by the cofactor of the model matrix, which matches the
+ *  inverse transpose up to scale and also handles a zero
+ *  scale on one axis.  The texture coordinates are kept as
+ *  they are and the UV scale is stored next to them, so the
+ *  fragment shader applies it the same way as for the
+ *  instanced draws, and the winding is reversed for
+ *  mirrored objects so front faces stay counter-clockwise.
+ ***********************************************************/
+void StaticBatches::AppendObject(
+	const InstancedMeshes::GLMESH& mesh,
+	const glm::mat4& model,
+	const glm::vec2& uvScale,
+	const glm::vec4& color,
+	int textureSlot,
+	int materialIndex,
+	std::vector<float>& vertices,
+	std::vector<GLuint>& indices)
+{
+	const int stride = InstancedMeshes::FLOATS_PER_VERTEX;
+	const GLuint firstVertex = (GLuint)(vertices.size() / FLOATS_PER_VERTEX);
+	const size_t vertexCount = mesh.vertices.size() / stride;
+
+	glm::vec3 axisX = glm::vec3(model[0]);
+	glm::vec3 axisY = glm::vec3(model[1]);
+	glm::vec3 axisZ = glm::vec3(model[2]);
+	glm::mat3 normalMatrix = glm::mat3(
+		glm::cross(axisY, axisZ),
+		glm::cross(axisZ, axisX),
+		glm::cross(axisX, axisY));
+	bool bMirrored = glm::dot(axisX, glm::cross(axisY, axisZ)) < 0.0f;
+
+	vertices.reserve(vertices.size() + vertexCount * FLOATS_PER_VERTEX);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		const float* source = &mesh.vertices[v * stride];
+		glm::vec4 position = model * glm::vec4(source[0], source[1], source[2], 1.0f);
+		glm::vec3 normal = normalMatrix * glm::vec3(source[3], source[4], source[5]);
+		float length = glm::length(normal);
+		if (length > 0.0f)
+		{
+			normal /= length;
+		}
+
+		vertices.push_back(position.x);
+		vertices.push_back(position.y);
+		vertices.push_back(position.z);
+		vertices.push_back(normal.x);
+		vertices.push_back(normal.y);
+		vertices.push_back(normal.z);
+		vertices.push_back(source[6]);
+		vertices.push_back(source[7]);
+		vertices.push_back(color.r);
+		vertices.push_back(color.g);
+		vertices.push_back(color.b);
+		vertices.push_back(color.a);
+		vertices.push_back(uvScale.x);
+		vertices.push_back(uvScale.y);
+		vertices.push_back(PackInt(textureSlot));
+		vertices.push_back(PackInt(materialIndex));
+	}
+
+	indices.reserve(indices.size() + mesh.indices.size());
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		indices.push_back(firstVertex + mesh.indices[i]);
+		if (bMirrored)
+		{
+			indices.push_back(firstVertex + mesh.indices[i + 2]);
+			indices.push_back(firstVertex + mesh.indices[i + 1]);
+		}
+		else
+		{
+			indices.push_back(firstVertex + mesh.indices[i + 1]);
+			indices.push_back(firstVertex + mesh.indices[i + 2]);
+		}
+	}
+}
+
+/***********************************************************
+ *  CreateBatch()
+ *
+ *  This method is used for uploading the merged geometry of
+ *  a batch.  The color, UV scale, texture layer and material
+ *  change per object, so they are read per vertex, and the
+ *  shader reads the model matrix from the constant value
+ *  set in DrawBoundBatch().
+ ***********************************************************/
+void StaticBatches::CreateBatch(BATCH& batch, const std::vector<float>& vertices, const std::vector<GLuint>& indices)
+{
+	const GLsizei stride = sizeof(float) * FLOATS_PER_VERTEX;
+
+	batch.nVertices = (GLuint)(vertices.size() / FLOATS_PER_VERTEX);
+	batch.nIndices = (GLuint)indices.size();
+
+	// the bounds center is used to sort the batch by distance
+	glm::vec3 boundsMin(0.0f);
+	glm::vec3 boundsMax(0.0f);
+	for (GLuint v = 0; v < batch.nVertices; v++)
+	{
+		glm::vec3 position(vertices[v * FLOATS_PER_VERTEX], vertices[v * FLOATS_PER_VERTEX + 1], vertices[v * FLOATS_PER_VERTEX + 2]);
+		boundsMin = (v == 0) ? position : glm::min(boundsMin, position);
+		boundsMax = (v == 0) ? position : glm::max(boundsMax, position);
+	}
+	batch.center = (boundsMin + boundsMax) * 0.5f;
+
+	glGenVertexArrays(1, &batch.vao);
+	glBindVertexArray(batch.vao);
+
+	glGenBuffers(2, batch.vbos);
+	glBindBuffer(GL_ARRAY_BUFFER, batch.vbos[0]);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.vbos[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+	glVertexAttribPointer(g_PositionLocation, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glEnableVertexAttribArray(g_PositionLocation);
+	glVertexAttribPointer(g_NormalLocation, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 3));
+	glEnableVertexAttribArray(g_NormalLocation);
+	glVertexAttribPointer(g_TextureCoordinateLocation, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 6));
+	glEnableVertexAttribArray(g_TextureCoordinateLocation);
+	// the color changes per object, so it is read per vertex
+	glVertexAttribPointer(g_InstanceColorLocation, 4, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 8));
+	glEnableVertexAttribArray(g_InstanceColorLocation);
+	glVertexAttribPointer(g_InstanceUVScaleLocation, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 12));
+	glEnableVertexAttribArray(g_InstanceUVScaleLocation);
+	glVertexAttribIPointer(g_InstanceIndicesLocation, 2, GL_INT, stride, (void*)(sizeof(float) * 14));
+	glEnableVertexAttribArray(g_InstanceIndicesLocation);
+
+	glBindVertexArray(0);
+}
+
+/***********************************************************
+ *  DrawBatch()
+ *
+ *  This method is used for binding the vertex array of a
+ *  batch and drawing it.
+ ***********************************************************/
+void StaticBatches::DrawBatch(int batch)
+{
+	if ((batch < 0) || (batch >= (int)m_batches.size()))
+	{
+		return;
+	}
+
+	glBindVertexArray(m_batches[batch].vao);
+	DrawBoundBatch(batch);
+	glBindVertexArray(0);
+}
+
+/***********************************************************
+ *  DrawBoundBatch()
+ *
+ *  This method is used for drawing the objects of a batch,
+ *  when the caller has already bound the vertex array of
+ *  the batch.  The vertices are already in world space, so
+ *  the model matrix input is set to identity.  When object
+ *  flags are passed, only the index ranges of the objects
+ *  flagged with drawFlag are drawn, and each run of them
+ *  becomes one draw of a single multi-draw call.
+ ***********************************************************/
+void StaticBatches::DrawBoundBatch(int batch, const uint8_t* objectFlags, uint8_t drawFlag)
+{
+	if ((batch < 0) || (batch >= (int)m_batches.size()))
+	{
+		return;
+	}
+
+	const BATCH& current = m_batches[batch];
+
+	for (GLuint column = 0; column < 4; column++)
+	{
+		glVertexAttrib4f(g_InstanceModelLocation + column,
+			(column == 0) ? 1.0f : 0.0f,
+			(column == 1) ? 1.0f : 0.0f,
+			(column == 2) ? 1.0f : 0.0f,
+			(column == 3) ? 1.0f : 0.0f);
+	}
+
+	if (objectFlags == NULL)
+	{
+		glDrawElements(GL_TRIANGLES, current.nIndices, GL_UNSIGNED_INT, NULL);
+		return;
+	}
+
+	m_drawCounts.clear();
+	m_drawOffsets.clear();
+	GLuint runEnd = 0;
+	for (int r = current.firstRange; r < current.firstRange + current.rangeCount; r++)
+	{
+		const OBJECT_RANGE& range = m_ranges[r];
+		if (objectFlags[range.object] != drawFlag)
+		{
+			continue;
+		}
+
+		// the ranges are consecutive, so a drawn object that
+		// follows the previous one extends its run
+		if (!m_drawCounts.empty() && (runEnd == range.firstIndex))
+		{
+			m_drawCounts.back() += (GLsizei)range.nIndices;
+		}
+		else
+		{
+			m_drawCounts.push_back((GLsizei)range.nIndices);
+			m_drawOffsets.push_back((const void*)(sizeof(GLuint) * range.firstIndex));
+		}
+		runEnd = range.firstIndex + range.nIndices;
+	}
+
+	if (m_drawCounts.size() == 1)
+	{
+		glDrawElements(GL_TRIANGLES, m_drawCounts[0], GL_UNSIGNED_INT, m_drawOffsets[0]);
+	}
+	else if (m_drawCounts.size() > 1)
+	{
+		glMultiDrawElements(GL_TRIANGLES, m_drawCounts.data(), GL_UNSIGNED_INT,
+			m_drawOffsets.data(), (GLsizei)m_drawCounts.size());
+	}
+}
+
+/***********************************************************
+ *  GetFlaggedObjectCount()
+ *
+ *  This method is used for counting the objects of a batch
+ *  with a given flag, so a batch with none of its objects
+ *  visible is not submitted at all.
+ ***********************************************************/
+int StaticBatches::GetFlaggedObjectCount(int batch, const uint8_t* objectFlags, uint8_t flag) const
+{
+	if ((batch < 0) || (batch >= (int)m_batches.size()))
+	{
+		return(0);
+	}
+
+	const BATCH& current = m_batches[batch];
+	int flaggedCount = 0;
+	for (int r = current.firstRange; r < current.firstRange + current.rangeCount; r++)
+	{
+		if (objectFlags[m_ranges[r].object] == flag)
+		{
+			flaggedCount++;
+		}
+	}
+
+	return(flaggedCount);
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method is used for releasing the GL objects of all
+ *  the batches.
+ ***********************************************************/
+void StaticBatches::Clear()
+{
+	for (size_t b = 0; b < m_batches.size(); b++)
+	{
+		glDeleteVertexArrays(1, &m_batches[b].vao);
+		glDeleteBuffers(2, m_batches[b].vbos);
+	}
+
+	m_batches.clear();
+	m_ranges.clear();
+	m_objectCount = 0;
+}
@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+// staticbatches.h
+// ============
+// immovable scene objects merged into pre-transformed vertex buffers
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "DrawList.h"
+#include "InstancedMeshes.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  StaticBatches
+ *
+ *  This class bakes the world transform of every static
+ *  draw list object into a copy of its mesh vertices, and
+ *  merges the objects into one vertex and index buffer.  The
+ *  color, UV scale, texture layer and material are stored
+ *  per vertex, so the batch is drawn with a single call,
+ *  through the same shader inputs as the instanced meshes,
+ *  using an identity model matrix.  The textured and the
+ *  solid colored objects go into separate batches, as they
+ *  are drawn with different shader permutations.
+ ***********************************************************/
+class StaticBatches
+{
+public:
+	// constructor
+	StaticBatches();
+	// destructor
+	~StaticBatches();
+
+	// merged objects drawn with one call
+	struct BATCH
+	{
+		GLuint vao;
+		GLuint vbos[2];
+		GLuint nVertices;
+		GLuint nIndices;
+		// center of the bounds of the merged vertices
+		glm::vec3 center;
+		// index ranges of the merged objects
+		int firstRange;
+		int rangeCount;
+		// true when the merged objects are textured
+		bool bTextured;
+	};
+
+	// indices of one merged draw list object within its batch
+	struct OBJECT_RANGE
+	{
+		int object;
+		GLuint firstIndex;
+		GLuint nIndices;
+	};
+
+	// number of floats in one vertex - position, normal, UV,
+	// color, UV scale, then the texture layer and material as
+	// integers
+	static const int FLOATS_PER_VERTEX = 16;
+
+	// merge the static objects of the draw list into batches
+	// and return the number of batches that were created,
+	// material indices from maxMaterials on are drawn as -1
+	int Build(const DrawList& drawList, const InstancedMeshes& meshes, int maxMaterials);
+
+	// release all the batches
+	void Clear();
+
+	// draw one batch
+	void DrawBatch(int batch);
+	// draw the objects of one batch whose vertex array is
+	// already bound, when objectFlags is not NULL only the
+	// objects whose flag equals drawFlag
+	void DrawBoundBatch(int batch, const uint8_t* objectFlags = NULL, uint8_t drawFlag = 1);
+	// number of objects of a batch whose flag equals flag
+	int GetFlaggedObjectCount(int batch, const uint8_t* objectFlags, uint8_t flag) const;
+
+	// number of batches
+	int GetBatchCount() const { return((int)m_batches.size()); }
+	// vertex array of a batch
+	GLuint GetVertexArray(int batch) const { return(m_batches[batch].vao); }
+	// center of the bounds of a batch in world space
+	const glm::vec3& GetCenter(int batch) const { return(m_batches[batch].center); }
+	// true when the objects of a batch are textured
+	bool IsTextured(int batch) const { return(m_batches[batch].bTextured); }
+	// number of draw list objects merged into the batches
+	int GetObjectCount() const { return(m_objectCount); }
+
+private:
+	std::vector<BATCH> m_batches;
+	// index range of every merged object, in batch order
+	std::vector<OBJECT_RANGE> m_ranges;
+	int m_objectCount;
+	// index counts and offsets of the runs of visible objects,
+	// kept between frames to avoid allocations
+	std::vector<GLsizei> m_drawCounts;
+	std::vector<const void*> m_drawOffsets;
+
+	// append the transformed vertices and indices of one object
+	void AppendObject(
+		const InstancedMeshes::GLMESH& mesh,
+		const glm::mat4& model,
+		const glm::vec2& uvScale,
+		const glm::vec4& color,
+		int textureSlot,
+		int materialIndex,
+		std::vector<float>& vertices,
+		std::vector<GLuint>& indices);
+	// upload the merged geometry of a batch
+	void CreateBatch(BATCH& batch, const std::vector<float>& vertices, const std::vector<GLuint>& indices);
+};
@@ -0,0 +1,226 @@
+///////////////////////////////////////////////////////////////////////////////
+// streambuffer.cpp
+// ============
+// ring buffer for data that is rewritten by the CPU every frame
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "StreamBuffer.h"
+
+// declaration of the global variables and defines
+namespace
+{
+	// time a single fence wait may block, in nanoseconds
+	const GLuint64 g_FenceTimeout = 100000000;
+}
+
+/***********************************************************
+ *  StreamBuffer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+StreamBuffer::StreamBuffer()
+{
+	m_buffer = 0;
+	m_regionSize = 0;
+	m_region = -1;
+	for (int i = 0; i < REGION_COUNT; i++)
+	{
+		m_fences[i] = NULL;
+	}
+	m_pMapped = NULL;
+	m_bPersistent = false;
+	m_waitCount = 0;
+}
+
+/***********************************************************
+ *  ~StreamBuffer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+StreamBuffer::~StreamBuffer()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  Reserve()
+ *
+ *  This method is used for making sure each region holds at
+ *  least the passed in number of bytes.  A larger buffer
+ *  replaces the current one once the GPU is done with it,
+ *  so any vertex array that points at the old buffer must
+ *  be set up again when this returns true.
+ ***********************************************************/
+bool StreamBuffer::Reserve(size_t regionSize)
+{
+	if ((m_buffer != 0) && (regionSize <= m_regionSize))
+	{
+		return(false);
+	}
+
+	Destroy();
+
+	m_regionSize = regionSize;
+	m_bPersistent = (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) ? true : false;
+
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+
+	if (m_bPersistent)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		const GLsizeiptr size = (GLsizeiptr)(m_regionSize * REGION_COUNT);
+
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+		m_pMapped = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+		if (m_pMapped == NULL)
+		{
+			// fall back to orphaning when the mapping fails
+			glDeleteBuffers(1, &m_buffer);
+			glGenBuffers(1, &m_buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+			m_bPersistent = false;
+		}
+	}
+
+	if (m_bPersistent == false)
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)m_regionSize, NULL, GL_STREAM_DRAW);
+		m_staging.resize(m_regionSize);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	return(true);
+}
+
+/***********************************************************
+ *  BeginWrite()
+ *
+ *  This method is used for getting a pointer to the region
+ *  that follows the last one written.  The write must fit
+ *  in a region, so Reserve() is called first when the data
+ *  has grown.
+ ***********************************************************/
+void* StreamBuffer::BeginWrite(size_t size)
+{
+	if ((m_buffer == 0) || (size > m_regionSize))
+	{
+		return(NULL);
+	}
+
+	if (m_bPersistent == false)
+	{
+		return(m_staging.data());
+	}
+
+	m_region = (m_region + 1) % REGION_COUNT;
+	WaitRegion(m_region);
+
+	return(m_pMapped + m_regionSize * m_region);
+}
+
+/***********************************************************
+ *  EndWrite()
+ *
+ *  This method is used for finishing the write of a region.
+ *  The mapping is coherent, so only the copy without buffer
+ *  storage needs to be uploaded, into freshly orphaned
+ *  storage so the driver does not wait for earlier draws.
+ ***********************************************************/
+size_t StreamBuffer::EndWrite(size_t size)
+{
+	if (m_bPersistent)
+	{
+		return(m_regionSize * m_region);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)m_regionSize, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr)size, m_staging.data());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	return(0);
+}
+
+/***********************************************************
+ *  Fence()
+ *
+ *  This method is used for placing a fence after the draws
+ *  that read the current region.  It is called once per
+ *  frame, after the draws are issued, and replaces the
+ *  fence of the frames that used the region before.
+ ***********************************************************/
+void StreamBuffer::Fence()
+{
+	if ((m_bPersistent == false) || (m_region < 0))
+	{
+		return;
+	}
+
+	if (m_fences[m_region] != NULL)
+	{
+		glDeleteSync(m_fences[m_region]);
+	}
+	m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/***********************************************************
+ *  WaitRegion()
+ *
+ *  This method is used for blocking until the draws that
+ *  read a region have completed.  With three regions the
+ *  fence has almost always signaled already.
+ ***********************************************************/
+void StreamBuffer::WaitRegion(int region)
+{
+	if (m_fences[region] == NULL)
+	{
+		return;
+	}
+
+	GLenum result = glClientWaitSync(m_fences[region], 0, 0);
+	if ((result == GL_TIMEOUT_EXPIRED) || (result == GL_WAIT_FAILED))
+	{
+		m_waitCount++;
+		do
+		{
+			result = glClientWaitSync(m_fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, g_FenceTimeout);
+		} while (result == GL_TIMEOUT_EXPIRED);
+	}
+
+	glDeleteSync(m_fences[region]);
+	m_fences[region] = NULL;
+}
+
+/***********************************************************
+ *  Destroy()
+ *
+ *  This method is used for waiting on every region and then
+ *  releasing the buffer.
+ ***********************************************************/
+void StreamBuffer::Destroy()
+{
+	for (int i = 0; i < REGION_COUNT; i++)
+	{
+		WaitRegion(i);
+	}
+
+	if (m_buffer != 0)
+	{
+		if (m_pMapped != NULL)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			m_pMapped = NULL;
+		}
+		glDeleteBuffers(1, &m_buffer);
+		m_buffer = 0;
+	}
+
+	m_staging.clear();
+	m_regionSize = 0;
+	m_region = -1;
+}
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+// streambuffer.h
+// ============
+// ring buffer for data that is rewritten by the CPU every frame
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  StreamBuffer
+ *
+ *  This class owns a buffer that is split into one region
+ *  per frame in flight.  When buffer storage is available
+ *  the buffer is mapped once, persistent and coherent, and
+ *  each region is protected by a fence, so the CPU writes
+ *  the next region directly while the GPU still reads the
+ *  previous ones.  Writing through the returned pointer
+ *  needs no GL call, so it can be done from any thread.
+ *  Without buffer storage the data is written to a CPU copy
+ *  and uploaded into an orphaned buffer instead.
+ ***********************************************************/
+class StreamBuffer
+{
+public:
+	// constructor
+	StreamBuffer();
+	// destructor
+	~StreamBuffer();
+
+	// number of regions, one for each frame in flight
+	static const int REGION_COUNT = 3;
+
+	// make room for the passed in bytes in each region,
+	// returns true when the buffer object was replaced
+	bool Reserve(size_t regionSize);
+
+	// get a pointer to the next free region, waiting for the
+	// GPU to finish reading it first
+	void* BeginWrite(size_t size);
+	// finish writing the region, returns its byte offset in
+	// the buffer
+	size_t EndWrite(size_t size);
+	// mark the region as used by the draws issued so far
+	void Fence();
+
+	// GL name of the buffer
+	GLuint GetBuffer() const { return(m_buffer); }
+	// size of one region in bytes
+	size_t GetRegionSize() const { return(m_regionSize); }
+	// true when the buffer is persistently mapped
+	bool IsPersistent() const { return(m_bPersistent); }
+	// number of times the CPU had to wait for a region
+	int GetWaitCount() const { return(m_waitCount); }
+
+private:
+	GLuint m_buffer;
+	size_t m_regionSize;
+	// region written last, -1 before the first write
+	int m_region;
+	// fence of the last draws that read each region
+	GLsync m_fences[REGION_COUNT];
+	// start of the persistent mapping
+	uint8_t* m_pMapped;
+	// CPU copy used when the buffer cannot be mapped
+	std::vector<uint8_t> m_staging;
+	bool m_bPersistent;
+	int m_waitCount;
+
+	// block until the GPU has finished reading a region
+	void WaitRegion(int region);
+	// release the buffer and the fences
+	void Destroy();
+};
@@ -0,0 +1,498 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecache.cpp
+// ============
+// GPU-ready texture containers with every mip level, keyed by content hash
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// declaration of the global variables and defines
+namespace
+{
+	// "TXC1" at the start of every container
+	const uint32_t g_ContainerMagic = 0x31435854u;
+	// bumped whenever the container layout or encoder changes
+	const uint32_t g_ContainerVersion = 1;
+	// directory the containers are written to
+	const char* g_CacheDirectory = "cache";
+	const char* g_TextureCacheDirectory = "cache/textures";
+
+	/***********************************************************
+	 *  MakeDirectory()
+	 *
+	 *  This function is used for creating a directory when it
+	 *  does not exist yet.
+	 ***********************************************************/
+	void MakeDirectory(const char* path)
+	{
+#ifdef _WIN32
+		_mkdir(path);
+#else
+		mkdir(path, 0755);
+#endif
+	}
+
+	/***********************************************************
+	 *  To565()
+	 *
+	 *  This function is used for packing an RGB color into the
+	 *  16-bit endpoint format of the color blocks.
+	 ***********************************************************/
+	uint16_t To565(const int color[3])
+	{
+		return((uint16_t)(((color[0] * 31 + 127) / 255) << 11 |
+			((color[1] * 63 + 127) / 255) << 5 |
+			((color[2] * 31 + 127) / 255)));
+	}
+
+	/***********************************************************
+	 *  From565()
+	 *
+	 *  This function is used for expanding a 16-bit endpoint
+	 *  back to the RGB color the GPU decodes it to.
+	 ***********************************************************/
+	void From565(uint16_t packed, int color[3])
+	{
+		const int r = (packed >> 11) & 31;
+		const int g = (packed >> 5) & 63;
+		const int b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	/***********************************************************
+	 *  EncodeColorBlock()
+	 *
+	 *  This function is used for compressing the RGB values of
+	 *  a 4x4 block into 8 bytes.  The endpoints are the corners
+	 *  of the color bounding box, inset slightly to reduce the
+	 *  error, and every pixel picks the nearest of the four
+	 *  palette colors.
+	 ***********************************************************/
+	void EncodeColorBlock(const unsigned char block[64], unsigned char* output)
+	{
+		int minimum[3] = { 255, 255, 255 };
+		int maximum[3] = { 0, 0, 0 };
+		for (int p = 0; p < 16; p++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				const int value = block[p * 4 + c];
+				minimum[c] = (value < minimum[c]) ? value : minimum[c];
+				maximum[c] = (value > maximum[c]) ? value : maximum[c];
+			}
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			const int inset = (maximum[c] - minimum[c]) / 16;
+			minimum[c] += inset;
+			maximum[c] -= inset;
+		}
+
+		uint16_t color0 = To565(maximum);
+		uint16_t color1 = To565(minimum);
+		if (color0 < color1)
+		{
+			uint16_t swap = color0;
+			color0 = color1;
+			color1 = swap;
+		}
+
+		int palette[4][3];
+		From565(color0, palette[0]);
+		From565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		uint32_t indices = 0;
+		if (color0 != color1)
+		{
+			for (int p = 0; p < 16; p++)
+			{
+				int best = 0;
+				int bestDistance = 0x7FFFFFFF;
+				for (int i = 0; i < 4; i++)
+				{
+					int distance = 0;
+					for (int c = 0; c < 3; c++)
+					{
+						const int difference = block[p * 4 + c] - palette[i][c];
+						distance += difference * difference;
+					}
+					if (distance < bestDistance)
+					{
+						best = i;
+						bestDistance = distance;
+					}
+				}
+				indices |= (uint32_t)best << (p * 2);
+			}
+		}
+
+		output[0] = (unsigned char)(color0 & 0xFF);
+		output[1] = (unsigned char)(color0 >> 8);
+		output[2] = (unsigned char)(color1 & 0xFF);
+		output[3] = (unsigned char)(color1 >> 8);
+		output[4] = (unsigned char)(indices & 0xFF);
+		output[5] = (unsigned char)((indices >> 8) & 0xFF);
+		output[6] = (unsigned char)((indices >> 16) & 0xFF);
+		output[7] = (unsigned char)(indices >> 24);
+	}
+
+	/***********************************************************
+	 *  EncodeAlphaBlock()
+	 *
+	 *  This function is used for compressing the alpha values
+	 *  of a 4x4 block into 8 bytes, with the minimum and the
+	 *  maximum as endpoints and six values between them.
+	 ***********************************************************/
+	void EncodeAlphaBlock(const unsigned char block[64], unsigned char* output)
+	{
+		int alpha0 = 0;
+		int alpha1 = 255;
+		for (int p = 0; p < 16; p++)
+		{
+			const int value = block[p * 4 + 3];
+			alpha0 = (value > alpha0) ? value : alpha0;
+			alpha1 = (value < alpha1) ? value : alpha1;
+		}
+
+		int palette[8];
+		palette[0] = alpha0;
+		palette[1] = alpha1;
+		for (int i = 1; i < 7; i++)
+		{
+			palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+		}
+
+		uint64_t indices = 0;
+		if (alpha0 != alpha1)
+		{
+			for (int p = 0; p < 16; p++)
+			{
+				int best = 0;
+				int bestDistance = 256;
+				for (int i = 0; i < 8; i++)
+				{
+					const int distance = (block[p * 4 + 3] > palette[i]) ?
+						block[p * 4 + 3] - palette[i] : palette[i] - block[p * 4 + 3];
+					if (distance < bestDistance)
+					{
+						best = i;
+						bestDistance = distance;
+					}
+				}
+				indices |= (uint64_t)best << (p * 3);
+			}
+		}
+
+		output[0] = (unsigned char)alpha0;
+		output[1] = (unsigned char)alpha1;
+		for (int i = 0; i < 6; i++)
+		{
+			output[2 + i] = (unsigned char)((indices >> (i * 8)) & 0xFF);
+		}
+	}
+
+	/***********************************************************
+	 *  EncodeLevel()
+	 *
+	 *  This function is used for storing one mip level in the
+	 *  container format.  Blocks that reach past the edge of a
+	 *  small level repeat the last row and column.
+	 ***********************************************************/
+	void EncodeLevel(
+		const unsigned char* pixels,
+		int width,
+		int height,
+		TextureCache::FORMAT format,
+		unsigned char* output)
+	{
+		if (format == TextureCache::FORMAT_RGBA8)
+		{
+			memcpy(output, pixels, (size_t)width * height * 4);
+			return;
+		}
+
+		unsigned char block[64];
+		for (int blockY = 0; blockY < height; blockY += 4)
+		{
+			for (int blockX = 0; blockX < width; blockX += 4)
+			{
+				for (int y = 0; y < 4; y++)
+				{
+					const int sourceY = (blockY + y < height) ? blockY + y : height - 1;
+					for (int x = 0; x < 4; x++)
+					{
+						const int sourceX = (blockX + x < width) ? blockX + x : width - 1;
+						memcpy(&block[(y * 4 + x) * 4], &pixels[((size_t)sourceY * width + sourceX) * 4], 4);
+					}
+				}
+
+				if (format == TextureCache::FORMAT_BC3)
+				{
+					EncodeAlphaBlock(block, output);
+					output += 8;
+				}
+				EncodeColorBlock(block, output);
+				output += 8;
+			}
+		}
+	}
+
+	/***********************************************************
+	 *  Downsample()
+	 *
+	 *  This function is used for averaging each 2x2 square of
+	 *  an RGBA level into one pixel of the next level.  An odd
+	 *  last row or column is averaged with itself.
+	 ***********************************************************/
+	void Downsample(
+		const std::vector<unsigned char>& source,
+		int width,
+		int height,
+		std::vector<unsigned char>& destination)
+	{
+		const int nextWidth = (width > 1) ? width / 2 : 1;
+		const int nextHeight = (height > 1) ? height / 2 : 1;
+
+		destination.resize((size_t)nextWidth * nextHeight * 4);
+		for (int y = 0; y < nextHeight; y++)
+		{
+			const int y0 = (y * 2 < height) ? y * 2 : height - 1;
+			const int y1 = (y * 2 + 1 < height) ? y * 2 + 1 : height - 1;
+			for (int x = 0; x < nextWidth; x++)
+			{
+				const int x0 = (x * 2 < width) ? x * 2 : width - 1;
+				const int x1 = (x * 2 + 1 < width) ? x * 2 + 1 : width - 1;
+				for (int c = 0; c < 4; c++)
+				{
+					const int sum =
+						source[((size_t)y0 * width + x0) * 4 + c] +
+						source[((size_t)y0 * width + x1) * 4 + c] +
+						source[((size_t)y1 * width + x0) * 4 + c] +
+						source[((size_t)y1 * width + x1) * 4 + c];
+					destination[((size_t)y * nextWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  HashBytes()
+ *
+ *  This method is used for hashing the contents of a source
+ *  image file, so an edited image gets a new container.
+ ***********************************************************/
+uint64_t TextureCache::HashBytes(const unsigned char* data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	}
+	return(hash);
+}
+
+/***********************************************************
+ *  GetCachePath()
+ *
+ *  This method is used for getting the container file name
+ *  of a source hash in a given format.
+ ***********************************************************/
+std::string TextureCache::GetCachePath(uint64_t sourceHash, FORMAT format)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "/%016llx_%d.txc", (unsigned long long)sourceHash, (int)format);
+	return(std::string(g_TextureCacheDirectory) + name);
+}
+
+int TextureCache::GetLevelCount(int width, int height)
+{
+	int levels = 1;
+	while (((width > 1) || (height > 1)) && (levels < MAX_LEVELS))
+	{
+		width = (width > 1) ? width / 2 : 1;
+		height = (height > 1) ? height / 2 : 1;
+		levels++;
+	}
+	return(levels);
+}
+
+int TextureCache::GetLevelDimension(int dimension, int level)
+{
+	dimension >>= level;
+	return((dimension > 0) ? dimension : 1);
+}
+
+size_t TextureCache::GetLevelSize(FORMAT format, int width, int height, int level)
+{
+	const size_t levelWidth = (size_t)GetLevelDimension(width, level);
+	const size_t levelHeight = (size_t)GetLevelDimension(height, level);
+
+	if (format == FORMAT_RGBA8)
+	{
+		return(levelWidth * levelHeight * 4);
+	}
+
+	const size_t blockSize = (format == FORMAT_BC1) ? 8 : 16;
+	return(((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockSize);
+}
+
+/***********************************************************
+ *  Build()
+ *
+ *  This method is used for generating every mip level of an
+ *  RGBA image with a box filter and storing the levels one
+ *  after the other behind the container header.
+ ***********************************************************/
+void TextureCache::Build(
+	const unsigned char* pixels,
+	int width,
+	int height,
+	FORMAT format,
+	uint64_t sourceHash,
+	std::vector<unsigned char>& container)
+{
+	HEADER header;
+	memset(&header, 0, sizeof(header));
+	header.magic = g_ContainerMagic;
+	header.version = g_ContainerVersion;
+	header.sourceHash = sourceHash;
+	header.format = (uint32_t)format;
+	header.width = (uint32_t)width;
+	header.height = (uint32_t)height;
+	header.levelCount = (uint32_t)GetLevelCount(width, height);
+
+	size_t offset = sizeof(HEADER);
+	for (uint32_t level = 0; level < header.levelCount; level++)
+	{
+		header.levels[level].offset = (uint32_t)offset;
+		header.levels[level].size = (uint32_t)GetLevelSize(format, width, height, (int)level);
+		offset += header.levels[level].size;
+	}
+
+	container.resize(offset);
+	memcpy(container.data(), &header, sizeof(header));
+
+	std::vector<unsigned char> current(pixels, pixels + (size_t)width * height * 4);
+	std::vector<unsigned char> next;
+	for (uint32_t level = 0; level < header.levelCount; level++)
+	{
+		const int levelWidth = GetLevelDimension(width, (int)level);
+		const int levelHeight = GetLevelDimension(height, (int)level);
+
+		EncodeLevel(current.data(), levelWidth, levelHeight, format,
+			&container[header.levels[level].offset]);
+
+		if (level + 1 < header.levelCount)
+		{
+			Downsample(current, levelWidth, levelHeight, next);
+			current.swap(next);
+		}
+	}
+}
+
+/***********************************************************
+ *  Write()
+ *
+ *  This method is used for saving a container.  It is
+ *  written under a temporary name first and then renamed,
+ *  so a container that is being written is never read.
+ ***********************************************************/
+bool TextureCache::Write(const std::string& path, const std::vector<unsigned char>& container)
+{
+	MakeDirectory(g_CacheDirectory);
+	MakeDirectory(g_TextureCacheDirectory);
+
+	const std::string temporaryPath = path + "." +
+		std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+
+	{
+		std::ofstream file(temporaryPath.c_str(), std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			return(false);
+		}
+		file.write((const char*)container.data(), (std::streamsize)container.size());
+		if (!file)
+		{
+			file.close();
+			std::remove(temporaryPath.c_str());
+			return(false);
+		}
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+	{
+		std::remove(temporaryPath.c_str());
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  Validate()
+ *
+ *  This method is used for checking that a container was
+ *  built by this version from the same source contents, in
+ *  the expected format and size, and that all of its levels
+ *  are complete.
+ ***********************************************************/
+const TextureCache::HEADER* TextureCache::Validate(
+	const unsigned char* data,
+	size_t size,
+	uint64_t sourceHash,
+	FORMAT format,
+	int width,
+	int height)
+{
+	if ((data == NULL) || (size < sizeof(HEADER)))
+	{
+		return(NULL);
+	}
+
+	const HEADER* header = (const HEADER*)data;
+	if ((header->magic != g_ContainerMagic) ||
+		(header->version != g_ContainerVersion) ||
+		(header->sourceHash != sourceHash) ||
+		(header->format != (uint32_t)format) ||
+		(header->width != (uint32_t)width) ||
+		(header->height != (uint32_t)height) ||
+		(header->levelCount != (uint32_t)GetLevelCount(width, height)))
+	{
+		return(NULL);
+	}
+
+	for (uint32_t level = 0; level < header->levelCount; level++)
+	{
+		const LEVEL& entry = header->levels[level];
+		if ((entry.size != GetLevelSize(format, width, height, (int)level)) ||
+			((size_t)entry.offset + entry.size > size))
+		{
+			return(NULL);
+		}
+	}
+
+	return(header);
+}
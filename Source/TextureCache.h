@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecache.h
+// ============
+// GPU-ready texture containers with every mip level, keyed by content hash
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  TextureCache
+ *
+ *  This class converts decoded RGBA images into containers
+ *  that hold every mip level in the format the texture is
+ *  stored in on the GPU, either block compressed or plain
+ *  RGBA.  The containers are written to a cache directory
+ *  under the hash of the source file contents, so an image
+ *  is only decoded and compressed the first time it is
+ *  seen, and later runs map the container and upload its
+ *  levels directly.
+ ***********************************************************/
+class TextureCache
+{
+public:
+	// GPU formats a container can hold
+	enum FORMAT
+	{
+		FORMAT_RGBA8 = 0,
+		FORMAT_BC1 = 1,
+		FORMAT_BC3 = 2
+	};
+
+	// most mip levels in one container
+	static const int MAX_LEVELS = 16;
+
+	// place of one mip level in a container
+	struct LEVEL
+	{
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	// start of every container file
+	struct HEADER
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceHash;
+		uint32_t format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+		LEVEL levels[MAX_LEVELS];
+	};
+
+	// 64-bit FNV-1a hash of the source file contents
+	static uint64_t HashBytes(const unsigned char* data, size_t size);
+	// file name of the container for a source hash and format
+	static std::string GetCachePath(uint64_t sourceHash, FORMAT format);
+
+	// number of mip levels down to 1x1
+	static int GetLevelCount(int width, int height);
+	// width or height of a mip level
+	static int GetLevelDimension(int dimension, int level);
+	// bytes of one mip level in a format
+	static size_t GetLevelSize(FORMAT format, int width, int height, int level);
+
+	// build a container with every mip level of an RGBA image
+	static void Build(
+		const unsigned char* pixels,
+		int width,
+		int height,
+		FORMAT format,
+		uint64_t sourceHash,
+		std::vector<unsigned char>& container);
+	// write a container into the cache directory
+	static bool Write(const std::string& path, const std::vector<unsigned char>& container);
+	// get the header of a container when it matches the expected
+	// source, format and size, NULL when it does not
+	static const HEADER* Validate(
+		const unsigned char* data,
+		size_t size,
+		uint64_t sourceHash,
+		FORMAT format,
+		int width,
+		int height);
+};
@@ -0,0 +1,882 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturemanager.cpp
+// ============
+// scene textures packed into texture array layers by size
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureManager.h"
+
+#ifndef STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#endif
+
+#include <cstring>
+#include <iostream>
+
+// declaration of the global variables and defines
+namespace
+{
+	// bytes of decoded pixels copied into the layers per frame,
+	// a larger image is still copied on its own
+	const size_t g_UploadBudget = 4 * 1024 * 1024;
+	// most decode worker threads started
+	const unsigned int g_MaxWorkers = 4;
+	// color shown by a layer until its image is resident
+	const unsigned char g_PlaceholderColor[4] = { 128, 128, 128, 255 };
+	// default most bytes of texture memory for the resident levels
+	const size_t g_DefaultBudget = 256 * 1024 * 1024;
+	// largest size of the coarse levels an array starts with
+	const int g_CoarsestSize = 64;
+	// frames an array can go undrawn before its finest levels
+	// are released
+	const int g_EvictFrames = 300;
+
+	/***********************************************************
+	 *  GetInternalFormat()
+	 *
+	 *  This function is used for getting the GL format that a
+	 *  texture cache format is stored in.
+	 ***********************************************************/
+	GLenum GetInternalFormat(TextureCache::FORMAT format)
+	{
+		switch (format)
+		{
+		case TextureCache::FORMAT_BC1:
+			return(GL_COMPRESSED_RGB_S3TC_DXT1_EXT);
+		case TextureCache::FORMAT_BC3:
+			return(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+		default:
+			return(GL_RGBA8);
+		}
+	}
+
+	/***********************************************************
+	 *  SetLevel()
+	 *
+	 *  This function is used for writing one mip level of the
+	 *  layers of the bound texture array, from client memory or
+	 *  from the bound pixel buffer.
+	 ***********************************************************/
+	void SetLevel(
+		TextureCache::FORMAT format,
+		int level,
+		int layer,
+		int width,
+		int height,
+		int layers,
+		size_t size,
+		const void* data)
+	{
+		if (format == TextureCache::FORMAT_RGBA8)
+		{
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+				width, height, layers, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		}
+		else
+		{
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+				width, height, layers, GetInternalFormat(format), (GLsizei)size, data);
+		}
+	}
+}
+
+/***********************************************************
+ *  TextureManager()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+TextureManager::TextureManager()
+{
+	m_maxLayers = 0;
+	m_pendingCount = 0;
+	m_budget = g_DefaultBudget;
+	m_residentBytes = 0;
+	m_frame = 0;
+	m_bStopWorkers = false;
+}
+
+/***********************************************************
+ *  ~TextureManager()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+TextureManager::~TextureManager()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		m_bStopWorkers = true;
+		m_jobs.clear();
+	}
+	m_queueCondition.notify_all();
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i].join();
+	}
+
+	for (size_t i = 0; i < m_arrays.size(); i++)
+	{
+		if (m_arrays[i].texture != 0)
+		{
+			glDeleteTextures(1, &m_arrays[i].texture);
+			m_arrays[i].texture = 0;
+		}
+	}
+}
+
+/***********************************************************
+ *  LoadTexture()
+ *
+ *  This method is used for adding an image file as the next
+ *  layer of the texture array for its size.  Only the image
+ *  header is read here, the pixels are decoded by a worker
+ *  thread and copied into the layer by Update().  RGB
+ *  images are stored as BC1 and RGBA images as BC3 when the
+ *  driver supports S3TC compression, so they only share an
+ *  array when both fall back to plain RGBA.
+ ***********************************************************/
+int TextureManager::LoadTexture(const char* filename, const std::string& tag)
+{
+	int width = 0;
+	int height = 0;
+	int colorChannels = 0;
+
+	if (m_maxLayers == 0)
+	{
+		glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &m_maxLayers);
+	}
+
+	if (stbi_info(filename, &width, &height, &colorChannels) == 0)
+	{
+		std::cout << "Could not load image:" << filename << std::endl;
+		return(INVALID_TEXTURE);
+	}
+
+	if ((colorChannels != 3) && (colorChannels != 4))
+	{
+		std::cout << "Not implemented to handle image with " << colorChannels << " channels" << std::endl;
+		return(INVALID_TEXTURE);
+	}
+
+	TextureCache::FORMAT format = TextureCache::FORMAT_RGBA8;
+	if (GLEW_EXT_texture_compression_s3tc)
+	{
+		format = (colorChannels == 4) ? TextureCache::FORMAT_BC3 : TextureCache::FORMAT_BC1;
+	}
+
+	const int arrayIndex = FindArray(width, height, format);
+	if (arrayIndex < 0)
+	{
+		std::cout << "No free texture array for image:" << filename << std::endl;
+		return(INVALID_TEXTURE);
+	}
+
+	TEXTURE_ARRAY& textureArray = m_arrays[arrayIndex];
+	const int texture = (arrayIndex << 16) | textureArray.layers;
+	textureArray.layers++;
+	textureArray.pendingLayers++;
+	m_handles[tag] = texture;
+	m_pendingCount++;
+
+	StartWorkers();
+
+	DECODE_JOB job;
+	job.filename = filename;
+	job.texture = texture;
+	job.format = format;
+	job.width = width;
+	job.height = height;
+	job.colorChannels = colorChannels;
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		m_jobs.push_back(job);
+	}
+	m_queueCondition.notify_one();
+
+	return(texture);
+}
+
+/***********************************************************
+ *  Find()
+ *
+ *  This method is used for getting the texture reference of
+ *  a loaded tag.  It is meant for compiling the scene, not
+ *  for the draws.
+ ***********************************************************/
+int TextureManager::Find(const std::string& tag) const
+{
+	std::unordered_map<std::string, int>::const_iterator found = m_handles.find(tag);
+
+	if (found == m_handles.end())
+	{
+		return(INVALID_TEXTURE);
+	}
+
+	return(found->second);
+}
+
+/***********************************************************
+ *  FindArray()
+ *
+ *  This method is used for finding the array that the next
+ *  image of a given size and format goes into.  Arrays that are
+ *  already uploaded are closed, so images loaded after an
+ *  upload start a new array.
+ ***********************************************************/
+int TextureManager::FindArray(int width, int height, TextureCache::FORMAT format)
+{
+	for (size_t i = 0; i < m_arrays.size(); i++)
+	{
+		if ((m_arrays[i].texture == 0) &&
+			(m_arrays[i].format == format) &&
+			(m_arrays[i].width == width) &&
+			(m_arrays[i].height == height) &&
+			(m_arrays[i].layers < m_maxLayers))
+		{
+			return((int)i);
+		}
+	}
+
+	if ((int)m_arrays.size() >= MAX_TEXTURE_ARRAYS)
+	{
+		return(-1);
+	}
+
+	TEXTURE_ARRAY textureArray;
+	textureArray.texture = 0;
+	textureArray.format = format;
+	textureArray.width = width;
+	textureArray.height = height;
+	textureArray.layers = 0;
+	textureArray.pendingLayers = 0;
+	textureArray.levelCount = TextureCache::GetLevelCount(width, height);
+	textureArray.residentLevel = 0;
+	textureArray.requestedLevel = textureArray.levelCount;
+	textureArray.lastUsedFrame = 0;
+	m_arrays.push_back(std::move(textureArray));
+
+	return((int)m_arrays.size() - 1);
+}
+
+/***********************************************************
+ *  Upload()
+ *
+ *  This method is used for creating a texture array for
+ *  each group of reserved layers and for binding every
+ *  array to its own texture unit.  An array starts out with
+ *  its coarse levels only, filled with the placeholder
+ *  color, so the scene can be drawn right away.
+ ***********************************************************/
+void TextureManager::Upload()
+{
+	for (size_t i = 0; i < m_arrays.size(); i++)
+	{
+		TEXTURE_ARRAY& textureArray = m_arrays[i];
+
+		if ((textureArray.texture == 0) && (textureArray.layers > 0))
+		{
+			textureArray.images.resize(textureArray.layers);
+			textureArray.lastUsedFrame = m_frame;
+			AllocateArray((int)i, GetCoarsestLevel(textureArray));
+		}
+
+		glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + (GLenum)i);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray.texture);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/***********************************************************
+ *  Update()
+ *
+ *  This method is used for copying the images decoded since
+ *  the last frame into their layers, and then for streaming
+ *  the levels of the arrays in and out for the textures
+ *  requested this frame.
+ ***********************************************************/
+void TextureManager::Update()
+{
+	m_frame++;
+
+	CopyDecodedImages();
+	UpdateResidency();
+}
+
+/***********************************************************
+ *  RequestTexture()
+ *
+ *  This method is used for recording the finest level that
+ *  a drawn texture needs, the level where one texel covers
+ *  about one pixel on screen.
+ ***********************************************************/
+void TextureManager::RequestTexture(int texture, float pixelsPerRepeat)
+{
+	if ((texture < 0) || (GetArray(texture) >= (int)m_arrays.size()))
+	{
+		return;
+	}
+
+	TEXTURE_ARRAY& textureArray = m_arrays[GetArray(texture)];
+
+	int level = textureArray.levelCount - 1;
+	if (pixelsPerRepeat > 0.0f)
+	{
+		float texelsPerPixel = (float)((textureArray.width > textureArray.height) ? textureArray.width : textureArray.height) / pixelsPerRepeat;
+		level = 0;
+		while ((texelsPerPixel >= 2.0f) && (level < textureArray.levelCount - 1))
+		{
+			texelsPerPixel *= 0.5f;
+			level++;
+		}
+	}
+
+	if (level < textureArray.requestedLevel)
+	{
+		textureArray.requestedLevel = level;
+	}
+}
+
+/***********************************************************
+ *  CopyDecodedImages()
+ *
+ *  This method is used for copying the resident levels of
+ *  the images decoded since the last frame into their
+ *  layers.  The levels of all the images taken this frame
+ *  are staged in one region of the upload ring, which is
+ *  fenced, so the copies do not wait on the GPU.  Every mip
+ *  level comes from the container, so no mipmaps are
+ *  generated here.  The containers are kept, so the levels
+ *  can be streamed in again later.
+ ***********************************************************/
+void TextureManager::CopyDecodedImages()
+{
+	if (m_pendingCount == 0)
+	{
+		return;
+	}
+
+	// take the decoded images that fit in this frame's budget
+	std::vector<DECODED_IMAGE> images;
+	size_t totalBytes = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		while (m_decoded.empty() == false)
+		{
+			const DECODED_IMAGE& image = m_decoded.front();
+			const TEXTURE_ARRAY& textureArray = m_arrays[GetArray(image.texture)];
+			if (textureArray.texture == 0)
+			{
+				// the array is created by the next Upload()
+				break;
+			}
+
+			size_t bytes = 0;
+			if (image.levelBytes > 0)
+			{
+				const TextureCache::HEADER* header = (const TextureCache::HEADER*)image.GetContainer();
+				bytes = header->levels[0].offset + image.levelBytes - header->levels[textureArray.residentLevel].offset;
+			}
+			if ((images.empty() == false) && (totalBytes + bytes > g_UploadBudget))
+			{
+				break;
+			}
+
+			totalBytes += bytes;
+			images.push_back(std::move(m_decoded.front()));
+			m_decoded.pop_front();
+		}
+	}
+
+	if (images.empty())
+	{
+		return;
+	}
+
+	size_t offset = 0;
+	if (totalBytes > 0)
+	{
+		m_uploadStream.Reserve((totalBytes > g_UploadBudget) ? totalBytes : g_UploadBudget);
+
+		unsigned char* staging = (unsigned char*)m_uploadStream.BeginWrite(totalBytes);
+		size_t position = 0;
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			if (images[i].levelBytes > 0)
+			{
+				const TEXTURE_ARRAY& textureArray = m_arrays[GetArray(images[i].texture)];
+				const TextureCache::HEADER* header = (const TextureCache::HEADER*)images[i].GetContainer();
+				const size_t first = header->levels[textureArray.residentLevel].offset;
+				const size_t bytes = header->levels[0].offset + images[i].levelBytes - first;
+
+				memcpy(staging + position, images[i].GetContainer() + first, bytes);
+				position += bytes;
+			}
+		}
+		offset = m_uploadStream.EndWrite(totalBytes);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadStream.GetBuffer());
+	}
+
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		const int arrayIndex = GetArray(images[i].texture);
+		TEXTURE_ARRAY& textureArray = m_arrays[arrayIndex];
+
+		if (images[i].levelBytes == 0)
+		{
+			std::cout << "Could not load image:" << images[i].filename << std::endl;
+		}
+		else
+		{
+			std::cout << "Successfully loaded image:" << images[i].filename << ", width:" << textureArray.width << ", height:" << textureArray.height << ", channels:" << images[i].colorChannels << (images[i].bCacheHit ? ", cached" : "") << std::endl;
+
+			glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + (GLenum)arrayIndex);
+
+			const TextureCache::HEADER* header = (const TextureCache::HEADER*)images[i].GetContainer();
+			const size_t first = header->levels[textureArray.residentLevel].offset;
+			for (int level = textureArray.residentLevel; level < (int)header->levelCount; level++)
+			{
+				SetLevel(textureArray.format, level - textureArray.residentLevel, GetLayer(images[i].texture),
+					TextureCache::GetLevelDimension(textureArray.width, level),
+					TextureCache::GetLevelDimension(textureArray.height, level), 1,
+					header->levels[level].size, (void*)(offset + header->levels[level].offset - first));
+			}
+			offset += header->levels[0].offset + images[i].levelBytes - first;
+		}
+
+		textureArray.pendingLayers--;
+		m_pendingCount--;
+		textureArray.images[GetLayer(images[i].texture)] = std::move(images[i]);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	if (totalBytes > 0)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		m_uploadStream.Fence();
+	}
+}
+
+/***********************************************************
+ *  UpdateResidency()
+ *
+ *  This method is used for choosing the finest resident
+ *  level of every array.  A drawn array keeps the levels it
+ *  has and is refined towards the level requested for it,
+ *  and an array that has gone undrawn for a while drops
+ *  back to its coarse levels.  When the choice exceeds the
+ *  budget, the finest levels of the arrays that have more
+ *  detail than requested, and then of the arrays drawn the
+ *  longest time ago, are released first.  Released levels
+ *  are freed right away, while refinement adds one level
+ *  per array and stops once this frame's upload budget is
+ *  used.
+ ***********************************************************/
+void TextureManager::UpdateResidency()
+{
+	std::vector<int> wanted(m_arrays.size(), 0);
+	size_t totalBytes = 0;
+
+	for (size_t i = 0; i < m_arrays.size(); i++)
+	{
+		TEXTURE_ARRAY& textureArray = m_arrays[i];
+		wanted[i] = textureArray.residentLevel;
+		if (textureArray.texture == 0)
+		{
+			continue;
+		}
+
+		if (textureArray.requestedLevel < textureArray.levelCount)
+		{
+			textureArray.lastUsedFrame = m_frame;
+			if (textureArray.requestedLevel < wanted[i])
+			{
+				wanted[i] = textureArray.requestedLevel;
+			}
+		}
+		else if (m_frame - textureArray.lastUsedFrame > g_EvictFrames)
+		{
+			wanted[i] = GetCoarsestLevel(textureArray);
+		}
+
+		totalBytes += GetArrayBytes(textureArray, wanted[i]);
+	}
+
+	// release levels until the choice fits in the budget
+	while (totalBytes > m_budget)
+	{
+		int victim = -1;
+		bool bVictimExcess = false;
+		for (size_t i = 0; i < m_arrays.size(); i++)
+		{
+			const TEXTURE_ARRAY& textureArray = m_arrays[i];
+			if ((textureArray.texture == 0) || (wanted[i] >= GetCoarsestLevel(textureArray)))
+			{
+				continue;
+			}
+
+			const bool bExcess = (wanted[i] < textureArray.requestedLevel);
+			if ((victim < 0) ||
+				(bExcess && (bVictimExcess == false)) ||
+				((bExcess == bVictimExcess) && (textureArray.lastUsedFrame < m_arrays[victim].lastUsedFrame)))
+			{
+				victim = (int)i;
+				bVictimExcess = bExcess;
+			}
+		}
+
+		if (victim < 0)
+		{
+			break;
+		}
+
+		totalBytes -= GetArrayBytes(m_arrays[victim], wanted[victim]);
+		wanted[victim]++;
+		totalBytes += GetArrayBytes(m_arrays[victim], wanted[victim]);
+	}
+
+	size_t refinedBytes = 0;
+	for (size_t i = 0; i < m_arrays.size(); i++)
+	{
+		TEXTURE_ARRAY& textureArray = m_arrays[i];
+		textureArray.requestedLevel = textureArray.levelCount;
+
+		if (textureArray.texture == 0)
+		{
+			continue;
+		}
+
+		if (wanted[i] > textureArray.residentLevel)
+		{
+			AllocateArray((int)i, wanted[i]);
+		}
+		else if ((wanted[i] < textureArray.residentLevel) && (refinedBytes < g_UploadBudget))
+		{
+			AllocateArray((int)i, textureArray.residentLevel - 1);
+			refinedBytes += GetArrayBytes(textureArray, textureArray.residentLevel);
+		}
+	}
+}
+
+/***********************************************************
+ *  AllocateArray()
+ *
+ *  This method is used for creating the texture of an array
+ *  with the passed in level as its finest level, with the
+ *  same wrapping as the single textures had.  The levels
+ *  below it are filtered between, so a minified texture
+ *  reads the precomputed levels instead of aliasing.
+ *  The layers that are decoded get their levels from their
+ *  containers through the upload ring and the others get
+ *  the placeholder.  The texture it replaces is deleted, so
+ *  the memory of released levels is freed.
+ ***********************************************************/
+void TextureManager::AllocateArray(int arrayIndex, int level)
+{
+	TEXTURE_ARRAY& textureArray = m_arrays[arrayIndex];
+	const GLenum internalFormat = GetInternalFormat(textureArray.format);
+	const int width = TextureCache::GetLevelDimension(textureArray.width, level);
+	const int height = TextureCache::GetLevelDimension(textureArray.height, level);
+
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + (GLenum)arrayIndex);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+	// set the texture wrapping parameters
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// set texture filtering parameters
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, textureArray.levelCount - 1 - level);
+
+	for (int source = level; source < textureArray.levelCount; source++)
+	{
+		const int levelWidth = TextureCache::GetLevelDimension(textureArray.width, source);
+		const int levelHeight = TextureCache::GetLevelDimension(textureArray.height, source);
+
+		if (textureArray.format == TextureCache::FORMAT_RGBA8)
+		{
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, source - level, internalFormat,
+				levelWidth, levelHeight, textureArray.layers,
+				0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+		else
+		{
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, source - level, internalFormat,
+				levelWidth, levelHeight, textureArray.layers, 0,
+				(GLsizei)(TextureCache::GetLevelSize(textureArray.format, textureArray.width, textureArray.height, source) * textureArray.layers),
+				NULL);
+		}
+	}
+
+	// the layers without an image get the levels of the
+	// placeholder, built at the size of the finest level
+	size_t totalBytes = 0;
+	std::vector<unsigned char> placeholder;
+	for (int layer = 0; layer < textureArray.layers; layer++)
+	{
+		const DECODED_IMAGE& image = textureArray.images[layer];
+		if (image.levelBytes > 0)
+		{
+			totalBytes += GetArrayBytes(textureArray, level) / textureArray.layers;
+			continue;
+		}
+
+		if (placeholder.empty())
+		{
+			std::vector<unsigned char> pixels((size_t)width * height * 4);
+			for (size_t p = 0; p < pixels.size(); p++)
+			{
+				pixels[p] = g_PlaceholderColor[p % 4];
+			}
+			TextureCache::Build(pixels.data(), width, height, textureArray.format, 0, placeholder);
+		}
+
+		const TextureCache::HEADER* header = (const TextureCache::HEADER*)placeholder.data();
+		for (int placeholderLevel = 0; placeholderLevel < (int)header->levelCount; placeholderLevel++)
+		{
+			SetLevel(textureArray.format, placeholderLevel, layer,
+				TextureCache::GetLevelDimension(width, placeholderLevel),
+				TextureCache::GetLevelDimension(height, placeholderLevel), 1,
+				header->levels[placeholderLevel].size, &placeholder[header->levels[placeholderLevel].offset]);
+		}
+	}
+
+	// the decoded layers are staged in one region of the ring
+	if (totalBytes > 0)
+	{
+		m_uploadStream.Reserve((totalBytes > g_UploadBudget) ? totalBytes : g_UploadBudget);
+
+		unsigned char* staging = (unsigned char*)m_uploadStream.BeginWrite(totalBytes);
+		size_t position = 0;
+		for (int layer = 0; layer < textureArray.layers; layer++)
+		{
+			const DECODED_IMAGE& image = textureArray.images[layer];
+			if (image.levelBytes > 0)
+			{
+				const TextureCache::HEADER* header = (const TextureCache::HEADER*)image.GetContainer();
+				const size_t first = header->levels[level].offset;
+				const size_t bytes = header->levels[0].offset + image.levelBytes - first;
+
+				memcpy(staging + position, image.GetContainer() + first, bytes);
+				position += bytes;
+			}
+		}
+		size_t offset = m_uploadStream.EndWrite(totalBytes);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadStream.GetBuffer());
+		for (int layer = 0; layer < textureArray.layers; layer++)
+		{
+			const DECODED_IMAGE& image = textureArray.images[layer];
+			if (image.levelBytes > 0)
+			{
+				const TextureCache::HEADER* header = (const TextureCache::HEADER*)image.GetContainer();
+				const size_t first = header->levels[level].offset;
+				for (int source = level; source < (int)header->levelCount; source++)
+				{
+					SetLevel(textureArray.format, source - level, layer,
+						TextureCache::GetLevelDimension(textureArray.width, source),
+						TextureCache::GetLevelDimension(textureArray.height, source), 1,
+						header->levels[source].size, (void*)(offset + header->levels[source].offset - first));
+				}
+				offset += header->levels[0].offset + image.levelBytes - first;
+			}
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		m_uploadStream.Fence();
+	}
+
+	if (textureArray.texture != 0)
+	{
+		glDeleteTextures(1, &textureArray.texture);
+		m_residentBytes -= GetArrayBytes(textureArray, textureArray.residentLevel);
+	}
+	textureArray.texture = texture;
+	textureArray.residentLevel = level;
+	m_residentBytes += GetArrayBytes(textureArray, level);
+
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/***********************************************************
+ *  GetCoarsestLevel()
+ *
+ *  This method is used for getting the level an array
+ *  starts with and is released down to, the first level
+ *  that is no larger than g_CoarsestSize.
+ ***********************************************************/
+int TextureManager::GetCoarsestLevel(const TEXTURE_ARRAY& textureArray)
+{
+	int level = 0;
+	while ((level < textureArray.levelCount - 1) &&
+		((TextureCache::GetLevelDimension(textureArray.width, level) > g_CoarsestSize) ||
+		(TextureCache::GetLevelDimension(textureArray.height, level) > g_CoarsestSize)))
+	{
+		level++;
+	}
+	return(level);
+}
+
+/***********************************************************
+ *  GetArrayBytes()
+ *
+ *  This method is used for getting the texture memory of all
+ *  the layers of an array from a level down to 1x1.
+ ***********************************************************/
+size_t TextureManager::GetArrayBytes(const TEXTURE_ARRAY& textureArray, int level)
+{
+	size_t bytes = 0;
+	for (int i = level; i < textureArray.levelCount; i++)
+	{
+		bytes += TextureCache::GetLevelSize(textureArray.format, textureArray.width, textureArray.height, i);
+	}
+	return(bytes * textureArray.layers);
+}
+
+/***********************************************************
+ *  StartWorkers()
+ *
+ *  This method is used for starting the decode threads the
+ *  first time an image is queued, one less than the number
+ *  of cores so the GL thread keeps a core to itself.
+ ***********************************************************/
+void TextureManager::StartWorkers()
+{
+	if (m_workers.empty() == false)
+	{
+		return;
+	}
+
+	// every image is flipped vertically when it is decoded
+	stbi_set_flip_vertically_on_load(true);
+
+	unsigned int workerCount = std::thread::hardware_concurrency();
+	workerCount = (workerCount > 1) ? workerCount - 1 : 1;
+	workerCount = (workerCount > g_MaxWorkers) ? g_MaxWorkers : workerCount;
+
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		m_workers.push_back(std::thread(&TextureManager::DecodeImages, this));
+	}
+}
+
+/***********************************************************
+ *  DecodeImages()
+ *
+ *  This method is run by each worker thread and makes no GL
+ *  calls.  The image file is mapped and hashed, and when the
+ *  texture cache has a matching container it is mapped and
+ *  passed on as it is.  Otherwise the image is decoded,
+ *  expanded to RGBA and built into a container, which is
+ *  also written to the cache for the next run.  An image
+ *  whose size differs from its header, or that cannot be
+ *  decoded, is passed on without levels so its layer keeps
+ *  the placeholder.
+ ***********************************************************/
+void TextureManager::DecodeImages()
+{
+	while (true)
+	{
+		DECODE_JOB job;
+		{
+			std::unique_lock<std::mutex> lock(m_queueMutex);
+			m_queueCondition.wait(lock, [this]() { return(m_bStopWorkers || (m_jobs.empty() == false)); });
+			if (m_bStopWorkers)
+			{
+				return;
+			}
+			job = m_jobs.front();
+			m_jobs.pop_front();
+		}
+
+		DECODED_IMAGE decoded;
+		decoded.filename = job.filename;
+		decoded.texture = job.texture;
+		decoded.colorChannels = job.colorChannels;
+		decoded.levelBytes = 0;
+		decoded.bCacheHit = false;
+
+		MappedFile source;
+		if (source.Open(job.filename.c_str()))
+		{
+			const uint64_t sourceHash = TextureCache::HashBytes(source.GetData(), source.GetSize());
+			const std::string cachePath = TextureCache::GetCachePath(sourceHash, job.format);
+
+			const TextureCache::HEADER* header = NULL;
+			std::unique_ptr<MappedFile> cached(new MappedFile());
+			if (cached->Open(cachePath.c_str()))
+			{
+				header = TextureCache::Validate(cached->GetData(), cached->GetSize(),
+					sourceHash, job.format, job.width, job.height);
+				// a stale or corrupt container is unmapped, so it
+				// can be replaced by the one written below
+				if (header == NULL)
+				{
+					cached->Close();
+				}
+			}
+
+			if (header != NULL)
+			{
+				decoded.cached = std::move(cached);
+				decoded.bCacheHit = true;
+			}
+			else
+			{
+				int width = 0;
+				int height = 0;
+				int colorChannels = 0;
+				unsigned char* image = stbi_load_from_memory(source.GetData(), (int)source.GetSize(),
+					&width, &height, &colorChannels, 0);
+
+				if ((image != NULL) && (width == job.width) && (height == job.height) &&
+					((colorChannels == 3) || (colorChannels == 4)))
+				{
+					const size_t pixelCount = (size_t)width * height;
+					std::vector<unsigned char> pixels(pixelCount * 4);
+					for (size_t p = 0; p < pixelCount; p++)
+					{
+						unsigned char* destination = &pixels[p * 4];
+						const unsigned char* pixel = image + p * colorChannels;
+						destination[0] = pixel[0];
+						destination[1] = pixel[1];
+						destination[2] = pixel[2];
+						destination[3] = (colorChannels == 4) ? pixel[3] : 255;
+					}
+
+					TextureCache::Build(pixels.data(), width, height, job.format, sourceHash, decoded.built);
+					header = (const TextureCache::HEADER*)decoded.built.data();
+
+					// the container is kept for streaming, so the
+					// written copy is mapped instead of held in memory
+					if (TextureCache::Write(cachePath, decoded.built) &&
+						cached->Open(cachePath.c_str()) &&
+						(TextureCache::Validate(cached->GetData(), cached->GetSize(),
+							sourceHash, job.format, job.width, job.height) != NULL))
+					{
+						decoded.cached = std::move(cached);
+						header = (const TextureCache::HEADER*)decoded.cached->GetData();
+						std::vector<unsigned char>().swap(decoded.built);
+					}
+				}
+				if (image != NULL)
+				{
+					stbi_image_free(image);
+				}
+			}
+
+			if (header != NULL)
+			{
+				const TextureCache::LEVEL& lastLevel = header->levels[header->levelCount - 1];
+				decoded.levelBytes = lastLevel.offset + lastLevel.size - header->levels[0].offset;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		m_decoded.push_back(std::move(decoded));
+	}
+}
@@ -0,0 +1,207 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturemanager.h
+// ============
+// scene textures packed into texture array layers by size
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include "MappedFile.h"
+#include "StreamBuffer.h"
+#include "TextureCache.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/***********************************************************
+ *  TextureManager
+ *
+ *  This class loads the scene textures and packs the ones
+ *  that share a size into the layers of one 2D texture
+ *  array.  A texture is referenced by a single integer that
+ *  holds its array and its layer, and every array stays
+ *  bound to its own texture unit, so the shader picks the
+ *  texture of each object and a change of texture between
+ *  objects needs no bind and no new draw call.
+ *
+ *  Only the image header is read when a texture is loaded.
+ *  The pixels are decoded by a pool of worker threads and
+ *  copied into the layers through pixel buffer objects a
+ *  few at a time, under a byte budget per frame.  Until
+ *  then the layer shows a plain placeholder.
+ *
+ *  The workers keep the decoded images in the texture cache
+ *  with all of their mip levels, block compressed when the
+ *  driver supports it, so later runs map the cached levels
+ *  and skip the decode, the compression and the mipmap
+ *  generation.
+ *
+ *  The levels of each array are streamed against a budget
+ *  of texture memory.  The scene reports how large each
+ *  texture appears on screen, an array starts with its
+ *  coarse levels only and is refined one level per frame up
+ *  to the finest level its textures need, and the finest
+ *  levels of arrays that have gone unused, or that exceed
+ *  the budget, are released again.  The containers stay
+ *  mapped, so a released level can be streamed back in.
+ *  Residency is tracked per array, since all the layers of
+ *  an array share its levels.
+ ***********************************************************/
+class TextureManager
+{
+public:
+	// constructor
+	TextureManager();
+	// destructor
+	~TextureManager();
+
+	// reference of a texture that was never loaded
+	static const int INVALID_TEXTURE = -1;
+	// number of arrays, must match MAX_TEXTURE_ARRAYS in the
+	// fragment shader
+	static const int MAX_TEXTURE_ARRAYS = 8;
+	// first texture unit of the arrays
+	static const int FIRST_TEXTURE_UNIT = 0;
+
+	// reserve the next layer of the array for the size of an
+	// image file, queue it for decoding and return the texture
+	// reference
+	int LoadTexture(const char* filename, const std::string& tag);
+	// get the reference of a tag, INVALID_TEXTURE when not loaded
+	int Find(const std::string& tag) const;
+
+	// create the arrays of the reserved layers, filled with the
+	// placeholder, and bind every array to its texture unit
+	void Upload();
+	// copy decoded images into their layers and stream levels
+	// in and out, called once per frame on the GL thread
+	void Update();
+
+	// record that a texture is drawn this frame, with one
+	// repeat of it covering the passed in pixels on screen
+	void RequestTexture(int texture, float pixelsPerRepeat);
+	// set the most bytes of texture memory the levels may use
+	void SetBudget(size_t bytes) { m_budget = bytes; }
+	// bytes of texture memory used by the resident levels
+	size_t GetResidentBytes() const { return(m_residentBytes); }
+
+	// array and layer of a texture reference
+	static int GetArray(int texture) { return(texture >> 16); }
+	static int GetLayer(int texture) { return(texture & 0xFFFF); }
+
+	// number of loaded textures
+	int GetTextureCount() const { return((int)m_handles.size()); }
+	// number of texture arrays
+	int GetArrayCount() const { return((int)m_arrays.size()); }
+	// number of textures that still show the placeholder
+	int GetPendingCount() const { return(m_pendingCount); }
+
+private:
+
+	// image waiting for a worker thread
+	struct DECODE_JOB
+	{
+		std::string filename;
+		int texture;
+		TextureCache::FORMAT format;
+		int width;
+		int height;
+		int colorChannels;
+	};
+
+	// image decoded by a worker thread
+	struct DECODED_IMAGE
+	{
+		std::string filename;
+		int texture;
+		int colorChannels;
+		// container read from the cache, or NULL when it was
+		// built by the worker
+		std::unique_ptr<MappedFile> cached;
+		// container built by the worker
+		std::vector<unsigned char> built;
+		// bytes of all mip levels, 0 when the decode failed
+		size_t levelBytes;
+		// true when the container was already in the cache
+		bool bCacheHit;
+
+		// start of the container
+		const unsigned char* GetContainer() const { return((cached != NULL) ? cached->GetData() : built.data()); }
+	};
+
+	// textures that share a size and a format
+	struct TEXTURE_ARRAY
+	{
+		GLuint texture;
+		TextureCache::FORMAT format;
+		int width;
+		int height;
+		int layers;
+		// layers that still show the placeholder
+		int pendingLayers;
+		// mip levels of a full resolution layer
+		int levelCount;
+		// finest level held by the texture, its level 0
+		int residentLevel;
+		// finest level requested this frame, levelCount when the
+		// array was not drawn
+		int requestedLevel;
+		// frame the array was last drawn in
+		int lastUsedFrame;
+		// container of each layer once it is decoded
+		std::vector<DECODED_IMAGE> images;
+	};
+
+	std::vector<TEXTURE_ARRAY> m_arrays;
+	// reference of every tag
+	std::unordered_map<std::string, int> m_handles;
+	// largest number of layers in one array
+	int m_maxLayers;
+	// number of queued textures that are not resident yet
+	int m_pendingCount;
+	// ring of pixel buffers the decoded images are staged in
+	StreamBuffer m_uploadStream;
+	// most bytes of texture memory the resident levels may use
+	size_t m_budget;
+	// bytes of texture memory used by the resident levels
+	size_t m_residentBytes;
+	// number of calls to Update()
+	int m_frame;
+
+	// decode workers and their queues
+	std::vector<std::thread> m_workers;
+	std::mutex m_queueMutex;
+	std::condition_variable m_queueCondition;
+	std::deque<DECODE_JOB> m_jobs;
+	std::deque<DECODED_IMAGE> m_decoded;
+	bool m_bStopWorkers;
+
+	// find an array that is not uploaded and has room for a
+	// layer of the passed in size and format, or start a new one
+	int FindArray(int width, int height, TextureCache::FORMAT format);
+	// copy the decoded images into their layers
+	void CopyDecodedImages();
+	// pick the resident level of every array and stream the
+	// levels in and out
+	void UpdateResidency();
+	// replace the texture of an array by one that holds the
+	// passed in level and all coarser ones
+	void AllocateArray(int arrayIndex, int level);
+	// coarsest level an array is streamed down to
+	static int GetCoarsestLevel(const TEXTURE_ARRAY& textureArray);
+	// bytes of texture memory of an array from a level down
+	static size_t GetArrayBytes(const TEXTURE_ARRAY& textureArray, int level);
+	// start the decode workers on the first load
+	void StartWorkers();
+	// decode queued images until the manager is destroyed
+	void DecodeImages();
+};
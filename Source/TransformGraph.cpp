@@ -0,0 +1,258 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformgraph.cpp
+// ============
+// parent/child hierarchy of scene transforms with dirty-flag propagation
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TransformGraph.h"
+#include "TransformKernel.h"
+
+/***********************************************************
+ *  TransformGraph()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+TransformGraph::TransformGraph()
+{
+	m_bAnyDirty = false;
+}
+
+/***********************************************************
+ *  ~TransformGraph()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+TransformGraph::~TransformGraph()
+{
+	Clear();
+}
+
+/***********************************************************
+ *  CreateNode()
+ *
+ *  This method is used for adding a node to the graph.  The
+ *  new node starts out dirty so that its world matrix is
+ *  calculated by the next update.
+ ***********************************************************/
+int TransformGraph::CreateNode(
+	int parentNode,
+	glm::vec3 scaleXYZ,
+	float XrotationDegrees,
+	float YrotationDegrees,
+	float ZrotationDegrees,
+	glm::vec3 positionXYZ)
+{
+	// a parent must already exist so that it is always
+	// updated before its children
+	if (parentNode >= (int)m_parents.size())
+	{
+		parentNode = -1;
+	}
+
+	m_parents.push_back(parentNode);
+	m_scaleX.push_back(scaleXYZ.x);
+	m_scaleY.push_back(scaleXYZ.y);
+	m_scaleZ.push_back(scaleXYZ.z);
+	m_rotationX.push_back(XrotationDegrees);
+	m_rotationY.push_back(YrotationDegrees);
+	m_rotationZ.push_back(ZrotationDegrees);
+	m_positionX.push_back(positionXYZ.x);
+	m_positionY.push_back(positionXYZ.y);
+	m_positionZ.push_back(positionXYZ.z);
+	m_worldMatrices.push_back(glm::mat4(1.0f));
+	m_dirtyFlags.push_back(1);
+	m_bAnyDirty = true;
+
+	return((int)m_parents.size() - 1);
+}
+
+/***********************************************************
+ *  SetLocalTransform()
+ *
+ *  This method is used for replacing all the local transform
+ *  values of a node and marking it dirty.
+ ***********************************************************/
+void TransformGraph::SetLocalTransform(
+	int node,
+	glm::vec3 scaleXYZ,
+	float XrotationDegrees,
+	float YrotationDegrees,
+	float ZrotationDegrees,
+	glm::vec3 positionXYZ)
+{
+	if ((node < 0) || (node >= (int)m_parents.size()))
+	{
+		return;
+	}
+
+	m_scaleX[node] = scaleXYZ.x;
+	m_scaleY[node] = scaleXYZ.y;
+	m_scaleZ[node] = scaleXYZ.z;
+	m_rotationX[node] = XrotationDegrees;
+	m_rotationY[node] = YrotationDegrees;
+	m_rotationZ[node] = ZrotationDegrees;
+	m_positionX[node] = positionXYZ.x;
+	m_positionY[node] = positionXYZ.y;
+	m_positionZ[node] = positionXYZ.z;
+	m_dirtyFlags[node] = 1;
+	m_bAnyDirty = true;
+}
+
+/***********************************************************
+ *  SetLocalPosition()
+ *
+ *  This method is used for moving a node, and everything
+ *  attached below it, to a new local position.
+ ***********************************************************/
+void TransformGraph::SetLocalPosition(int node, glm::vec3 positionXYZ)
+{
+	if ((node < 0) || (node >= (int)m_parents.size()))
+	{
+		return;
+	}
+
+	m_positionX[node] = positionXYZ.x;
+	m_positionY[node] = positionXYZ.y;
+	m_positionZ[node] = positionXYZ.z;
+	m_dirtyFlags[node] = 1;
+	m_bAnyDirty = true;
+}
+
+/***********************************************************
+ *  UpdateWorldTransforms()
+ *
+ *  This method is used for recalculating the world matrices
+ *  of the dirty nodes and of all the nodes below them.  The
+ *  local matrices of those nodes are calculated together by
+ *  the batched transform kernel, and when nothing has
+ *  changed no transform math is done at all.  The number of
+ *  recalculated nodes is returned.
+ ***********************************************************/
+int TransformGraph::UpdateWorldTransforms()
+{
+	m_updatedNodes.clear();
+
+	if (m_bAnyDirty == false)
+	{
+		return(0);
+	}
+
+	// find the dirty nodes - a changed parent invalidates
+	// all of its children
+	const int nodeCount = (int)m_parents.size();
+	for (int i = 0; i < nodeCount; i++)
+	{
+		const int parent = m_parents[i];
+		if ((parent >= 0) && (m_dirtyFlags[parent] != 0))
+		{
+			m_dirtyFlags[i] = 1;
+		}
+
+		if (m_dirtyFlags[i] != 0)
+		{
+			m_updatedNodes.push_back(i);
+		}
+	}
+
+	BuildLocalMatrices();
+
+	// the updated nodes are in creation order, so a parent's
+	// world matrix is always ready before its children need it
+	for (size_t i = 0; i < m_updatedNodes.size(); i++)
+	{
+		const int node = m_updatedNodes[i];
+		const int parent = m_parents[node];
+
+		if (parent >= 0)
+		{
+			m_worldMatrices[node] = m_worldMatrices[parent] * m_batchMatrices[i];
+		}
+		else
+		{
+			m_worldMatrices[node] = m_batchMatrices[i];
+		}
+		m_dirtyFlags[node] = 0;
+	}
+	m_bAnyDirty = false;
+
+	return((int)m_updatedNodes.size());
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method is used for removing all the nodes.
+ ***********************************************************/
+void TransformGraph::Clear()
+{
+	m_parents.clear();
+	m_scaleX.clear();
+	m_scaleY.clear();
+	m_scaleZ.clear();
+	m_rotationX.clear();
+	m_rotationY.clear();
+	m_rotationZ.clear();
+	m_positionX.clear();
+	m_positionY.clear();
+	m_positionZ.clear();
+	m_worldMatrices.clear();
+	m_dirtyFlags.clear();
+	m_updatedNodes.clear();
+	m_bAnyDirty = false;
+}
+
+/***********************************************************
+ *  BuildLocalMatrices()
+ *
+ *  This method is used for gathering the local transform
+ *  values of the updated nodes into contiguous arrays, and
+ *  converting them all to local matrices in one batch.
+ ***********************************************************/
+void TransformGraph::BuildLocalMatrices()
+{
+	const int count = (int)m_updatedNodes.size();
+	const std::vector<float>* sources[9] =
+	{
+		&m_scaleX, &m_scaleY, &m_scaleZ,
+		&m_rotationX, &m_rotationY, &m_rotationZ,
+		&m_positionX, &m_positionY, &m_positionZ
+	};
+
+	// when every node is dirty the arrays can be used directly
+	const bool bAllNodes = (count == (int)m_parents.size());
+
+	const float* columns[9];
+	for (int column = 0; column < 9; column++)
+	{
+		if (bAllNodes)
+		{
+			columns[column] = sources[column]->data();
+		}
+		else
+		{
+			const std::vector<float>& source = *sources[column];
+			std::vector<float>& batch = m_batchValues[column];
+			batch.resize(count);
+			for (int i = 0; i < count; i++)
+			{
+				batch[i] = source[m_updatedNodes[i]];
+			}
+			columns[column] = batch.data();
+		}
+	}
+
+	TransformKernel::TRS_ARRAYS input;
+	input.scaleX = columns[0];
+	input.scaleY = columns[1];
+	input.scaleZ = columns[2];
+	input.rotationX = columns[3];
+	input.rotationY = columns[4];
+	input.rotationZ = columns[5];
+	input.positionX = columns[6];
+	input.positionY = columns[7];
+	input.positionZ = columns[8];
+
+	m_batchMatrices.resize(count);
+	TransformKernel::BuildModelMatrices(input, count, m_batchMatrices.data());
+}
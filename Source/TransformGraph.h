@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformgraph.h
+// ============
+// parent/child hierarchy of scene transforms with dirty-flag propagation
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  TransformGraph
+ *
+ *  This class stores the local scale, rotation and position
+ *  of every node once, and only recalculates the world
+ *  matrix of a node when it, or one of its ancestors, has
+ *  been marked dirty.  A parent is always created before
+ *  its children, so a single pass in creation order is
+ *  enough to propagate the changes down the hierarchy.
+ ***********************************************************/
+class TransformGraph
+{
+public:
+	// constructor
+	TransformGraph();
+	// destructor
+	~TransformGraph();
+
+	// create a node with the passed in local transform values,
+	// parentNode is -1 for a root node
+	int CreateNode(
+		int parentNode,
+		glm::vec3 scaleXYZ,
+		float XrotationDegrees,
+		float YrotationDegrees,
+		float ZrotationDegrees,
+		glm::vec3 positionXYZ);
+
+	// replace the local transform values of a node
+	void SetLocalTransform(
+		int node,
+		glm::vec3 scaleXYZ,
+		float XrotationDegrees,
+		float YrotationDegrees,
+		float ZrotationDegrees,
+		glm::vec3 positionXYZ);
+	// replace only the local position of a node
+	void SetLocalPosition(int node, glm::vec3 positionXYZ);
+
+	// recalculate the world matrices of the dirty nodes
+	int UpdateWorldTransforms();
+
+	// remove all the nodes
+	void Clear();
+
+	// number of nodes in the graph
+	int GetNodeCount() const { return((int)m_parents.size()); }
+	// parent of a node, -1 for a root node
+	int GetParentNode(int node) const { return(m_parents[node]); }
+	// world matrix of a node
+	const glm::mat4& GetWorldMatrix(int node) const { return(m_worldMatrices[node]); }
+	// nodes recalculated by the last update
+	const std::vector<int>& GetUpdatedNodes() const { return(m_updatedNodes); }
+
+private:
+	// parent of each node, -1 for a root node
+	std::vector<int> m_parents;
+	// local transform values of each node, stored as separate
+	// arrays so they can be fed to the batched transform kernel
+	std::vector<float> m_scaleX;
+	std::vector<float> m_scaleY;
+	std::vector<float> m_scaleZ;
+	std::vector<float> m_rotationX;
+	std::vector<float> m_rotationY;
+	std::vector<float> m_rotationZ;
+	std::vector<float> m_positionX;
+	std::vector<float> m_positionY;
+	std::vector<float> m_positionZ;
+	// cached world matrix of each node
+	std::vector<glm::mat4> m_worldMatrices;
+	// set when the node needs its world matrix recalculated
+	std::vector<uint8_t> m_dirtyFlags;
+	// true when at least one node is dirty
+	bool m_bAnyDirty;
+	// nodes recalculated by the last update
+	std::vector<int> m_updatedNodes;
+	// gathered local transform values of the updated nodes
+	std::vector<float> m_batchValues[9];
+	// local matrices of the updated nodes
+	std::vector<glm::mat4> m_batchMatrices;
+
+	// calculate the local matrices of all the updated nodes
+	void BuildLocalMatrices();
+};
@@ -0,0 +1,509 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformkernel.cpp
+// ============
+// batched conversion of scale, rotation and position arrays to model matrices
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TransformKernel.h"
+
+#include <glm/gtx/transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#if defined(TRANSFORM_KERNEL_AVX2)
+#include <immintrin.h>
+#elif defined(TRANSFORM_KERNEL_SSE2)
+#include <emmintrin.h>
+#endif
+
+// declaration of the constants used by the kernels
+namespace
+{
+	const float g_DegreesToRadians = 0.01745329251994329577f;
+	const float g_TwoOverPi = 0.63661977236758134308f;
+
+	// pi/2 split into three parts for accurate range reduction
+	const float g_HalfPiPart1 = 1.5703125f;
+	const float g_HalfPiPart2 = 4.837512969970703125e-4f;
+	const float g_HalfPiPart3 = 7.54978995489188216e-8f;
+
+	// minimax polynomial coefficients for the range [-pi/4, pi/4]
+	const float g_SinCoefficient0 = -1.9515295891e-4f;
+	const float g_SinCoefficient1 = 8.3321608736e-3f;
+	const float g_SinCoefficient2 = -1.6666654611e-1f;
+	const float g_CosCoefficient0 = 2.443315711809948e-5f;
+	const float g_CosCoefficient1 = -1.388731625493765e-3f;
+	const float g_CosCoefficient2 = 4.166664568298827e-2f;
+}
+
+/***********************************************************
+ *  WriteMatrix()
+ *
+ *  This function is used for writing the closed-form
+ *  T * Rz * Ry * Rx * S matrix from the sines and cosines
+ *  of the three rotation angles.
+ ***********************************************************/
+static inline void WriteMatrix(
+	float sx, float cx,
+	float sy, float cy,
+	float sz, float cz,
+	float scaleX, float scaleY, float scaleZ,
+	float positionX, float positionY, float positionZ,
+	glm::mat4& output)
+{
+	const float szsy = sz * sy;
+	const float czsy = cz * sy;
+
+	output[0] = glm::vec4(cz * cy * scaleX, sz * cy * scaleX, -sy * scaleX, 0.0f);
+	output[1] = glm::vec4((czsy * sx - sz * cx) * scaleY, (szsy * sx + cz * cx) * scaleY, cy * sx * scaleY, 0.0f);
+	output[2] = glm::vec4((czsy * cx + sz * sx) * scaleZ, (szsy * cx - cz * sx) * scaleZ, cy * cx * scaleZ, 0.0f);
+	output[3] = glm::vec4(positionX, positionY, positionZ, 1.0f);
+}
+
+/***********************************************************
+ *  BuildModelMatricesScalar()
+ *
+ *  This function is used for calculating the model matrices
+ *  one object at a time.  It is also used for the objects
+ *  left over after the last full SIMD batch.
+ ***********************************************************/
+void TransformKernel::BuildModelMatricesScalar(const TRS_ARRAYS& input, int count, glm::mat4* output)
+{
+	for (int i = 0; i < count; i++)
+	{
+		const float x = input.rotationX[i] * g_DegreesToRadians;
+		const float y = input.rotationY[i] * g_DegreesToRadians;
+		const float z = input.rotationZ[i] * g_DegreesToRadians;
+
+		WriteMatrix(
+			std::sin(x), std::cos(x),
+			std::sin(y), std::cos(y),
+			std::sin(z), std::cos(z),
+			input.scaleX[i], input.scaleY[i], input.scaleZ[i],
+			input.positionX[i], input.positionY[i], input.positionZ[i],
+			output[i]);
+	}
+}
+
+#if defined(TRANSFORM_KERNEL_SSE2) || defined(TRANSFORM_KERNEL_AVX2)
+
+/***********************************************************
+ *  SinCos4()
+ *
+ *  This function is used for calculating the sine and cosine
+ *  of four angles at once.  The angles are reduced to the
+ *  range [-pi/4, pi/4] around the nearest multiple of pi/2,
+ *  and the quadrant selects which polynomial and sign is
+ *  used for each result.
+ ***********************************************************/
+static inline void SinCos4(__m128 angle, __m128& sine, __m128& cosine)
+{
+	__m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(angle, _mm_set1_ps(g_TwoOverPi)));
+	__m128 q = _mm_cvtepi32_ps(quadrant);
+
+	__m128 r = _mm_sub_ps(angle, _mm_mul_ps(q, _mm_set1_ps(g_HalfPiPart1)));
+	r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(g_HalfPiPart2)));
+	r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(g_HalfPiPart3)));
+	__m128 r2 = _mm_mul_ps(r, r);
+
+	__m128 sinR = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(g_SinCoefficient0), r2), _mm_set1_ps(g_SinCoefficient1));
+	sinR = _mm_add_ps(_mm_mul_ps(sinR, r2), _mm_set1_ps(g_SinCoefficient2));
+	sinR = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinR, r2), r), r);
+
+	__m128 cosR = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(g_CosCoefficient0), r2), _mm_set1_ps(g_CosCoefficient1));
+	cosR = _mm_add_ps(_mm_mul_ps(cosR, r2), _mm_set1_ps(g_CosCoefficient2));
+	cosR = _mm_mul_ps(_mm_mul_ps(cosR, r2), r2);
+	cosR = _mm_add_ps(_mm_sub_ps(cosR, _mm_mul_ps(r2, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+	// odd quadrants swap the sine and cosine polynomials
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(
+		_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+	__m128 s = _mm_or_ps(_mm_and_ps(swap, cosR), _mm_andnot_ps(swap, sinR));
+	__m128 c = _mm_or_ps(_mm_and_ps(swap, sinR), _mm_andnot_ps(swap, cosR));
+
+	// bit 1 of the quadrant gives the sign of the sine, and
+	// bit 1 of the next quadrant gives the sign of the cosine
+	__m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(
+		_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+	__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(
+		_mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+
+	sine = _mm_xor_ps(s, sinSign);
+	cosine = _mm_xor_ps(c, cosSign);
+}
+
+/***********************************************************
+ *  StoreColumn4()
+ *
+ *  This function is used for transposing one matrix column
+ *  of four objects from SIMD lanes into the output matrices.
+ ***********************************************************/
+static inline void StoreColumn4(
+	__m128 row0, __m128 row1, __m128 row2, __m128 row3,
+	int column, glm::mat4* output)
+{
+	_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+	_mm_storeu_ps(&output[0][column][0], row0);
+	_mm_storeu_ps(&output[1][column][0], row1);
+	_mm_storeu_ps(&output[2][column][0], row2);
+	_mm_storeu_ps(&output[3][column][0], row3);
+}
+
+#endif
+
+#if defined(TRANSFORM_KERNEL_SSE2)
+
+/***********************************************************
+ *  BuildModelMatrices4()
+ *
+ *  This function is used for calculating the model matrices
+ *  of four objects at once with SSE2.
+ ***********************************************************/
+static inline void BuildModelMatrices4(const TransformKernel::TRS_ARRAYS& input, int first, glm::mat4* output)
+{
+	const __m128 toRadians = _mm_set1_ps(g_DegreesToRadians);
+
+	__m128 sx, cx, sy, cy, sz, cz;
+	SinCos4(_mm_mul_ps(_mm_loadu_ps(input.rotationX + first), toRadians), sx, cx);
+	SinCos4(_mm_mul_ps(_mm_loadu_ps(input.rotationY + first), toRadians), sy, cy);
+	SinCos4(_mm_mul_ps(_mm_loadu_ps(input.rotationZ + first), toRadians), sz, cz);
+
+	const __m128 scaleX = _mm_loadu_ps(input.scaleX + first);
+	const __m128 scaleY = _mm_loadu_ps(input.scaleY + first);
+	const __m128 scaleZ = _mm_loadu_ps(input.scaleZ + first);
+	const __m128 zero = _mm_setzero_ps();
+
+	const __m128 szsy = _mm_mul_ps(sz, sy);
+	const __m128 czsy = _mm_mul_ps(cz, sy);
+
+	// first column - rotated X axis
+	StoreColumn4(
+		_mm_mul_ps(_mm_mul_ps(cz, cy), scaleX),
+		_mm_mul_ps(_mm_mul_ps(sz, cy), scaleX),
+		_mm_mul_ps(_mm_sub_ps(zero, sy), scaleX),
+		zero, 0, output);
+
+	// second column - rotated Y axis
+	StoreColumn4(
+		_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(czsy, sx), _mm_mul_ps(sz, cx)), scaleY),
+		_mm_mul_ps(_mm_add_ps(_mm_mul_ps(szsy, sx), _mm_mul_ps(cz, cx)), scaleY),
+		_mm_mul_ps(_mm_mul_ps(cy, sx), scaleY),
+		zero, 1, output);
+
+	// third column - rotated Z axis
+	StoreColumn4(
+		_mm_mul_ps(_mm_add_ps(_mm_mul_ps(czsy, cx), _mm_mul_ps(sz, sx)), scaleZ),
+		_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(szsy, cx), _mm_mul_ps(cz, sx)), scaleZ),
+		_mm_mul_ps(_mm_mul_ps(cy, cx), scaleZ),
+		zero, 2, output);
+
+	// fourth column - translation
+	StoreColumn4(
+		_mm_loadu_ps(input.positionX + first),
+		_mm_loadu_ps(input.positionY + first),
+		_mm_loadu_ps(input.positionZ + first),
+		_mm_set1_ps(1.0f), 3, output);
+}
+
+#endif
+
+#if defined(TRANSFORM_KERNEL_AVX2)
+
+/***********************************************************
+ *  SinCos8()
+ *
+ *  This function is used for calculating the sine and cosine
+ *  of eight angles at once with AVX2.  It follows the same
+ *  steps as SinCos4().
+ ***********************************************************/
+static inline void SinCos8(__m256 angle, __m256& sine, __m256& cosine)
+{
+	__m256i quadrant = _mm256_cvtps_epi32(_mm256_mul_ps(angle, _mm256_set1_ps(g_TwoOverPi)));
+	__m256 q = _mm256_cvtepi32_ps(quadrant);
+
+	__m256 r = _mm256_sub_ps(angle, _mm256_mul_ps(q, _mm256_set1_ps(g_HalfPiPart1)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(q, _mm256_set1_ps(g_HalfPiPart2)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(q, _mm256_set1_ps(g_HalfPiPart3)));
+	__m256 r2 = _mm256_mul_ps(r, r);
+
+	__m256 sinR = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(g_SinCoefficient0), r2), _mm256_set1_ps(g_SinCoefficient1));
+	sinR = _mm256_add_ps(_mm256_mul_ps(sinR, r2), _mm256_set1_ps(g_SinCoefficient2));
+	sinR = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sinR, r2), r), r);
+
+	__m256 cosR = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(g_CosCoefficient0), r2), _mm256_set1_ps(g_CosCoefficient1));
+	cosR = _mm256_add_ps(_mm256_mul_ps(cosR, r2), _mm256_set1_ps(g_CosCoefficient2));
+	cosR = _mm256_mul_ps(_mm256_mul_ps(cosR, r2), r2);
+	cosR = _mm256_add_ps(_mm256_sub_ps(cosR, _mm256_mul_ps(r2, _mm256_set1_ps(0.5f))), _mm256_set1_ps(1.0f));
+
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+		_mm256_and_si256(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+	__m256 s = _mm256_blendv_ps(sinR, cosR, swap);
+	__m256 c = _mm256_blendv_ps(cosR, sinR, swap);
+
+	__m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(
+		_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30));
+	__m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(
+		_mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+
+	sine = _mm256_xor_ps(s, sinSign);
+	cosine = _mm256_xor_ps(c, cosSign);
+}
+
+/***********************************************************
+ *  StoreColumn8()
+ *
+ *  This function is used for transposing one matrix column
+ *  of eight objects into the output matrices, four objects
+ *  at a time.
+ ***********************************************************/
+static inline void StoreColumn8(
+	__m256 row0, __m256 row1, __m256 row2, __m256 row3,
+	int column, glm::mat4* output)
+{
+	StoreColumn4(
+		_mm256_castps256_ps128(row0), _mm256_castps256_ps128(row1),
+		_mm256_castps256_ps128(row2), _mm256_castps256_ps128(row3),
+		column, output);
+	StoreColumn4(
+		_mm256_extractf128_ps(row0, 1), _mm256_extractf128_ps(row1, 1),
+		_mm256_extractf128_ps(row2, 1), _mm256_extractf128_ps(row3, 1),
+		column, output + 4);
+}
+
+/***********************************************************
+ *  BuildModelMatrices8()
+ *
+ *  This function is used for calculating the model matrices
+ *  of eight objects at once with AVX2.
+ ***********************************************************/
+static inline void BuildModelMatrices8(const TransformKernel::TRS_ARRAYS& input, int first, glm::mat4* output)
+{
+	const __m256 toRadians = _mm256_set1_ps(g_DegreesToRadians);
+
+	__m256 sx, cx, sy, cy, sz, cz;
+	SinCos8(_mm256_mul_ps(_mm256_loadu_ps(input.rotationX + first), toRadians), sx, cx);
+	SinCos8(_mm256_mul_ps(_mm256_loadu_ps(input.rotationY + first), toRadians), sy, cy);
+	SinCos8(_mm256_mul_ps(_mm256_loadu_ps(input.rotationZ + first), toRadians), sz, cz);
+
+	const __m256 scaleX = _mm256_loadu_ps(input.scaleX + first);
+	const __m256 scaleY = _mm256_loadu_ps(input.scaleY + first);
+	const __m256 scaleZ = _mm256_loadu_ps(input.scaleZ + first);
+	const __m256 zero = _mm256_setzero_ps();
+
+	const __m256 szsy = _mm256_mul_ps(sz, sy);
+	const __m256 czsy = _mm256_mul_ps(cz, sy);
+
+	// first column - rotated X axis
+	StoreColumn8(
+		_mm256_mul_ps(_mm256_mul_ps(cz, cy), scaleX),
+		_mm256_mul_ps(_mm256_mul_ps(sz, cy), scaleX),
+		_mm256_mul_ps(_mm256_sub_ps(zero, sy), scaleX),
+		zero, 0, output);
+
+	// second column - rotated Y axis
+	StoreColumn8(
+		_mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(czsy, sx), _mm256_mul_ps(sz, cx)), scaleY),
+		_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(szsy, sx), _mm256_mul_ps(cz, cx)), scaleY),
+		_mm256_mul_ps(_mm256_mul_ps(cy, sx), scaleY),
+		zero, 1, output);
+
+	// third column - rotated Z axis
+	StoreColumn8(
+		_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(czsy, cx), _mm256_mul_ps(sz, sx)), scaleZ),
+		_mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(szsy, cx), _mm256_mul_ps(cz, sx)), scaleZ),
+		_mm256_mul_ps(_mm256_mul_ps(cy, cx), scaleZ),
+		zero, 2, output);
+
+	// fourth column - translation
+	StoreColumn8(
+		_mm256_loadu_ps(input.positionX + first),
+		_mm256_loadu_ps(input.positionY + first),
+		_mm256_loadu_ps(input.positionZ + first),
+		_mm256_set1_ps(1.0f), 3, output);
+}
+
+#endif
+
+/***********************************************************
+ *  BuildModelMatrices()
+ *
+ *  This function is used for calculating the model matrices
+ *  of all the objects, as many at a time as the instruction
+ *  set allows, with the remainder done by the scalar path.
+ ***********************************************************/
+void TransformKernel::BuildModelMatrices(const TRS_ARRAYS& input, int count, glm::mat4* output)
+{
+	int first = 0;
+
+#if defined(TRANSFORM_KERNEL_AVX2)
+	for (; first + 8 <= count; first += 8)
+	{
+		BuildModelMatrices8(input, first, output + first);
+	}
+#elif defined(TRANSFORM_KERNEL_SSE2)
+	for (; first + 4 <= count; first += 4)
+	{
+		BuildModelMatrices4(input, first, output + first);
+	}
+#endif
+
+	if (first < count)
+	{
+		TRS_ARRAYS remainder;
+		remainder.scaleX = input.scaleX + first;
+		remainder.scaleY = input.scaleY + first;
+		remainder.scaleZ = input.scaleZ + first;
+		remainder.rotationX = input.rotationX + first;
+		remainder.rotationY = input.rotationY + first;
+		remainder.rotationZ = input.rotationZ + first;
+		remainder.positionX = input.positionX + first;
+		remainder.positionY = input.positionY + first;
+		remainder.positionZ = input.positionZ + first;
+
+		BuildModelMatricesScalar(remainder, count - first, output + first);
+	}
+}
+
+/***********************************************************
+ *  GetInstructionSet()
+ *
+ *  This function is used for getting the name of the
+ *  instruction set that was compiled into the kernel.
+ ***********************************************************/
+const char* TransformKernel::GetInstructionSet()
+{
+#if defined(TRANSFORM_KERNEL_AVX2)
+	return("AVX2");
+#elif defined(TRANSFORM_KERNEL_SSE2)
+	return("SSE2");
+#else
+	return("scalar");
+#endif
+}
+
+/***********************************************************
+ *  RunBenchmark()
+ *
+ *  This function is used for checking the scalar and SIMD
+ *  kernels against the separate glm::rotate() matrix
+ *  multiplies, and for measuring the throughput of the glm,
+ *  scalar and SIMD paths.  It returns false if any matrix
+ *  does not match.
+ ***********************************************************/
+bool TransformKernel::RunBenchmark(int objectCount, int iterations)
+{
+	std::vector<float> values[9];
+	for (int i = 0; i < 9; i++)
+	{
+		values[i].resize(objectCount);
+	}
+
+	// fill the input with random transforms, including angles
+	// outside of the [-360, 360] range
+	srand(330);
+	for (int i = 0; i < objectCount; i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			values[axis][i] = 0.1f + 4.0f * ((float)rand() / RAND_MAX);
+			values[3 + axis][i] = -720.0f + 1440.0f * ((float)rand() / RAND_MAX);
+			values[6 + axis][i] = -50.0f + 100.0f * ((float)rand() / RAND_MAX);
+		}
+	}
+
+	TRS_ARRAYS input;
+	input.scaleX = values[0].data();
+	input.scaleY = values[1].data();
+	input.scaleZ = values[2].data();
+	input.rotationX = values[3].data();
+	input.rotationY = values[4].data();
+	input.rotationZ = values[5].data();
+	input.positionX = values[6].data();
+	input.positionY = values[7].data();
+	input.positionZ = values[8].data();
+
+	std::vector<glm::mat4> reference(objectCount);
+	std::vector<glm::mat4> kernel(objectCount);
+	std::vector<glm::mat4> scalar(objectCount);
+
+	typedef std::chrono::high_resolution_clock Clock;
+	double glmSeconds = 0.0;
+	double scalarSeconds = 0.0;
+	double kernelSeconds = 0.0;
+
+	for (int pass = 0; pass < iterations; pass++)
+	{
+		Clock::time_point start = Clock::now();
+		for (int i = 0; i < objectCount; i++)
+		{
+			reference[i] =
+				glm::translate(glm::vec3(input.positionX[i], input.positionY[i], input.positionZ[i])) *
+				glm::rotate(glm::radians(input.rotationZ[i]), glm::vec3(0.0f, 0.0f, 1.0f)) *
+				glm::rotate(glm::radians(input.rotationY[i]), glm::vec3(0.0f, 1.0f, 0.0f)) *
+				glm::rotate(glm::radians(input.rotationX[i]), glm::vec3(1.0f, 0.0f, 0.0f)) *
+				glm::scale(glm::vec3(input.scaleX[i], input.scaleY[i], input.scaleZ[i]));
+		}
+		Clock::time_point middle = Clock::now();
+		BuildModelMatricesScalar(input, objectCount, scalar.data());
+		Clock::time_point scalarEnd = Clock::now();
+		BuildModelMatrices(input, objectCount, kernel.data());
+		Clock::time_point end = Clock::now();
+
+		glmSeconds += std::chrono::duration<double>(middle - start).count();
+		scalarSeconds += std::chrono::duration<double>(scalarEnd - middle).count();
+		kernelSeconds += std::chrono::duration<double>(end - scalarEnd).count();
+	}
+
+	// compare every element of both kernels against the glm
+	// path, relative to the scale of the object so that large
+	// scales do not fail
+	float maxError = 0.0f;
+	float maxScalarError = 0.0f;
+	for (int i = 0; i < objectCount; i++)
+	{
+		float tolerance = 1.0f + values[0][i] + values[1][i] + values[2][i];
+		for (int column = 0; column < 4; column++)
+		{
+			for (int row = 0; row < 4; row++)
+			{
+				float error = std::fabs(kernel[i][column][row] - reference[i][column][row]) / tolerance;
+				if (error > maxError)
+				{
+					maxError = error;
+				}
+				float scalarError = std::fabs(scalar[i][column][row] - reference[i][column][row]) / tolerance;
+				if (scalarError > maxScalarError)
+				{
+					maxScalarError = scalarError;
+				}
+			}
+		}
+	}
+
+	const double total = (double)objectCount * iterations;
+	std::cout << "Transform kernel benchmark: " << objectCount << " objects x " << iterations << " iterations" << std::endl;
+	std::cout << "  glm path:      " << (total / glmSeconds) / 1.0e6 << " M matrices/s" << std::endl;
+	std::cout << "  scalar kernel: " << (total / scalarSeconds) / 1.0e6 << " M matrices/s" << std::endl;
+	std::cout << "  " << GetInstructionSet() << " kernel:   " << (total / kernelSeconds) / 1.0e6 << " M matrices/s" << std::endl;
+	std::cout << "  max relative error against glm: scalar " << maxScalarError <<
+		", " << GetInstructionSet() << " " << maxError << std::endl;
+
+	bool bPassed = true;
+	if (maxScalarError >= 1.0e-5f)
+	{
+		std::cout << "  FAILED: scalar kernel does not match the glm path" << std::endl;
+		bPassed = false;
+	}
+	if (maxError >= 1.0e-5f)
+	{
+		std::cout << "  FAILED: " << GetInstructionSet() << " kernel does not match the glm path" << std::endl;
+		bPassed = false;
+	}
+
+	return(bPassed);
+}
@@ -0,0 +1,54 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformkernel.h
+// ============
+// batched conversion of scale, rotation and position arrays to model matrices
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+// select the widest instruction set enabled for the compiler
+#if defined(__AVX2__)
+#define TRANSFORM_KERNEL_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define TRANSFORM_KERNEL_SSE2
+#endif
+
+namespace TransformKernel
+{
+	/***********************************************************
+	 *  TRS_ARRAYS
+	 *
+	 *  Structure-of-arrays input for the kernel.  Each pointer
+	 *  references one value per object, and the rotations are
+	 *  Euler angles in degrees, as used by the scene objects.
+	 ***********************************************************/
+	struct TRS_ARRAYS
+	{
+		const float* scaleX;
+		const float* scaleY;
+		const float* scaleZ;
+		const float* rotationX;
+		const float* rotationY;
+		const float* rotationZ;
+		const float* positionX;
+		const float* positionY;
+		const float* positionZ;
+	};
+
+	// calculate T * Rz * Ry * Rx * S for every object using
+	// the widest instruction set that is available
+	void BuildModelMatrices(const TRS_ARRAYS& input, int count, glm::mat4* output);
+
+	// calculate the same matrices one object at a time
+	void BuildModelMatricesScalar(const TRS_ARRAYS& input, int count, glm::mat4* output);
+
+	// name of the instruction set used by BuildModelMatrices()
+	const char* GetInstructionSet();
+
+	// compare the kernel against the glm matrix path and print
+	// the throughput in matrices per second
+	bool RunBenchmark(int objectCount, int iterations);
+}
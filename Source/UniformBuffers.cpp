@@ -0,0 +1,291 @@
+///////////////////////////////////////////////////////////////////////////////
+// uniformbuffers.cpp
+// ============
+// std140 uniform buffers for the camera values, the light table and the shadows
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "UniformBuffers.h"
+
+#include <cstring>
+
+// the CPU copies must match the std140 sizes of the shader blocks
+static_assert(sizeof(UniformBuffers::DIRECTIONAL_LIGHT) == 64, "DirectionalLight is 64 bytes in std140");
+static_assert(sizeof(UniformBuffers::POINT_LIGHT) == 64, "PointLight is 64 bytes in std140");
+static_assert(sizeof(UniformBuffers::SPOT_LIGHT) == 96, "SpotLight is 96 bytes in std140");
+static_assert(sizeof(UniformBuffers::CAMERA_BLOCK) == 144, "CameraData is 144 bytes in std140");
+static_assert(sizeof(UniformBuffers::LIGHT_BLOCK) == 480, "LightData is 480 bytes in std140");
+static_assert(sizeof(UniformBuffers::SHADOW_BLOCK) == 2000, "ShadowData is 2000 bytes in std140");
+
+// declaration of the global variables and defines
+namespace
+{
+	// names of the uniform blocks in the shaders
+	const char* g_CameraBlockName = "CameraData";
+	const char* g_LightBlockName = "LightData";
+	const char* g_ShadowBlockName = "ShadowData";
+}
+
+/***********************************************************
+ *  UniformBuffers()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+UniformBuffers::UniformBuffers()
+{
+	m_cameraBuffer = 0;
+	m_lightBuffer = 0;
+	m_shadowBuffer = 0;
+	m_camera = CAMERA_BLOCK();
+	m_lights = LIGHT_BLOCK();
+	m_shadows = SHADOW_BLOCK();
+	m_bCameraDirty = true;
+	m_bLightsDirty = true;
+	m_uploadedBytes = 0;
+}
+
+/***********************************************************
+ *  ~UniformBuffers()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+UniformBuffers::~UniformBuffers()
+{
+	if (m_cameraBuffer != 0)
+	{
+		glDeleteBuffers(1, &m_cameraBuffer);
+		m_cameraBuffer = 0;
+	}
+	if (m_lightBuffer != 0)
+	{
+		glDeleteBuffers(1, &m_lightBuffer);
+		m_lightBuffer = 0;
+	}
+	if (m_shadowBuffer != 0)
+	{
+		glDeleteBuffers(1, &m_shadowBuffer);
+		m_shadowBuffer = 0;
+	}
+}
+
+/***********************************************************
+ *  Create()
+ *
+ *  This method is used for allocating the uniform buffers
+ *  and attaching them to their binding points.  The buffers
+ *  stay attached for the life of the application.  No
+ *  light casts shadows until the shadow values are set.
+ ***********************************************************/
+void UniformBuffers::Create()
+{
+	glGenBuffers(1, &m_cameraBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_cameraBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(CAMERA_BLOCK), &m_camera, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &m_lightBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_lightBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LIGHT_BLOCK), &m_lights, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &m_shadowBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_shadowBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(SHADOW_BLOCK), &m_shadows, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, m_cameraBuffer);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BINDING, m_lightBuffer);
+	glBindBufferBase(GL_UNIFORM_BUFFER, SHADOW_BINDING, m_shadowBuffer);
+}
+
+/***********************************************************
+ *  BindProgram()
+ *
+ *  This method is used for attaching the uniform blocks of
+ *  a linked program to the fixed binding points.  A program
+ *  that does not declare a block is skipped for that block.
+ ***********************************************************/
+void UniformBuffers::BindProgram(GLuint program)
+{
+	GLuint blockIndex = glGetUniformBlockIndex(program, g_CameraBlockName);
+	if (blockIndex != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(program, blockIndex, CAMERA_BINDING);
+	}
+
+	blockIndex = glGetUniformBlockIndex(program, g_LightBlockName);
+	if (blockIndex != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(program, blockIndex, LIGHT_BINDING);
+	}
+
+	blockIndex = glGetUniformBlockIndex(program, g_ShadowBlockName);
+	if (blockIndex != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(program, blockIndex, SHADOW_BINDING);
+	}
+}
+
+/***********************************************************
+ *  SetCamera()
+ *
+ *  This method is used for replacing the camera values.  The
+ *  block is uploaded right away, but only when the values
+ *  differ from the previous upload, so a still camera costs
+ *  nothing per frame.
+ ***********************************************************/
+void UniformBuffers::SetCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition)
+{
+	CAMERA_BLOCK camera = CAMERA_BLOCK();
+	camera.view = view;
+	camera.projection = projection;
+	camera.viewPosition = viewPosition;
+
+	if ((m_bCameraDirty == false) && (memcmp(&camera, &m_camera, sizeof(camera)) == 0))
+	{
+		return;
+	}
+
+	m_camera = camera;
+	m_bCameraDirty = false;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_cameraBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CAMERA_BLOCK), &m_camera);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	m_uploadedBytes += sizeof(CAMERA_BLOCK);
+}
+
+/***********************************************************
+ *  SetShadows()
+ *
+ *  This method is used for replacing the shadow values.
+ *  They only change when the shadow maps are fitted to the
+ *  lights again, so the block is uploaded right away, and
+ *  only when it differs from the previous upload.
+ ***********************************************************/
+void UniformBuffers::SetShadows(const SHADOW_BLOCK& shadows)
+{
+	if (memcmp(&shadows, &m_shadows, sizeof(shadows)) == 0)
+	{
+		return;
+	}
+
+	m_shadows = shadows;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_shadowBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SHADOW_BLOCK), &m_shadows);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	m_uploadedBytes += sizeof(SHADOW_BLOCK);
+}
+
+/***********************************************************
+ *  SetDirectionalLight()
+ *
+ *  This method is used for replacing the directional light
+ *  in the CPU copy of the light table.
+ ***********************************************************/
+void UniformBuffers::SetDirectionalLight(const DIRECTIONAL_LIGHT& light)
+{
+	DIRECTIONAL_LIGHT value = light;
+	value.padding0 = value.padding1 = value.padding2 = 0.0f;
+
+	if (memcmp(&value, &m_lights.directionalLight, sizeof(value)) != 0)
+	{
+		m_lights.directionalLight = value;
+		m_bLightsDirty = true;
+	}
+}
+
+/***********************************************************
+ *  SetPointLight()
+ *
+ *  This method is used for replacing one of the point
+ *  lights in the CPU copy of the light table.
+ ***********************************************************/
+void UniformBuffers::SetPointLight(int index, const POINT_LIGHT& light)
+{
+	if ((index < 0) || (index >= TOTAL_POINT_LIGHTS))
+	{
+		return;
+	}
+
+	POINT_LIGHT value = light;
+	value.padding0 = value.padding1 = value.padding2 = 0.0f;
+
+	if (memcmp(&value, &m_lights.pointLights[index], sizeof(value)) != 0)
+	{
+		m_lights.pointLights[index] = value;
+		m_bLightsDirty = true;
+	}
+}
+
+/***********************************************************
+ *  SetSpotLight()
+ *
+ *  This method is used for replacing the spot light in the
+ *  CPU copy of the light table.
+ ***********************************************************/
+void UniformBuffers::SetSpotLight(const SPOT_LIGHT& light)
+{
+	SPOT_LIGHT value = light;
+	value.padding0 = value.padding1 = value.padding2 = 0.0f;
+
+	if (memcmp(&value, &m_lights.spotLight, sizeof(value)) != 0)
+	{
+		m_lights.spotLight = value;
+		m_bLightsDirty = true;
+	}
+}
+
+/***********************************************************
+ *  UploadLights()
+ *
+ *  This method is used for uploading the whole light table
+ *  with one call, when any light has changed since the last
+ *  upload.  The active point lights are moved ahead of the
+ *  inactive ones in the uploaded copy, keeping their order.
+ ***********************************************************/
+void UniformBuffers::UploadLights()
+{
+	if (m_bLightsDirty == false)
+	{
+		return;
+	}
+
+	LIGHT_BLOCK lights = m_lights;
+	int packed = 0;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int i = 0; i < TOTAL_POINT_LIGHTS; i++)
+		{
+			if ((m_lights.pointLights[i].bActive != 0) == (pass == 0))
+			{
+				lights.pointLights[packed++] = m_lights.pointLights[i];
+			}
+		}
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_lightBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LIGHT_BLOCK), &lights);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	m_uploadedBytes += sizeof(LIGHT_BLOCK);
+	m_bLightsDirty = false;
+}
+
+/***********************************************************
+ *  GetActivePointLightCount()
+ *
+ *  This method is used for counting the active point
+ *  lights, which are the first ones of the uploaded table.
+ ***********************************************************/
+int UniformBuffers::GetActivePointLightCount() const
+{
+	int count = 0;
+	for (int i = 0; i < TOTAL_POINT_LIGHTS; i++)
+	{
+		if (m_lights.pointLights[i].bActive != 0)
+		{
+			count++;
+		}
+	}
+
+	return(count);
+}
@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////
+// uniformbuffers.h
+// ============
+// std140 uniform buffers for the camera values, the light table and the shadows
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/***********************************************************
+ *  UniformBuffers
+ *
+ *  This class owns the uniform buffers that hold the values
+ *  shared by every draw of a frame.  Each buffer keeps a
+ *  CPU copy laid out with the std140 rules, and is only
+ *  uploaded, with a single glBufferSubData() call, when its
+ *  contents have changed.  The buffers are attached to fixed
+ *  binding points, so any number of shader programs can
+ *  read them.  The active point lights are uploaded ahead
+ *  of the others, so a shader that knows how many are
+ *  active can skip testing each one.
+ ***********************************************************/
+class UniformBuffers
+{
+public:
+	// constructor
+	UniformBuffers();
+	// destructor
+	~UniformBuffers();
+
+	// fixed binding points of the uniform blocks
+	enum BINDING_POINT
+	{
+		CAMERA_BINDING = 0,
+		LIGHT_BINDING = 1,
+		SHADOW_BINDING = 2
+	};
+
+	// must match TOTAL_POINT_LIGHTS in the fragment shader
+	static const int TOTAL_POINT_LIGHTS = 5;
+	// must match TOTAL_SHADOW_LAYERS in the fragment shader,
+	// the directional light and six cube faces per point light
+	static const int TOTAL_SHADOW_LAYERS = 1 + 6 * TOTAL_POINT_LIGHTS;
+
+	// std140 layout of the DirectionalLight structure
+	struct DIRECTIONAL_LIGHT
+	{
+		glm::vec3 direction;
+		float padding0;
+		glm::vec3 ambient;
+		float padding1;
+		glm::vec3 diffuse;
+		float padding2;
+		glm::vec3 specular;
+		int bActive;
+	};
+
+	// std140 layout of the PointLight structure
+	struct POINT_LIGHT
+	{
+		glm::vec3 position;
+		float padding0;
+		glm::vec3 ambient;
+		float padding1;
+		glm::vec3 diffuse;
+		float padding2;
+		glm::vec3 specular;
+		int bActive;
+	};
+
+	// std140 layout of the SpotLight structure
+	struct SPOT_LIGHT
+	{
+		glm::vec3 position;
+		float padding0;
+		glm::vec3 direction;
+		float cutOff;
+		float outerCutOff;
+		float constant;
+		float linear;
+		float quadratic;
+		glm::vec3 ambient;
+		float padding1;
+		glm::vec3 diffuse;
+		float padding2;
+		glm::vec3 specular;
+		int bActive;
+	};
+
+	// std140 layout of the CameraData block
+	struct CAMERA_BLOCK
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::vec3 viewPosition;
+		float padding0;
+	};
+
+	// std140 layout of the LightData block
+	struct LIGHT_BLOCK
+	{
+		DIRECTIONAL_LIGHT directionalLight;
+		POINT_LIGHT pointLights[TOTAL_POINT_LIGHTS];
+		SPOT_LIGHT spotLight;
+	};
+
+	// std140 layout of the ShadowData block
+	struct SHADOW_BLOCK
+	{
+		// world to shadow map clip space of every layer
+		glm::mat4 shadowMatrices[TOTAL_SHADOW_LAYERS];
+		// world size of a texel of the directional map, and of
+		// a cube face texel at unit distance from its light
+		float directionalTexelSize;
+		float pointTexelSize;
+		// true when the directional light casts shadows, and
+		// the number of packed point lights that do
+		int bDirectionalShadow;
+		int pointShadowCount;
+	};
+
+	// create the buffers and attach them to their binding points
+	void Create();
+	// attach the uniform blocks of a program to the binding points
+	void BindProgram(GLuint program);
+
+	// replace the camera values, uploading them if they changed
+	void SetCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition);
+	// camera values of the last upload
+	const CAMERA_BLOCK& GetCamera() const { return(m_camera); }
+	// replace the shadow values, uploading them if they changed
+	void SetShadows(const SHADOW_BLOCK& shadows);
+
+	// replace the values of a light in the CPU copy
+	void SetDirectionalLight(const DIRECTIONAL_LIGHT& light);
+	void SetPointLight(int index, const POINT_LIGHT& light);
+	void SetSpotLight(const SPOT_LIGHT& light);
+	// upload the light table if any light changed
+	void UploadLights();
+
+	// light table as set, before the active point lights are
+	// packed ahead of the others
+	const LIGHT_BLOCK& GetLights() const { return(m_lights); }
+	// state of the lights, for selecting a shader permutation
+	bool IsDirectionalLightActive() const { return(m_lights.directionalLight.bActive != 0); }
+	int GetActivePointLightCount() const;
+	bool IsSpotLightActive() const { return(m_lights.spotLight.bActive != 0); }
+
+	// number of bytes uploaded since the counter was reset
+	size_t GetUploadedBytes() const { return(m_uploadedBytes); }
+	void ResetUploadedBytes() { m_uploadedBytes = 0; }
+
+private:
+	GLuint m_cameraBuffer;
+	GLuint m_lightBuffer;
+	GLuint m_shadowBuffer;
+	CAMERA_BLOCK m_camera;
+	LIGHT_BLOCK m_lights;
+	SHADOW_BLOCK m_shadows;
+	// true when the camera values have never been uploaded
+	bool m_bCameraDirty;
+	// true when a light has changed since the last upload
+	bool m_bLightsDirty;
+	size_t m_uploadedBytes;
+};
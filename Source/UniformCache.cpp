@@ -0,0 +1,239 @@
+///////////////////////////////////////////////////////////////////////////////
+// uniformcache.cpp
+// ============
+// uniform locations read once from the linked shader program
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "UniformCache.h"
+
+#include <cstdlib>
+#include <string>
+
+constexpr UniformCache::UNIFORM_INFO UniformCache::UNIFORMS[];
+
+// declaration of the global variables and defines
+namespace
+{
+	// longest uniform name read from the program
+	const GLsizei g_MaxNameLength = 256;
+
+	/***********************************************************
+	 *  HasUniqueHashes()
+	 *
+	 *  This function is used for checking at compile time that
+	 *  no two names in the table share a hash, since the IDs
+	 *  are found by comparing hashes.
+	 ***********************************************************/
+	constexpr bool HasUniqueHashes()
+	{
+		for (int i = 0; i < UniformCache::UNIFORM_COUNT; i++)
+		{
+			for (int j = i + 1; j < UniformCache::UNIFORM_COUNT; j++)
+			{
+				if (UniformCache::HashName(UniformCache::UNIFORMS[i].name) ==
+					UniformCache::HashName(UniformCache::UNIFORMS[j].name))
+				{
+					return(false);
+				}
+			}
+		}
+		return(true);
+	}
+
+	static_assert(HasUniqueHashes(), "two uniform names in UniformCache::UNIFORMS share a hash");
+}
+
+/***********************************************************
+ *  UniformCache()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+UniformCache::UniformCache()
+{
+	m_program = 0;
+	m_locations.assign(FindSlot(UNIFORM_COUNT), -1);
+}
+
+/***********************************************************
+ *  ~UniformCache()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+UniformCache::~UniformCache()
+{
+}
+
+/***********************************************************
+ *  LoadProgram()
+ *
+ *  This method is used for reading the locations of all the
+ *  active uniforms of the program that is in use.  It is
+ *  called once after the shaders are linked.  The program
+ *  interface query is used when it is available, otherwise
+ *  the uniforms are listed with glGetActiveUniform().
+ ***********************************************************/
+bool UniformCache::LoadProgram()
+{
+	GLint currentProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &currentProgram);
+
+	m_program = (GLuint)currentProgram;
+	m_locations.assign(FindSlot(UNIFORM_COUNT), -1);
+
+	if (m_program == 0)
+	{
+		return(false);
+	}
+
+	char name[g_MaxNameLength];
+
+	if (GLEW_VERSION_4_3 || GLEW_ARB_program_interface_query)
+	{
+		GLint uniformCount = 0;
+		glGetProgramInterfaceiv(m_program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+
+		for (GLint i = 0; i < uniformCount; i++)
+		{
+			const GLenum property = GL_ARRAY_SIZE;
+			GLint arraySize = 1;
+
+			glGetProgramResourceName(m_program, GL_UNIFORM, i, g_MaxNameLength, NULL, name);
+			glGetProgramResourceiv(m_program, GL_UNIFORM, i, 1, &property, 1, NULL, &arraySize);
+			AddActiveUniform(name, arraySize);
+		}
+	}
+	else
+	{
+		GLint uniformCount = 0;
+		glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &uniformCount);
+
+		for (GLint i = 0; i < uniformCount; i++)
+		{
+			GLint arraySize = 1;
+			GLenum type = 0;
+
+			glGetActiveUniform(m_program, i, g_MaxNameLength, NULL, &arraySize, &type, name);
+			AddActiveUniform(name, arraySize);
+		}
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  AddActiveUniform()
+ *
+ *  This method is used for storing the locations of one
+ *  active uniform.  The element index is removed from the
+ *  name before it is looked up in the table, so an element
+ *  like "textureArrays[2]" fills element 2 of
+ *  "textureArrays[]".  An array of a basic type is reported
+ *  once as "name[0]", so each of its elements is located by
+ *  name here.
+ ***********************************************************/
+void UniformCache::AddActiveUniform(const char* name, GLint arraySize)
+{
+	std::string tableName;
+	int element = 0;
+	bool bInBrackets = false;
+
+	for (const char* character = name; *character != '\0'; character++)
+	{
+		if (*character == '[')
+		{
+			bInBrackets = true;
+			element = atoi(character + 1);
+			tableName += *character;
+		}
+		else if (*character == ']')
+		{
+			bInBrackets = false;
+			tableName += *character;
+		}
+		else if (bInBrackets == false)
+		{
+			tableName += *character;
+		}
+	}
+
+	const int index = FindUniform(HashName(tableName.c_str()));
+	if (index < 0)
+	{
+		return;
+	}
+
+	const int slot = FindSlot(index);
+	const int count = UNIFORMS[index].count;
+
+	if (arraySize > 1)
+	{
+		// an array of a basic type, "name[0]" with arraySize elements
+		std::string baseName(name, tableName.size() - 2);
+		for (int i = 0; (i < arraySize) && (i < count); i++)
+		{
+			std::string elementName = baseName + "[" + std::to_string(i) + "]";
+			m_locations[slot + i] = glGetUniformLocation(m_program, elementName.c_str());
+		}
+	}
+	else if (element < count)
+	{
+		m_locations[slot + element] = glGetUniformLocation(m_program, name);
+	}
+}
+
+/***********************************************************
+ *  GetLocation()
+ *
+ *  This method is used for getting the cached location of
+ *  a uniform element.
+ ***********************************************************/
+GLint UniformCache::GetLocation(UniformId id, int element) const
+{
+	if ((element < 0) || (element >= id.count))
+	{
+		return(-1);
+	}
+
+	return(m_locations[id.slot + element]);
+}
+
+void UniformCache::SetBool(UniformId id, bool value, int element) const
+{
+	glUniform1i(GetLocation(id, element), value ? 1 : 0);
+}
+
+void UniformCache::SetInt(UniformId id, int value, int element) const
+{
+	glUniform1i(GetLocation(id, element), value);
+}
+
+void UniformCache::SetFloat(UniformId id, float value, int element) const
+{
+	glUniform1f(GetLocation(id, element), value);
+}
+
+void UniformCache::SetVec2(UniformId id, const glm::vec2& value, int element) const
+{
+	glUniform2f(GetLocation(id, element), value.x, value.y);
+}
+
+void UniformCache::SetVec3(UniformId id, const glm::vec3& value, int element) const
+{
+	glUniform3f(GetLocation(id, element), value.x, value.y, value.z);
+}
+
+void UniformCache::SetVec4(UniformId id, const glm::vec4& value, int element) const
+{
+	glUniform4f(GetLocation(id, element), value.x, value.y, value.z, value.w);
+}
+
+void UniformCache::SetMat4(UniformId id, const glm::mat4& value, int element) const
+{
+	glUniformMatrix4fv(GetLocation(id, element), 1, GL_FALSE, &value[0][0]);
+}
+
+void UniformCache::SetSampler2D(UniformId id, int textureUnit, int element) const
+{
+	glUniform1i(GetLocation(id, element), textureUnit);
+}
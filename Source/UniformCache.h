@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////////////////////////////////
+// uniformcache.h
+// ============
+// uniform locations read once from the linked shader program
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  UniformId
+ *
+ *  Compact reference to a uniform of the shader program.
+ *  It is created at compile time by UniformCache::MakeId(),
+ *  so setting a uniform through it is an array lookup
+ *  without any string hashing or comparing.
+ ***********************************************************/
+struct UniformId
+{
+	// first slot of the uniform in the location table
+	int slot;
+	// number of elements for an array of structures
+	int count;
+
+	constexpr UniformId(int slotValue, int countValue) : slot(slotValue), count(countValue) {}
+};
+
+/***********************************************************
+ *  UniformCache
+ *
+ *  This class stores the location of every uniform the
+ *  application sets.  The uniform names are listed once in
+ *  the table below, with the element index of an array
+ *  left out, as in "textureArrays[]".  The locations
+ *  are filled in by introspecting the linked program, so
+ *  the draw code never calls glGetUniformLocation().
+ ***********************************************************/
+class UniformCache
+{
+public:
+	// constructor
+	UniformCache();
+	// destructor
+	~UniformCache();
+
+	// name and number of elements of a known uniform
+	struct UNIFORM_INFO
+	{
+		const char* name;
+		int count;
+	};
+
+	// every uniform of the default block that can be set
+	// through the cache, an unknown name passed to MakeId()
+	// does not compile - the camera and light values are in
+	// the UniformBuffers blocks instead
+	static constexpr UNIFORM_INFO UNIFORMS[] =
+	{
+		{ "textureArrays[]", 8 },
+		{ "bUseLighting", 1 },
+		{ "materialTable", 1 },
+		{ "clusterTable", 1 },
+		{ "clusterLightIndices", 1 },
+		{ "clusterLights", 1 },
+		{ "gBufferAlbedo", 1 },
+		{ "gBufferNormal", 1 },
+		{ "gBufferDepth", 1 },
+		{ "shadowMaps", 1 },
+	};
+	static constexpr int UNIFORM_COUNT = sizeof(UNIFORMS) / sizeof(UNIFORMS[0]);
+
+	// 32-bit FNV-1a hash of a uniform name
+	static constexpr uint32_t HashName(const char* name)
+	{
+		uint32_t hash = 2166136261u;
+		while (*name != '\0')
+		{
+			hash = (hash ^ (uint8_t)*name) * 16777619u;
+			name++;
+		}
+		return(hash);
+	}
+
+	// index of a name in the table, -1 when it is not listed
+	static constexpr int FindUniform(uint32_t hash)
+	{
+		for (int i = 0; i < UNIFORM_COUNT; i++)
+		{
+			if (HashName(UNIFORMS[i].name) == hash)
+			{
+				return(i);
+			}
+		}
+		return(-1);
+	}
+
+	// first location slot used by a table entry
+	static constexpr int FindSlot(int index)
+	{
+		int slot = 0;
+		for (int i = 0; i < index; i++)
+		{
+			slot += UNIFORMS[i].count;
+		}
+		return(slot);
+	}
+
+	// build the ID of a listed uniform, when this is used to
+	// initialize a constexpr value an unknown name is a
+	// compile error, because the throw is not constant
+	static constexpr UniformId MakeId(const char* name)
+	{
+		return((FindUniform(HashName(name)) >= 0) ?
+			UniformId(FindSlot(FindUniform(HashName(name))), UNIFORMS[FindUniform(HashName(name))].count) :
+			throw "uniform name is not listed in UniformCache::UNIFORMS");
+	}
+
+	// read the uniform locations of the program that is in use
+	bool LoadProgram();
+
+	// location of a uniform element, -1 when it is not active
+	GLint GetLocation(UniformId id, int element = 0) const;
+
+	// set the value of a uniform element in the program in use
+	void SetBool(UniformId id, bool value, int element = 0) const;
+	void SetInt(UniformId id, int value, int element = 0) const;
+	void SetFloat(UniformId id, float value, int element = 0) const;
+	void SetVec2(UniformId id, const glm::vec2& value, int element = 0) const;
+	void SetVec3(UniformId id, const glm::vec3& value, int element = 0) const;
+	void SetVec4(UniformId id, const glm::vec4& value, int element = 0) const;
+	void SetMat4(UniformId id, const glm::mat4& value, int element = 0) const;
+	void SetSampler2D(UniformId id, int textureUnit, int element = 0) const;
+
+	// program the locations were read from
+	GLuint GetProgram() const { return(m_program); }
+
+private:
+	// program the locations were read from
+	GLuint m_program;
+	// location of every table entry element, by slot
+	std::vector<GLint> m_locations;
+
+	// store the locations of one active uniform of the program
+	void AddActiveUniform(const char* name, GLint arraySize);
+};
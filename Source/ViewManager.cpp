@@ -20,8 +20,6 @@ namespace
 	// Variables for window width and height
 	const int WINDOW_WIDTH = 1000;
 	const int WINDOW_HEIGHT = 800;
-	const char* g_ViewName = "view";
-	const char* g_ProjectionName = "projection";
 
 	// camera object used for viewing and interacting with
 	// the 3D scene
@@ -39,6 +37,8 @@ namespace
 	// the following variable is false when orthographic projection
 	// is off and true when it is on
 	bool bOrthographicProjection = false;
+	// half the height of the orthographic view volume
+	const float ORTHO_SIZE = 16.0f;
 }
 
 /***********************************************************
@@ -47,11 +47,14 @@ namespace
  *  The constructor for the class
  ***********************************************************/
 ViewManager::ViewManager(
-	ShaderManager *pShaderManager)
+	ShaderManager *pShaderManager,
+	UniformBuffers* pUniformBuffers)
 {
 	// initialize the member variables
 	m_pShaderManager = pShaderManager;
+	m_pUniformBuffers = pUniformBuffers;
 	m_pWindow = NULL;
+	m_viewProjection = glm::mat4(1.0f);
 	g_pCamera = new Camera();
 	// default camera view parameters
 	g_pCamera->Position = glm::vec3(0.0f, 5.0f, 12.0f);
@@ -243,7 +246,7 @@ void ViewManager::PrepareSceneView()
 	//persepective choice
 	if (bOrthographicProjection)
 	{
-		float orthoSize = 16.0f; 
+		float orthoSize = ORTHO_SIZE;
 		float aspect = (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT;
 		projection = glm::ortho(-orthoSize * aspect, orthoSize * aspect, -orthoSize, orthoSize, 0.1f, 100.0f);
 	}
@@ -251,14 +254,64 @@ void ViewManager::PrepareSceneView()
 	{
 		projection = glm::perspective(glm::radians(g_pCamera->Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
 	}
-	// if the shader manager object is valid
-	if (NULL != m_pShaderManager)
+	m_viewProjection = projection * view;
+
+	// if the uniform buffers object is valid
+	if (NULL != m_pUniformBuffers)
+	{
+		// set the view and projection matrices and the view position
+		// of the camera into the shared camera block - it is only
+		// uploaded when the camera has changed
+		m_pUniformBuffers->SetCamera(view, projection, g_pCamera->Position);
+	}
+}
+
+/***********************************************************
+ *  GetViewPosition()
+ *
+ *  This method is used for getting the current position of
+ *  the camera, so the scene can order its draws by distance.
+ ***********************************************************/
+glm::vec3 ViewManager::GetViewPosition() const
+{
+	if (NULL == g_pCamera)
+	{
+		return(glm::vec3(0.0f, 0.0f, 0.0f));
+	}
+
+	return(g_pCamera->Position);
+}
+
+/***********************************************************
+ *  GetViewScale()
+ *
+ *  This method is used for getting the number of pixels one
+ *  unit covers on screen, at unit distance from the camera
+ *  for the perspective projection, and at any distance for
+ *  the orthographic one.
+ ***********************************************************/
+float ViewManager::GetViewScale() const
+{
+	if (bOrthographicProjection)
 	{
-		// set the view matrix into the shader for proper rendering
-		m_pShaderManager->setMat4Value(g_ViewName, view);
-		// set the view matrix into the shader for proper rendering
-		m_pShaderManager->setMat4Value(g_ProjectionName, projection);
-		// set the view position of the camera into the shader for proper rendering
-		m_pShaderManager->setVec3Value("viewPosition", g_pCamera->Position);
+		return(WINDOW_HEIGHT / (2.0f * ORTHO_SIZE));
 	}
-}
\ No newline at end of file
+
+	if (NULL == g_pCamera)
+	{
+		return(1.0f);
+	}
+
+	return(WINDOW_HEIGHT / (2.0f * tanf(glm::radians(g_pCamera->Zoom) * 0.5f)));
+}
+
+/***********************************************************
+ *  IsPerspective()
+ *
+ *  This method is used for checking whether the size of an
+ *  object on screen shrinks with its distance.
+ ***********************************************************/
+bool ViewManager::IsPerspective() const
+{
+	return(bOrthographicProjection == false);
+}
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "ShaderManager.h"
+#include "UniformBuffers.h"
 #include "camera.h"
 
 // GLFW library
@@ -20,7 +21,8 @@ class ViewManager
 public:
 	// constructor
 	ViewManager(
-		ShaderManager* pShaderManager);
+		ShaderManager* pShaderManager,
+		UniformBuffers* pUniformBuffers);
 	// destructor
 	~ViewManager();
 
@@ -32,8 +34,12 @@ public:
 private:
 	// pointer to shader manager object
 	ShaderManager* m_pShaderManager;
+	// pointer to the shared camera and light uniform buffers
+	UniformBuffers* m_pUniformBuffers;
 	// active OpenGL display window
 	GLFWwindow* m_pWindow;
+	// projection times view of the last prepared frame
+	glm::mat4 m_viewProjection;
 
 	// process keyboard events for interaction with the 3D scene
 	void ProcessKeyboardEvents();
@@ -44,4 +50,13 @@ public:
 	
 	// prepare the conversion from 3D object display to 2D scene display
 	void PrepareSceneView();
+
+	// current position of the camera in world space
+	glm::vec3 GetViewPosition() const;
+	// pixels covered by one unit at unit distance from the camera
+	float GetViewScale() const;
+	// true unless the orthographic projection is selected
+	bool IsPerspective() const;
+	// projection times view of the last prepared frame, for culling
+	const glm::mat4& GetViewProjection() const { return(m_viewProjection); }
 };
\ No newline at end of file
@@ -0,0 +1,230 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// tessellation levels of the curved meshes, must match
+// InstancedMeshes::LOD_COUNT
+#define LOD_COUNT 4
+
+// per-instance values, laid out like INSTANCE_DATA
+struct Instance
+{
+    mat4 model;
+    vec4 color;
+    vec2 uvScale;
+    ivec2 indices;
+};
+
+// one scene object, the draw command of the finest level of
+// its mesh and the number of levels, with one command each
+struct Object
+{
+    Instance instance;
+    uint mesh;
+    uint lodCount;
+};
+
+// layout of one glMultiDrawElementsIndirect command
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer Objects
+{
+    Object objects[];
+};
+
+// bounds of each mesh in mesh space, a sphere as center and
+// radius, and the half extents of the box around the vertices
+struct Bounds
+{
+    vec4 sphere;
+    vec4 extent;
+};
+
+layout (std430, binding = 1) readonly buffer MeshBounds
+{
+    Bounds meshBounds[];
+};
+
+layout (std430, binding = 2) buffer DrawCommands
+{
+    DrawCommand commands[];
+};
+
+// visible instances, read by the draws as vertex attributes
+layout (std430, binding = 3) writeonly buffer VisibleInstances
+{
+    Instance instances[];
+};
+
+// level each object was last drawn with
+layout (std430, binding = 4) buffer ObjectLODs
+{
+    uint objectLODs[];
+};
+
+// per-frame camera values, shared with the render shaders
+layout (std140) uniform CameraData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+};
+
+uniform uint objectCount;
+
+// pixels covered by one unit at unit distance from the camera
+uniform float lodScale;
+uniform bool bPerspective = true;
+// smallest radius on screen drawn with each level, and how far
+// past it an object has to be to change level
+uniform float lodRadii[LOD_COUNT];
+uniform float lodHysteresis;
+
+// farthest depth of the large occluders, reduced 2x2 per level
+uniform bool bOcclusionCulling = false;
+uniform sampler2D occlusionPyramid;
+// depth difference below which a box counts as visible
+const float depthBias = 0.00001;
+
+// true when a world space box is behind the occluders over
+// the whole of its rectangle on screen
+bool IsOccluded(vec3 center, vec3 extent)
+{
+   vec2 rectMin = vec2(1.0);
+   vec2 rectMax = vec2(0.0);
+   float nearest = 1.0;
+
+   for (int corner = 0; corner < 8; corner++)
+   {
+      vec3 offset = vec3(((corner & 1) != 0) ? extent.x : -extent.x,
+         ((corner & 2) != 0) ? extent.y : -extent.y,
+         ((corner & 4) != 0) ? extent.z : -extent.z);
+      vec4 clip = projection * view * vec4(center + offset, 1.0);
+      if ((clip.w < 0.0001) || (clip.z < -clip.w))
+      {
+         return false;
+      }
+
+      vec3 screen = clip.xyz / clip.w * 0.5 + 0.5;
+      rectMin = min(rectMin, screen.xy);
+      rectMax = max(rectMax, screen.xy);
+      nearest = min(nearest, screen.z);
+   }
+
+   rectMin = clamp(rectMin, 0.0, 1.0);
+   rectMax = clamp(rectMax, 0.0, 1.0);
+   if ((rectMin.x >= rectMax.x) || (rectMin.y >= rectMax.y))
+   {
+      return false;
+   }
+
+   // grow the rectangle by a texel, then read the level where
+   // it spans at most two texels each way
+   ivec2 size = textureSize(occlusionPyramid, 0);
+   ivec2 texelMin = max(ivec2(rectMin * vec2(size)) - 1, ivec2(0));
+   ivec2 texelMax = min(ivec2(rectMax * vec2(size)) + 1, size - 1);
+   int topLevel = textureQueryLevels(occlusionPyramid) - 1;
+   int level = 0;
+   while ((level < topLevel) && any(greaterThan((texelMax >> level) - (texelMin >> level), ivec2(1))))
+   {
+      level++;
+   }
+
+   float farthest = 0.0;
+   for (int y = texelMin.y >> level; y <= (texelMax.y >> level); y++)
+   {
+      for (int x = texelMin.x >> level; x <= (texelMax.x >> level); x++)
+      {
+         farthest = max(farthest, texelFetch(occlusionPyramid, ivec2(x, y), level).r);
+      }
+   }
+
+   return nearest > farthest + depthBias;
+}
+
+// level to draw an object of the passed in radius on screen
+// with, mirroring InstancedMeshes::SelectLOD()
+uint SelectLOD(float screenRadius, uint currentLOD)
+{
+   uint lod = min(currentLOD, uint(LOD_COUNT - 1));
+
+   while ((lod > 0u) && (screenRadius >= lodRadii[lod - 1u] * (1.0 + lodHysteresis)))
+   {
+      lod--;
+   }
+   while ((lod < uint(LOD_COUNT - 1)) && (screenRadius < lodRadii[lod] * (1.0 - lodHysteresis)))
+   {
+      lod++;
+   }
+   return lod;
+}
+
+void main()
+{
+   uint index = gl_GlobalInvocationID.x;
+   if (index >= objectCount)
+   {
+      return;
+   }
+
+   Object object = objects[index];
+   vec4 sphere = meshBounds[object.mesh].sphere;
+   mat4 model = object.instance.model;
+
+   // move the sphere to world space, growing it by the
+   // largest scale of the model matrix
+   vec3 center = vec3(model * vec4(sphere.xyz, 1.0));
+   float scale = max(length(model[0].xyz), max(length(model[1].xyz), length(model[2].xyz)));
+   float radius = sphere.w * scale;
+
+   // the frustum planes are sums and differences of the rows
+   // of the view-projection matrix
+   mat4 rows = transpose(projection * view);
+   vec4 planes[6] = vec4[6](
+      rows[3] + rows[0], rows[3] - rows[0],
+      rows[3] + rows[1], rows[3] - rows[1],
+      rows[3] + rows[2], rows[3] - rows[2]);
+
+   for (int i = 0; i < 6; i++)
+   {
+      if (dot(planes[i].xyz, center) + planes[i].w < -radius * length(planes[i].xyz))
+      {
+         return;
+      }
+   }
+
+   // the box around the mesh, moved to world space
+   if (bOcclusionCulling)
+   {
+      vec3 local = meshBounds[object.mesh].extent.xyz;
+      vec3 extent = abs(model[0].xyz) * local.x + abs(model[1].xyz) * local.y + abs(model[2].xyz) * local.z;
+      if (IsOccluded(center, extent))
+      {
+         return;
+      }
+   }
+
+   // the sphere sized on screen picks the level, and so the
+   // draw command, of a curved mesh
+   uint command = object.mesh;
+   if (object.lodCount > 1u)
+   {
+      float pixels = radius * lodScale;
+      if (bPerspective)
+      {
+         pixels /= max(length(center - viewPosition), 0.1);
+      }
+      uint lod = min(SelectLOD(pixels, objectLODs[index]), object.lodCount - 1u);
+      objectLODs[index] = lod;
+      command += lod;
+   }
+
+   uint slot = atomicAdd(commands[command].instanceCount, 1u);
+   instances[commands[command].baseInstance + slot] = object.instance;
+}
@@ -1,10 +1,27 @@
 #version 330 core
+#ifdef GEOMETRY_PASS
+// the geometry pass of the deferred shading writes the surface
+// of each pixel instead of its color: the base color, and the
+// normal with the material index, or UNLIT_MATERIAL
+layout (location = 0) out vec4 outAlbedo;
+layout (location = 1) out vec4 outNormalMaterial;
+#else
 out vec4 fragmentColor;
+#endif
 
+#ifdef LIGHTING_PASS
+flat in mat4 fragmentInverseViewProjection;
+#else
 in vec3 fragmentPosition;
 in vec3 fragmentVertexNormal;
 in vec2 fragmentTextureCoordinate;
 
+flat in vec4 fragmentObjectColor;
+flat in vec2 fragmentUVScale;
+flat in int fragmentTextureSlot;
+flat in int fragmentMaterialIndex;
+#endif
+
 struct Material {
     vec3 diffuseColor;
     vec3 specularColor;
@@ -49,86 +66,239 @@ struct SpotLight {
 };
 
 #define TOTAL_POINT_LIGHTS 5
+// the directional light layer, then six cube faces per point light
+#define TOTAL_SHADOW_LAYERS 31
+#define MAX_TEXTURE_ARRAYS 8
+
+// grid of clusters the view frustum is split into for the
+// small point lights, and the view depth range of its slices
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 8
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_NEAR 0.1
+#define CLUSTER_FAR 100.0
+
+// material index stored in the G-buffer for the pixels of the
+// objects drawn without lighting
+#define UNLIT_MATERIAL -2.0
+
+// a specialised permutation is compiled with PERMUTATION and
+// its TEXTURED, LIGHTING, DIRECTIONAL_LIGHT, POINT_LIGHT_COUNT,
+// SPOT_LIGHT and CLUSTERED_LIGHTS values defined after the
+// version line, so the branches on them are removed by the
+// compiler; the general shader decides each of them per
+// fragment instead, and always reads the cluster lists
+#ifndef PERMUTATION
+#define TEXTURED (fragmentTextureSlot >= 0)
+#define LIGHTING bUseLighting
+#define DIRECTIONAL_LIGHT directionalLight.bActive
+#define POINT_LIGHT_COUNT TOTAL_POINT_LIGHTS
+#define POINT_LIGHT_ACTIVE(index) pointLights[index].bActive
+#define SPOT_LIGHT spotLight.bActive
+#define CLUSTERED_LIGHTS true
+#else
+// the active point lights are uploaded first
+#define POINT_LIGHT_ACTIVE(index) true
+#endif
+
+// per-frame camera values, shared with the vertex shader
+layout (std140) uniform CameraData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+};
+
+// light table, only uploaded when a light changes
+layout (std140) uniform LightData
+{
+    DirectionalLight directionalLight;
+    PointLight pointLights[TOTAL_POINT_LIGHTS];
+    SpotLight spotLight;
+};
+
+// shadow map of every layer, only uploaded when the shadow maps
+// are fitted to the lights again
+layout (std140) uniform ShadowData
+{
+    mat4 shadowMatrices[TOTAL_SHADOW_LAYERS];
+    float directionalTexelSize;
+    float pointTexelSize;
+    bool bDirectionalShadow;
+    int pointShadowCount;
+};
 
-uniform bool bUseTexture=false;
 uniform bool bUseLighting=false;
-uniform vec4 objectColor = vec4(1.0f);
-uniform vec3 viewPosition;
-uniform DirectionalLight directionalLight;
-uniform PointLight pointLights[TOTAL_POINT_LIGHTS];
-uniform SpotLight spotLight;
-uniform Material material;
-uniform sampler2D objectTexture;
-uniform vec2 UVscale = vec2(1.0f, 1.0f);
+// every defined material as two texels, indexed by handle
+uniform samplerBuffer materialTable;
+// scene textures packed by size, one array per texture unit
+uniform sampler2DArray textureArrays[MAX_TEXTURE_ARRAYS];
+// first entry and length of the light list of every cluster,
+// the light lists of all the clusters, and every small point
+// light as two texels, the position with the radius and then
+// the color
+uniform usamplerBuffer clusterTable;
+uniform usamplerBuffer clusterLightIndices;
+uniform samplerBuffer clusterLights;
+// the G-buffer read by the lighting pass
+uniform sampler2D gBufferAlbedo;
+uniform sampler2D gBufferNormal;
+uniform sampler2D gBufferDepth;
+// depth of the nearest caster of every shadow map layer
+uniform sampler2DArrayShadow shadowMaps;
+
+// per-instance values, set at the start of main()
+vec4 objectColor = vec4(1.0f);
+vec2 UVscale = vec2(1.0f, 1.0f);
+Material material = Material(vec3(0.0f), vec3(0.0f), 0.0f);
 
 // function prototypes
-vec3 CalcDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+void LoadMaterial(int materialIndex);
+vec3 CalcLighting(vec3 normal, vec3 fragPos, vec3 baseColor);
+vec3 CalcDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDir, vec3 baseColor, float lit);
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 baseColor, float lit);
+float CalcDirectionalShadow(vec3 normal, vec3 fragPos);
+float CalcPointShadow(int light, vec3 normal, vec3 fragPos);
+float SampleShadow(int layer, vec3 fragPos);
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 baseColor);
+vec3 CalcClusteredLights(vec3 normal, vec3 fragPos, vec3 viewDir, vec3 baseColor);
+#ifndef LIGHTING_PASS
+vec4 SampleObjectTexture(vec2 textureCoordinate);
+#endif
 
+#if defined(DEPTH_PASS)
+// the depth pre-pass and the coverage count only write the
+// depth, so nothing is shaded
+void main()
+{
+}
+#elif !defined(LIGHTING_PASS)
 void main()
 {    
-    if(bUseLighting == true)
+    objectColor = fragmentObjectColor;
+    UVscale = fragmentUVScale;
+    LoadMaterial(fragmentMaterialIndex);
+
+    // the texture is sampled once, and its color is passed to
+    // every light in place of the object color; the lit path
+    // samples without the UV scale
+    vec4 baseColor = objectColor;
+    if(TEXTURED)
     {
-        vec3 phongResult = vec3(0.0f);
-        // properties
-        vec3 norm = normalize(fragmentVertexNormal);
-        vec3 viewDir = normalize(viewPosition - fragmentPosition);
-    
-        // == =====================================================
-        // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
-        // For each phase, a calculate function is defined that calculates the corresponding color
-        // per light source. In the main() function we take all the calculated colors and sum them 
-        // up for this fragment's final color.
-        // == =====================================================
-        // phase 1: directional lighting
-        if(directionalLight.bActive == true)
+        if(LIGHTING)
         {
-            phongResult += CalcDirectionalLight(directionalLight, norm, viewDir);
-        }
-        // phase 2: point lights
-        for(int i = 0; i < TOTAL_POINT_LIGHTS; i++)
-        {
-	    if(pointLights[i].bActive == true)
-            {
-                phongResult += CalcPointLight(pointLights[i], norm, fragmentPosition, viewDir);   
-            }
-        } 
-        // phase 3: spot light
-        if(spotLight.bActive == true)
-        {
-            phongResult += CalcSpotLight(spotLight, norm, fragmentPosition, viewDir);    
-        }
-    
-        if(bUseTexture == true)
-        {
-            fragmentColor = vec4(phongResult, (texture(objectTexture, fragmentTextureCoordinate)).a);
+            baseColor = SampleObjectTexture(fragmentTextureCoordinate);
         }
         else
         {
-            fragmentColor = vec4(phongResult, objectColor.a);
+            baseColor = SampleObjectTexture(fragmentTextureCoordinate * UVscale);
         }
     }
+
+#ifdef GEOMETRY_PASS
+    // the lights are left to the lighting pass, which reads the
+    // material back through its index
+    outAlbedo = baseColor;
+    outNormalMaterial = vec4(normalize(fragmentVertexNormal),
+        LIGHTING ? float(fragmentMaterialIndex) : UNLIT_MATERIAL);
+#else
+    if(LIGHTING)
+    {
+        fragmentColor = vec4(CalcLighting(normalize(fragmentVertexNormal), fragmentPosition, baseColor.rgb), baseColor.a);
+    }
     else
     {
-        if(bUseTexture == true)
-        {
-            fragmentColor = texture(objectTexture, fragmentTextureCoordinate * UVscale);
-        }
-        else
+        fragmentColor = baseColor;
+    }
+#endif
+}
+#else
+// the lighting pass shades every pixel of the G-buffer once,
+// however many surfaces were drawn over it
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gBufferDepth, pixel, 0).r;
+    // nothing was drawn here, so the background is kept
+    if(depth >= 1.0)
+    {
+        discard;
+    }
+    vec4 baseColor = texelFetch(gBufferAlbedo, pixel, 0);
+    vec4 normalMaterial = texelFetch(gBufferNormal, pixel, 0);
+    gl_FragDepth = depth;
+
+    if(!LIGHTING || (normalMaterial.w < UNLIT_MATERIAL + 0.5))
+    {
+        fragmentColor = baseColor;
+        return;
+    }
+    LoadMaterial(int(normalMaterial.w));
+
+    // the world position is rebuilt from the depth
+    vec2 screen = gl_FragCoord.xy / vec2(textureSize(gBufferDepth, 0));
+    vec4 worldPosition = fragmentInverseViewProjection * vec4(vec3(screen, depth) * 2.0 - 1.0, 1.0);
+    fragmentColor = vec4(CalcLighting(normalMaterial.xyz, worldPosition.xyz / worldPosition.w, baseColor.rgb), baseColor.a);
+}
+#endif
+
+// reads the material of a handle from the material table, no
+// material is used for a negative handle
+void LoadMaterial(int materialIndex)
+{
+    if(materialIndex >= 0)
+    {
+        vec4 diffuseShininess = texelFetch(materialTable, materialIndex * 2);
+        vec4 specular = texelFetch(materialTable, materialIndex * 2 + 1);
+        material = Material(diffuseShininess.rgb, specular.rgb, diffuseShininess.a);
+    }
+}
+
+// calculates the color of a surface lit by all the lights
+vec3 CalcLighting(vec3 normal, vec3 fragPos, vec3 baseColor)
+{
+    vec3 phongResult = vec3(0.0f);
+    vec3 viewDir = normalize(viewPosition - fragPos);
+
+    // == =====================================================
+    // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
+    // For each phase, a calculate function is defined that calculates the corresponding color
+    // per light source. Here we take all the calculated colors and sum them 
+    // up for this fragment's final color.
+    // == =====================================================
+    // phase 1: directional lighting
+    if(DIRECTIONAL_LIGHT)
+    {
+        phongResult += CalcDirectionalLight(directionalLight, normal, viewDir, baseColor,
+            CalcDirectionalShadow(normal, fragPos));
+    }
+    // phase 2: point lights
+    for(int i = 0; i < POINT_LIGHT_COUNT; i++)
+    {
+        if(POINT_LIGHT_ACTIVE(i))
         {
-            fragmentColor = objectColor;
+            phongResult += CalcPointLight(pointLights[i], normal, fragPos, viewDir, baseColor,
+                CalcPointShadow(i, normal, fragPos));
         }
+    } 
+    // phase 3: spot light
+    if(SPOT_LIGHT)
+    {
+        phongResult += CalcSpotLight(spotLight, normal, fragPos, viewDir, baseColor);
     }
+    // phase 4: the small point lights of the fragment's cluster
+    if(CLUSTERED_LIGHTS)
+    {
+        phongResult += CalcClusteredLights(normal, fragPos, viewDir, baseColor);
+    }
+
+    return phongResult;
 }
 
-// calculates the color when using a directional light.
-vec3 CalcDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDir)
+// calculates the color when using a directional light, the
+// shadow leaves the ambient light
+vec3 CalcDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDir, vec3 baseColor, float lit)
 {
-    vec3 ambient = vec3(0.0f);
-    vec3 diffuse = vec3(0.0f);
-    vec3 specular = vec3(0.0f);
-
     vec3 lightDirection = normalize(-light.direction);
     // diffuse shading
     float diff = max(dot(normal, lightDirection), 0.0);
@@ -136,29 +306,17 @@ vec3 CalcDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDir)
     vec3 reflectDir = reflect(-lightDirection, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
-    if(bUseTexture == true)
-    {
-        ambient = light.ambient * vec3(texture(objectTexture, fragmentTextureCoordinate));
-        diffuse = light.diffuse * diff * material.diffuseColor * vec3(texture(objectTexture, fragmentTextureCoordinate));
-        specular = light.specular * spec * material.specularColor * vec3(texture(objectTexture, fragmentTextureCoordinate));
-    }
-    else
-    {
-        ambient = light.ambient * vec3(objectColor);
-        diffuse = light.diffuse * diff * material.diffuseColor * vec3(objectColor);
-        specular = light.specular * spec * material.specularColor * vec3(objectColor);
-    }
+    vec3 ambient = light.ambient * baseColor;
+    vec3 diffuse = light.diffuse * diff * material.diffuseColor * baseColor;
+    vec3 specular = light.specular * spec * material.specularColor * baseColor;
     
-    return (ambient + diffuse + specular);
+    return (ambient + lit * (diffuse + specular));
 }
 
-// calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+// calculates the color when using a point light, the shadow
+// leaves the ambient light
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 baseColor, float lit)
 {
-    vec3 ambient = vec3(0.0f);
-    vec3 diffuse = vec3(0.0f);
-    vec3 specular= vec3(0.0f);
-
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
@@ -167,30 +325,76 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     // Calculate specular component
     float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
    
-    // combine results
-    if(bUseTexture == true)
+    // combine results, the specular highlight keeps the light color
+    vec3 ambient = light.ambient * baseColor;
+    vec3 diffuse = light.diffuse * diff * material.diffuseColor * baseColor;
+    vec3 specular = light.specular * specularComponent * material.specularColor;
+    
+    return (ambient + lit * (diffuse + specular));
+}
+
+// fraction of the directional light reaching a fragment, the
+// position is moved off the surface by about a texel, so the
+// surface does not shadow itself
+float CalcDirectionalShadow(vec3 normal, vec3 fragPos)
+{
+    if(!bDirectionalShadow)
+    {
+        return 1.0;
+    }
+    return SampleShadow(0, fragPos + normal * (directionalTexelSize * 1.5));
+}
+
+// fraction of a packed point light reaching a fragment, read
+// from the cube face the fragment is seen through, whose
+// texels grow with the distance from the light
+float CalcPointShadow(int light, vec3 normal, vec3 fragPos)
+{
+    if(light >= pointShadowCount)
     {
-        ambient = light.ambient * vec3(texture(objectTexture, fragmentTextureCoordinate));
-        diffuse = light.diffuse * diff * material.diffuseColor * vec3(texture(objectTexture, fragmentTextureCoordinate));
-        specular = light.specular * specularComponent * material.specularColor;
+        return 1.0;
+    }
+    vec3 toFragment = fragPos - pointLights[light].position;
+    vec3 axis = abs(toFragment);
+    int face;
+    if((axis.x >= axis.y) && (axis.x >= axis.z))
+    {
+        face = (toFragment.x > 0.0) ? 0 : 1;
+    }
+    else if(axis.y >= axis.z)
+    {
+        face = (toFragment.y > 0.0) ? 2 : 3;
     }
     else
     {
-        ambient = light.ambient * vec3(objectColor);
-        diffuse = light.diffuse * diff * material.diffuseColor * vec3(objectColor);
-        specular = light.specular * specularComponent * material.specularColor;
+        face = (toFragment.z > 0.0) ? 4 : 5;
     }
-    
-    return (ambient + diffuse + specular);
+    float offset = pointTexelSize * max(axis.x, max(axis.y, axis.z)) * 1.5;
+    return SampleShadow(1 + 6 * light + face, fragPos + normal * offset);
 }
 
-// calculates the color when using a spot light.
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+// fraction of four filtered depth comparisons around the
+// position in a shadow map layer that pass, a position past
+// the far plane of the layer is lit
+float SampleShadow(int layer, vec3 fragPos)
 {
-    vec3 ambient = vec3(0.0f);
-    vec3 diffuse = vec3(0.0f);
-    vec3 specular = vec3(0.0f);
+    vec4 shadowPos = shadowMatrices[layer] * vec4(fragPos, 1.0);
+    vec3 coords = shadowPos.xyz / shadowPos.w * 0.5 + 0.5;
+    if(coords.z >= 1.0)
+    {
+        return 1.0;
+    }
+    vec2 texel = 0.5 / vec2(textureSize(shadowMaps, 0).xy);
+    float lit = texture(shadowMaps, vec4(coords.xy + vec2(-texel.x, -texel.y), float(layer), coords.z));
+    lit += texture(shadowMaps, vec4(coords.xy + vec2(texel.x, -texel.y), float(layer), coords.z));
+    lit += texture(shadowMaps, vec4(coords.xy + vec2(-texel.x, texel.y), float(layer), coords.z));
+    lit += texture(shadowMaps, vec4(coords.xy + vec2(texel.x, texel.y), float(layer), coords.z));
+    return lit * 0.25;
+}
 
+// calculates the color when using a spot light.
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 baseColor)
+{
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
@@ -205,21 +409,78 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    if(bUseTexture == true)
-    {
-        ambient = light.ambient * vec3(texture(objectTexture, fragmentTextureCoordinate));
-        diffuse = light.diffuse * diff * material.diffuseColor * vec3(texture(objectTexture, fragmentTextureCoordinate));
-        specular = light.specular * spec * material.specularColor * vec3(texture(objectTexture, fragmentTextureCoordinate));
-    }
-    else
-    {
-        ambient = light.ambient * vec3(objectColor);
-        diffuse = light.diffuse * diff * material.diffuseColor * vec3(objectColor);
-        specular = light.specular * spec * material.specularColor * vec3(objectColor);
-    }
+    vec3 ambient = light.ambient * baseColor;
+    vec3 diffuse = light.diffuse * diff * material.diffuseColor * baseColor;
+    vec3 specular = light.specular * spec * material.specularColor * baseColor;
     
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
     return (ambient + diffuse + specular);
 }
+
+// calculates the color from the small point lights whose range
+// reaches the cluster of the fragment, each fading smoothly to
+// nothing at its radius
+vec3 CalcClusteredLights(vec3 normal, vec3 fragPos, vec3 viewDir, vec3 baseColor)
+{
+    // the cluster is found from the tile on screen and the
+    // slice of the view depth, as LightClusters assigns them
+    vec4 viewPos = view * vec4(fragPos, 1.0);
+    vec4 clipPos = projection * viewPos;
+    vec2 screen = clipPos.xy / clipPos.w * 0.5 + 0.5;
+    ivec2 tile = clamp(ivec2(floor(screen * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y))),
+        ivec2(0), ivec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+    float depth = max(-viewPos.z, CLUSTER_NEAR);
+    int slice = clamp(int(floor(log(depth / CLUSTER_NEAR) * (float(CLUSTER_GRID_Z) / log(CLUSTER_FAR / CLUSTER_NEAR)))),
+        0, CLUSTER_GRID_Z - 1);
+    uvec2 lightList = texelFetch(clusterTable, tile.x + CLUSTER_GRID_X * (tile.y + CLUSTER_GRID_Y * slice)).xy;
+
+    vec3 result = vec3(0.0f);
+    for(uint i = 0u; i < lightList.y; i++)
+    {
+        int light = int(texelFetch(clusterLightIndices, int(lightList.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLights, light * 2);
+        vec3 color = texelFetch(clusterLights, light * 2 + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - fragPos;
+        float distance = length(toLight);
+        vec3 lightDir = toLight / max(distance, 0.0001);
+        // diffuse shading
+        float diff = max(dot(normal, lightDir), 0.0);
+        // specular shading
+        vec3 reflectDir = reflect(-lightDir, normal);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+        // inverse square falloff, windowed to end at the radius
+        float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (distance * distance + 1.0);
+
+        result += attenuation * color * (diff * material.diffuseColor * baseColor + spec * material.specularColor);
+    }
+
+    return result;
+}
+
+#ifndef LIGHTING_PASS
+// the texture reference holds the array in the high bits and
+// the layer in the low 16 bits, the arrays are selected with
+// constant indices as GLSL 330 requires
+vec4 SampleObjectTexture(vec2 textureCoordinate)
+{
+    int textureArray = fragmentTextureSlot >> 16;
+    vec3 layerCoordinate = vec3(textureCoordinate, float(fragmentTextureSlot & 0xFFFF));
+
+    switch(textureArray)
+    {
+        case 0: return texture(textureArrays[0], layerCoordinate);
+        case 1: return texture(textureArrays[1], layerCoordinate);
+        case 2: return texture(textureArrays[2], layerCoordinate);
+        case 3: return texture(textureArrays[3], layerCoordinate);
+        case 4: return texture(textureArrays[4], layerCoordinate);
+        case 5: return texture(textureArrays[5], layerCoordinate);
+        case 6: return texture(textureArrays[6], layerCoordinate);
+        case 7: return texture(textureArrays[7], layerCoordinate);
+    }
+    return vec4(1.0f);
+}
+#endif
@@ -1,20 +1,65 @@
 #version 330 core
+// per-frame camera values, shared with the fragment shader
+layout (std140) uniform CameraData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+};
+
+#ifdef LIGHTING_PASS
+// the lighting pass of the deferred shading covers the screen
+// with one triangle, and hands the inverse view-projection to
+// the fragments, which rebuild their position from the depth
+flat out mat4 fragmentInverseViewProjection;
+
+void main()
+{
+   vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+   gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+   fragmentInverseViewProjection = inverse(projection * view);
+}
+#else
 layout (location = 0) in vec3 inVertexPosition;
 layout (location = 1) in vec3 inVertexNormal;
 layout (location = 2) in vec2 inTextureCoordinate;
 
+// per-instance attributes, advanced once per drawn instance
+layout (location = 3) in mat4 inInstanceModel;
+layout (location = 7) in vec4 inInstanceColor;
+layout (location = 8) in vec2 inInstanceUVScale;
+layout (location = 9) in ivec2 inInstanceIndices;
+
 out vec3 fragmentPosition;
 out vec3 fragmentVertexNormal;
 out vec2 fragmentTextureCoordinate;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// values that are the same for every fragment of an instance
+flat out vec4 fragmentObjectColor;
+flat out vec2 fragmentUVScale;
+flat out int fragmentTextureSlot;
+flat out int fragmentMaterialIndex;
+
+// the depth pre-pass and the color pass compute the same depth
+// in different programs
+invariant gl_Position;
 
 void main()
 {
-   fragmentPosition = vec3(model * vec4(inVertexPosition, 1.0));
-   gl_Position = projection * view * model * vec4(inVertexPosition, 1.0f);
-   fragmentVertexNormal = inVertexNormal;
+   fragmentPosition = vec3(inInstanceModel * vec4(inVertexPosition, 1.0));
+   gl_Position = projection * view * vec4(fragmentPosition, 1.0f);
+   // the cofactor matrix transforms normals like the inverse
+   // transpose, and the length is fixed by the fragment shader
+   vec3 axisX = vec3(inInstanceModel[0]);
+   vec3 axisY = vec3(inInstanceModel[1]);
+   vec3 axisZ = vec3(inInstanceModel[2]);
+   mat3 normalMatrix = mat3(cross(axisY, axisZ), cross(axisZ, axisX), cross(axisX, axisY));
+   fragmentVertexNormal = normalMatrix * inVertexNormal;
    fragmentTextureCoordinate = inTextureCoordinate;
-}
\ No newline at end of file
+
+   fragmentObjectColor = inInstanceColor;
+   fragmentUVScale = inInstanceUVScale;
+   fragmentTextureSlot = inInstanceIndices.x;
+   fragmentMaterialIndex = inInstanceIndices.y;
+}
+#endif